@@ -359,10 +359,21 @@ typedef enum {
      * (API notified through a callback).
      */
     FDB_RESULT_CANCELLED = -73,
+    /**
+     * An optimistic transaction was aborted at commit time because a key it
+     * read or wrote was committed by another writer in the meantime.
+     * The transaction can be retried.
+     */
+    FDB_RESULT_TRANSACTION_CONFLICT = -74,
+    /**
+     * The file cannot be closed or compacted while it has named checkpoints,
+     * as they are kept in memory only. Release the checkpoints first.
+     */
+    FDB_RESULT_CHECKPOINT_EXISTS = -75,
 
     // Any new error codes can be added here.
 
-    FDB_RESULT_LAST = FDB_RESULT_CANCELLED // Last (minimum) fdb_status value
+    FDB_RESULT_LAST = FDB_RESULT_CHECKPOINT_EXISTS // Last (minimum) fdb_status value
 } fdb_status;
 
 #ifdef __cplusplus
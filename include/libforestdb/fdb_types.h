@@ -78,7 +78,37 @@ enum {
      * Opening existing files which use CRC32C with this flag results
      * in FDB_RESULT_INVALID_ARGS.
      */
-    FDB_OPEN_WITH_LEGACY_CRC = 4
+    FDB_OPEN_WITH_LEGACY_CRC = 4,
+
+    /**
+     * Read the committed blocks of a ForestDB file directly from a read-only
+     * memory mapping of the file, instead of caching them in the buffer
+     * cache, so that they are kept only once in the OS page cache. Forward
+     * iterators advise the mapping for sequential access, and reverse
+     * iterators prefetch the region they are moving into.
+     *
+     * This flag should be used together with FDB_OPEN_FLAG_RDONLY, and is
+     * best suited to immutable (e.g., compacted) files. The blocks appended
+     * after the file is mapped, and the files using custom file operations,
+     * are read in the regular way.
+     *
+     * The mapping is shared by the read-only handles of the file in the
+     * process. The file is read in the regular way once it is opened for
+     * writing in the same process (until all of its handles are closed), or
+     * when it is found shorter than the mapping, e.g., truncated by another
+     * process.
+     */
+    FDB_OPEN_FLAG_MMAP = 8,
+
+    /**
+     * Defer the loading of file-level state that only writers need, so that
+     * opening a file that is mostly idle reads little more than its header.
+     * The stale-block info used for block reusing is loaded by the first
+     * commit on the file. If the file is also opened with
+     * FDB_OPEN_FLAG_RDONLY, the bitmap of reusable blocks is not read either,
+     * and is loaded by the first read-write open of the file.
+     */
+    FDB_OPEN_FLAG_LAZY = 16
 };
 
 /**
@@ -158,7 +188,17 @@ enum {
     /**
      * Allow a transaction to see uncommitted data from other transaction.
      */
-    FDB_ISOLATION_READ_UNCOMMITTED = 3
+    FDB_ISOLATION_READ_UNCOMMITTED = 3,
+    /**
+     * Read committed data like FDB_ISOLATION_READ_COMMITTED, but also keep
+     * track of the version of every key read or written by the transaction.
+     * When the transaction ends, the tracked versions are validated against
+     * the latest committed versions, and the transaction is aborted with
+     * FDB_RESULT_TRANSACTION_CONFLICT if any of those keys has been updated
+     * by another writer since the transaction first accessed it.
+     * Range scans through iterators are not tracked.
+     */
+    FDB_ISOLATION_OPTIMISTIC = 4
 };
 
 /**
@@ -229,6 +269,56 @@ typedef struct fdb_doc_struct {
 #define FDB_CUSTOM_SEQNUM 0x01
 } fdb_doc;
 
+/**
+ * Read-only view of a doc returned by fdb_get_pinned API.
+ * The key, metadata, and body pointers refer to the doc block pinned in
+ * the buffer cache if possible, or to memory allocated by ForestDB otherwise.
+ * In both cases, they remain valid until the view is released by fdb_release.
+ */
+typedef struct {
+    /**
+     * key length.
+     */
+    size_t keylen;
+    /**
+     * metadata length.
+     */
+    size_t metalen;
+    /**
+     * doc body length.
+     */
+    size_t bodylen;
+    /**
+     * actual doc size written on disk.
+     */
+    size_t size_ondisk;
+    /**
+     * Pointer to doc's key.
+     */
+    const void *key;
+    /**
+     * Sequence number assigned to a doc.
+     */
+    fdb_seqnum_t seqnum;
+    /**
+     * Offset to the doc (header + key + metadata + body) on disk.
+     */
+    uint64_t offset;
+    /**
+     * Pointer to doc's metadata.
+     */
+    const void *meta;
+    /**
+     * Pointer to doc's body.
+     */
+    const void *body;
+    /**
+     * Internal reference to the pinned cache block (NULL if the doc was
+     * copied into memory allocated by ForestDB). Must not be modified.
+     */
+    void *pinned_block;
+} fdb_pinned_doc;
+
 /**
  * Opaque reference to a ForestDB file handle, which is exposed in public APIs.
  */
@@ -293,6 +383,74 @@ typedef struct {
     uint8_t bytes[32];
 } fdb_encryption_key;
 
+/**
+ * Return type for the iterator filter callback: fdb_iterator_filter_fn
+ */
+typedef int fdb_filter_decision;
+enum {
+    /**
+     * The document is returned by the iterator.
+     */
+    FDB_FILTER_ACCEPT = 0,
+    /**
+     * The document is skipped by the iterator, without reading its value.
+     */
+    FDB_FILTER_SKIP = 1
+};
+
+/**
+ * The callback function used by an iterator to decide whether a document is
+ * returned or not. It is invoked with the key and the metadata of each
+ * document, and the body of the document is NULL. Note that the document is
+ * valid only during the call.
+ *
+ * @param handle Pointer to ForestDB KV store instance of the iterator
+ * @param doc Pointer to the current document
+ * @param ctx Client context
+ */
+typedef fdb_filter_decision (*fdb_iterator_filter_fn)(fdb_kvs_handle *handle,
+                                                      fdb_doc *doc,
+                                                      void *ctx);
+
+/**
+ * Parts of a document returned by an iterator.
+ */
+typedef uint8_t fdb_projection_mode_t;
+enum {
+    /**
+     * Key, metadata, and the whole body.
+     */
+    FDB_PROJECT_ALL = 0x00,
+    /**
+     * Key and metadata only (same as fdb_iterator_get_metaonly).
+     */
+    FDB_PROJECT_META_ONLY = 0x01,
+    /**
+     * Key, metadata, and a byte range of the body.
+     */
+    FDB_PROJECT_BODY_RANGE = 0x02
+};
+
+/**
+ * Projection of the documents returned by an iterator.
+ */
+typedef struct {
+    /**
+     * Parts of a document to be returned.
+     */
+    fdb_projection_mode_t mode;
+    /**
+     * Offset of the byte range in the body (FDB_PROJECT_BODY_RANGE only).
+     * The range is empty if the offset is past the end of the body.
+     */
+    size_t body_offset;
+    /**
+     * Length of the byte range in the body (FDB_PROJECT_BODY_RANGE only).
+     * The range is truncated at the end of the body.
+     */
+    size_t body_length;
+} fdb_iterator_projection;
+
 /**
  * Using off_t turned out to be a real challenge. On "unix-like" systems
  * its size is set by a combination of #defines like: _LARGE_FILE,
@@ -395,6 +553,8 @@ typedef struct {
      * Chunk size (bytes) that is used to build B+-tree at each level.
      * It is set to 8 bytes by default and has a min value of 4 bytes
      * and a max value of 64 bytes.
+     * It is only used when a new file is created; an existing file keeps
+     * the chunk size that it was created (or compacted) with.
      * This is a local config to each ForestDB file.
      */
     uint16_t chunksize;
@@ -581,6 +741,131 @@ typedef struct {
      * Custom file operations
      */
     fdb_filemgr_ops_t* custom_file_ops;
+    /**
+     * Flag to store the common prefix of the keys in each B+tree node only
+     * once. It applies to the KV stores using custom compare functions, whose
+     * keys are indexed by variable-length key B+trees. Higher fanout from
+     * the compression reduces the number of index levels for keys sharing
+     * long prefixes. The nodes written without the compression remain
+     * readable, and vice versa, so that this flag can be changed on reopen.
+     * Once a file is opened for writes with this flag, it is marked with a
+     * new file format version at the next commit, and ForestDB versions
+     * without key prefix compression support refuse to open it. The mark
+     * stays even if the flag is turned off later, until the file is compacted
+     * without the flag.
+     * It is disabled by default.
+     * This is a local config to each ForestDB file.
+     */
+    bool key_prefix_compression;
+    /**
+     * Number of keys between two consecutive restart points in each
+     * prefix-compressed B+tree node. The keys between restart points are
+     * delta-encoded against their predecessors, and a lookup decodes at most
+     * this number of keys. Delta encoding is disabled if it is 0 or 1.
+     * This is a local config to each ForestDB file.
+     */
+    uint16_t key_prefix_restart_interval;
+    /**
+     * Flag to choose the chunk size of the new file from a sample of the
+     * current keys whenever the file is compacted, so that the depth of the
+     * HB+trie follows the key distribution. It is only applied to the files
+     * in single KV instance mode, as the ID of each KV store is stored in a
+     * chunk-sized prefix of its keys otherwise.
+     * It is disabled by default.
+     * This is a local config to each ForestDB file.
+     */
+    bool adaptive_chunksize;
+    /**
+     * Flag to let iterators read ahead of their cursors. The offsets of the
+     * next documents in the index are collected in the direction of the
+     * iteration, and the blocks containing them are loaded into the buffer
+     * cache in the order of their positions in the file (using async I/O if
+     * it is available). The number of documents read ahead grows while most of
+     * the blocks are not cached, and shrinks while they are.
+     * It is disabled by default, and has no effect if the buffer cache is
+     * disabled.
+     * This is a local config to each ForestDB file.
+     */
+    bool iterator_readahead;
+    /**
+     * Size (in bytes) of the private write buffer of each transaction.
+     * If it is greater than 0, the updates made within a transaction are kept
+     * in memory, and appended to the file and inserted into the shared WAL
+     * all at once when the transaction is committed. Aborted transactions
+     * leave nothing behind. Once the buffered key, meta, and body sizes
+     * exceed this value, the buffer is spilled into the WAL and refilled.
+     * The buffer is also spilled when an in-memory snapshot or an iterator is
+     * opened, or a document is retrieved by its sequence number, within the
+     * transaction, so that the updates can be seen.
+     * Buffering is disabled by default (0).
+     * This is a local config to each ForestDB file.
+     */
+    uint64_t txn_buffer_size;
+    /**
+     * Number of blocks reserved at once for B+tree index nodes.
+     * If it is greater than 1, index nodes are allocated from extents of
+     * this many consecutive blocks that are reserved for them, instead of
+     * being interleaved with document blocks in the same append stream.
+     * Index nodes written around the same time are then co-located in the
+     * file, which makes range scans, index prefetch, and cache warm-up read
+     * fewer and larger regions. Blocks of an extent that are not used yet
+     * remain available across commits; the unused rest of the last extent
+     * is reclaimed when the file is compacted.
+     * It is disabled by default (0).
+     * This is a local config to each ForestDB file.
+     */
+    uint32_t index_block_extent;
+    /**
+     * Flag to warm up the buffer cache with the blocks that were resident
+     * in it before the file was closed. If enabled, the IDs and cache scores
+     * of the blocks of the file in the buffer cache are recorded into a
+     * sidecar file ('<filename>.warmup') in the background when the file is
+     * closed by its last handle, unless it was opened in read-only mode, or
+     * when fdb_save_cache_warmup() is called. When the file is
+     * opened next time, those blocks are reloaded by a background thread
+     * (instead of the prefetch of the end of the file) in the order of their
+     * scores, i.e., index nodes first, using large sorted reads. The reload
+     * stops when the buffer cache becomes full, or after prefetch_duration
+     * seconds if prefetch_duration is greater than 0.
+     * It is disabled by default, and has no effect if the buffer cache is
+     * disabled.
+     * This is a local config to each ForestDB file.
+     */
+    bool warmup_cache_onopen;
+    /**
+     * Size in bytes of the compressed block cache, the second tier of the
+     * buffer cache. When a clean block is evicted from the buffer cache, it is
+     * compressed and kept in this tier, so that a later miss in the buffer
+     * cache is served by decompressing the block instead of reading it from
+     * disk. Blocks that don't compress well (e.g., blocks of documents that
+     * are already compressed) are not kept. If the size is set to zero, then
+     * the compressed block cache is disabled. It is disabled by default, and
+     * has no effect if the buffer cache is disabled.
+     * This is a global config that is used across all ForestDB files.
+     */
+    uint64_t compressed_cache_size;
+    /**
+     * Path of the cache file for the secondary block cache. Clean blocks
+     * evicted from the buffer cache are kept in this file, so that it should
+     * be placed on a local storage device that is faster than the one of the
+     * database files (e.g., a local SSD for files on HDD or network storage).
+     * Index nodes are kept as soon as they are evicted, while other blocks
+     * are kept when they are evicted again after being read back. The cache
+     * file is recreated by fdb_init() and removed by fdb_shutdown(). The
+     * blocks of a file are reused after the file is closed and re-opened only
+     * if the file has not been changed in the meantime.
+     * If the path is NULL (by default) or secondary_cache_size is zero,
+     * then the secondary block cache is disabled. It has no effect if the
+     * buffer cache is disabled or the file is encrypted.
+     * This is a global config that is used across all ForestDB files.
+     */
+    const char *secondary_cache_path;
+    /**
+     * Size of the secondary block cache file in bytes. See
+     * secondary_cache_path. It is zero by default.
+     * This is a global config that is used across all ForestDB files.
+     */
+    uint64_t secondary_cache_size;
 
 } fdb_config;
 
@@ -657,6 +942,12 @@ enum {
  */
 typedef struct FdbIterator fdb_iterator;
 
+/**
+ * Opaque reference to ForestDB changes feed cursor structure definition,
+ * which is exposed in public APIs.
+ */
+typedef struct FdbChangesCursor fdb_changes_cursor;
+
 /**
  * Return type for the fdb_changes_since API's callback: fdb_changes_function_fn
  */
@@ -841,7 +1132,8 @@ enum {
     FDB_LATENCY_WAL_COMMIT   = 21, // wal_commit()
     FDB_LATENCY_WAL_FLUSH    = 22, // _wal_flush()
     FDB_LATENCY_WAL_RELEASE  = 23, // wal_release_flushed_items()
-    FDB_LATENCY_NUM_STATS    = 24  // Number of stats (keep as highest elem)
+    FDB_LATENCY_ITR_NEXT_BATCH = 24, // fdb_iterator_next_batch API
+    FDB_LATENCY_NUM_STATS    = 25  // Number of stats (keep as highest elem)
 };
 
 /**
@@ -880,6 +1172,36 @@ typedef struct {
     char **kvs_names;
 } fdb_kvs_name_list;
 
+/**
+ * Key range returned by fdb_iterator_split().
+ */
+typedef struct {
+    /**
+     * Start key of the range. NULL means the smallest key.
+     */
+    void *start_key;
+    /**
+     * Length of the start key.
+     */
+    size_t start_keylen;
+    /**
+     * End key of the range. NULL means the largest key.
+     */
+    void *end_key;
+    /**
+     * Length of the end key.
+     */
+    size_t end_keylen;
+    /**
+     * Estimated number of documents in the range.
+     */
+    uint64_t num_docs;
+    /**
+     * Estimated disk space used by the documents in the range.
+     */
+    uint64_t num_bytes;
+} fdb_key_range;
+
 /**
  * Persisted Snapshot Marker in file (Sequence number + KV Store name)
  */
@@ -920,6 +1242,48 @@ typedef struct {
     fdb_kvs_commit_marker_t *kvs_markers;
 } fdb_snapshot_info_t;
 
+/**
+ * A file to be opened by fdb_open_many().
+ */
+typedef struct {
+    /**
+     * Name of the ForestDB file to be opened.
+     */
+    const char *filename;
+    /**
+     * Pointer to the config instance used to open the file. If NULL is passed,
+     * then we use default settings of ForestDB configs.
+     */
+    fdb_config *config;
+    /**
+     * Priority of the file. Files with higher priorities are opened first,
+     * and files with the same priority are opened in the array order.
+     */
+    int priority;
+    /**
+     * [OUT] ForestDB file handle of the opened file, NULL if the open failed.
+     */
+    fdb_file_handle *fhandle;
+    /**
+     * [OUT] Result of opening the file.
+     */
+    fdb_status status;
+} fdb_open_request;
+
+/**
+ * The callback function invoked by fdb_open_many() as soon as each file has
+ * been opened (or failed to open). It can be invoked concurrently by multiple
+ * threads of fdb_open_many().
+ *
+ * @param request Pointer to the request of the file, whose fhandle and status
+ *        are already set.
+ * @param index Index of the request in the array passed to fdb_open_many().
+ * @param ctx Client context
+ */
+typedef void (*fdb_open_callback_fn)(fdb_open_request *request,
+                                     size_t index,
+                                     void *ctx);
+
 #ifdef __cplusplus
 }
 #endif
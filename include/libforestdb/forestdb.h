@@ -117,6 +117,31 @@ fdb_status fdb_open_custom_cmp(fdb_file_handle **ptr_fhandle,
                                char **kvs_names,
                                fdb_custom_cmp_variable *functions);
 
+/**
+ * Open multiple ForestDB files in parallel, e.g., at process start-up.
+ * Files are opened (and recovered if necessary) by a pool of threads in
+ * descending order of their priorities, so that files with higher priorities
+ * become available first. The callback function is invoked as soon as each
+ * file is ready, and the result is also stored in its request.
+ * Each opened file should be closed with fdb_close API call.
+ *
+ * @param requests Array of the files to be opened.
+ * @param num_requests The number of files in the array.
+ * @param num_threads The number of threads opening the files, including the
+ *        calling thread. 0 is regarded as 1.
+ * @param callback Callback function invoked whenever a file is opened. It can
+ *        be NULL.
+ * @param ctx Client context passed to the callback function.
+ * @return FDB_RESULT_SUCCESS if all the files are opened successfully.
+ *         Otherwise, the result of the first failed request in the array.
+ */
+LIBFDB_API
+fdb_status fdb_open_many(fdb_open_request *requests,
+                         size_t num_requests,
+                         size_t num_threads,
+                         fdb_open_callback_fn callback,
+                         void *ctx);
+
 /**
  * Set up the error logging callback that allows an application to process
  * error code and message from ForestDB.
@@ -226,6 +251,46 @@ LIBFDB_API
 fdb_status fdb_get(fdb_kvs_handle *handle,
                    fdb_doc *doc);
 
+/**
+ * Retrieve the metadata and doc body for a given key without copying them
+ * into separately allocated buffers.
+ * If the doc resides in a single committed block, the returned view points
+ * directly into the buffer cache block, which is pinned in the cache until
+ * the view is released. Otherwise, the doc is read into memory allocated by
+ * ForestDB. In both cases, the view must be released by calling fdb_release
+ * before the ForestDB file is closed. Pinned views remain intact across
+ * updates and compactions of the doc.
+ *
+ * Example usage:
+ *   fdb_pinned_doc pdoc;
+ *   status = fdb_get_pinned(handle, key, keylen, &pdoc);
+ *   if (status == FDB_RESULT_SUCCESS) {
+ *       ... // read pdoc.key, pdoc.meta, pdoc.body
+ *       fdb_release(&pdoc);
+ *   }
+ *
+ * @param handle Pointer to ForestDB KV store handle.
+ * @param key Pointer to the key to be retrieved.
+ * @param keylen Length of the key.
+ * @param doc Pointer to the caller-allocated view to be populated as a result
+ *        of this API call.
+ * @return FDB_RESULT_SUCCESS on success.
+ */
+LIBFDB_API
+fdb_status fdb_get_pinned(fdb_kvs_handle *handle,
+                          const void *key, size_t keylen,
+                          fdb_pinned_doc *doc);
+
+/**
+ * Release a doc view returned by fdb_get_pinned, which unpins its block from
+ * the buffer cache or frees the memory allocated for it.
+ *
+ * @param doc Pointer to the doc view to be released.
+ * @return FDB_RESULT_SUCCESS on success.
+ */
+LIBFDB_API
+fdb_status fdb_release(fdb_pinned_doc *doc);
+
 /**
  * Retrieve the metadata for a given key.
  * Note that FDB_DOC instance should be created by calling
@@ -416,6 +481,64 @@ LIBFDB_API
 fdb_status fdb_snapshot_open(fdb_kvs_handle *handle_in, fdb_kvs_handle **handle_out,
                              fdb_seqnum_t snapshot_seqnum);
 
+/**
+ * Create a named checkpoint that pins the last committed DB header of a
+ * ForestDB file. While the checkpoint exists, the blocks reachable from the
+ * pinned header are not reused by circular block reusing, while all other
+ * stale blocks are reused as usual. Snapshots of the pinned header can be
+ * opened by fdb_snapshot_open_checkpoint(), and they do not prevent block
+ * reusing for the rest of the file. Snapshots opened by fdb_snapshot_open()
+ * are not affected by checkpoints, even if they are on the pinned header.
+ *
+ * Checkpoints are kept in memory only, so they should be released before the
+ * file is compacted or its last file handle is closed; otherwise
+ * fdb_compact() and fdb_close() fail with FDB_RESULT_CHECKPOINT_EXISTS.
+ * The compaction daemon does not compact a file while it has checkpoints.
+ *
+ * @param fhandle Pointer to ForestDB file handle.
+ * @param name Name of the checkpoint.
+ * @return FDB_RESULT_SUCCESS on success.
+ *         FDB_RESULT_INVALID_ARGS if a checkpoint with the same name exists.
+ *         FDB_RESULT_NO_DB_INSTANCE if there is no committed header.
+ *         FDB_RESULT_FAIL_BY_COMPACTION if the file is being compacted.
+ */
+LIBFDB_API
+fdb_status fdb_checkpoint_create(fdb_file_handle *fhandle, const char *name);
+
+/**
+ * Release a checkpoint created by fdb_checkpoint_create(). The blocks that
+ * were protected by the checkpoint become reusable at the next block reclaim.
+ * Snapshots still open on the checkpoint keep the blocks reachable from the
+ * pinned header from being reused, just like snapshots opened by
+ * fdb_snapshot_open(), until they are closed.
+ *
+ * @param fhandle Pointer to ForestDB file handle.
+ * @param name Name of the checkpoint.
+ * @return FDB_RESULT_SUCCESS on success.
+ *         FDB_RESULT_KEY_NOT_FOUND if the checkpoint does not exist.
+ */
+LIBFDB_API
+fdb_status fdb_checkpoint_release(fdb_file_handle *fhandle, const char *name);
+
+/**
+ * Create a snapshot of a KV store at the header pinned by a checkpoint.
+ *
+ * @param handle_in ForestDB KV store handle pointer from which snapshot is to
+ *        be made. It should not be a snapshot handle.
+ * @param handle_out Pointer to KV store snapshot handle, close with
+ *        fdb_kvs_close()
+ * @param name Name of the checkpoint.
+ * @return FDB_RESULT_SUCCESS on success.
+ *         FDB_RESULT_KEY_NOT_FOUND if the checkpoint does not exist.
+ *         FDB_RESULT_NO_DB_INSTANCE if the KV store does not exist or is
+ *                                   empty as of the checkpoint.
+ *         Any other error from fdb_snapshot_open may be returned
+ */
+LIBFDB_API
+fdb_status fdb_snapshot_open_checkpoint(fdb_kvs_handle *handle_in,
+                                        fdb_kvs_handle **handle_out,
+                                        const char *name);
+
 /**
  * Rollback a KV store to a specified point represented by a given sequence
  * number.
@@ -596,6 +719,50 @@ fdb_status fdb_iterator_seek_to_min(fdb_iterator *iterator);
 LIBFDB_API
 fdb_status fdb_iterator_seek_to_max(fdb_iterator *iterator);
 
+/**
+ * Read multiple documents in one call, starting from the document that the
+ * iterator currently points to and moving the iterator forward. This is
+ * equivalent to repeating fdb_iterator_get and fdb_iterator_next, but avoids
+ * the per-call overhead and the allocation of each document.
+ *
+ * Keys, metadata, and bodies are copied into the caller-provided buffer, and
+ * the key, meta, and body pointers of the returned docs refer to that buffer,
+ * so they remain valid until the buffer is reused or freed. The docs must not
+ * be freed by fdb_doc_free. The call stops when 'max_docs' documents are
+ * read, when the next document does not fit in the remaining buffer, or when
+ * the iteration ends. After the call, the iterator points to the first
+ * document that was not returned.
+ *
+ * Example:
+ *   fdb_doc docs[64];
+ *   size_t i, n;
+ *   while (fdb_iterator_next_batch(it, docs, 64, buf, bufsize, &n) ==
+ *          FDB_RESULT_SUCCESS) {
+ *       for (i = 0; i < n; ++i) {
+ *           // process docs[i]
+ *       }
+ *   }
+ *
+ * @param iterator Pointer to the iterator.
+ * @param docs Array of docs to be filled.
+ * @param max_docs Number of elements in 'docs'.
+ * @param buf Buffer where the keys, metadata, and bodies are copied.
+ * @param bytes_budget Size of 'buf'.
+ * @param num_docs Pointer to the variable where the number of docs filled is
+ *        returned.
+ * @return FDB_RESULT_SUCCESS if at least one document is returned,
+ *         FDB_RESULT_ITERATOR_FAIL if there are no more documents, or
+ *         FDB_RESULT_ENOBUFS if the next document is larger than
+ *         'bytes_budget'.
+ */
+LIBFDB_API
+fdb_status fdb_iterator_next_batch(fdb_iterator *iterator,
+                                   fdb_doc *docs,
+                                   size_t max_docs,
+                                   void *buf,
+                                   size_t bytes_budget,
+                                   size_t *num_docs);
+
 /**
  * Close the iterator and free its associated resources.
  *
@@ -605,6 +772,128 @@ fdb_status fdb_iterator_seek_to_max(fdb_iterator *iterator);
 LIBFDB_API
 fdb_status fdb_iterator_close(fdb_iterator *iterator);
 
+/**
+ * Set a filter to the iterator. The filter callback is invoked with the key
+ * and metadata of each document before its body is read, and the documents
+ * rejected by the callback are skipped by all the iterator operations. If
+ * the document that the iterator currently points to is rejected, the
+ * iterator moves to the next accepted document in the current direction.
+ *
+ * @param iterator Pointer to the iterator.
+ * @param filter Filter callback function. Passing NULL removes the filter.
+ * @param ctx Client context passed to the filter callback.
+ * @return FDB_RESULT_SUCCESS on success, or FDB_RESULT_ITERATOR_FAIL if there
+ *         is no accepted document to move to.
+ */
+LIBFDB_API
+fdb_status fdb_iterator_set_filter(fdb_iterator *iterator,
+                                   fdb_iterator_filter_fn filter,
+                                   void *ctx);
+
+/**
+ * Set the parts of the documents returned by fdb_iterator_get and
+ * fdb_iterator_next_batch. With FDB_PROJECT_BODY_RANGE, the body of the
+ * returned document contains the given byte range only, and its bodylen is
+ * the length of the range. Parts of the body outside the range are not read
+ * from disk unless the body is compressed.
+ *
+ * @param iterator Pointer to the iterator.
+ * @param projection Pointer to the projection. Passing NULL resets it to
+ *        FDB_PROJECT_ALL.
+ * @return FDB_RESULT_SUCCESS on success.
+ */
+LIBFDB_API
+fdb_status fdb_iterator_set_projection(fdb_iterator *iterator,
+                                       const fdb_iterator_projection *projection);
+
+/**
+ * Split a key range into sub-ranges holding roughly equal numbers of keys, so
+ * that the range can be scanned by multiple iterators in parallel.
+ * Split points are estimated from the upper levels of the index without
+ * reading any documents, so the sub-ranges are not exactly balanced, and
+ * documents not yet reflected in the index (i.e., in the WAL) are not taken
+ * into account.
+ *
+ * Consecutive sub-ranges share their boundary key: the end key of a sub-range
+ * is the start key of the next one. Hence every sub-range except the last one
+ * should be scanned with FDB_ITR_SKIP_MAX_KEY option, so that each key belongs
+ * to exactly one sub-range. The start key of the first sub-range and the end
+ * key of the last sub-range are the given start and end keys.
+ *
+ * Each iterator should be created on its own handle; for a consistent view,
+ * open a snapshot and then clone it for each iterator using fdb_snapshot_open
+ * with the snapshot's sequence number.
+ *
+ * The split keys are approximate quantiles of the keys in the range, and each
+ * sub-range also carries the estimated number of documents and bytes in it,
+ * computed in the same way as fdb_estimate_range.
+ *
+ * @param handle Pointer to ForestDB KV store handle.
+ * @param start_key Pointer to the start key. Passing NULL means that the range
+ *        starts from the smallest key.
+ * @param start_keylen Length of the start key.
+ * @param end_key Pointer to the end key. Passing NULL means that the range
+ *        ends at the largest key.
+ * @param end_keylen Length of the end key.
+ * @param num_ranges Number of sub-ranges to be created.
+ * @param ranges Pointer to the variable that the allocated array of
+ *        sub-ranges will be returned. The array should be released using
+ *        fdb_free_key_ranges API call.
+ * @param num_ranges_out Pointer to the variable that the number of sub-ranges
+ *        will be returned. It can be smaller than 'num_ranges' if the range
+ *        is too small to be split.
+ * @return FDB_RESULT_SUCCESS on success.
+ */
+LIBFDB_API
+fdb_status fdb_iterator_split(fdb_kvs_handle *handle,
+                              const void *start_key,
+                              size_t start_keylen,
+                              const void *end_key,
+                              size_t end_keylen,
+                              size_t num_ranges,
+                              fdb_key_range **ranges,
+                              size_t *num_ranges_out);
+
+/**
+ * Estimate the number of documents in a key range and the disk space used by
+ * them, without scanning the range. The share of the KV store's keys that
+ * belong to the range is estimated by sampling the index nodes covering the
+ * range, and then applied to the document count and space used reported by
+ * fdb_get_kvs_info. The result is approximate; documents in the WAL are
+ * assumed to be distributed in the same way as the indexed documents.
+ *
+ * @param handle Pointer to ForestDB KV store handle.
+ * @param start_key Pointer to the start key. Passing NULL means that the range
+ *        starts from the smallest key.
+ * @param start_keylen Length of the start key.
+ * @param end_key Pointer to the end key (exclusive). Passing NULL means that
+ *        the range ends at the largest key.
+ * @param end_keylen Length of the end key.
+ * @param num_docs Pointer to the variable that the estimated number of
+ *        documents will be returned. Can be NULL.
+ * @param num_bytes Pointer to the variable that the estimated disk space used
+ *        by the documents will be returned. Can be NULL.
+ * @return FDB_RESULT_SUCCESS on success.
+ */
+LIBFDB_API
+fdb_status fdb_estimate_range(fdb_kvs_handle *handle,
+                              const void *start_key,
+                              size_t start_keylen,
+                              const void *end_key,
+                              size_t end_keylen,
+                              uint64_t *num_docs,
+                              uint64_t *num_bytes);
+
+/**
+ * Free a key range array allocated by fdb_iterator_split API.
+ *
+ * @param ranges Pointer to a key range array.
+ * @param num_ranges Number of elements in the array.
+ * @return FDB_RESULT_SUCCESS on success.
+ */
+LIBFDB_API
+fdb_status fdb_free_key_ranges(fdb_key_range *ranges, size_t num_ranges);
+
 /**
  * Iterate through the changes since sequence number `since` with a provided
  * callback function.
@@ -624,6 +913,126 @@ fdb_status fdb_changes_since(fdb_kvs_handle *handle,
                              fdb_changes_callback_fn callback,
                              void *ctx);
 
+/**
+ * Iterate through the changes since sequence number `since` with a provided
+ * callback function, passing only the documents accepted by the filter.
+ * The documents rejected by the filter are skipped without reading their
+ * bodies.
+ *
+ * @param handle Pointer to ForestDB KV store instance.
+ * @param since The sequence number to start iterating from.
+ * @param opt Iterator option.
+ * @param filter Filter callback function, or NULL.
+ * @param projection Parts of the documents passed to the callback, or NULL
+ *        for the whole documents.
+ * @param callback The callback function used to iterate over all changes.
+ * @param ctx Client context (passed to the filter and the callback).
+ * @return FDB_RESULT_SUCCESS on success, FDB_RESULT_CANCELLED if cancelled
+ *         by caller through callback.
+ */
+LIBFDB_API
+fdb_status fdb_changes_since_filtered(fdb_kvs_handle *handle,
+                                      fdb_seqnum_t since,
+                                      fdb_iterator_opt_t opt,
+                                      fdb_iterator_filter_fn filter,
+                                      const fdb_iterator_projection *projection,
+                                      fdb_changes_callback_fn callback,
+                                      void *ctx);
+
+/**
+ * Open a changes feed cursor that returns the changes of a KV store since
+ * sequence number `since` in batches. Unlike fdb_changes_since, the cursor
+ * keeps its sequence iterator (and the snapshot under it) open between the
+ * batches, and moves to a new snapshot only when all the changes in the
+ * current one have been returned and newer changes exist.
+ *
+ * The handle should not be used by other threads while the cursor is in use,
+ * and should be kept open until the cursor is closed.
+ *
+ * @param handle Pointer to ForestDB KV store instance.
+ * @param since The sequence number to start from.
+ * @param opt Iterator option. With FDB_ITR_NO_VALUES, only the keys and
+ *        metadata are returned.
+ * @param ptr_cursor Pointer to the place where the cursor is returned.
+ * @return FDB_RESULT_SUCCESS on success.
+ */
+LIBFDB_API
+fdb_status fdb_changes_cursor_open(fdb_kvs_handle *handle,
+                                   fdb_seqnum_t since,
+                                   fdb_iterator_opt_t opt,
+                                   fdb_changes_cursor **ptr_cursor);
+
+/**
+ * Read the next batch of changes from a changes feed cursor, in the order of
+ * their sequence numbers. The blocks of the docs in the batch are prefetched
+ * into the buffer cache before they are read. The docs are returned in the
+ * same way as fdb_iterator_next_batch, i.e., their keys, metadata, and
+ * bodies refer to the caller-provided buffer.
+ *
+ * @param cursor Pointer to the changes feed cursor.
+ * @param docs Array of docs to be filled.
+ * @param max_docs Number of elements in 'docs'.
+ * @param buf Buffer where the keys, metadata, and bodies are copied.
+ * @param bufsize Size of 'buf'.
+ * @param num_docs Pointer to the variable where the number of docs filled is
+ *        returned.
+ * @return FDB_RESULT_SUCCESS if at least one document is returned,
+ *         FDB_RESULT_ITERATOR_FAIL if there are no more changes at the moment,
+ *         or FDB_RESULT_ENOBUFS if the next document is larger than 'bufsize'.
+ */
+LIBFDB_API
+fdb_status fdb_changes_cursor_pull(fdb_changes_cursor *cursor,
+                                   fdb_doc *docs,
+                                   size_t max_docs,
+                                   void *buf,
+                                   size_t bufsize,
+                                   size_t *num_docs);
+
+/**
+ * Serialize the position of a changes feed cursor, so that it can be resumed
+ * by fdb_changes_cursor_resume later, e.g., after a restart.
+ *
+ * @param cursor Pointer to the changes feed cursor.
+ * @param buf Buffer where the serialized cursor is stored.
+ * @param bufsize Size of 'buf'.
+ * @param len Pointer to the variable where the length of the serialized
+ *        cursor is returned. It is also returned on FDB_RESULT_ENOBUFS.
+ * @return FDB_RESULT_SUCCESS on success, or FDB_RESULT_ENOBUFS if 'buf' is
+ *         too small.
+ */
+LIBFDB_API
+fdb_status fdb_changes_cursor_serialize(fdb_changes_cursor *cursor,
+                                        void *buf,
+                                        size_t bufsize,
+                                        size_t *len);
+
+/**
+ * Open a changes feed cursor at the position serialized by
+ * fdb_changes_cursor_serialize.
+ *
+ * @param handle Pointer to ForestDB KV store instance. It should refer to
+ *        the same KV store as the serialized cursor.
+ * @param buf Serialized cursor.
+ * @param len Length of the serialized cursor.
+ * @param ptr_cursor Pointer to the place where the cursor is returned.
+ * @return FDB_RESULT_SUCCESS on success, or FDB_RESULT_INVALID_ARGS if 'buf'
+ *         is not a serialized cursor of the KV store.
+ */
+LIBFDB_API
+fdb_status fdb_changes_cursor_resume(fdb_kvs_handle *handle,
+                                     const void *buf,
+                                     size_t len,
+                                     fdb_changes_cursor **ptr_cursor);
+
+/**
+ * Close a changes feed cursor and free its associated resources.
+ *
+ * @param cursor Pointer to the changes feed cursor.
+ * @return FDB_RESULT_SUCCESS on success.
+ */
+LIBFDB_API
+fdb_status fdb_changes_cursor_close(fdb_changes_cursor *cursor);
+
 /**
  * Compact the current file and create a new compacted file.
  * Note that a new file name passed to this API will be ignored if the compaction
@@ -656,6 +1065,8 @@ fdb_status fdb_changes_since(fdb_kvs_handle *handle,
  *
  * Also note that if a given ForestDB file is currently being compacted by the
  * compaction daemon, then FDB_RESULT_FILE_IS_BUSY is returned to the caller.
+ * If the file has checkpoints created by fdb_checkpoint_create(), then
+ * FDB_RESULT_CHECKPOINT_EXISTS is returned.
  *
  * @param fhandle Pointer to ForestDB file handle.
  * @param new_filename Name of a new compacted file.
@@ -776,6 +1187,39 @@ fdb_status fdb_rekey(fdb_file_handle *fhandle,
 LIBFDB_API
 size_t fdb_get_buffer_cache_used();
 
+/**
+ * Return the overall memory space used by the compressed blocks kept in the
+ * compressed block cache tier. See fdb_config.compressed_cache_size.
+ *
+ * @return Size of compressed block cache currently used.
+ */
+LIBFDB_API
+size_t fdb_get_compressed_cache_used();
+
+/**
+ * Return the space of the secondary block cache file used by the blocks
+ * cached in it. See fdb_config.secondary_cache_path.
+ *
+ * @return Size of secondary block cache currently used.
+ */
+LIBFDB_API
+size_t fdb_get_secondary_cache_used();
+
+/**
+ * Record the blocks of a given ForestDB file that are currently resident in
+ * the buffer cache into its cache warm-up sidecar file ('<filename>.warmup'),
+ * so that they are reloaded when the file is opened next time with
+ * the warmup_cache_onopen option. The same is done automatically when the
+ * file opened for writing is closed by its last handle, but calling this API
+ * periodically keeps the recorded set useful even if the process does not
+ * shut down cleanly.
+ *
+ * @param fhandle Pointer to ForestDB file handle.
+ * @return FDB_RESULT_SUCCESS on success.
+ */
+LIBFDB_API
+fdb_status fdb_save_cache_warmup(fdb_file_handle *fhandle);
+
 /**
  * Return the overall disk space actively used by a ForestDB file.
  * Note that this doesn't include the disk space used by stale btree nodes
@@ -803,6 +1247,28 @@ LIBFDB_API
 size_t fdb_estimate_space_used_from(fdb_file_handle *fhandle,
                                     fdb_snapshot_marker_t marker);
 
+/**
+ * Estimate the HB+trie chunk size that fits a sample of keys best, i.e., the
+ * one that minimizes the expected number of index nodes visited by a lookup.
+ * The result can be used as 'chunksize' in fdb_config when a new file is
+ * created. Note that the chunk size of an existing file is kept until it is
+ * compacted with 'adaptive_chunksize' enabled.
+ *
+ * @param keys Array of pointers to the sample keys.
+ * @param keylens Array of the lengths of the sample keys.
+ * @param num_keys Number of the sample keys.
+ * @param num_docs Expected number of documents that the sample represents.
+ * @param chunksize_out Pointer to the variable where the estimated chunk size
+ *        is returned.
+ * @return FDB_RESULT_SUCCESS on success.
+ */
+LIBFDB_API
+fdb_status fdb_estimate_chunksize(const void **keys,
+                                  const size_t *keylens,
+                                  size_t num_keys,
+                                  uint64_t num_docs,
+                                  uint16_t *chunksize_out);
+
 /**
  * Return the information about a ForestDB file.
  *
@@ -969,6 +1435,8 @@ fdb_status fdb_switch_compaction_mode(fdb_file_handle *fhandle,
  *
  * @param fhandle Pointer to ForestDB file handle.
  * @return FDB_RESULT_SUCCESS on success.
+ *         FDB_RESULT_CHECKPOINT_EXISTS if the handle is the last one on the
+ *         file and the file has checkpoints that are not released.
  */
 LIBFDB_API
 fdb_status fdb_close(fdb_file_handle *fhandle);
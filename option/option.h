@@ -83,9 +83,18 @@
 #define BCACHE_EVICT_UNIT (1)
 #define BCACHE_MEMORY_THRESHOLD (0.8) // 80% of physical RAM
 #define __BCACHE_SECOND_CHANCE
+#define BCACHE_COMP_NPARTITIONS (16)
+// Blocks whose compressed size is larger than this ratio are not kept
+// in the compressed block cache
+#define BCACHE_COMP_MAX_RATIO (0.875)
+#define SCACHE_NPARTITIONS (16)
 
 #define FILEMGR_PREFETCH_UNIT (4194304) // 4MB
 #define FILEMGR_RESIDENT_THRESHOLD (0.9) // 90 % of file is in buffer cache
+#define FILEMGR_WARMUP_READ_UNIT (1048576) // 1MB
+#define FILEMGR_PWRITEV_MAX_BUFS (256) // buffers per vectored write
+// Max number of unwanted blocks read to merge two runs of warm-up blocks
+#define FILEMGR_WARMUP_MAX_GAP (4)
 #define __FILEMGR_DATA_PARTIAL_LOCK
 //#define __FILEMGR_DATA_MUTEX_LOCK
 
@@ -99,6 +108,8 @@
 #define SB_RECLAIM_TIMELIMIT (100000) // 100 ms
 // Threshold for pre-reclaiming
 #define SB_PRE_RECLAIM_RATIO (10) // 10 %
+// Max number of free blocks skipped per block allocated as a contiguous extent
+#define SB_EXTENT_SKIP_RATIO (4)
 
 #define __BTREEBLK_BLOCKPOOL
 #define __BTREEBLK_SUBBLOCK
@@ -134,4 +145,21 @@
 
 #define DEFAULT_NUM_BGFLUSHER_THREADS (0) // temporarily disable bgflusher
 #define MAX_NUM_BGFLUSHER_THREADS (64)
+
+// Restart interval of prefix-compressed B+tree nodes
+#define DEFAULT_KEY_PREFIX_RESTART_INTERVAL (16)
+#define MAX_KEY_PREFIX_RESTART_INTERVAL (256)
+
+// Key sampling for the adaptive chunk size of HB+trie
+#define ADAPTIVE_CHUNKSIZE_NUM_SAMPLES (1024)
+#define ADAPTIVE_CHUNKSIZE_SCAN_LIMIT (65536)
+
+// Prefetch window of iterators over memory-mapped files
+#define ITR_MMAP_PREFETCH_SIZE (262144)
+
+// Min/max number of docs read ahead by iterators
+#define ITR_READAHEAD_MIN_WINDOW (16)
+#define ITR_READAHEAD_MAX_WINDOW (1024)
+// Max number of blocks read ahead at once by iterators
+#define ITR_READAHEAD_MAX_BLOCKS (4096)
 #endif
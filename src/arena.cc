@@ -0,0 +1,212 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#include "memleak.h"
+
+// Size classes: 16, 32, 64, 128, 256, and 512 bytes.
+#define SLAB_MIN_SHIFT (4)
+#define SLAB_NUM_CLASSES (6)
+// Maximum amount of memory cached per size class per thread.
+#define SLAB_CACHE_LIMIT (65536)
+
+struct slab_free_obj {
+    struct slab_free_obj *next;
+};
+
+struct slab_thread_cache {
+    slab_thread_cache() {
+        memset(heads, 0x0, sizeof(heads));
+        memset(counts, 0x0, sizeof(counts));
+    }
+
+    ~slab_thread_cache() {
+        release();
+    }
+
+    void release() {
+        for (size_t i = 0; i < SLAB_NUM_CLASSES; ++i) {
+            while (heads[i]) {
+                struct slab_free_obj *obj = heads[i];
+                heads[i] = obj->next;
+                free(obj);
+            }
+            counts[i] = 0;
+        }
+    }
+
+    struct slab_free_obj *heads[SLAB_NUM_CLASSES];
+    size_t counts[SLAB_NUM_CLASSES];
+};
+
+static thread_local slab_thread_cache slabCache;
+
+static inline size_t _slab_class(size_t size) {
+    size_t idx = 0;
+    size_t class_size = (size_t)1 << SLAB_MIN_SHIFT;
+    while (class_size < size) {
+        class_size <<= 1;
+        ++idx;
+    }
+    return idx;
+}
+
+void *SlabAllocator::allocate(size_t size) {
+    if (size > maxObjectSize) {
+        return malloc(size);
+    }
+
+    size_t idx = _slab_class(size);
+    struct slab_free_obj *obj = slabCache.heads[idx];
+    if (obj) {
+        slabCache.heads[idx] = obj->next;
+        slabCache.counts[idx]--;
+        return obj;
+    }
+    return malloc((size_t)1 << (idx + SLAB_MIN_SHIFT));
+}
+
+void *SlabAllocator::allocateZeroed(size_t size) {
+    void *ptr = allocate(size);
+    memset(ptr, 0x0, size);
+    return ptr;
+}
+
+void SlabAllocator::deallocate(void *ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    if (size > maxObjectSize) {
+        free(ptr);
+        return;
+    }
+
+    size_t idx = _slab_class(size);
+    size_t class_size = (size_t)1 << (idx + SLAB_MIN_SHIFT);
+    if (slabCache.counts[idx] * class_size >= SLAB_CACHE_LIMIT) {
+        free(ptr);
+        return;
+    }
+
+    struct slab_free_obj *obj = reinterpret_cast<struct slab_free_obj *>(ptr);
+    obj->next = slabCache.heads[idx];
+    slabCache.heads[idx] = obj;
+    slabCache.counts[idx]++;
+}
+
+void SlabAllocator::releaseThreadCache() {
+    slabCache.release();
+}
+
+MemoryArena::MemoryArena(size_t chunk_size)
+    : chunks(NULL), chunkSize(chunk_size), cur(NULL), end(NULL) {
+}
+
+MemoryArena::~MemoryArena() {
+    freeChunks();
+}
+
+void MemoryArena::freeChunks() {
+    while (chunks) {
+        struct arena_chunk *chunk = chunks;
+        chunks = chunk->next;
+        free(chunk);
+    }
+    cur = end = NULL;
+}
+
+void *MemoryArena::allocateChunk(size_t size) {
+    size_t alloc_size = sizeof(struct arena_chunk) + size;
+    struct arena_chunk *chunk = (struct arena_chunk *)malloc(alloc_size);
+    chunk->size = size;
+    chunk->next = chunks;
+    chunks = chunk;
+    return reinterpret_cast<uint8_t *>(chunk) + sizeof(struct arena_chunk);
+}
+
+void *MemoryArena::allocate(size_t size) {
+    void *ret;
+
+    size = (size + 7) & ~(size_t)7;
+    if (cur && cur + size <= end) {
+        ret = cur;
+        cur += size;
+    } else if (size > chunkSize / 4) {
+        // dedicated chunk for a large object, the current chunk is kept
+        // being used for the following small objects.
+        ret = allocateChunk(size);
+        if (chunks->next) {
+            // keep the active chunk at the head of the list
+            struct arena_chunk *large = chunks;
+            chunks = large->next;
+            large->next = chunks->next;
+            chunks->next = large;
+        }
+    } else {
+        cur = (uint8_t *)allocateChunk(chunkSize);
+        end = cur + chunkSize;
+        ret = cur;
+        cur += size;
+    }
+
+    memset(ret, 0x0, size);
+    return ret;
+}
+
+void MemoryArena::reset() {
+    if (!chunks) {
+        return;
+    }
+
+    // keep the oldest regular chunk only
+    struct arena_chunk *keep = NULL;
+    while (chunks) {
+        struct arena_chunk *chunk = chunks;
+        chunks = chunk->next;
+        if (chunk->size == chunkSize) {
+            if (keep) {
+                free(keep);
+            }
+            keep = chunk;
+        } else {
+            free(chunk);
+        }
+    }
+
+    if (keep) {
+        keep->next = NULL;
+        chunks = keep;
+        cur = reinterpret_cast<uint8_t *>(keep) + sizeof(struct arena_chunk);
+        end = cur + chunkSize;
+    } else {
+        cur = end = NULL;
+    }
+}
+
+static thread_local MemoryArena threadArena;
+
+MemoryArena *MemoryArena::getThreadArena() {
+    return &threadArena;
+}
+
+void MemoryArena::releaseThreadArena() {
+    threadArena.freeChunks();
+}
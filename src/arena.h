@@ -0,0 +1,124 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Size-class allocator for small objects that are allocated and freed on
+ * every write operation (WAL items, WAL item headers, and WAL keys).
+ *
+ * Freed objects are kept in per-thread free lists (one list per size class)
+ * and are handed out again by later allocations of the same class without
+ * grabbing any lock. An object can be freed by a thread other than the one
+ * that allocated it; it then simply moves to the freeing thread's cache.
+ * Each cache is bounded, and the objects beyond the bound, as well as the
+ * objects larger than the largest size class, go back to malloc.
+ */
+class SlabAllocator {
+public:
+    /**
+     * Allocate an object.
+     *
+     * @param size Size of the object.
+     * @return Pointer to the allocated object.
+     */
+    static void *allocate(size_t size);
+
+    /**
+     * Allocate a zero-filled object.
+     *
+     * @param size Size of the object.
+     * @return Pointer to the allocated object.
+     */
+    static void *allocateZeroed(size_t size);
+
+    /**
+     * Free an object allocated by allocate() or allocateZeroed().
+     *
+     * @param ptr Pointer to the object.
+     * @param size Size of the object, which should be the same as the size
+     *        passed to the allocation.
+     */
+    static void deallocate(void *ptr, size_t size);
+
+    /**
+     * Return all the objects cached by the calling thread to malloc.
+     * The caches of other threads are released when those threads exit.
+     */
+    static void releaseThreadCache();
+
+    // Largest size served from the per-thread caches.
+    static const size_t maxObjectSize = 512;
+};
+
+/**
+ * Bump-pointer arena for short-lived scratch objects that are all released
+ * at the same time, e.g., the stale sequence number entries and the KV store
+ * delta stats collected during a WAL flush. Objects are never freed one by
+ * one; reset() releases all of them at once while keeping the first chunk
+ * for the next round.
+ */
+class MemoryArena {
+public:
+    MemoryArena(size_t chunk_size = defaultChunkSize);
+
+    ~MemoryArena();
+
+    /**
+     * Allocate a zero-filled and 8-byte aligned object from the arena.
+     *
+     * @param size Size of the object.
+     * @return Pointer to the allocated object.
+     */
+    void *allocate(size_t size);
+
+    /**
+     * Release all the objects allocated from the arena.
+     */
+    void reset();
+
+    /**
+     * Return the arena of the calling thread used for the WAL flush scratch.
+     * It is reset at the end of every WAL flush.
+     */
+    static MemoryArena *getThreadArena();
+
+    /**
+     * Free all the chunks of the calling thread's arena.
+     */
+    static void releaseThreadArena();
+
+    static const size_t defaultChunkSize = 16384;
+
+private:
+    struct arena_chunk {
+        struct arena_chunk *next;
+        size_t size;
+    };
+
+    void *allocateChunk(size_t size);
+
+    void freeChunks();
+
+    struct arena_chunk *chunks;
+    size_t chunkSize;
+    uint8_t *cur;
+    uint8_t *end;
+};
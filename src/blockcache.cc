@@ -22,7 +22,10 @@
 #if !defined(WIN32) && !defined(_WIN32)
 #include <sys/time.h>
 #endif
+#include <iterator>
 #include <map>
+#include <thread>
+#include <unordered_map>
 
 #include "hash_functions.h"
 #include "common.h"
@@ -30,6 +33,7 @@
 #include "hash.h"
 #include "list.h"
 #include "blockcache.h"
+#include "secondary_cache.h"
 #include "avltree.h"
 #include "atomic.h"
 #include "fdb_internal.h"
@@ -54,12 +58,13 @@ const uint32_t BlockCacheManager::defaultBlockSize = FDB_BLOCKSIZE; // 4KB
 
 class BlockCacheItem {
 public:
-    BlockCacheItem() : bid(BLK_NOT_FOUND), addr(NULL), flag(0), score(0) {
+    BlockCacheItem() : bid(BLK_NOT_FOUND), addr(NULL), flag(0), score(0),
+                       pinState(0) {
         list_elem.prev = list_elem.next = NULL;
     }
 
     BlockCacheItem(bid_t _bid, void *_addr, uint8_t _flag, uint8_t _score) :
-        bid(_bid), addr(_addr), flag(_flag), score(_score) {
+        bid(_bid), addr(_addr), flag(_flag), score(_score), pinState(0) {
         list_elem.prev = list_elem.next = NULL;
     }
 
@@ -81,6 +86,35 @@ public:
         return score;
     }
 
+    uint32_t getPinCount(void) const {
+        return pinState.load() & ~PIN_DETACHED;
+    }
+
+    // Caller should grab the shard lock.
+    void incrPinCount(void) {
+        pinState.fetch_add(1);
+    }
+
+    // Return true if the last pin of a detached item is released.
+    bool decrPinCount(void) {
+        return pinState.fetch_sub(1) == (PIN_DETACHED | 1);
+    }
+
+    // Mark the item as detached from its shard. Return false if it is not
+    // pinned anymore. Caller should grab the shard lock.
+    bool markDetached(void) {
+        uint32_t prev = pinState.fetch_or(PIN_DETACHED);
+        if ((prev & ~PIN_DETACHED) == 0) {
+            pinState.fetch_and(~PIN_DETACHED);
+            return false;
+        }
+        return true;
+    }
+
+    void resetPinState(void) {
+        pinState.store(0);
+    }
+
     void setBid(bid_t _bid) {
         bid = _bid;
     }
@@ -105,6 +139,13 @@ private:
     std::atomic<uint8_t> flag;
     // cache block score
     uint8_t score;
+    // Number of readers that directly access the block memory, and
+    // PIN_DETACHED if the item was removed from its shard while pinned.
+    // Unpinning doesn't grab the shard lock as the file may be closed
+    // by that time.
+    std::atomic<uint32_t> pinState;
+
+    static const uint32_t PIN_DETACHED = 0x80000000;
 };
 
 typedef std::unordered_map<bid_t, BlockCacheItem *> block_map_t;
@@ -130,6 +171,26 @@ public:
             dirtyIndexBlocks.empty();
     }
 
+    // Mark a block being evicted as stale, if any, so that the copies made
+    // by the eviction are discarded. Caller should grab the shard lock.
+    void markEvictingBlockStale(bid_t bid) {
+        auto entry = evictingBlocks.find(bid);
+        if (entry != evictingBlocks.end()) {
+            entry->second = true;
+        }
+    }
+
+    // Wait until a given block (or all the blocks if BLK_NOT_FOUND) is no
+    // longer being evicted. Caller should grab the shard lock.
+    void waitForEviction(bid_t bid) {
+        while (bid == BLK_NOT_FOUND ? !evictingBlocks.empty()
+                                    : evictingBlocks.count(bid) > 0) {
+            spin_unlock(&lock);
+            std::this_thread::yield();
+            spin_lock(&lock);
+        }
+    }
+
 private:
     friend class BlockCacheManager;
     friend class FileBlockCache;
@@ -143,6 +204,10 @@ private:
     std::map<bid_t, BlockCacheItem *> dirtyIndexBlocks;
     // Hashtable of all the blocks belonging to this shard
     block_map_t allBlocks;
+    // Blocks removed from this shard and being copied into the lower cache
+    // tiers without the shard lock, and whether each of them became stale
+    // in the meantime.
+    std::unordered_map<bid_t, bool> evictingBlocks;
 };
 
 class FileBlockCache {
@@ -252,6 +317,10 @@ private:
     std::atomic<uint64_t> numImmutables;
     std::atomic<uint64_t> accessTimestamp;
     size_t numShards;
+    // Serializes the flushes that write back dirty blocks, so that an older
+    // version of a block written by one flush can't land on disk after a
+    // newer version written by another flush.
+    std::mutex flushMutex;
 };
 
 static const size_t MAX_VICTIM_SELECTIONS = 5;
@@ -260,6 +329,368 @@ static const size_t MAX_VICTIM_SELECTIONS = 5;
 #define BCACHE_IMMUTABLE (0x2)
 #define BCACHE_FREE (0x4)
 
+// Byte-oriented LZ77 codec used by the compressed block cache.
+// A compressed block is a sequence of (token, literals, match) runs. The upper
+// and lower 4 bits of a token are the number of literals and the match length
+// (minus BLOCK_LZ_MIN_MATCH) respectively, where 15 means that the length
+// continues in the following bytes until a byte other than 255 appears.
+// A match is encoded as a 2-byte little-endian offset, and the last run
+// consists of literals only.
+static const size_t BLOCK_LZ_MIN_MATCH = 4;
+static const size_t BLOCK_LZ_HASH_BITS = 12;
+static const size_t BLOCK_LZ_MAX_OFFSET = 65535;
+
+static inline uint32_t _block_lz_read32(const uint8_t *ptr) {
+    uint32_t val;
+    memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+static inline uint8_t *_block_lz_put_length(uint8_t *op, uint8_t *oend,
+                                            size_t len) {
+    for (; len >= 255; len -= 255) {
+        if (op >= oend) {
+            return NULL;
+        }
+        *op++ = 255;
+    }
+    if (op >= oend) {
+        return NULL;
+    }
+    *op++ = static_cast<uint8_t>(len);
+    return op;
+}
+
+static uint8_t *_block_lz_put_run(uint8_t *op, uint8_t *oend,
+                                  const uint8_t *literals, size_t num_literals,
+                                  size_t offset, size_t match_len) {
+    if (op >= oend) {
+        return NULL;
+    }
+    uint8_t *token = op++;
+    *token = static_cast<uint8_t>((num_literals < 15 ? num_literals : 15) << 4);
+    if (num_literals >= 15) {
+        op = _block_lz_put_length(op, oend, num_literals - 15);
+        if (!op) {
+            return NULL;
+        }
+    }
+    if (num_literals > static_cast<size_t>(oend - op)) {
+        return NULL;
+    }
+    memcpy(op, literals, num_literals);
+    op += num_literals;
+
+    if (!offset) {
+        // the last run
+        return op;
+    }
+    if (oend - op < 2) {
+        return NULL;
+    }
+    *op++ = static_cast<uint8_t>(offset & 0xff);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+    *token |= static_cast<uint8_t>(match_len < 15 ? match_len : 15);
+    if (match_len >= 15) {
+        op = _block_lz_put_length(op, oend, match_len - 15);
+    }
+    return op;
+}
+
+// Return the compressed length, or 0 if it doesn't fit in 'dst_len' bytes.
+static size_t _block_lz_compress(const uint8_t *src, size_t src_len,
+                                 uint8_t *dst, size_t dst_len) {
+    uint32_t table[1 << BLOCK_LZ_HASH_BITS];
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *iend = src + src_len;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dst_len;
+
+    memset(table, 0xff, sizeof(table));
+    while (ip + BLOCK_LZ_MIN_MATCH <= iend) {
+        uint32_t seq = _block_lz_read32(ip);
+        uint32_t h = (seq * 2654435761U) >> (32 - BLOCK_LZ_HASH_BITS);
+        uint32_t pos = static_cast<uint32_t>(ip - src);
+        uint32_t cand = table[h];
+        table[h] = pos;
+
+        if (cand == UINT32_MAX || pos - cand > BLOCK_LZ_MAX_OFFSET ||
+            _block_lz_read32(src + cand) != seq) {
+            ++ip;
+            continue;
+        }
+
+        const uint8_t *mp = src + cand + BLOCK_LZ_MIN_MATCH;
+        const uint8_t *end = ip + BLOCK_LZ_MIN_MATCH;
+        while (end < iend && *end == *mp) {
+            ++end;
+            ++mp;
+        }
+        op = _block_lz_put_run(op, oend, anchor, ip - anchor, pos - cand,
+                               (end - ip) - BLOCK_LZ_MIN_MATCH);
+        if (!op) {
+            return 0;
+        }
+        ip = anchor = end;
+    }
+
+    op = _block_lz_put_run(op, oend, anchor, iend - anchor, 0, 0);
+    return op ? static_cast<size_t>(op - dst) : 0;
+}
+
+// Return the decompressed length, or 0 if the input is corrupted.
+static size_t _block_lz_decompress(const uint8_t *src, size_t src_len,
+                                   uint8_t *dst, size_t dst_len) {
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + src_len;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dst_len;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t len = token >> 4;
+        if (len == 15) {
+            uint8_t byte;
+            do {
+                if (ip >= iend) {
+                    return 0;
+                }
+                byte = *ip++;
+                len += byte;
+            } while (byte == 255);
+        }
+        if (len > static_cast<size_t>(iend - ip) ||
+            len > static_cast<size_t>(oend - op)) {
+            return 0;
+        }
+        memcpy(op, ip, len);
+        ip += len;
+        op += len;
+        if (ip == iend) {
+            // the last run
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return 0;
+        }
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)) {
+            return 0;
+        }
+        len = token & 0xf;
+        if (len == 15) {
+            uint8_t byte;
+            do {
+                if (ip >= iend) {
+                    return 0;
+                }
+                byte = *ip++;
+                len += byte;
+            } while (byte == 255);
+        }
+        len += BLOCK_LZ_MIN_MATCH;
+        if (len > static_cast<size_t>(oend - op)) {
+            return 0;
+        }
+        // the match may overlap with the bytes being produced
+        const uint8_t *mp = op - offset;
+        while (len--) {
+            *op++ = *mp++;
+        }
+    }
+    return op - dst;
+}
+
+/**
+ * Second tier of the block cache that keeps clean blocks evicted from the
+ * block cache in compressed form, within a separate memory budget.
+ * Blocks are moved back to the block cache when they are read again, so that
+ * a block is cached in at most one of the two tiers.
+ */
+class CompressedBlockCache {
+public:
+    CompressedBlockCache(uint64_t capacity, uint32_t blocksize) :
+        blockSize(blocksize), usedSpace(0) {
+        partitionCapacity = capacity / BCACHE_COMP_NPARTITIONS;
+        maxCompressedSize = static_cast<size_t>(blocksize *
+                                                BCACHE_COMP_MAX_RATIO);
+        for (size_t i = 0; i < BCACHE_COMP_NPARTITIONS; ++i) {
+            partitions.push_back(new Partition());
+        }
+    }
+
+    ~CompressedBlockCache() {
+        for (auto partition : partitions) {
+            for (auto &entry : partition->lruList) {
+                free(entry.data);
+            }
+            delete partition;
+        }
+    }
+
+    uint64_t getUsedSpace(void) const {
+        return usedSpace.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Compress a given clean block and keep it in the cache. The least
+     * recently used blocks of the partition are dropped if its budget is
+     * exceeded.
+     */
+    void put(FileBlockCache *fcache, bid_t bid, const void *block) {
+        uint8_t *data = (uint8_t *) malloc(maxCompressedSize);
+        size_t len = _block_lz_compress((const uint8_t *) block, blockSize,
+                                        data, maxCompressedSize);
+        if (!len || len + sizeof(Entry) > partitionCapacity) {
+            // not compressible enough .. not worth caching
+            free(data);
+            return;
+        }
+        uint8_t *shrunk = (uint8_t *) realloc(data, len);
+        if (shrunk) {
+            data = shrunk;
+        }
+
+        Partition *partition = getPartition(fcache, bid);
+        spin_lock(&partition->lock);
+        auto file_entry = partition->index.find(fcache);
+        if (file_entry != partition->index.end()) {
+            auto block_entry = file_entry->second.find(bid);
+            if (block_entry != file_entry->second.end()) {
+                eraseEntry(partition, block_entry->second);
+            }
+        }
+        partition->lruList.push_front(Entry(fcache, bid, data,
+                                            static_cast<uint32_t>(len)));
+        partition->index[fcache][bid] = partition->lruList.begin();
+        partition->used += len + sizeof(Entry);
+        usedSpace += len + sizeof(Entry);
+
+        while (partition->used > partitionCapacity) {
+            eraseEntry(partition, std::prev(partition->lruList.end()));
+        }
+        spin_unlock(&partition->lock);
+    }
+
+    /**
+     * Decompress a given block into 'buf' and remove it from the cache.
+     *
+     * @return True if the block was found.
+     */
+    bool take(FileBlockCache *fcache, bid_t bid, void *buf) {
+        bool ret = false;
+        Partition *partition = getPartition(fcache, bid);
+        spin_lock(&partition->lock);
+        auto file_entry = partition->index.find(fcache);
+        if (file_entry != partition->index.end()) {
+            auto block_entry = file_entry->second.find(bid);
+            if (block_entry != file_entry->second.end()) {
+                Entry &entry = *block_entry->second;
+                ret = _block_lz_decompress(entry.data, entry.len,
+                                           (uint8_t *) buf,
+                                           blockSize) == blockSize;
+                eraseEntry(partition, block_entry->second);
+            }
+        }
+        spin_unlock(&partition->lock);
+        return ret;
+    }
+
+    void remove(FileBlockCache *fcache, bid_t bid) {
+        Partition *partition = getPartition(fcache, bid);
+        spin_lock(&partition->lock);
+        auto file_entry = partition->index.find(fcache);
+        if (file_entry != partition->index.end()) {
+            auto block_entry = file_entry->second.find(bid);
+            if (block_entry != file_entry->second.end()) {
+                eraseEntry(partition, block_entry->second);
+            }
+        }
+        spin_unlock(&partition->lock);
+    }
+
+    /**
+     * Remove all the blocks of a given file.
+     */
+    void removeFile(FileBlockCache *fcache) {
+        for (auto partition : partitions) {
+            spin_lock(&partition->lock);
+            auto file_entry = partition->index.find(fcache);
+            if (file_entry != partition->index.end()) {
+                for (auto &block_entry : file_entry->second) {
+                    Entry &entry = *block_entry.second;
+                    partition->used -= entry.len + sizeof(Entry);
+                    usedSpace -= entry.len + sizeof(Entry);
+                    free(entry.data);
+                    partition->lruList.erase(block_entry.second);
+                }
+                partition->index.erase(file_entry);
+            }
+            spin_unlock(&partition->lock);
+        }
+    }
+
+private:
+    struct Entry {
+        Entry(FileBlockCache *_fcache, bid_t _bid, uint8_t *_data,
+              uint32_t _len) :
+            fcache(_fcache), bid(_bid), data(_data), len(_len) { }
+
+        FileBlockCache *fcache;
+        bid_t bid;
+        uint8_t *data;
+        uint32_t len;
+    };
+
+    typedef std::list<Entry> entry_list_t;
+
+    struct Partition {
+        Partition() : used(0) {
+            spin_init(&lock);
+        }
+
+        ~Partition() {
+            spin_destroy(&lock);
+        }
+
+        spin_t lock;
+        // LRU list of compressed blocks (the most recent one at the head)
+        entry_list_t lruList;
+        // Compressed blocks indexed by their files and block IDs
+        std::unordered_map<FileBlockCache *,
+                           std::unordered_map<bid_t,
+                                              entry_list_t::iterator> > index;
+        uint64_t used;
+    };
+
+    Partition *getPartition(FileBlockCache *fcache, bid_t bid) {
+        uint64_t hash = bid ^ (reinterpret_cast<uintptr_t>(fcache) >> 4);
+        return partitions[hash % BCACHE_COMP_NPARTITIONS];
+    }
+
+    // Caller should grab the partition lock.
+    void eraseEntry(Partition *partition, entry_list_t::iterator it) {
+        auto file_entry = partition->index.find(it->fcache);
+        file_entry->second.erase(it->bid);
+        if (file_entry->second.empty()) {
+            partition->index.erase(file_entry);
+        }
+        partition->used -= it->len + sizeof(Entry);
+        usedSpace -= it->len + sizeof(Entry);
+        free(it->data);
+        partition->lruList.erase(it);
+    }
+
+    std::vector<Partition *> partitions;
+    uint64_t partitionCapacity;
+    size_t maxCompressedSize;
+    uint32_t blockSize;
+    std::atomic<uint64_t> usedSpace;
+};
+
 FileBlockCache *BlockCacheManager::chooseEvictionVictim() {
     FileBlockCache *ret = NULL;
     uint64_t min_timestamp = static_cast<uint64_t>(-1);
@@ -318,7 +749,22 @@ BlockCacheItem *BlockCacheManager::getFreeBlock() {
     return NULL;
 }
 
+bool BlockCacheManager::detachPinnedBlock(FileBlockCache *fcache,
+                                          size_t shard_num,
+                                          BlockCacheItem *item) {
+    if (!item->markDetached()) {
+        // all pins have been released in the meantime
+        return false;
+    }
+    // Pinned blocks are always clean, so they only belong to the clean list.
+    list_remove(&fcache->shards[shard_num]->cleanBlocks, &item->list_elem);
+    fcache->shards[shard_num]->allBlocks.erase(item->getBid());
+    fcache->numItems--;
+    return true;
+}
+
 void BlockCacheManager::addToFreeBlockList(BlockCacheItem *item) {
+    item->resetPinState();
     spin_lock(&freeListLock);
     item->setFlag(BCACHE_FREE);
     item->setScore(0);
@@ -345,6 +791,9 @@ bool BlockCacheManager::freeFileBlockCache(FileBlockCache *fcache,
         return false;
     }
 
+    if (compCache) {
+        compCache->removeFile(fcache);
+    }
     // free a file block cache
     delete fcache;
     return true;
@@ -376,29 +825,32 @@ fdb_status BlockCacheManager::flushDirtyBlocks(FileBlockCache *fcache,
                                                bool sync,
                                                bool flush_all,
                                                bool immutables_only) {
-    void *buf = NULL;
     std::map<bid_t, BlockCacheItem *> *shard_dirty_tree;
 
     uint64_t count = 0;
-    ssize_t ret = 0;
     bid_t start_bid = 0, prev_bid = 0;
     void *ptr = NULL;
     uint8_t marker = 0x0;
     fdb_status status = FDB_RESULT_SUCCESS;
-    bool o_direct = false;
     bool data_block_completed = false;
+    // Consecutive dirty blocks in the current batch write, and their addresses.
+    std::vector<BlockCacheItem *> batch;
+    std::vector<void *> blocks;
+    std::unique_lock<std::mutex> flush_lock(fcache->flushMutex,
+                                            std::defer_lock);
 
     // Cross-shard dirty block list for sequential writes.
     std::map<bid_t, BlockCacheItem *> dirty_blocks;
 
-    if (fcache->getFileManager()->getConfig()->getFlag() & _ARCH_O_DIRECT) {
-        o_direct = true;
-    }
-
-    // scan and write back dirty blocks sequentially for O_DIRECT option.
-    if (sync && o_direct) {
-        malloc_align(buf, FDB_SECTOR_SIZE, flushUnit);
-        fcache->acquireAllShardLocks();
+    // Scan dirty blocks in BID order, and write back each run of consecutive
+    // blocks directly from the cache memory by vectored writes. The blocks in
+    // a batch are moved to the clean list and pinned, so that they are
+    // neither evicted nor overwritten while they are written without the
+    // shard locks.
+    if (sync) {
+        batch.resize(flushUnit / blockSize + 1);
+        blocks.resize(flushUnit / blockSize + 1);
+        flush_lock.lock();
     }
 
     prev_bid = start_bid = BLK_NOT_FOUND;
@@ -406,15 +858,12 @@ fdb_status BlockCacheManager::flushDirtyBlocks(FileBlockCache *fcache,
 
     // Try to flush the dirty data blocks first and then index blocks.
     size_t i = 0;
-    bool consecutive_blocks = true;
     BlockCacheItem *item = NULL;
 
     while (1) {
         if (dirty_blocks.empty()) {
             for (i = 0; i < fcache->getNumShards(); ++i) {
-                if (!(sync && o_direct)) {
-                    spin_lock(&fcache->shards[i]->lock);
-                }
+                spin_lock(&fcache->shards[i]->lock);
                 if (!data_block_completed) {
                     auto entry = fcache->shards[i]->dirtyDataBlocks.begin();
                     if (entry != fcache->shards[i]->dirtyDataBlocks.end()) {
@@ -436,9 +885,7 @@ fdb_status BlockCacheManager::flushDirtyBlocks(FileBlockCache *fcache,
                         dirty_blocks.insert(std::make_pair(item->getBid(), item));
                     }
                 }
-                if (!(sync && o_direct)) {
-                    spin_unlock(&fcache->shards[i]->lock);
-                }
+                spin_unlock(&fcache->shards[i]->lock);
             }
             if (dirty_blocks.empty()) {
                 if (!data_block_completed) {
@@ -460,9 +907,7 @@ fdb_status BlockCacheManager::flushDirtyBlocks(FileBlockCache *fcache,
         bid_t dirty_bid = dirty_entry->first;
 
         size_t shard_num = dirty_bid % fcache->getNumShards();
-        if (!(sync && o_direct)) {
-            spin_lock(&fcache->shards[shard_num]->lock);
-        }
+        spin_lock(&fcache->shards[shard_num]->lock);
         if (!data_block_completed) {
             shard_dirty_tree = &fcache->shards[shard_num]->dirtyDataBlocks;
         } else {
@@ -479,33 +924,38 @@ fdb_status BlockCacheManager::flushDirtyBlocks(FileBlockCache *fcache,
             }
         }
 
-        // remove from the cross-shard dirty block list.
-        dirty_blocks.erase(dirty_bid);
         if (!item_exist) {
             // The original first item in the shard dirty block list was removed.
             // Grab the next one from the cross-shard dirty block list.
-            if (!(sync && o_direct)) {
-                spin_unlock(&fcache->shards[shard_num]->lock);
-            }
+            dirty_blocks.erase(dirty_bid);
+            spin_unlock(&fcache->shards[shard_num]->lock);
             if (immutables_only && !fcache->numImmutables.load()) {
                 break;
             }
             continue;
         }
 
-        consecutive_blocks = true;
         // if BID of next dirty block is not consecutive .. stop
         if (dirty_block->getBid() != prev_bid + 1 && prev_bid != BLK_NOT_FOUND &&
             sync) {
-            if (flush_all) {
-                consecutive_blocks = false;
-            } else {
-                if (!(sync && o_direct)) {
-                    spin_unlock(&fcache->shards[shard_num]->lock);
-                }
+            spin_unlock(&fcache->shards[shard_num]->lock);
+            if (!flush_all) {
+                break;
+            }
+            // Write the current batch, and start a new batch from this block.
+            status = writeBatch(fcache, batch.data(), blocks.data(), count,
+                                start_bid);
+            if (status != FDB_RESULT_SUCCESS) {
                 break;
             }
+            count = 0;
+            start_bid = prev_bid = BLK_NOT_FOUND;
+            continue;
         }
+
+        // remove from the cross-shard dirty block list.
+        dirty_blocks.erase(dirty_bid);
+
         // set START_BID if this is the start block for a single batch write.
         if (start_bid == BLK_NOT_FOUND) {
             start_bid = dirty_block->getBid();
@@ -532,13 +982,9 @@ fdb_status BlockCacheManager::flushDirtyBlocks(FileBlockCache *fcache,
         shard_dirty_tree->erase(dirty_block->getBid());
         if (dirty_block->getFlag() & BCACHE_IMMUTABLE) {
             fcache->numImmutables--;
-            if (!(sync && o_direct)) {
-                spin_unlock(&fcache->shards[shard_num]->lock);
-            }
         }
 
         if (sync) {
-            // copy to buffer
 #ifdef __CRC32
             if (marker == BLK_MARKER_BNODE) {
                 // b-tree node .. calculate crc32 and put it into the block
@@ -551,45 +997,10 @@ fdb_status BlockCacheManager::flushDirtyBlocks(FileBlockCache *fcache,
                 memcpy((uint8_t *)(ptr) + BTREE_CRC_OFFSET, &crc, sizeof(crc));
             }
 #endif
-            if (o_direct) {
-                if (count > 0 && !consecutive_blocks) {
-                    int64_t bytes_written;
-                    // Note that this path can be only executed in flush_all case.
-                    bytes_written = fcache->getFileManager()->writeBlocks(buf,
-                                                                          count,
-                                                                          start_bid);
-                    if ((uint64_t)bytes_written != count * blockSize) {
-                        count = 0;
-                        status = bytes_written < 0 ?
-                            (fdb_status) bytes_written : FDB_RESULT_WRITE_FAIL;
-                        break;
-                    }
-                    // Start a new batch again.
-                    count = 0;
-                    start_bid = dirty_block->getBid();
-                }
-                memcpy((uint8_t *)(buf) + count * blockSize,
-                       dirty_block->getBlockAddr(), blockSize);
-            } else {
-                ret = fcache->getFileManager()->writeBlocks(
-                                            dirty_block->getBlockAddr(),
-                                            1,
-                                            dirty_block->getBid());
-                if (ret != blockSize) {
-                    if (!(dirty_block->getFlag() & BCACHE_IMMUTABLE) &&
-                        !(sync && o_direct)) {
-                        spin_unlock(&fcache->shards[shard_num]->lock);
-                    }
-                    status = ret < 0 ? (fdb_status) ret : FDB_RESULT_WRITE_FAIL;
-                    break;
-                }
-            }
-        }
-
-        if (!(sync && o_direct)) {
-            if (dirty_block->getFlag() & BCACHE_IMMUTABLE) {
-                spin_lock(&fcache->shards[shard_num]->lock);
-            }
+            // pinned until the batch is written
+            dirty_block->incrPinCount();
+            batch[count] = dirty_block;
+            blocks[count] = ptr;
         }
 
         dirty_block->setFlag(dirty_block->getFlag() & ~(BCACHE_DIRTY));
@@ -601,26 +1012,19 @@ fdb_status BlockCacheManager::flushDirtyBlocks(FileBlockCache *fcache,
         fdb_assert(!(dirty_block->getFlag() & BCACHE_FREE),
                    dirty_block->getFlag(), BCACHE_FREE);
 
-        if (!(sync && o_direct)) {
-            spin_unlock(&fcache->shards[shard_num]->lock);
-        }
+        spin_unlock(&fcache->shards[shard_num]->lock);
 
         count++;
         if (count * blockSize >= flushUnit && sync) {
             if (flush_all) {
-                if (o_direct) {
-                    ret = fcache->getFileManager()->writeBlocks(buf,
-                                                                count,
-                                                                start_bid);
-                    if ((size_t)ret != count * blockSize) {
-                        count = 0;
-                        status = ret < 0 ? (fdb_status) ret : FDB_RESULT_WRITE_FAIL;
-                        break;
-                    }
-                    count = 0;
-                    start_bid = BLK_NOT_FOUND;
-                    prev_bid = BLK_NOT_FOUND;
+                status = writeBatch(fcache, batch.data(), blocks.data(), count,
+                                    start_bid);
+                count = 0;
+                if (status != FDB_RESULT_SUCCESS) {
+                    break;
                 }
+                start_bid = BLK_NOT_FOUND;
+                prev_bid = BLK_NOT_FOUND;
             } else {
                 break;
             }
@@ -628,20 +1032,34 @@ fdb_status BlockCacheManager::flushDirtyBlocks(FileBlockCache *fcache,
     }
 
     // synchronize
-    if (sync && o_direct) {
-        if (count > 0) {
-            ret = fcache->getFileManager()->writeBlocks(buf, count, start_bid);
-            if ((size_t)ret != count * blockSize) {
-                status = ret < 0 ? (fdb_status) ret : FDB_RESULT_WRITE_FAIL;
-            }
+    if (sync && count > 0) {
+        fdb_status fs = writeBatch(fcache, batch.data(), blocks.data(), count,
+                                   start_bid);
+        if (status == FDB_RESULT_SUCCESS) {
+            status = fs;
         }
-        fcache->releaseAllShardLocks();
-        free_align(buf);
     }
 
     return status;
 }
 
+fdb_status BlockCacheManager::writeBatch(FileBlockCache *fcache,
+                                         BlockCacheItem **items,
+                                         void **blocks,
+                                         uint64_t count,
+                                         bid_t start_bid) {
+    fdb_status status = FDB_RESULT_SUCCESS;
+    ssize_t ret = fcache->getFileManager()->writeBlockVector(blocks, count,
+                                                             start_bid);
+    if ((uint64_t)ret != count * blockSize) {
+        status = ret < 0 ? (fdb_status) ret : FDB_RESULT_WRITE_FAIL;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        unpin(items[i]);
+    }
+    return status;
+}
+
 void BlockCacheManager::performEviction() {
     size_t n_evict;
     struct list_elem *elem = NULL;
@@ -701,6 +1119,12 @@ void BlockCacheManager::performEviction() {
 
             elem = list_pop_back(&bshard->cleanBlocks);
             item = reinterpret_cast<BlockCacheItem *>(elem);
+            if (item->getPinCount()) {
+                // pinned blocks cannot be evicted .. move to the head of list
+                list_push_front(&bshard->cleanBlocks, &item->list_elem);
+                spin_unlock(&bshard->lock);
+                continue;
+            }
 #ifdef __BCACHE_SECOND_CHANCE
             // repeat until zero-score item is found
             if (item->getScore() == 0) {
@@ -728,7 +1152,41 @@ void BlockCacheManager::performEviction() {
 
         victim->numItems--;
         // remove from the shard block list
-        bshard->allBlocks.erase(item->getBid());
+        bid_t bid = item->getBid();
+        bshard->allBlocks.erase(bid);
+        SecondaryCacheFile *sfile =
+            victim->getFileManager()->getSecondaryCacheFile();
+        if ((compCache || sfile) &&
+            bshard->evictingBlocks.find(bid) == bshard->evictingBlocks.end()) {
+            // Keep the block in the compressed and secondary block caches.
+            // The block can't be reached through the shard any more, so it
+            // is compressed and written without holding the shard lock.
+            // Closing the file waits for this in removeCleanBlocks().
+            bshard->evictingBlocks[bid] = false;
+            spin_unlock(&bshard->lock);
+
+            if (compCache) {
+                compCache->put(victim, bid, item->getBlockAddr());
+            }
+            if (sfile) {
+                SecondaryBlockCache::getInstance()->admit(
+                                        sfile, bid, item->getBlockAddr());
+            }
+
+            spin_lock(&bshard->lock);
+            auto entry = bshard->evictingBlocks.find(bid);
+            if (entry->second) {
+                // the block was cached again or invalidated in the meantime
+                if (compCache) {
+                    compCache->remove(victim, bid);
+                }
+                if (sfile) {
+                    SecondaryBlockCache::getInstance()->invalidate(sfile,
+                                                                   bid, 1);
+                }
+            }
+            bshard->evictingBlocks.erase(entry);
+        }
         // add to the free block list
         addToFreeBlockList(item);
         n_evict++;
@@ -881,6 +1339,12 @@ int BlockCacheManager::read(FileMgr *file,
         } else {
             // cache miss
             spin_unlock(&fcache->shards[shard_num]->lock);
+            if (compCache && compCache->take(fcache, bid, buf)) {
+                // the block was evicted into the compressed block cache ..
+                // move it back to the block cache
+                write(file, bid, buf, BCACHE_REQ_CLEAN, false);
+                return blockSize;
+            }
         }
     }
 
@@ -888,6 +1352,51 @@ int BlockCacheManager::read(FileMgr *file,
     return 0;
 }
 
+void *BlockCacheManager::pin(FileMgr *file,
+                             bid_t bid,
+                             BlockCacheItem **item_out) {
+    FileBlockCache *fcache;
+    void *addr = NULL;
+
+    fcache = file->getBCache();
+    if (!fcache) {
+        return NULL;
+    }
+
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    fcache->setAccessTimestamp(static_cast<uint64_t>(tp.tv_sec * 1000000 +
+                                                     tp.tv_usec));
+
+    size_t shard_num = bid % fcache->getNumShards();
+    spin_lock(&fcache->shards[shard_num]->lock);
+
+    auto block_entry = fcache->shards[shard_num]->allBlocks.find(bid);
+    if (block_entry != fcache->shards[shard_num]->allBlocks.end()) {
+        BlockCacheItem *item = block_entry->second;
+        // dirty blocks can be modified by writers, so only clean blocks
+        // are allowed to be accessed in place.
+        if (!(item->getFlag() & (BCACHE_FREE | BCACHE_DIRTY))) {
+            list_remove(&fcache->shards[shard_num]->cleanBlocks, &item->list_elem);
+            list_push_front(&fcache->shards[shard_num]->cleanBlocks, &item->list_elem);
+            item->incrPinCount();
+            setScore(*item);
+            addr = item->getBlockAddr();
+            *item_out = item;
+        }
+    }
+
+    spin_unlock(&fcache->shards[shard_num]->lock);
+    return addr;
+}
+
+void BlockCacheManager::unpin(BlockCacheItem *item) {
+    if (item->decrPinCount()) {
+        // the block was invalidated or overwritten while it was pinned.
+        addToFreeBlockList(item);
+    }
+}
+
 bool BlockCacheManager::invalidateBlock(FileMgr *file,
                                         bid_t bid) {
     FileBlockCache *fcache;
@@ -923,7 +1432,12 @@ bool BlockCacheManager::invalidateBlock(FileMgr *file,
                 return false;
             }
 
-            if (!(item->getFlag() & BCACHE_DIRTY)) {
+            if (item->getPinCount() &&
+                detachPinnedBlock(fcache, shard_num, item)) {
+                // pinned clean block .. it will be freed when unpinned
+                spin_unlock(&fcache->shards[shard_num]->lock);
+                ret = true;
+            } else if (!(item->getFlag() & BCACHE_DIRTY)) {
                 fcache->numItems--;
                 // only for clean blocks
                 // remove from the shard block list
@@ -944,7 +1458,14 @@ bool BlockCacheManager::invalidateBlock(FileMgr *file,
             }
         } else {
             // cache miss
+            // the block may be on its way to the lower cache tiers .. wait
+            // until the stale copies are discarded.
+            fcache->shards[shard_num]->markEvictingBlockStale(bid);
+            fcache->shards[shard_num]->waitForEviction(bid);
             spin_unlock(&fcache->shards[shard_num]->lock);
+            if (compCache) {
+                compCache->remove(fcache, bid);
+            }
         }
     }
     return ret;
@@ -980,6 +1501,13 @@ int BlockCacheManager::write(FileMgr *file,
 
     // search shard hash table
     auto block_entry = fcache->shards[shard_num]->allBlocks.find(bid);
+    if (block_entry != fcache->shards[shard_num]->allBlocks.end() &&
+        block_entry->second->getPinCount() &&
+        detachPinnedBlock(fcache, shard_num, block_entry->second)) {
+        // the cached block is accessed in place by pinned readers ..
+        // keep its memory intact and cache the new contents in another block.
+        block_entry = fcache->shards[shard_num]->allBlocks.end();
+    }
     if (block_entry == fcache->shards[shard_num]->allBlocks.end()) {
         // cache miss
         // get a block from the free list
@@ -992,12 +1520,22 @@ int BlockCacheManager::write(FileMgr *file,
 
         // re-search hash table
         block_entry = fcache->shards[shard_num]->allBlocks.find(bid);
+        if (block_entry != fcache->shards[shard_num]->allBlocks.end() &&
+            block_entry->second->getPinCount() &&
+            detachPinnedBlock(fcache, shard_num, block_entry->second)) {
+            block_entry = fcache->shards[shard_num]->allBlocks.end();
+        }
         if (block_entry == fcache->shards[shard_num]->allBlocks.end()) {
             // insert into hash table
             item->setBid(bid);
             item->setFlag(BCACHE_FREE);
             fcache->shards[shard_num]->allBlocks.insert(std::make_pair(item->getBid(),
                                                                        item));
+            fcache->shards[shard_num]->markEvictingBlockStale(bid);
+            if (compCache) {
+                // drop the stale copy in the compressed block cache if any
+                compCache->remove(fcache, bid);
+            }
         } else {
             // insert into freelist again
             addToFreeBlockList(item);
@@ -1058,6 +1596,65 @@ int BlockCacheManager::write(FileMgr *file,
     return blockSize;
 }
 
+int BlockCacheManager::writeIfAbsent(FileMgr *file,
+                                     bid_t bid,
+                                     void *buf) {
+    BlockCacheItem *item;
+    FileBlockCache *fcache;
+
+    fcache = file->getBCache();
+    if (fcache == NULL) {
+        spin_lock(&bcacheLock);
+        fcache = file->getBCache();
+        if (fcache == NULL) {
+            fcache = createFileBlockCache(file);
+        }
+        spin_unlock(&bcacheLock);
+    }
+
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    fcache->setAccessTimestamp(static_cast<uint64_t>(tp.tv_sec * 1000000 + tp.tv_usec));
+
+    size_t shard_num = bid % fcache->getNumShards();
+    spin_lock(&fcache->shards[shard_num]->lock);
+    if (fcache->shards[shard_num]->allBlocks.count(bid)) {
+        spin_unlock(&fcache->shards[shard_num]->lock);
+        return 0;
+    }
+    while ((item = getFreeBlock()) == NULL) {
+        // no free block .. perform eviction
+        spin_unlock(&fcache->shards[shard_num]->lock);
+        performEviction();
+        spin_lock(&fcache->shards[shard_num]->lock);
+    }
+
+    // the block may have been cached while the lock was released for the
+    // eviction, or may have become writable since it was read
+    if (fcache->shards[shard_num]->allBlocks.count(bid) ||
+        file->isWritable(bid)) {
+        spin_unlock(&fcache->shards[shard_num]->lock);
+        addToFreeBlockList(item);
+        return 0;
+    }
+
+    item->setBid(bid);
+    item->setFlag(0x0);
+    fcache->shards[shard_num]->allBlocks.insert(std::make_pair(bid, item));
+    fcache->shards[shard_num]->markEvictingBlockStale(bid);
+    if (compCache) {
+        compCache->remove(fcache, bid);
+    }
+    fcache->numItems++;
+    list_push_front(&fcache->shards[shard_num]->cleanBlocks, &item->list_elem);
+    memcpy(item->getBlockAddr(), buf, blockSize);
+    setScore(*item);
+
+    spin_unlock(&fcache->shards[shard_num]->lock);
+
+    return blockSize;
+}
+
 int BlockCacheManager::writePartial(FileMgr *file,
                                     bid_t bid,
                                     void *buf,
@@ -1098,6 +1695,14 @@ int BlockCacheManager::writePartial(FileMgr *file,
         item = block_entry->second;
     }
 
+    if (item->getPinCount() && detachPinnedBlock(fcache, shard_num, item)) {
+        // the block is accessed in place by pinned readers ..
+        // treat as a cache miss so that the whole block is written into
+        // another cache block.
+        spin_unlock(&fcache->shards[shard_num]->lock);
+        return 0;
+    }
+
     if (item->getFlag() & BCACHE_FREE) {
         DBG("Warning: failed to write on the buffer cache entry for a file '%s' "
             "because the entry belongs to the free list!\n",
@@ -1192,9 +1797,19 @@ void BlockCacheManager::removeCleanBlocks(FileMgr *file) {
         size_t i = 0;
         for (; i < fcache->getNumShards(); ++i) {
             spin_lock(&fcache->shards[i]->lock);
+            // blocks being evicted still refer to the file
+            fcache->shards[i]->waitForEviction(BLK_NOT_FOUND);
             elem = list_begin(&fcache->shards[i]->cleanBlocks);
             while (elem) {
                 item = reinterpret_cast<BlockCacheItem *>(elem);
+                if (item->getPinCount()) {
+                    // it will be freed when unpinned
+                    elem = list_next(elem);
+                    if (detachPinnedBlock(fcache, i, item)) {
+                        continue;
+                    }
+                    elem = &item->list_elem;
+                }
                 // remove from clean block list
                 elem = list_remove(&fcache->shards[i]->cleanBlocks, elem);
                 // remove from the all block list
@@ -1204,6 +1819,10 @@ void BlockCacheManager::removeCleanBlocks(FileMgr *file) {
             }
             spin_unlock(&fcache->shards[i]->lock);
         }
+
+        if (compCache) {
+            compCache->removeFile(fcache);
+        }
     }
 }
 
@@ -1262,13 +1881,18 @@ fdb_status BlockCacheManager::flush(FileMgr *file) {
     return status;
 }
 
-BlockCacheManager::BlockCacheManager(uint64_t nblock, uint32_t blocksize) {
+BlockCacheManager::BlockCacheManager(uint64_t nblock, uint32_t blocksize,
+                                     uint64_t comp_cache_size) {
     BlockCacheItem *item;
     uint8_t *block_ptr;
 
     blockSize = blocksize;
     flushUnit = BCACHE_FLUSH_UNIT;
     numBlocks = nblock;
+    compCache = NULL;
+    if (comp_cache_size) {
+        compCache = new CompressedBlockCache(comp_cache_size, blockSize);
+    }
 
     spin_init(&bcacheLock);
     spin_init(&freeListLock);
@@ -1283,8 +1907,11 @@ BlockCacheManager::BlockCacheManager(uint64_t nblock, uint32_t blocksize) {
 
     freeListCount = 0;
 
-    // Allocate entire buffer cache memory
-    block_ptr = (uint8_t *) malloc((uint64_t) blockSize * numBlocks);
+    // Allocate entire buffer cache memory. Blocks are aligned to the sector
+    // size so that they can be read and written through direct I/O in place.
+    void *addr = NULL;
+    malloc_align(addr, FDB_SECTOR_SIZE, (uint64_t) blockSize * numBlocks);
+    block_ptr = (uint8_t *) addr;
     bufferCache = block_ptr;
 
     for (uint64_t i = 0; i < numBlocks; ++i) {
@@ -1295,14 +1922,15 @@ BlockCacheManager::BlockCacheManager(uint64_t nblock, uint32_t blocksize) {
     }
 }
 
-BlockCacheManager* BlockCacheManager::init(uint64_t nblock, uint32_t blocksize) {
+BlockCacheManager* BlockCacheManager::init(uint64_t nblock, uint32_t blocksize,
+                                           uint64_t comp_cache_size) {
     BlockCacheManager* tmp = instance.load();
     if (tmp == nullptr) {
         // Ensure two threads don't both create an instance.
         std::lock_guard<std::mutex> lock(instanceMutex);
         tmp = instance.load();
         if (tmp == nullptr) {
-            tmp = new BlockCacheManager(nblock, blocksize);
+            tmp = new BlockCacheManager(nblock, blocksize, comp_cache_size);
             instance.store(tmp);
         }
     }
@@ -1346,7 +1974,7 @@ BlockCacheManager::~BlockCacheManager() {
     writer_unlock(&fileListLock);
 
     // Free entire buffer cache memory
-    free(bufferCache);
+    free_align(bufferCache);
 
     spin_lock(&bcacheLock);
     for (auto &file_entry : fileMap) {
@@ -1354,6 +1982,8 @@ BlockCacheManager::~BlockCacheManager() {
     }
     spin_unlock(&bcacheLock);
 
+    delete compCache;
+
     spin_destroy(&bcacheLock);
     spin_destroy(&freeListLock);
 
@@ -1382,6 +2012,10 @@ uint64_t BlockCacheManager::getNumBlocks(FileMgr *file) {
     return 0;
 }
 
+uint64_t BlockCacheManager::getCompressedCacheUsed() const {
+    return compCache ? compCache->getUsedSpace() : 0;
+}
+
 uint64_t BlockCacheManager::getNumImmutables(FileMgr *file) {
     FileBlockCache *fcache = file->getBCache();
     if (fcache) {
@@ -1390,6 +2024,28 @@ uint64_t BlockCacheManager::getNumImmutables(FileMgr *file) {
     return 0;
 }
 
+void BlockCacheManager::getResidentBlocks(FileMgr *file,
+                        std::vector<std::pair<bid_t, uint8_t> > &blocks) {
+    FileBlockCache *fcache = file->getBCache();
+    struct list_elem *elem;
+    BlockCacheItem *item;
+
+    if (!fcache) {
+        return;
+    }
+    for (size_t i = 0; i < fcache->getNumShards(); ++i) {
+        BlockCacheShard *bshard = fcache->shards[i];
+        spin_lock(&bshard->lock);
+        elem = list_begin(&bshard->cleanBlocks);
+        while (elem) {
+            item = reinterpret_cast<BlockCacheItem *>(elem);
+            blocks.push_back(std::make_pair(item->getBid(), item->getScore()));
+            elem = list_next(elem);
+        }
+        spin_unlock(&bshard->lock);
+    }
+}
+
 // LCOV_EXCL_START
 void BlockCacheManager::printItems() {
     size_t n=1;
@@ -33,6 +33,7 @@ typedef enum {
 
 class BlockCacheItem;
 class FileBlockCache;
+class CompressedBlockCache;
 
 // Block cache file map with a file name as a key.
 typedef std::unordered_map<std::string, FileBlockCache *> bcache_file_map;
@@ -50,10 +51,13 @@ public:
      *
      * @param nblock Number of blocks to be allocated in the cache
      * @param blocksize Size of each block in the cache
+     * @param comp_cache_size Memory budget in bytes of the compressed block
+     *        cache tier (0: disabled)
      * @return Pointer to the block cache manager
      */
     static BlockCacheManager* init(uint64_t nblock,
-                                   uint32_t blocksize);
+                                   uint32_t blocksize,
+                                   uint64_t comp_cache_size = 0);
 
     /**
      * Get the singleton instance of the block cache manager.
@@ -87,6 +91,30 @@ public:
              bid_t bid,
              void *buf);
 
+    /**
+     * Pin a given cached block so that its memory can be accessed directly
+     * without being evicted or overwritten. Only clean blocks can be pinned.
+     * Every successful call should be paired with a call to unpin().
+     *
+     * @param file Pointer to the file manager instance
+     * @param bid ID of a block to be pinned
+     * @param item Pointer to the place where the pinned cache item is returned
+     * @return Address of the pinned block memory, or NULL if a given block
+     *         is not cached or is dirty.
+     */
+    void *pin(FileMgr *file,
+              bid_t bid,
+              BlockCacheItem **item);
+
+    /**
+     * Release a block pinned by pin(). If the block was invalidated or
+     * overwritten while it was pinned, its memory is returned to the free list.
+     * This can be called even after the file that owns the block is closed.
+     *
+     * @param item Pointer to the cache item returned by pin()
+     */
+    void unpin(BlockCacheItem *item);
+
     /**
      * Invalidate a given cached block and return its memory to the free list
      * to be used for future allocations.
@@ -116,6 +144,21 @@ public:
               bcache_dirty_t dirty,
               bool final_write);
 
+    /**
+     * Write a block read from disk into the block cache as a clean block,
+     * unless the block is already cached or became writable. Both are
+     * checked under the cache lock, so that a newer version cached by a
+     * writer in the meantime is never replaced.
+     *
+     * @param file Pointer to the file manager instance
+     * @param bid ID of block to be written
+     * @param buf Pointer to the buffer containing the block content
+     * @return Number of bytes written into the cache, or 0 if skipped
+     */
+    int writeIfAbsent(FileMgr *file,
+                      bid_t bid,
+                      void *buf);
+
     /**
      * Write a offset range of a given block into the block cache.
      *
@@ -191,6 +234,17 @@ public:
      */
     uint64_t getNumImmutables(FileMgr *file);
 
+    /**
+     * Collect the IDs and scores of the clean blocks of a given file that
+     * are resident in the block cache.
+     *
+     * @param file Pointer to the file manager instance
+     * @param blocks Vector that the pairs of block ID and score are
+     *        appended to
+     */
+    void getResidentBlocks(FileMgr *file,
+                           std::vector<std::pair<bid_t, uint8_t> > &blocks);
+
     /**
      * Return the number of blocks in the block cache's free list.
      *
@@ -199,6 +253,12 @@ public:
         return freeListCount;
     }
 
+    /**
+     * Return the memory space used by the compressed block cache tier.
+     *
+     */
+    uint64_t getCompressedCacheUsed() const;
+
     /**
      * Print the stats summary of the block cache.
      */
@@ -210,8 +270,11 @@ private:
      *
      * @param nblock Number of blocks to be allocated in the cache
      * @param blocksize Size of each block in the cache
+     * @param comp_cache_size Memory budget in bytes of the compressed block
+     *        cache tier (0: disabled)
      */
-    BlockCacheManager(uint64_t nblock, uint32_t blocksize);
+    BlockCacheManager(uint64_t nblock, uint32_t blocksize,
+                      uint64_t comp_cache_size);
 
     ~BlockCacheManager();
 
@@ -260,6 +323,20 @@ private:
      */
     void cleanUpInvalidFileBlockCaches();
 
+    /**
+     * Detach a pinned cache item from its shard so that the block ID can be
+     * cached again with another item. The detached item is returned to the
+     * free list when it is unpinned. Caller should grab the shard lock.
+     *
+     * @param fcache Pointer to the file block cache that owns the item
+     * @param shard_num Shard number of the item
+     * @param item Pointer to the pinned cache item to be detached
+     * @return True if the item is detached, false if it is not pinned anymore.
+     */
+    bool detachPinnedBlock(FileBlockCache *fcache,
+                           size_t shard_num,
+                           BlockCacheItem *item);
+
     /**
      * Get a block from the free block list.
      *
@@ -294,6 +371,23 @@ private:
                                 bool flush_all,
                                 bool immutables_only);
 
+    /**
+     * Write a batch of consecutive blocks pinned by flushDirtyBlocks() and
+     * unpin them. Caller should not grab any shard lock.
+     *
+     * @param fcache Pointer to a file block cache the blocks belong to
+     * @param items Array of the pinned cache items
+     * @param blocks Array of the addresses of the blocks
+     * @param count Number of the blocks
+     * @param start_bid ID of the first block
+     * @return FDB_RESULT_SUCCESS if the write is successful
+     */
+    fdb_status writeBatch(FileBlockCache *fcache,
+                          BlockCacheItem **items,
+                          void **blocks,
+                          uint64_t count,
+                          bid_t start_bid);
+
 
     // Singleton block cache manager and mutex guarding it's creation.
     static std::atomic<BlockCacheManager *> instance;
@@ -326,6 +420,9 @@ private:
     size_t flushUnit;
     // Pointer to the block cache memory
     void *bufferCache;
+    // Second tier keeping evicted clean blocks in compressed form
+    // (NULL if disabled)
+    CompressedBlockCache *compCache;
 
     DISALLOW_COPY_AND_ASSIGN(BlockCacheManager);
 };
@@ -661,6 +661,31 @@ btree_result BTree::getKeyRange(idx_t num, idx_t den, void *key_begin, void *key
     return BTREE_RESULT_SUCCESS;
 }
 
+btree_result BTree::readNodeEntries(bid_t bid, btree_node_entry_func *func,
+                                    void *ctx)
+{
+    void *addr;
+    uint8_t *k = alca(uint8_t, ksize);
+    uint8_t *v = alca(uint8_t, vsize);
+    struct bnode *node;
+    idx_t i;
+
+    addr = bhandle->read(bid);
+    if (!addr) {
+        return BTREE_RESULT_FAIL;
+    }
+    node = _fetch_bnode(addr, 0);
+
+    kv_ops->initKVVar(k, v);
+    for (i = 0; i < node->nentry; ++i) {
+        kv_ops->getKV(node, i, k, v);
+        func(k, v, ctx);
+    }
+    kv_ops->freeKVVar(k, v);
+
+    return BTREE_RESULT_SUCCESS;
+}
+
 btree_result BTree::find(void *key, void *value_buf)
 {
     void *addr;
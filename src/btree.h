@@ -58,6 +58,8 @@ struct bnode{
 #define BNODE_MASK_ROOT 0x1
 #define BNODE_MASK_METADATA 0x2
 #define BNODE_MASK_SEQTREE 0x4
+// node->data is in the prefix compressed format (see PrefixStrKVOps)
+#define BNODE_MASK_PREFIX 0x8
 
 typedef uint16_t metasize_t;
 struct btree_meta{
@@ -68,6 +70,7 @@ struct btree_meta{
 typedef void* voidref;
 typedef struct bnode* bnoderef;
 typedef int btree_cmp_func(void *key1, void *key2, void *aux);
+typedef void btree_node_entry_func(void *key, void *value, void *ctx);
 
 /**
  * B+tree key-value operation wrapper class definition.
@@ -310,6 +313,20 @@ public:
      */
     btree_result getKeyRange(idx_t num, idx_t den, void *key_begin, void *key_end);
 
+    /**
+     * Read the node located at 'bid', and invoke 'func' for each key-value
+     * pair in the node, in key order. The key and value passed to 'func' are
+     * in the format of the B+tree's KV operations, and are valid only during
+     * the call. Values of a non-leaf node are the BIDs of its child nodes.
+     *
+     * @param bid BID of the node to be read.
+     * @param func Callback function invoked for each entry.
+     * @param ctx Context passed to 'func'.
+     * @return BTREE_RESULT_SUCCESS on success.
+     */
+    btree_result readNodeEntries(bid_t bid, btree_node_entry_func *func,
+                                 void *ctx);
+
     // Get the value for the given key.
     btree_result find(void *key, void *value_buf);
     // Insert the given key-value pair.
@@ -0,0 +1,605 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "btree_prefix_str_kv.h"
+
+#include "memleak.h"
+
+typedef uint16_t key_len_t;
+typedef uint8_t shared_len_t;
+
+#define PREFIX_KV_MAX_SHARED (0xff)
+#define PREFIX_KV_HEADER_SIZE (sizeof(key_len_t) * 2)
+
+/**
+ * === node->data structure overview (BNODE_MASK_PREFIX is set) ===
+ *
+ * [prefix len]: sizeof(key_len_t) bytes
+ * [restart interval]: sizeof(key_len_t) bytes
+ * [common prefix]: 'prefix len' bytes
+ * [offset of entry 1]: sizeof(key_len_t) bytes
+ * ...
+ * [offset of entry n]: ...
+ * [offset of entry n+1]: points to the byte offset right after the end of n-th entry
+ * [entry 1]
+ * ...
+ * [entry n]
+ *
+ * Each entry at a restart point (i.e., i % restart interval == 0) is
+ *   [key suffix][value]
+ * and the others are
+ *   [shared len (1 byte)][unshared part of key suffix][value]
+ * where 'key suffix' is the key excluding the common prefix, and 'shared len'
+ * is the number of leading bytes of the key suffix that are same as those of
+ * the previous entry's key suffix.
+ *
+ * Offsets are relative to the beginning of node->data, and all the key_len_t
+ * fields are not aligned.
+ *
+ * Nodes without BNODE_MASK_PREFIX have the same layout as FastStrKVOps.
+ */
+
+struct prefix_kv_entry {
+    uint8_t *key;
+    size_t keylen;
+    uint8_t *value;
+};
+
+INLINE key_len_t _read_len(void *ptr)
+{
+    key_len_t len;
+    memcpy(&len, ptr, sizeof(key_len_t));
+    return _endian_decode(len);
+}
+
+INLINE void _write_len(void *ptr, size_t len)
+{
+    key_len_t _len = _endian_encode((key_len_t)len);
+    memcpy(ptr, &_len, sizeof(key_len_t));
+}
+
+INLINE size_t _common_prefix(uint8_t *a, size_t alen, uint8_t *b, size_t blen)
+{
+    size_t i, len = MIN(alen, blen);
+    for (i = 0; i < len && a[i] == b[i]; ++i);
+    return i;
+}
+
+INLINE bool _is_restart(size_t idx, size_t restart_interval)
+{
+    return restart_interval <= 1 || (idx % restart_interval) == 0;
+}
+
+INLINE void _get_var_key_str(void *key, uint8_t **str, size_t *len)
+{
+    void *key_ptr;
+    memcpy(&key_ptr, key, sizeof(void *));
+    *len = _read_len(key_ptr);
+    *str = (uint8_t*)key_ptr + sizeof(key_len_t);
+}
+
+// position of the unshared part of the idx-th entry's key suffix in a prefix
+// compressed node, and the lengths of the shared and unshared parts.
+INLINE void _locate_entry(uint8_t *ptr, uint8_t *offset_arr, size_t idx,
+                          size_t interval, size_t vsize, size_t *offset,
+                          size_t *shared, size_t *unshared)
+{
+    size_t offset_next;
+    bool restart = _is_restart(idx, interval);
+
+    *offset = _read_len(offset_arr + sizeof(key_len_t) * idx);
+    offset_next = _read_len(offset_arr + sizeof(key_len_t) * (idx+1));
+    *shared = restart ? 0 : ptr[*offset];
+    if (!restart) {
+        *offset += sizeof(shared_len_t);
+    }
+    *unshared = offset_next - *offset - vsize;
+}
+
+// size of an encoded entry, whose predecessor is 'prev'.
+INLINE size_t _entry_size(struct prefix_kv_entry *entry,
+                          struct prefix_kv_entry *prev,
+                          size_t prefix_len, bool restart, size_t vsize)
+{
+    size_t suffix_len = entry->keylen - prefix_len;
+    if (restart) {
+        return suffix_len + vsize;
+    }
+    size_t shared = _common_prefix(entry->key + prefix_len, suffix_len,
+                                   prev->key + prefix_len,
+                                   prev->keylen - prefix_len);
+    shared = MIN(shared, PREFIX_KV_MAX_SHARED);
+    return sizeof(shared_len_t) + suffix_len - shared + vsize;
+}
+
+PrefixStrKVOps::PrefixStrKVOps() :
+    FastStrKVOps(), compression(false), restartInterval(0), scratch(NULL),
+    scratchSize(0) { }
+
+PrefixStrKVOps::PrefixStrKVOps(size_t _ksize, size_t _vsize) :
+    FastStrKVOps(_ksize, _vsize), compression(false), restartInterval(0),
+    scratch(NULL), scratchSize(0) { }
+
+PrefixStrKVOps::PrefixStrKVOps(size_t _ksize, size_t _vsize,
+                               btree_cmp_func _cmp_func) :
+    FastStrKVOps(_ksize, _vsize, _cmp_func), compression(false),
+    restartInterval(0), scratch(NULL), scratchSize(0) { }
+
+PrefixStrKVOps::~PrefixStrKVOps()
+{
+    free(scratch);
+}
+
+void *PrefixStrKVOps::getScratch(size_t size)
+{
+    if (size > scratchSize) {
+        free(scratch);
+        scratch = malloc(size);
+        scratchSize = size;
+    }
+    return scratch;
+}
+
+void PrefixStrKVOps::setPrefixCompression(bool enable, uint16_t restart_interval)
+{
+    compression = enable;
+    restartInterval = restart_interval;
+}
+
+bool PrefixStrKVOps::isLegacyWrite(struct bnode *node) const
+{
+    return !compression &&
+           (!(node->flag & BNODE_MASK_PREFIX) || node->nentry == 0);
+}
+
+struct prefix_kv_entry *PrefixStrKVOps::decodeNode(struct bnode *node,
+                                                   idx_t num)
+{
+    size_t i, total, keylen;
+    size_t entries_size = sizeof(struct prefix_kv_entry) * (num + 1);
+    uint8_t *ptr = (uint8_t*)node->data;
+    uint8_t *cur;
+    struct prefix_kv_entry *entries;
+
+    if (num == 0) {
+        return (struct prefix_kv_entry *)getScratch(entries_size);
+    }
+
+    if (!(node->flag & BNODE_MASK_PREFIX)) {
+        key_len_t *_offset_arr = (key_len_t*)ptr;
+
+        total = _endian_decode(_offset_arr[num]) -
+                _endian_decode(_offset_arr[0]);
+        entries = (struct prefix_kv_entry *)
+                  getScratch(entries_size + total);
+        cur = (uint8_t*)entries + entries_size;
+        memcpy(cur, ptr + _endian_decode(_offset_arr[0]), total);
+
+        for (i = 0; i < num; ++i) {
+            keylen = _endian_decode(_offset_arr[i+1]) -
+                     _endian_decode(_offset_arr[i]) - vsize;
+            entries[i].key = cur;
+            entries[i].keylen = keylen;
+            entries[i].value = cur + keylen;
+            cur += keylen + vsize;
+        }
+        return entries;
+    }
+
+    size_t prefix_len = _read_len(ptr);
+    size_t interval = _read_len(ptr + sizeof(key_len_t));
+    uint8_t *prefix = ptr + PREFIX_KV_HEADER_SIZE;
+    uint8_t *offset_arr = prefix + prefix_len;
+    size_t offset, shared, unshared;
+
+    // calculate the total length of the decoded keys first
+    total = 0;
+    for (i = 0; i < num; ++i) {
+        _locate_entry(ptr, offset_arr, i, interval, vsize,
+                      &offset, &shared, &unshared);
+        total += prefix_len + shared + unshared + vsize;
+    }
+
+    entries = (struct prefix_kv_entry *)getScratch(entries_size + total);
+    cur = (uint8_t*)entries + entries_size;
+
+    for (i = 0; i < num; ++i) {
+        _locate_entry(ptr, offset_arr, i, interval, vsize,
+                      &offset, &shared, &unshared);
+        entries[i].key = cur;
+        entries[i].keylen = prefix_len + shared + unshared;
+        memcpy(cur, prefix, prefix_len);
+        if (shared) {
+            // the previous entry's key also contains the prefix
+            memcpy(cur + prefix_len, entries[i-1].key + prefix_len, shared);
+        }
+        memcpy(cur + prefix_len + shared, ptr + offset, unshared);
+        cur += entries[i].keylen;
+        entries[i].value = cur;
+        memcpy(cur, ptr + offset + unshared, vsize);
+        cur += vsize;
+    }
+
+    return entries;
+}
+
+void PrefixStrKVOps::encodeNode(struct bnode *node,
+                                struct prefix_kv_entry *entries,
+                                size_t num)
+{
+    size_t i, offset;
+    uint8_t *ptr = (uint8_t*)node->data;
+
+    if (num == 0) {
+        node->flag &= ~BNODE_MASK_PREFIX;
+        return;
+    }
+
+    if (!compression) {
+        // the same layout as FastStrKVOps
+        key_len_t *_offset_arr = (key_len_t*)ptr;
+        offset = sizeof(key_len_t) * (num + 1);
+        for (i = 0; i < num; ++i) {
+            _offset_arr[i] = _endian_encode((key_len_t)offset);
+            memcpy(ptr + offset, entries[i].key, entries[i].keylen);
+            memcpy(ptr + offset + entries[i].keylen, entries[i].value, vsize);
+            offset += entries[i].keylen + vsize;
+        }
+        _offset_arr[num] = _endian_encode((key_len_t)offset);
+        node->flag &= ~BNODE_MASK_PREFIX;
+        return;
+    }
+
+    // the longest common prefix of all keys. Note that keys may not be in
+    // lexicographical order if a custom compare function is used.
+    size_t prefix_len = entries[0].keylen;
+    for (i = 1; i < num && prefix_len; ++i) {
+        prefix_len = _common_prefix(entries[0].key, prefix_len,
+                                    entries[i].key, entries[i].keylen);
+    }
+
+    _write_len(ptr, prefix_len);
+    _write_len(ptr + sizeof(key_len_t), restartInterval);
+    memcpy(ptr + PREFIX_KV_HEADER_SIZE, entries[0].key, prefix_len);
+
+    uint8_t *offset_arr = ptr + PREFIX_KV_HEADER_SIZE + prefix_len;
+    offset = PREFIX_KV_HEADER_SIZE + prefix_len + sizeof(key_len_t) * (num + 1);
+    for (i = 0; i < num; ++i) {
+        size_t suffix_len = entries[i].keylen - prefix_len;
+        size_t shared = 0;
+
+        _write_len(offset_arr + sizeof(key_len_t) * i, offset);
+        if (!_is_restart(i, restartInterval)) {
+            shared = _common_prefix(entries[i].key + prefix_len, suffix_len,
+                                    entries[i-1].key + prefix_len,
+                                    entries[i-1].keylen - prefix_len);
+            shared = MIN(shared, PREFIX_KV_MAX_SHARED);
+            ptr[offset] = (shared_len_t)shared;
+            offset += sizeof(shared_len_t);
+        }
+        memcpy(ptr + offset, entries[i].key + prefix_len + shared,
+               suffix_len - shared);
+        offset += suffix_len - shared;
+        memcpy(ptr + offset, entries[i].value, vsize);
+        offset += vsize;
+    }
+    _write_len(offset_arr + sizeof(key_len_t) * num, offset);
+    node->flag |= BNODE_MASK_PREFIX;
+}
+
+void PrefixStrKVOps::getKV(struct bnode *node, idx_t idx, void *key, void *value)
+{
+    if (!(node->flag & BNODE_MASK_PREFIX)) {
+        FastStrKVOps::getKV(node, idx, key, value);
+        return;
+    }
+
+    void *key_ptr;
+    uint8_t *ptr = (uint8_t*)node->data;
+    size_t prefix_len = _read_len(ptr);
+    size_t interval = _read_len(ptr + sizeof(key_len_t));
+    uint8_t *offset_arr = ptr + PREFIX_KV_HEADER_SIZE + prefix_len;
+    size_t offset, shared, unshared, keylen, need;
+    bool restart;
+
+    _locate_entry(ptr, offset_arr, idx, interval, vsize,
+                  &offset, &shared, &unshared);
+    keylen = prefix_len + shared + unshared;
+
+    // if KEY already points to previous key, then free it
+    memcpy(&key_ptr, key, ksize);
+    if (key_ptr) {
+        free(key_ptr);
+    }
+
+    key_ptr = (void*)malloc(sizeof(key_len_t) + keylen);
+    uint8_t *str = (uint8_t*)key_ptr + sizeof(key_len_t);
+    _write_len(key_ptr, keylen);
+    memcpy(str, ptr + PREFIX_KV_HEADER_SIZE, prefix_len);
+    memcpy(str + prefix_len + shared, ptr + offset, unshared);
+    if (value) {
+        memcpy(value, ptr + offset + unshared, vsize);
+    }
+
+    // fill the shared part by walking backward until the restart point.
+    // Each previous entry provides the bytes from its own shared length
+    // up to the bytes still needed.
+    need = shared;
+    for (size_t i = idx; need > 0 && i > 0; --i) {
+        size_t prev_offset, prev_shared;
+        prev_offset = _read_len(offset_arr + sizeof(key_len_t) * (i-1));
+        restart = _is_restart(i-1, interval);
+        prev_shared = restart ? 0 : ptr[prev_offset];
+        if (!restart) {
+            prev_offset += sizeof(shared_len_t);
+        }
+        if (need > prev_shared) {
+            memcpy(str + prefix_len + prev_shared, ptr + prev_offset,
+                   need - prev_shared);
+            need = prev_shared;
+        }
+    }
+
+    memcpy(key, &key_ptr, ksize);
+}
+
+bool PrefixStrKVOps::isSameKey(struct bnode *node, idx_t idx,
+                               uint8_t *str, size_t len)
+{
+    uint8_t *ptr = (uint8_t*)node->data;
+    size_t prefix_len = _read_len(ptr);
+    size_t interval = _read_len(ptr + sizeof(key_len_t));
+    uint8_t *offset_arr = ptr + PREFIX_KV_HEADER_SIZE + prefix_len;
+    size_t offset, shared, unshared, need;
+
+    _locate_entry(ptr, offset_arr, idx, interval, vsize,
+                  &offset, &shared, &unshared);
+    if (len != prefix_len + shared + unshared ||
+        memcmp(str, ptr + PREFIX_KV_HEADER_SIZE, prefix_len) ||
+        memcmp(str + prefix_len + shared, ptr + offset, unshared)) {
+        return false;
+    }
+
+    // compare the shared part in the same way as getKV() rebuilds it
+    need = shared;
+    for (size_t i = idx; need > 0 && i > 0; --i) {
+        size_t prev_offset, prev_shared, prev_unshared;
+        _locate_entry(ptr, offset_arr, i-1, interval, vsize,
+                      &prev_offset, &prev_shared, &prev_unshared);
+        if (need > prev_shared) {
+            if (memcmp(str + prefix_len + prev_shared, ptr + prev_offset,
+                       need - prev_shared)) {
+                return false;
+            }
+            need = prev_shared;
+        }
+    }
+    return true;
+}
+
+void PrefixStrKVOps::setKV(struct bnode *node, idx_t idx, void *key, void *value)
+{
+    if (isLegacyWrite(node)) {
+        node->flag &= ~BNODE_MASK_PREFIX;
+        FastStrKVOps::setKV(node, idx, key, value);
+        return;
+    }
+
+    uint8_t *keystr;
+    size_t keylen, num = node->nentry;
+
+    _get_var_key_str(key, &keystr, &keylen);
+    if (compression && (node->flag & BNODE_MASK_PREFIX) && idx < num &&
+        isSameKey(node, idx, keystr, keylen)) {
+        // only the value is updated (e.g., a child node is moved), which
+        // does not change the encoding of the keys
+        uint8_t *ptr = (uint8_t*)node->data;
+        uint8_t *offset_arr = ptr + PREFIX_KV_HEADER_SIZE + _read_len(ptr);
+        size_t offset_next = _read_len(offset_arr +
+                                       sizeof(key_len_t) * (idx+1));
+        memcpy(ptr + offset_next - vsize, value, vsize);
+        return;
+    }
+
+    struct prefix_kv_entry *entries = decodeNode(node, num);
+    entries[idx].key = keystr;
+    entries[idx].keylen = keylen;
+    entries[idx].value = (uint8_t*)value;
+    if (idx >= num) {
+        num = idx + 1;
+    }
+
+    encodeNode(node, entries, num);
+}
+
+void PrefixStrKVOps::insKV(struct bnode *node, idx_t idx, void *key, void *value)
+{
+    if (isLegacyWrite(node)) {
+        FastStrKVOps::insKV(node, idx, key, value);
+        return;
+    }
+
+    size_t num = node->nentry;
+    struct prefix_kv_entry *entries = decodeNode(node, num);
+
+    if (key && value) {
+        // insert
+        memmove(entries + idx + 1, entries + idx,
+                sizeof(struct prefix_kv_entry) * (num - idx));
+        _get_var_key_str(key, &entries[idx].key, &entries[idx].keylen);
+        entries[idx].value = (uint8_t*)value;
+        num++;
+    } else {
+        // remove
+        memmove(entries + idx, entries + idx + 1,
+                sizeof(struct prefix_kv_entry) * (num - idx - 1));
+        num--;
+    }
+
+    encodeNode(node, entries, num);
+}
+
+void PrefixStrKVOps::copyKV(struct bnode *node_dst,
+                            struct bnode *node_src,
+                            idx_t dst_idx,
+                            idx_t src_idx,
+                            idx_t len)
+{
+    // not support when dst_idx != 0
+    assert(dst_idx == 0);
+
+    if (!compression && !(node_src->flag & BNODE_MASK_PREFIX)) {
+        FastStrKVOps::copyKV(node_dst, node_src, dst_idx, src_idx, len);
+        node_dst->flag &= ~BNODE_MASK_PREFIX;
+        return;
+    }
+
+    struct prefix_kv_entry *entries;
+
+    // delta-encoded keys can be decoded only from the beginning of the node
+    entries = decodeNode(node_src, src_idx + len);
+    encodeNode(node_dst, entries + src_idx, len);
+}
+
+size_t PrefixStrKVOps::getDataSize(struct bnode *node,
+                                   void *new_minkey,
+                                   void *key_arr,
+                                   void *value_arr,
+                                   size_t len)
+{
+    bool insertion = (key_arr && value_arr && len > 0);
+
+    if (isLegacyWrite(node)) {
+        return FastStrKVOps::getDataSize(node, new_minkey, key_arr,
+                                         value_arr, len);
+    }
+
+    if (!new_minkey && !insertion) {
+        // the current size of the node
+        if (!node->nentry) {
+            return 0;
+        }
+        if (!(node->flag & BNODE_MASK_PREFIX)) {
+            return FastStrKVOps::getDataSize(node, NULL, NULL, NULL, 0);
+        }
+        uint8_t *ptr = (uint8_t*)node->data;
+        size_t prefix_len = _read_len(ptr);
+        return _read_len(ptr + PREFIX_KV_HEADER_SIZE + prefix_len +
+                         sizeof(key_len_t) * node->nentry);
+    }
+
+    size_t i, size, keylen, num = node->nentry;
+    size_t begin = (new_minkey && num) ? 1 : 0;
+    uint8_t *keystr;
+    struct prefix_kv_entry *entries = decodeNode(node, num);
+
+    if (!compression) {
+        // will be written in the same layout as FastStrKVOps
+        size = sizeof(key_len_t);
+        for (i = begin; i < num; ++i) {
+            size += sizeof(key_len_t) + entries[i].keylen + vsize;
+        }
+        if (new_minkey && num) {
+            _get_var_key_str(new_minkey, &keystr, &keylen);
+            size += sizeof(key_len_t) + keylen + vsize;
+        }
+        for (i = 0; insertion && i < len; ++i) {
+            _get_var_key_str((uint8_t*)key_arr + ksize * i, &keystr, &keylen);
+            size += sizeof(key_len_t) + keylen + vsize;
+        }
+        return size;
+    }
+
+    // The exact size cannot be calculated without knowing the positions of
+    // the new keys, which are decided by the (custom) compare function.
+    // Return the upper bound instead: the existing entries re-encoded with
+    // the new common prefix, plus the new keys without any delta encoding,
+    // plus the bytes that can be lost by the delta encoding of the existing
+    // keys when they are shifted or get a new predecessor.
+    uint8_t *prefix = NULL;
+    size_t prefix_len = 0;
+    size_t num_new = 0;
+    size_t new_keys_len = 0;
+
+    if (begin < num) {
+        prefix = entries[begin].key;
+        prefix_len = entries[begin].keylen;
+        for (i = begin + 1; i < num; ++i) {
+            prefix_len = _common_prefix(prefix, prefix_len,
+                                        entries[i].key, entries[i].keylen);
+        }
+    }
+    for (i = 0; i < len + 1; ++i) {
+        void *cur_key;
+        if (i < len) {
+            if (!insertion) {
+                continue;
+            }
+            cur_key = (uint8_t*)key_arr + ksize * i;
+        } else {
+            if (!new_minkey) {
+                continue;
+            }
+            cur_key = new_minkey;
+        }
+        _get_var_key_str(cur_key, &keystr, &keylen);
+        if (!prefix) {
+            prefix = keystr;
+            prefix_len = keylen;
+        } else {
+            prefix_len = _common_prefix(prefix, prefix_len, keystr, keylen);
+        }
+        new_keys_len += keylen;
+        num_new++;
+    }
+
+    size_t max_shared = 0;
+    size_t num_survivors = num - begin;
+    size = PREFIX_KV_HEADER_SIZE + prefix_len +
+           sizeof(key_len_t) * (num_survivors + num_new + 1);
+    for (i = begin; i < num; ++i) {
+        bool restart = _is_restart(i - begin, restartInterval);
+        size_t entry_size = _entry_size(&entries[i],
+                                        (restart) ? NULL : &entries[i-1],
+                                        prefix_len, restart, vsize);
+        if (!restart) {
+            size_t shared = sizeof(shared_len_t) + vsize +
+                            entries[i].keylen - prefix_len - entry_size;
+            max_shared = MAX(max_shared, shared);
+        }
+        size += entry_size;
+    }
+    size += new_keys_len - prefix_len * num_new +
+            (sizeof(shared_len_t) + vsize) * num_new;
+
+    if (restartInterval > 1) {
+        size_t num_total = num_survivors + num_new;
+        // each new key may break the delta encoding of its successor
+        size += max_shared * num_new;
+        // shifted entries may become restart points
+        size += max_shared * (num_total / restartInterval + 1);
+        // former restart points may get a shared length field
+        size += sizeof(shared_len_t) * (num_survivors / restartInterval + 1);
+    }
+
+    return size;
+}
@@ -0,0 +1,125 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "common.h"
+
+#include "btree.h"
+#include "btree_fast_str_kv.h"
+
+struct prefix_kv_entry;
+
+/**
+ * B+tree key-value operation class for variable-length string keys, which
+ * stores the longest common prefix of all keys in a node only once, and
+ * optionally delta-encodes each key against its predecessor. Every
+ * 'restart interval'-th key is stored without delta encoding, so that any key
+ * can be rebuilt from the nearest preceding restart point and the binary
+ * search over the node is still possible.
+ *
+ * Keys and values are represented in the same way as FastStrKVOps, and the
+ * nodes written by FastStrKVOps (i.e., nodes without BNODE_MASK_PREFIX flag)
+ * can be read and modified as well. Whether a modified node is written in the
+ * prefix compressed format or in the FastStrKVOps format is decided by
+ * setPrefixCompression(), so that a file can be opened regardless of the
+ * format that its nodes were written in.
+ */
+class PrefixStrKVOps : public FastStrKVOps {
+public:
+    PrefixStrKVOps();
+    PrefixStrKVOps(size_t _ksize, size_t _vsize);
+    PrefixStrKVOps(size_t _ksize, size_t _vsize, btree_cmp_func _cmp_func);
+
+    virtual ~PrefixStrKVOps();
+
+    /**
+     * Enable or disable the prefix compression for the nodes modified
+     * afterwards.
+     *
+     * @param enable Flag to enable the prefix compression.
+     * @param restart_interval Number of keys between two consecutive restart
+     *        points. Delta encoding is disabled if it is 0 or 1.
+     */
+    void setPrefixCompression(bool enable, uint16_t restart_interval);
+
+    bool isPrefixCompressionEnabled() const {
+        return compression;
+    }
+
+    uint16_t getRestartInterval() const {
+        return restartInterval;
+    }
+
+    void getKV(struct bnode *node, idx_t idx, void *key, void *value);
+    void setKV(struct bnode *node, idx_t idx, void *key, void *value);
+    void insKV(struct bnode *node, idx_t idx, void *key, void *value);
+    void copyKV(struct bnode *node_dst,
+                struct bnode *node_src,
+                idx_t dst_idx,
+                idx_t src_idx,
+                idx_t len);
+    size_t getDataSize(struct bnode *node,
+                       void *new_minkey,
+                       void *key_arr,
+                       void *value_arr,
+                       size_t len);
+
+private:
+    /**
+     * Check if the node can be modified by FastStrKVOps as it is.
+     */
+    bool isLegacyWrite(struct bnode *node) const;
+
+    /**
+     * Check if the key of the idx-th entry of a prefix compressed node is
+     * the same as the given key string, without decoding the node.
+     */
+    bool isSameKey(struct bnode *node, idx_t idx, uint8_t *str, size_t len);
+
+    /**
+     * Return the scratch buffer of at least 'size' bytes, which is reused by
+     * the subsequent calls.
+     */
+    void *getScratch(size_t size);
+
+    /**
+     * Decode the first 'num' entries of the node into 'entries'. The key
+     * strings and values are copied into the scratch buffer, which is
+     * overwritten by the next call.
+     *
+     * @return Pointer to the array of decoded entries, which has room for
+     *         one more entry.
+     */
+    struct prefix_kv_entry *decodeNode(struct bnode *node, idx_t num);
+
+    /**
+     * Write the entries into the node, in the format selected by
+     * setPrefixCompression().
+     */
+    void encodeNode(struct bnode *node,
+                    struct prefix_kv_entry *entries,
+                    size_t num);
+
+    bool compression;
+    uint16_t restartInterval;
+    // Buffer for the decoded entries of a node being modified. Nodes are
+    // modified only by the writer of the B+tree that owns this instance.
+    void *scratch;
+    size_t scratchSize;
+};
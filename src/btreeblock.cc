@@ -283,7 +283,7 @@ void * BTreeBlkHandle::_alloc(bid_t& bid, int sb_no)
     }
     block->sb_no = sb_no;
     block->pos = nodesize;
-    block->bid = file->alloc_FileMgr(log_callback);
+    block->bid = file->allocIndex_FileMgr(log_callback);
     block->dirty = 1;
     block->age = 0;
 
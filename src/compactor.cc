@@ -212,9 +212,9 @@ bool FileCompactionEntry::isCompactionThresholdSatisfied() {
     uint64_t active_data;
     int threshold;
 
-    if (compactionFlag || file->isRollbackOn()) {
-        // do not perform compaction if the file is already being compacted or
-        // in rollback.
+    if (compactionFlag || file->isRollbackOn() || file->hasCheckpoints()) {
+        // do not perform compaction if the file is already being compacted,
+        // in rollback, or has checkpoints that compaction would discard.
         return false;
     }
 
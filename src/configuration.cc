@@ -107,6 +107,18 @@ fdb_config get_default_config(void) {
 
     fconfig.custom_file_ops = NULL;
 
+    // Key prefix compression is disabled by default.
+    fconfig.key_prefix_compression = false;
+    fconfig.key_prefix_restart_interval = DEFAULT_KEY_PREFIX_RESTART_INTERVAL;
+    fconfig.adaptive_chunksize = false;
+    fconfig.iterator_readahead = false;
+    fconfig.txn_buffer_size = 0;
+    fconfig.index_block_extent = 0;
+    fconfig.warmup_cache_onopen = false;
+    fconfig.compressed_cache_size = 0;
+    fconfig.secondary_cache_path = NULL;
+    fconfig.secondary_cache_size = 0;
+
     return fconfig;
 }
 
@@ -180,6 +192,15 @@ bool validate_fdb_config(fdb_config *fconfig) {
         return false;
     }
 
+    if ((fconfig->flags & FDB_OPEN_FLAG_MMAP) &&
+        !(fconfig->flags & FDB_OPEN_FLAG_RDONLY)) {
+        fdb_log(NULL, FDB_RESULT_INVALID_ARGS,
+                "Config Error: Open flags (%x) : FDB_OPEN_FLAG_MMAP (%x) "
+                "requires FDB_OPEN_FLAG_RDONLY (%x)\n",
+                fconfig->flags, FDB_OPEN_FLAG_MMAP, FDB_OPEN_FLAG_RDONLY);
+        return false;
+    }
+
     if (fconfig->compaction_threshold > 100) {
         // Compaction threshold should be equal or less then 100 (%).
         fdb_log(NULL, FDB_RESULT_INVALID_ARGS,
@@ -238,6 +259,14 @@ bool validate_fdb_config(fdb_config *fconfig) {
                 (uint64_t)fconfig->num_bgflusher_threads, MAX_NUM_BGFLUSHER_THREADS);
         return false;
     }
+    if (fconfig->key_prefix_restart_interval > MAX_KEY_PREFIX_RESTART_INTERVAL) {
+        fdb_log(NULL, FDB_RESULT_INVALID_ARGS,
+                "Config Error: Key prefix restart interval (%u) greater than "
+                "allowed value (%d)!\n",
+                fconfig->key_prefix_restart_interval,
+                MAX_KEY_PREFIX_RESTART_INTERVAL);
+        return false;
+    }
     if (fconfig->num_keeping_headers == 0) {
         // num_keeping_headers should be greater than zero
         return false;
@@ -264,10 +264,19 @@ bid_t DocioHandle::appendDocRaw_Docio(uint64_t size, void *buf)
             }
 
             block_list_size = nblock + ((new_block)?1:0);
-            for (i=0; i<block_list_size; ++i) {
-                bmp_revnum_list[i] = file_Docio->getSbBmpRevnum() &
-                                     BMP_REVNUM_MASK;
-                block_list[i] = file_Docio->alloc_FileMgr(log_callback);
+            i = 0;
+            while (i < block_list_size) {
+                // request the remaining blocks as a single extent, so that
+                // the document is written into consecutive blocks if possible.
+                uint64_t j, count;
+                uint16_t bmp_revnum_hash = file_Docio->getSbBmpRevnum() &
+                                           BMP_REVNUM_MASK;
+                begin = file_Docio->allocExtent_FileMgr(block_list_size - i,
+                                                        &count, log_callback);
+                for (j=0; j<count; ++j) {
+                    bmp_revnum_list[i+j] = bmp_revnum_hash;
+                    block_list[i+j] = begin + j;
+                }
 
                 if (i == 0 && curblock != BLK_NOT_FOUND &&
                     block_list[i] > curblock+1) {
@@ -282,6 +291,7 @@ bid_t DocioHandle::appendDocRaw_Docio(uint64_t size, void *buf)
                         block_list_size++;
                     }
                 }
+                i += count;
             }
 
             if (offset > 0 && !start_from_new_block) {
@@ -887,11 +897,17 @@ int64_t DocioHandle::_readDocComponent_Docio(uint64_t offset,
         restsize = blocksize - pos;
 
         if (restsize >= rest_len) {
-            memcpy((uint8_t *)buf_out + (len - rest_len), (uint8_t *)buf + pos, rest_len);
+            if (buf_out) {
+                memcpy((uint8_t *)buf_out + (len - rest_len),
+                       (uint8_t *)buf + pos, rest_len);
+            }
             pos += rest_len;
             rest_len = 0;
         }else{
-            memcpy((uint8_t *)buf_out + (len - rest_len), (uint8_t *)buf + pos, restsize);
+            if (buf_out) {
+                memcpy((uint8_t *)buf_out + (len - rest_len),
+                       (uint8_t *)buf + pos, restsize);
+            }
 
             if (non_consecutive) {
                 memcpy(&blk_meta, (uint8_t*)buf + blocksize, sizeof(blk_meta));
@@ -1079,6 +1095,64 @@ fdb_status DocioHandle::readDocKey_Docio(uint64_t offset,
     return FDB_RESULT_SUCCESS;
 }
 
+fdb_status DocioHandle::readCachedDocKey_Docio(uint64_t offset,
+                                               keylen_t *keylen,
+                                               void *keybuf,
+                                               bid_t *last_bid)
+{
+    size_t blocksize = file_Docio->getBlockSize();
+    size_t real_blocksize = blocksize;
+    bool non_consecutive = ver_non_consecutive_doc(file_Docio->getVersion());
+#ifdef __CRC32
+    if (non_consecutive) {
+        blocksize -= DOCBLK_META_SIZE;
+    } else {
+        blocksize -= BLK_MARKER_SIZE;
+    }
+#endif
+
+    bid_t bid = offset / real_blocksize;
+    uint32_t pos = offset % real_blocksize;
+    if (pos + sizeof(struct docio_length) > blocksize) {
+        return FDB_RESULT_READ_FAIL;
+    }
+
+    BlockCacheItem *item;
+    uint8_t *addr = static_cast<uint8_t *>(
+        file_Docio->pinCachedBlock(bid, &item));
+    if (!addr) {
+        return FDB_RESULT_READ_FAIL;
+    }
+
+    uint8_t marker = *(addr + real_blocksize - BLK_MARKER_SIZE);
+    if (non_consecutive) {
+        struct docblk_meta blk_meta;
+        memcpy(&blk_meta, addr + real_blocksize - DOCBLK_META_SIZE,
+               sizeof(blk_meta));
+        marker = blk_meta.marker;
+    }
+
+    struct docio_length length, _length;
+    memcpy(&_length, addr + pos, sizeof(_length));
+    length = _decodeLength_Docio(_length);
+    // keys spanning two blocks are not read, as the second block may not be
+    // cached
+    if (marker != BLK_MARKER_DOC ||
+        _docio_length_checksum(_length) != _length.checksum ||
+        length.keylen == 0 || length.keylen > FDB_MAX_KEYLEN_INTERNAL ||
+        pos + sizeof(struct docio_length) + length.keylen > blocksize) {
+        file_Docio->unpinBlock(item);
+        return FDB_RESULT_READ_FAIL;
+    }
+
+    memcpy(keybuf, addr + pos + sizeof(struct docio_length), length.keylen);
+    file_Docio->unpinBlock(item);
+
+    *keylen = length.keylen;
+    *last_bid = bid + (pos + _fdb_get_docsize(length) - 1) / blocksize;
+    return FDB_RESULT_SUCCESS;
+}
+
 void free_docio_object(struct docio_object *doc, bool key_alloc,
                        bool meta_alloc, bool body_alloc) {
     if (!doc) {
@@ -1445,6 +1519,168 @@ int64_t DocioHandle::readDoc_Docio(uint64_t offset,
     return _offset;
 }
 
+int64_t DocioHandle::readDocBodyRange_Docio(uint64_t offset,
+                                            struct docio_object *doc,
+                                            uint64_t body_offset,
+                                            uint64_t body_len,
+                                            bool read_on_cache_miss)
+{
+    bool key_alloc = (doc->key == NULL);
+    bool meta_alloc = (doc->meta == NULL);
+    bool body_alloc = false;
+    uint32_t start, len;
+    int64_t _offset;
+
+    _offset = readDocKeyMeta_Docio(offset, doc, read_on_cache_miss);
+    if (_offset <= 0) {
+        return _offset;
+    }
+
+    // clamp the range before narrowing it to the width of the body length
+    start = (body_offset < doc->length.bodylen) ? (uint32_t)body_offset
+                                                : doc->length.bodylen;
+    len = doc->length.bodylen - start;
+    if (body_len < len) {
+        len = (uint32_t)body_len;
+    }
+    if (doc->body == NULL && len) {
+        doc->body = (void *)malloc(len);
+        body_alloc = true;
+    }
+
+    if (doc->length.flag & DOCIO_COMPRESSED) {
+        // the whole body should be decompressed
+        struct docio_object full;
+        memset(&full, 0x0, sizeof(full));
+        _offset = readDoc_Docio(offset, &full, read_on_cache_miss);
+        if (_offset > 0 && len) {
+            memcpy(doc->body, (uint8_t *)full.body + start, len);
+        }
+        free_docio_object(&full, true, true, true);
+    } else {
+        // skip the body before the range
+        _offset = _readDocComponent_Docio(_offset, start, NULL);
+        if (_offset >= 0) {
+            _offset = _readDocComponent_Docio(_offset, len, doc->body);
+        }
+    }
+
+    if (_offset <= 0) {
+        fdb_log(log_callback, (fdb_status) _offset,
+                "Error in reading a part of the doc body with offset %" _F64
+                " from a database file '%s'", offset,
+                file_Docio->getFileName());
+        free_docio_object(doc, key_alloc, meta_alloc, body_alloc);
+        return _offset;
+    }
+
+    doc->length.bodylen = len;
+    return _offset;
+}
+
+fdb_status DocioHandle::pinDoc_Docio(uint64_t offset,
+                                     struct docio_object *doc,
+                                     BlockCacheItem **item)
+{
+    size_t blocksize = file_Docio->getBlockSize();
+    size_t real_blocksize = blocksize;
+    bool non_consecutive = ver_non_consecutive_doc(file_Docio->getVersion());
+#ifdef __CRC32
+    if (non_consecutive) {
+        blocksize -= DOCBLK_META_SIZE;
+    } else {
+        blocksize -= BLK_MARKER_SIZE;
+    }
+#endif
+
+    bid_t bid = offset / real_blocksize;
+    uint32_t pos = offset % real_blocksize;
+    if (pos + sizeof(struct docio_length) > blocksize) {
+        return FDB_RESULT_READ_FAIL;
+    }
+
+    uint8_t *addr = static_cast<uint8_t *>(
+        file_Docio->pinBlock(bid, item, log_callback));
+    if (!addr) {
+        return FDB_RESULT_READ_FAIL;
+    }
+
+    uint8_t marker = *(addr + real_blocksize - BLK_MARKER_SIZE);
+    if (non_consecutive) {
+        struct docblk_meta blk_meta;
+        memcpy(&blk_meta, addr + real_blocksize - DOCBLK_META_SIZE,
+               sizeof(blk_meta));
+        marker = blk_meta.marker;
+    }
+    if (marker != BLK_MARKER_DOC) {
+        file_Docio->unpinBlock(*item);
+        return FDB_RESULT_READ_FAIL;
+    }
+
+    struct docio_length _length;
+    uint8_t *ptr = addr + pos;
+    memcpy(&_length, ptr, sizeof(_length));
+    if (_docio_length_checksum(_length) != _length.checksum) {
+        file_Docio->unpinBlock(*item);
+        return FDB_RESULT_READ_FAIL;
+    }
+
+    doc->length = _decodeLength_Docio(_length);
+    // Commit marks, compressed bodies, and corrupted lengths are handled by
+    // the regular read path.
+    if ((doc->length.flag & (DOCIO_TXN_COMMITTED | DOCIO_COMPRESSED)) ||
+        doc->length.keylen == 0 ||
+        doc->length.keylen > FDB_MAX_KEYLEN_INTERNAL ||
+        pos + _fdb_get_docsize(doc->length) > blocksize) {
+        file_Docio->unpinBlock(*item);
+        return FDB_RESULT_READ_FAIL;
+    }
+
+    timestamp_t _timestamp;
+    fdb_seqnum_t _seqnum;
+
+    ptr += sizeof(struct docio_length);
+    doc->key = ptr;
+    ptr += doc->length.keylen;
+    memcpy(&_timestamp, ptr, sizeof(timestamp_t));
+    doc->timestamp = _endian_decode(_timestamp);
+    ptr += sizeof(timestamp_t);
+    memcpy(&_seqnum, ptr, sizeof(fdb_seqnum_t));
+    doc->seqnum = _endian_decode(_seqnum);
+    ptr += sizeof(fdb_seqnum_t);
+    doc->meta = doc->length.metalen ? ptr : NULL;
+    ptr += doc->length.metalen;
+    doc->body = doc->length.bodylen ? ptr : NULL;
+    ptr += doc->length.bodylen;
+
+#ifdef __CRC32
+    // all the components are contiguous in the block,
+    // so that the checksum can be computed at once.
+    uint32_t crc_file, crc;
+    memcpy(&crc_file, ptr, sizeof(crc_file));
+    crc = get_checksum(addr + pos, ptr - (addr + pos),
+                       file_Docio->getCrcMode());
+    if (crc != crc_file) {
+        fdb_log(log_callback, FDB_RESULT_CHECKSUM_ERROR,
+                "doc_body checksum mismatch error in a database file '%s'"
+                " crc %x != %x (crc in doc) keylen %d metalen %d bodylen %d "
+                "offset %" _F64, file_Docio->getFileName(),
+                crc, crc_file, doc->length.keylen, doc->length.metalen,
+                doc->length.bodylen, offset);
+        file_Docio->unpinBlock(*item);
+        doc->key = doc->meta = doc->body = NULL;
+        return FDB_RESULT_CHECKSUM_ERROR;
+    }
+#endif
+
+    return FDB_RESULT_SUCCESS;
+}
+
+void DocioHandle::unpinDoc_Docio(BlockCacheItem *item)
+{
+    FileMgr::unpinBlock(item);
+}
+
 int DocioHandle::_submitAsyncIORequests_Docio(struct docio_object *doc_array,
                                      size_t doc_idx,
                                      struct async_io_handle *aio_handle,
@@ -21,6 +21,8 @@
 #include "filemgr.h"
 #include "common.h"
 
+class BlockCacheItem;
+
 typedef uint16_t keylen_t;
 typedef uint32_t timestamp_t;
 
@@ -85,6 +87,23 @@ public:
                                 keylen_t *keylen,
                                 void *keybuf);
 
+    /**
+     * Read a key at a given file offset only from the block cache, and get
+     * the last block of the KV item, assuming that the item is stored in
+     * consecutive blocks. No disk read is performed.
+     *
+     * @param offset File offset to a KV item
+     * @param keylen Pointer to a key length variable
+     * @param keybuf Pointer to a key buffer
+     * @param last_bid Pointer to the ID of the last block of the KV item
+     * @return FDB_RESULT_SUCCESS on success, or an error code if the blocks
+     *         holding the key are not cached.
+     */
+    fdb_status readCachedDocKey_Docio(uint64_t offset,
+                                      keylen_t *keylen,
+                                      void *keybuf,
+                                      bid_t *last_bid);
+
     /**
      * Read a key and its metadata at a given file offset.
      *
@@ -113,6 +132,55 @@ public:
                           struct docio_object *doc,
                           bool read_on_cache_miss);
 
+    /**
+     * Read a key, its metadata, and the part of its value at a given file
+     * offset. Only 'body_len' bytes of the value starting from 'body_offset'
+     * are read, except for a compressed value that has to be entirely read
+     * and decompressed. The checksum of the KV item is not verified.
+     *
+     * @param offset File offset to a KV item
+     * @param doc Pointer to docio_object instance. doc->length.bodylen is set
+     *        to the number of value bytes read.
+     * @param body_offset Offset of the part in the value, clamped to the
+     *        length of the value
+     * @param body_len Length of the part, clamped to the rest of the value
+     * @param read_on_cache_miss Flag indicating if a disk read should be performed
+     *        on cache miss
+     * @return next offset right after the part of the value on successful
+     *         read, otherwise, the corresponding error code is returned.
+     */
+    int64_t readDocBodyRange_Docio(uint64_t offset,
+                                   struct docio_object *doc,
+                                   uint64_t body_offset,
+                                   uint64_t body_len,
+                                   bool read_on_cache_miss);
+
+    /**
+     * Read a KV item at a given file offset without copying it, by pinning
+     * its document block in the block cache. This succeeds only if the whole
+     * item is uncompressed and resides in a single committed block.
+     * On success, the key, meta, and body pointers of 'doc' refer to the
+     * pinned block memory, which remains valid until unpinDoc_Docio() is
+     * called with the returned cache item.
+     *
+     * @param offset File offset to a KV item
+     * @param doc Pointer to docio_object instance to be populated
+     * @param item Pointer to the place where the pinned cache item is returned
+     * @return FDB_RESULT_SUCCESS if the item is pinned, FDB_RESULT_READ_FAIL
+     *         if it cannot be accessed in place (the caller should then read
+     *         it through readDoc_Docio()), or FDB_RESULT_CHECKSUM_ERROR.
+     */
+    fdb_status pinDoc_Docio(uint64_t offset,
+                            struct docio_object *doc,
+                            BlockCacheItem **item);
+
+    /**
+     * Release a KV item pinned by pinDoc_Docio().
+     *
+     * @param item Pointer to the cache item returned by pinDoc_Docio()
+     */
+    static void unpinDoc_Docio(BlockCacheItem *item);
+
     /**
      * Read a batch of docs using async reads if possible
      *
@@ -231,6 +231,10 @@ const char* fdb_error_msg(fdb_status err_code)
             return "Resource temporarily unavailable";
         case FDB_RESULT_CANCELLED:
             return "Execution cancelled";
+        case FDB_RESULT_TRANSACTION_CONFLICT:
+            return "Transaction aborted due to a conflicting commit";
+        case FDB_RESULT_CHECKPOINT_EXISTS:
+            return "File has named checkpoints that are not released";
 
         default:
             return "unknown error";
@@ -99,6 +99,19 @@ fdb_status fdb_compact_file(fdb_file_handle *fhandle,
                             const fdb_encryption_key *new_encryption_key);
 
 fdb_status _fdb_abort_transaction(FdbKvsHandle *handle);
+struct txn_key_version *fdb_txn_find_key(fdb_txn *txn,
+                                         void *key, size_t keylen,
+                                         fdb_custom_cmp_variable custom_cmp);
+void fdb_txn_add_key(fdb_txn *txn, void *key, size_t keylen,
+                     fdb_seqnum_t seqnum, fdb_custom_cmp_variable custom_cmp);
+fdb_status _fdb_validate_transaction(FdbKvsHandle *handle, fdb_txn *txn);
+struct txn_buffered_doc *fdb_txn_buffer_find(fdb_txn *txn,
+                                             void *key, size_t keylen,
+                                             fdb_custom_cmp_variable custom_cmp);
+void fdb_txn_buffer_add(fdb_txn *txn, struct docio_object *doc, bool deleted,
+                        fdb_custom_cmp_variable custom_cmp);
+void fdb_txn_buffer_remove(fdb_txn *txn, struct txn_buffered_doc *bdoc);
+fdb_status _fdb_flush_txn_buffer(FdbKvsHandle *handle, fdb_txn *txn);
 
 typedef enum {
     FDB_RESTORE_NORMAL,
@@ -23,6 +23,7 @@
 #include "filemgr.h"
 #include "file_handle.h"
 #include "kvs_handle.h"
+#include "wal.h"
 
 
 FdbFileHandle::FdbFileHandle() :
@@ -267,6 +268,15 @@ stale_header_info FdbFileHandle::getOldestActiveHeader() {
     while (e) {
         item = _get_entry(e, struct kvs_opened_node, le);
         e = list_next(e);
+        if (item->handle->checkpoint_snapshot &&
+            item->handle->file->isCheckpointRevnum(
+                                    item->handle->cur_header_revnum)) {
+            // blocks reachable from a header pinned by a checkpoint are
+            // protected by the checkpoint itself. Other snapshots on the
+            // same header, and checkpoint snapshots left open after the
+            // checkpoint is released, still count.
+            continue;
+        }
         if (item->handle->cur_header_revnum < oldest_header.revnum) {
             oldest_header.revnum = item->handle->cur_header_revnum;
             oldest_header.bid = item->handle->last_hdr_bid;
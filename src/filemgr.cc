@@ -25,13 +25,17 @@
 #include <sys/time.h>
 #endif
 
+#include <algorithm>
 #include <sstream>
+#include <vector>
 
 #include "filemgr.h"
 #include "filemgr_ops.h"
 #include "hash_functions.h"
 #include "blockcache.h"
+#include "secondary_cache.h"
 #include "wal.h"
+#include "arena.h"
 #include "list.h"
 #include "fdb_internal.h"
 #include "time_utils.h"
@@ -71,11 +75,39 @@ std::atomic<FileMgrMap *> FileMgrMap::instance(nullptr);
 
 static const int MAX_STAT_UPDATE_RETRIES = 5;
 
+// Direct I/O requires the buffer address to be aligned to the sector size.
+static inline bool _is_sector_aligned(const void *buf) {
+    return ((uintptr_t)buf % FDB_SECTOR_SIZE) == 0;
+}
+
 struct temp_buf_item {
     void *addr;
     struct list_elem le;
 };
 
+// Number of I/O buffers that each thread keeps for itself, so that
+// the buffer pool lock is not grabbed in the common case.
+#define TEMP_BUF_THREAD_CACHE_SIZE (4)
+
+struct temp_buf_thread_cache {
+    temp_buf_thread_cache() : num(0) { }
+
+    ~temp_buf_thread_cache() {
+        release();
+    }
+
+    void release() {
+        while (num) {
+            free_align(bufs[--num]);
+        }
+    }
+
+    void *bufs[TEMP_BUF_THREAD_CACHE_SIZE];
+    size_t num;
+};
+
+static thread_local temp_buf_thread_cache tempBufCache;
+
 static void spin_init_wrap(void *lock) {
     spin_init((spin_t*)lock);
 }
@@ -271,14 +303,41 @@ void FileMgrMap::freeEntries(filemgr_factory_free_cb free_callback) {
     spin_unlock(&fileMapLock);
 }
 
+void FileMgrMap::lockFileName(const std::string &filename) {
+    size_t idx = std::hash<std::string>()(filename) % FILEMGR_OPEN_LOCK_STRIPES;
+    fileNameLocks[idx].lock();
+}
+
+void FileMgrMap::unlockFileName(const std::string &filename) {
+    size_t idx = std::hash<std::string>()(filename) % FILEMGR_OPEN_LOCK_STRIPES;
+    fileNameLocks[idx].unlock();
+}
+
+void FileMgrMap::lockAllFileNames(void) {
+    for (size_t i = 0; i < FILEMGR_OPEN_LOCK_STRIPES; ++i) {
+        fileNameLocks[i].lock();
+    }
+}
+
+void FileMgrMap::unlockAllFileNames(void) {
+    for (size_t i = FILEMGR_OPEN_LOCK_STRIPES; i > 0; --i) {
+        fileNameLocks[i - 1].unlock();
+    }
+}
+
 FileMgr::FileMgr()
     : refCount(1), fMgrFlags(0x00), blockSize(global_config.getBlockSize()),
       fopsHandle(nullptr), lastPos(0), lastCommit(0), lastWritableBmpRevnum(0),
       ioInprog(0), fMgrWal(nullptr), fMgrOps(nullptr), fMgrStatus(FILE_NORMAL),
       fileConfig(nullptr), newFile(nullptr), prevFile(nullptr), bCache(nullptr),
+      sCacheFile(nullptr),
       inPlaceCompaction(false), fsType(0), kvHeader(nullptr),
       throttlingDelay(0), fMgrVersion(0), fMgrSb(nullptr), kvsStatOps(this),
-      crcMode(CRC_DEFAULT), staleData(nullptr), latestDirtyUpdate(nullptr)
+      crcMode(CRC_DEFAULT), staleData(nullptr), latestDirtyUpdate(nullptr),
+      mmapAddr(nullptr), mmapBase(nullptr), mmapLen(0), mmapSeqScanners(0),
+      mmapDisabled(false), openedForWrite(false), numCheckpoints(0),
+      reusedBlockCounter(0), indexExtentNext(0), indexExtentEnd(0),
+      indexExtentCommit(0), indexExtentCommitEnd(0)
 {
 
     fMgrHeader.bid = 0;
@@ -339,6 +398,8 @@ FileMgr::FileMgr()
 
     avl_init(&handleIdx, nullptr);
     spin_init(&handleIdxLock);
+    spin_init(&checkpointLock);
+    spin_init(&indexExtentLock);
 }
 
 FileMgr::~FileMgr()
@@ -371,6 +432,8 @@ FileMgr::~FileMgr()
 
     freeFileHandleIdx();
     spin_destroy(&handleIdxLock);
+    spin_destroy(&checkpointLock);
+    spin_destroy(&indexExtentLock);
  }
 
 void FileMgr::init(FileMgrConfig *config)
@@ -384,7 +447,23 @@ void FileMgr::init(FileMgrConfig *config)
 
             if (global_config.getNcacheBlock() > 0)
                 BlockCacheManager::init(global_config.getNcacheBlock(),
+                                        global_config.getBlockSize(),
+                                        global_config.getCompressedCacheSize());
+
+            if (global_config.getNcacheBlock() > 0 &&
+                global_config.getSecondaryCacheSize() > 0 &&
+                !global_config.getSecondaryCachePath().empty()) {
+                fdb_status status = SecondaryBlockCache::init(
+                                        global_config.getSecondaryCachePath(),
+                                        global_config.getSecondaryCacheSize(),
                                         global_config.getBlockSize());
+                if (status != FDB_RESULT_SUCCESS) {
+                    fdb_log(NULL, status,
+                            "Failed to create a secondary block cache file "
+                            "'%s'; the secondary block cache is disabled",
+                            global_config.getSecondaryCachePath().c_str());
+                }
+            }
 
             // initialize temp buffer
             list_init(&tempBuf);
@@ -418,6 +497,10 @@ void * FileMgr::getTempBuf()
     struct list_elem *e;
     struct temp_buf_item *item;
 
+    if (tempBufCache.num) {
+        return tempBufCache.bufs[--tempBufCache.num];
+    }
+
     spin_lock(&tempBufLock);
     e = list_pop_front(&tempBuf);
     if (e) {
@@ -441,6 +524,11 @@ void FileMgr::releaseTempBuf(void *buf)
 {
     struct temp_buf_item *item;
 
+    if (tempBufCache.num < TEMP_BUF_THREAD_CACHE_SIZE) {
+        tempBufCache.bufs[tempBufCache.num++] = buf;
+        return;
+    }
+
     spin_lock(&tempBufLock);
     item = (struct temp_buf_item*)((uint8_t *)buf +
                                    global_config.getBlockSize());
@@ -448,12 +536,35 @@ void FileMgr::releaseTempBuf(void *buf)
     spin_unlock(&tempBufLock);
 }
 
+void * FileMgr::getAlignedBuf(size_t nbytes)
+{
+    if (nbytes == (size_t)global_config.getBlockSize()) {
+        // most common case (single block)
+        return getTempBuf();
+    }
+    void *addr = NULL;
+    malloc_align(addr, FDB_SECTOR_SIZE, nbytes);
+    return addr;
+}
+
+void FileMgr::releaseAlignedBuf(void *buf, size_t nbytes)
+{
+    if (nbytes == (size_t)global_config.getBlockSize()) {
+        releaseTempBuf(buf);
+    } else {
+        free_align(buf);
+    }
+}
+
 void FileMgr::shutdownTempBuf()
 {
     struct list_elem *e;
     struct temp_buf_item *item;
     size_t count=0;
 
+    // buffers cached by other threads are freed when those threads exit
+    tempBufCache.release();
+
     spin_lock(&tempBufLock);
     e = list_begin(&tempBuf);
     while(e){
@@ -465,16 +576,51 @@ void FileMgr::shutdownTempBuf()
     spin_unlock(&tempBufLock);
 }
 
-// Read a block from the file, decrypting if necessary.
+// Read a block from the secondary block cache or the file, decrypting
+// if necessary.
 ssize_t FileMgr::readBlock(void *buf, bid_t bid) {
-    ssize_t result = fMgrOps->pread(fopsHandle, buf, blockSize, blockSize * bid);
+    if (sCacheFile &&
+        SecondaryBlockCache::getInstance()->read(sCacheFile, bid, buf)) {
+        return blockSize;
+    }
+    return readBlocks(buf, 1, bid);
+}
+
+// Read consecutive block(s) from the file, decrypting if necessary.
+ssize_t FileMgr::readBlocks(void *buf, unsigned num_blocks, bid_t start_bid) {
+    ssize_t result;
+    uint8_t *map_addr = mmapAddr.load(std::memory_order_acquire);
+    uint64_t pos = (uint64_t)blockSize * start_bid;
+    size_t nbytes = (size_t)num_blocks * blockSize;
+    if (map_addr && pos + nbytes <= mmapLen.load(std::memory_order_relaxed)) {
+        // the mapping reflects the file contents as pread() does
+        memcpy(buf, map_addr + pos, nbytes);
+        result = nbytes;
+    } else if (isDirectIo() && !_is_sector_aligned(buf)) {
+        // direct I/O can't transfer into an unaligned buffer
+        void *io_buf = getAlignedBuf(nbytes);
+        if (!io_buf) {
+            return FDB_RESULT_ALLOC_FAIL;
+        }
+        result = fMgrOps->pread(fopsHandle, io_buf, nbytes, pos);
+        if (result > 0) {
+            memcpy(buf, io_buf, result);
+        }
+        releaseAlignedBuf(io_buf, nbytes);
+    } else {
+        result = fMgrOps->pread(fopsHandle, buf, nbytes, pos);
+    }
     if (fMgrEncryption.ops && result > 0) {
-        if (result != (ssize_t)blockSize) {
+        if (result != (ssize_t)nbytes) {
             return FDB_RESULT_READ_FAIL;
         }
-        fdb_status status = fdb_decrypt_block(&fMgrEncryption, buf, result, bid);
-        if (status != FDB_RESULT_SUCCESS) {
-            return status;
+        for (unsigned i = 0; i < num_blocks; ++i) {
+            fdb_status status = fdb_decrypt_block(&fMgrEncryption,
+                                                  (uint8_t*)buf + i * blockSize,
+                                                  blockSize, start_bid + i);
+            if (status != FDB_RESULT_SUCCESS) {
+                return status;
+            }
         }
     }
     return result;
@@ -486,40 +632,103 @@ ssize_t FileMgr::writeBlocks(void *buf, unsigned num_blocks,
     size_t blocksize = blockSize;
     cs_off_t offset = start_bid * blocksize;
     size_t nbytes = num_blocks * blocksize;
-    if (fMgrEncryption.ops == NULL) {
+    if (sCacheFile) {
+        SecondaryBlockCache::getInstance()->invalidate(sCacheFile, start_bid,
+                                                       num_blocks);
+    }
+    if (fMgrEncryption.ops == NULL &&
+        (!isDirectIo() || _is_sector_aligned(buf))) {
         return fMgrOps->pwrite(fopsHandle, buf, nbytes, offset);
-    } else {
-        uint8_t *encrypted_buf;
-        if (nbytes > 4096) {
-            encrypted_buf = (uint8_t*)malloc(nbytes);
-        } else {
-            // most common case (writing single block)
-            encrypted_buf = alca(uint8_t, nbytes);
-        }
-
-        if (!encrypted_buf) {
-            return FDB_RESULT_ALLOC_FAIL;
-        }
+    }
 
+    // encrypt the blocks, or copy them for direct I/O that can't transfer
+    // from an unaligned buffer, into an aligned I/O buffer.
+    uint8_t *io_buf = (uint8_t *)getAlignedBuf(nbytes);
+    if (!io_buf) {
+        return FDB_RESULT_ALLOC_FAIL;
+    }
+    if (fMgrEncryption.ops) {
         fdb_status status = fdb_encrypt_blocks(&fMgrEncryption,
-                                               encrypted_buf,
+                                               io_buf,
                                                buf,
                                                blocksize,
                                                num_blocks,
                                                start_bid);
-        if (nbytes > 4096) {
-            free(encrypted_buf);
-        }
-
         if (status != FDB_RESULT_SUCCESS) {
+            releaseAlignedBuf(io_buf, nbytes);
             return status;
         }
+    } else {
+        memcpy(io_buf, buf, nbytes);
+    }
+
+    ssize_t result = fMgrOps->pwrite(fopsHandle, io_buf, nbytes, offset);
+    releaseAlignedBuf(io_buf, nbytes);
+    return result;
+}
+
+// Write consecutive blocks in separate buffers to the file, encrypting if
+// necessary.
+ssize_t FileMgr::writeBlockVector(void * const *blocks, unsigned num_blocks,
+                                  bid_t start_bid) {
+    size_t blocksize = blockSize;
+    cs_off_t offset = start_bid * blocksize;
+    size_t nbytes = num_blocks * blocksize;
+    if (num_blocks == 1) {
+        return writeBlocks(blocks[0], 1, start_bid);
+    }
+
+    // custom file operations don't support vectored writes, and encryption
+    // needs a separate output buffer anyway.
+    bool gather = fMgrEncryption.ops || fMgrOps != get_filemgr_ops();
+    if (!gather && isDirectIo()) {
+        for (unsigned i = 0; i < num_blocks; ++i) {
+            if (!_is_sector_aligned(blocks[i])) {
+                gather = true;
+                break;
+            }
+        }
+    }
+    if (sCacheFile) {
+        SecondaryBlockCache::getInstance()->invalidate(sCacheFile, start_bid,
+                                                       num_blocks);
+    }
+    if (!gather) {
+        return filemgr_pwritev(fopsHandle, blocks, num_blocks, blocksize,
+                               offset);
+    }
 
-        return fMgrOps->pwrite(fopsHandle, encrypted_buf, nbytes, offset);
+    uint8_t *io_buf = (uint8_t *)getAlignedBuf(nbytes);
+    if (!io_buf) {
+        return FDB_RESULT_ALLOC_FAIL;
     }
+    for (unsigned i = 0; i < num_blocks; ++i) {
+        if (fMgrEncryption.ops) {
+            fdb_status status = fdb_encrypt_blocks(&fMgrEncryption,
+                                                   io_buf + i * blocksize,
+                                                   blocks[i],
+                                                   blocksize,
+                                                   1,
+                                                   start_bid + i);
+            if (status != FDB_RESULT_SUCCESS) {
+                releaseAlignedBuf(io_buf, nbytes);
+                return status;
+            }
+        } else {
+            memcpy(io_buf + i * blocksize, blocks[i], blocksize);
+        }
+    }
+
+    ssize_t result = fMgrOps->pwrite(fopsHandle, io_buf, nbytes, offset);
+    releaseAlignedBuf(io_buf, nbytes);
+    return result;
 }
 
 int FileMgr::isWritable(bid_t bid) {
+    if (isIndexExtentWritable(bid)) {
+        // uncommitted part of the extent reserved for index nodes
+        return true;
+    }
     if (fMgrSb && fMgrSb->bmpExists()) {
         // block reusing is enabled
         return fMgrSb->isWritable(bid);
@@ -542,6 +751,46 @@ uint64_t FileMgr::getSbBmpRevnum() {
     }
 }
 
+ssize_t FileMgr::readHeaderBlock(void *buf, bid_t bid, bid_t start_bid,
+                                 uint8_t **scan_buf,
+                                 bid_t *scan_begin, bid_t *scan_end)
+{
+    if (bid == start_bid) {
+        // the first block is the last header in most cases
+        return readBlock(buf, bid);
+    }
+    if (*scan_begin == BLK_NOT_FOUND || bid < *scan_begin || bid > *scan_end) {
+        // read the chunk ending at 'bid'. The scan goes backward from
+        // 'start_bid' to zero, and then from the end of the file down to
+        // 'start_bid + 1', so the chunk doesn't go below that point.
+        bid_t lowest = (bid > start_bid) ? start_bid + 1 : 0;
+        bid_t begin = (bid >= lowest + FILEMGR_HDR_SCAN_BLOCKS)
+                      ? bid - FILEMGR_HDR_SCAN_BLOCKS + 1 : lowest;
+        unsigned num = bid - begin + 1;
+
+        *scan_begin = *scan_end = BLK_NOT_FOUND;
+        if (num > 1) {
+            if (!*scan_buf) {
+                void *addr;
+                malloc_align(addr, FDB_SECTOR_SIZE,
+                             (size_t)FILEMGR_HDR_SCAN_BLOCKS * blockSize);
+                *scan_buf = (uint8_t *)addr;
+            }
+            if (readBlocks(*scan_buf, num, begin) ==
+                    (ssize_t)num * blockSize) {
+                *scan_begin = begin;
+                *scan_end = bid;
+            }
+        }
+        if (*scan_begin == BLK_NOT_FOUND) {
+            // the last chunk, or a chunk that couldn't be read entirely
+            return readBlock(buf, bid);
+        }
+    }
+    memcpy(buf, *scan_buf + (bid - *scan_begin) * blockSize, blockSize);
+    return blockSize;
+}
+
 fdb_status FileMgr::readHeader(ErrLogCallback *log_callback)
 {
     uint8_t marker[BLK_MARKER_SIZE];
@@ -554,6 +803,12 @@ fdb_status FileMgr::readHeader(ErrLogCallback *log_callback)
     bid_t hdr_bid, hdr_bid_local;
     size_t min_filesize = 0;
 
+    // blocks are read backward in chunks of FILEMGR_HDR_SCAN_BLOCKS so that
+    // a long tail of documents after the last header costs a few large
+    // sequential reads rather than one read per block.
+    uint8_t *scan_buf = NULL;
+    bid_t scan_begin = BLK_NOT_FOUND, scan_end = BLK_NOT_FOUND;
+
     // get temp buffer
     buf = (uint8_t *) FileMgr::getTempBuf();
 
@@ -600,7 +855,8 @@ fdb_status FileMgr::readHeader(ErrLogCallback *log_callback)
                 fdb_log(log_callback, status, msg, getFileName());
                 break;
             }
-            ssize_t rv = readBlock(buf, hdr_bid_local);
+            ssize_t rv = readHeaderBlock(buf, hdr_bid_local, hdr_bid,
+                                         &scan_buf, &scan_begin, &scan_end);
             if (rv != (ssize_t) getBlockSize()) {
                 status = (fdb_status)rv;
                 const char *msg = "Unable to read a database file '%s' with "
@@ -680,6 +936,9 @@ fdb_status FileMgr::readHeader(ErrLogCallback *log_callback)
                             releaseTempBuf(buf);
                         }
 
+                        if (scan_buf) {
+                            free_align(scan_buf);
+                        }
                         setVersion(magic);
                         return status;
                     } else {
@@ -727,6 +986,9 @@ fdb_status FileMgr::readHeader(ErrLogCallback *log_callback)
 
     // release temp buffer
     releaseTempBuf(buf);
+    if (scan_buf) {
+        free_align(scan_buf);
+    }
 
     accessHeader()->reset();
     setVersion(magic);
@@ -753,9 +1015,24 @@ uint64_t FileMgr::getBcacheUsedSpace(void)
     return bcache_free_space;
 }
 
+uint64_t FileMgr::getCompressedCacheUsedSpace(void)
+{
+    if (global_config.getNcacheBlock()) {
+        return BlockCacheManager::getInstance()->getCompressedCacheUsed();
+    }
+    return 0;
+}
+
+uint64_t FileMgr::getSecondaryCacheUsedSpace(void)
+{
+    SecondaryBlockCache *scache = SecondaryBlockCache::getInstance();
+    return scache ? scache->getUsedSpace() : 0;
+}
+
 struct filemgr_prefetch_args {
     FileMgr *file;
     uint64_t duration;
+    bool warmup;
     ErrLogCallback *log_callback;
     void *aux;
 };
@@ -770,6 +1047,13 @@ static void *_filemgr_prefetch_thread(void *voidargs)
     bool terminate = false;
     struct timeval begin, cur, gap;
 
+    if (args->warmup && args->file->loadWarmupSet(args->duration)) {
+        // the blocks that were resident before are reloaded instead
+        args->file->prefetchStatus.store(FILEMGR_PREFETCH_TERMINATED);
+        free(args);
+        return NULL;
+    }
+
     args->file->acquireSpinLock();
     cur_pos = args->file->getLastCommit();
     args->file->releaseSpinLock();
@@ -847,6 +1131,7 @@ void FileMgr::prefetch(ErrLogCallback *log_callback)
                             calloc(1, sizeof(struct filemgr_prefetch_args));
         args->file = this;
         args->duration = fileConfig->getPrefetchDuration();
+        args->warmup = fileConfig->getWarmupCache();
         args->log_callback = log_callback;
         thread_create(&prefetchTid, _filemgr_prefetch_thread, args);
     }
@@ -908,10 +1193,6 @@ filemgr_open_result FileMgr::open(std::string filename,
                                   FileMgrConfig *config,
                                   ErrLogCallback *log_callback)
 {
-    bool create = config->getOptions() & FILEMGR_CREATE;
-    bool fail_if_exists = config->getOptions() & FILEMGR_EXCL_CREATE;
-    int file_flag = 0x0;
-    fdb_status status;
     filemgr_open_result result = {nullptr, FDB_RESULT_OPEN_FAIL};
 
     init(config);
@@ -923,6 +1204,32 @@ filemgr_open_result FileMgr::open(std::string filename,
         return result;
     }
 
+    // Opens of the same file name are serialized by the name's open lock,
+    // so that a new file can be loaded without holding fileMgrOpenlock.
+    FileMgrMap::get()->lockFileName(filename);
+    result = openFile(filename, ops, config, log_callback);
+    if (result.rv == FDB_RESULT_SUCCESS &&
+        !(config->getOptions() & FILEMGR_READONLY)) {
+        // a file opened for writing is not read through a mapping
+        result.file->disableMapping();
+        result.file->openedForWrite.store(true);
+    }
+    FileMgrMap::get()->unlockFileName(filename);
+
+    return result;
+}
+
+filemgr_open_result FileMgr::openFile(std::string filename,
+                                      struct filemgr_ops *ops,
+                                      FileMgrConfig *config,
+                                      ErrLogCallback *log_callback)
+{
+    bool create = config->getOptions() & FILEMGR_CREATE;
+    bool fail_if_exists = config->getOptions() & FILEMGR_EXCL_CREATE;
+    int file_flag = 0x0;
+    fdb_status status;
+    filemgr_open_result result = {nullptr, FDB_RESULT_OPEN_FAIL};
+
     // check whether file is already opened or not
     spin_lock(&fileMgrOpenlock);
     FileMgr *file = FileMgrMap::get()->fetchEntry(filename);
@@ -987,6 +1294,11 @@ filemgr_open_result FileMgr::open(std::string filename,
                 }
             } else { // Reopening the closed file is succeed.
                 file->fMgrStatus.store(FILE_NORMAL);
+                // forget the index extent reserved before the close
+                spin_lock(&file->indexExtentLock);
+                file->indexExtentCommit = file->indexExtentCommitEnd = 0;
+                file->indexExtentNext = file->indexExtentEnd = 0;
+                spin_unlock(&file->indexExtentLock);
                 if (config->getOptions() & FILEMGR_SYNC) {
                     file->fMgrFlags |= FILEMGR_SYNC;
                 } else {
@@ -1016,6 +1328,11 @@ filemgr_open_result FileMgr::open(std::string filename,
         }
     }
 
+    // The file is not opened yet. Other threads cannot open it until we
+    // release its open lock, so that the superblock and DB header are read
+    // without blocking opens of other files.
+    spin_unlock(&fileMgrOpenlock);
+
     file_flag = O_RDWR;
     if (create) {
         file_flag |= O_CREAT;
@@ -1031,7 +1348,6 @@ filemgr_open_result FileMgr::open(std::string filename,
     if (status != FDB_RESULT_SUCCESS) {
         _log_errno_str(fops_handle, ops, log_callback, status, "OPEN",
                        filename.c_str());
-        spin_unlock(&fileMgrOpenlock);
         result.rv = status;
         return result;
     }
@@ -1044,7 +1360,6 @@ filemgr_open_result FileMgr::open(std::string filename,
     if (status != FDB_RESULT_SUCCESS) {
         FileMgr::fileClose(ops, fops_handle);
         delete file;
-        spin_unlock(&fileMgrOpenlock);
         result.rv = status;
         return result;
     }
@@ -1063,7 +1378,6 @@ filemgr_open_result FileMgr::open(std::string filename,
         FileMgr::fileClose(file->fMgrOps, file->fopsHandle);
         delete file->fileConfig;
         delete file;
-        spin_unlock(&fileMgrOpenlock);
         result.rv = (fdb_status) offset;
         return result;
     }
@@ -1091,7 +1405,6 @@ filemgr_open_result FileMgr::open(std::string filename,
             delete file->staleData;
             delete file->fileConfig;
             delete file;
-            spin_unlock(&fileMgrOpenlock);
             result.rv = status;
             return result;
         }
@@ -1110,7 +1423,6 @@ filemgr_open_result FileMgr::open(std::string filename,
             delete file->staleData;
             delete file->fileConfig;
             delete file;
-            spin_unlock(&fileMgrOpenlock);
             result.rv = status;
             return result;
         }
@@ -1131,6 +1443,15 @@ filemgr_open_result FileMgr::open(std::string filename,
         file->staleData = new StaleDataManagerBase();
     }
 
+    if (SecondaryBlockCache::getInstance() && !file->fMgrEncryption.ops) {
+        // blocks cached before the last close are reused only if the file
+        // has not been changed since then.
+        file->sCacheFile = SecondaryBlockCache::getInstance()->attachFile(
+                                            file->fileName,
+                                            file->accessHeader()->revnum,
+                                            file->getPos() == 0);
+    }
+
     // initialize WAL
     if (!file->fMgrWal) {
         file->fMgrWal = new Wal(file, FDB_WAL_NBUCKET);
@@ -1152,14 +1473,14 @@ filemgr_open_result FileMgr::open(std::string filename,
     file->globalTxn.isolation = FDB_ISOLATION_READ_COMMITTED;
     file->fMgrWal->addTransaction_Wal(&file->globalTxn);
 
+    spin_lock(&fileMgrOpenlock);
     FileMgrMap::get()->addEntry(filename, file);
+    spin_unlock(&fileMgrOpenlock);
 
-    if (config->getPrefetchDuration() > 0) {
+    if (config->getPrefetchDuration() > 0 || config->getWarmupCache()) {
         file->prefetch(log_callback);
     }
 
-    spin_unlock(&fileMgrOpenlock);
-
     if (config->getOptions() & FILEMGR_SYNC) {
         file->fMgrFlags |= FILEMGR_SYNC;
     } else {
@@ -1565,6 +1886,23 @@ fdb_status FileMgr::close(FileMgr *file,
         return FDB_RESULT_SUCCESS;
     }
 
+    if (global_config.getNcacheBlock() > 0 &&
+        file->fileConfig->getWarmupCache() &&
+        file->openedForWrite.load() &&
+        file->getFileStatus() == FILE_NORMAL) {
+        // record the resident blocks before they are discarded, and write
+        // them in the background. Read-only opens leave the sidecar file
+        // as it is. An in-place compacted file is going to be renamed to
+        // its original name.
+        file->saveWarmupSet(file->inPlaceCompaction ? orig_file_name : NULL,
+                            true, log_callback);
+    }
+
+    // An in-place compacted file may be renamed to its original name below,
+    // which must not race with a concurrent open loading that name.
+    if (orig_file_name) {
+        FileMgrMap::get()->lockFileName(orig_file_name);
+    }
     spin_lock(&fileMgrOpenlock);  // Grab the fileMgrOpenlock to avoid the race with
                                   // Filemgr::open() because file->fMgrLock won't
                                   // prevent the race condition.
@@ -1611,6 +1949,7 @@ fdb_status FileMgr::close(FileMgr *file,
 
                 // As the file is already unlinked, the file will be removed
                 // as soon as we close it.
+                file->unmapFile();
                 rv = FileMgr::fileClose(file->fMgrOps, file->fopsHandle);
                 _log_errno_str(file->fopsHandle, file->fMgrOps, log_callback,
                                (fdb_status)rv, "CLOSE", file->fileName);
@@ -1627,6 +1966,9 @@ fdb_status FileMgr::close(FileMgr *file,
 
             file->updateFilePointers();
             spin_unlock(&fileMgrOpenlock);
+            if (orig_file_name) {
+                FileMgrMap::get()->unlockFileName(orig_file_name);
+            }
 
             if (foreground_deletion) {
                 FileMgr::freeFunc(file);
@@ -1635,6 +1977,8 @@ fdb_status FileMgr::close(FileMgr *file,
             }
             return (fdb_status) rv;
         } else {
+            file->unmapFile();
+            file->openedForWrite.store(false);
             rv = FileMgr::fileClose(file->fMgrOps, file->fopsHandle);
             if (cleanup_cache_onclose) {
                 _log_errno_str(file->fopsHandle, file->fMgrOps, log_callback,
@@ -1659,6 +2003,9 @@ fdb_status FileMgr::close(FileMgr *file,
                         isFileRemoved(orig_file_name)) {
                         // If background file removal is not done yet, we postpone
                         // file renaming at this time.
+                        // the blocks cached for the original name belong to
+                        // the old file
+                        FileMgr::removeSecondaryCache(orig_file_name);
                         if (rename(file->fileName, orig_file_name) < 0) {
                             // Note that the renaming failure is not a critical
                             // issue because the last compacted file will be
@@ -1677,6 +2024,9 @@ fdb_status FileMgr::close(FileMgr *file,
 
                 file->updateFilePointers();
                 spin_unlock(&fileMgrOpenlock);
+                if (orig_file_name) {
+                    FileMgrMap::get()->unlockFileName(orig_file_name);
+                }
 
                 FileMgr::freeFunc(file);
                 return (fdb_status) rv;
@@ -1691,6 +2041,9 @@ fdb_status FileMgr::close(FileMgr *file,
 
     file->releaseSpinLock();
     spin_unlock(&fileMgrOpenlock);
+    if (orig_file_name) {
+        FileMgrMap::get()->unlockFileName(orig_file_name);
+    }
     return (fdb_status) rv;
 }
 
@@ -1719,6 +2072,8 @@ void FileMgr::freeFunc(FileMgr *file)
         thread_join(file->prefetchTid, &ret);
     }
 
+    file->unmapFile();
+
     // remove all cached blocks
     if (global_config.getNcacheBlock() > 0 &&
         file->bCache.load(std::memory_order_relaxed)) {
@@ -1727,6 +2082,16 @@ void FileMgr::freeFunc(FileMgr *file)
         file->bCache.store(NULL, std::memory_order_relaxed);
     }
 
+    if (file->sCacheFile && SecondaryBlockCache::getInstance()) {
+        // the cached blocks are discarded if the file is removed or renamed
+        bool removed = file->fMgrStatus.load() == FILE_REMOVED_PENDING ||
+                       doesFileExist(file->fileName) != FDB_RESULT_SUCCESS;
+        SecondaryBlockCache::getInstance()->detachFile(
+                        file->sCacheFile, file->accessHeader()->revnum,
+                        removed);
+        file->sCacheFile = NULL;
+    }
+
     if (file->getKVHeader_UNLOCKED()) {
         // multi KV intance mode & KV header exists
         file->free_kv_header(file);
@@ -1809,6 +2174,8 @@ fdb_status FileMgr::shutdown()
             // filemgr is already shut down
             return ret;
         }
+        // the sidecar files of the closed files are written first
+        waitWarmupSaves();
 
         spin_lock(&fileMgrOpenlock);
         open_file = FileMgrMap::get()->scan(_filemgr_is_closed, nullptr);
@@ -1819,8 +2186,11 @@ fdb_status FileMgr::shutdown()
             if (global_config.getNcacheBlock() > 0) {
                 BlockCacheManager::getInstance()->destroyInstance();
             }
+            SecondaryBlockCache::destroyInstance();
             fileMgrInitialized.store(false);
             shutdownTempBuf();
+            SlabAllocator::releaseThreadCache();
+            MemoryArena::releaseThreadArena();
         } else {
             ret = FDB_RESULT_FILE_IS_BUSY;
         }
@@ -1828,6 +2198,21 @@ fdb_status FileMgr::shutdown()
     return ret;
 }
 
+void FileMgr::markReusedBlocks(bid_t bid, uint64_t count) {
+    if (!hasCheckpoints()) {
+        return;
+    }
+    // remember that the blocks are reused after the checkpoints, so that
+    // they are not regarded as a part of the pinned headers.
+    spin_lock(&checkpointLock);
+    if (!checkpoints.empty()) {
+        for (uint64_t i = 0; i < count; ++i) {
+            reusedBlocks[bid + i] = ++reusedBlockCounter;
+        }
+    }
+    spin_unlock(&checkpointLock);
+}
+
 bid_t FileMgr::alloc_FileMgr(ErrLogCallback *log_callback) {
     acquireSpinLock();
     bid_t bid = BLK_NOT_FOUND;
@@ -1836,6 +2221,9 @@ bid_t FileMgr::alloc_FileMgr(ErrLogCallback *log_callback) {
     // for easy implementation.
     if (getFileStatus() == FILE_NORMAL && fMgrSb) {
         bid = fMgrSb->allocBlock();
+        if (bid != BLK_NOT_FOUND) {
+            markReusedBlocks(bid, 1);
+        }
     }
     if (bid == BLK_NOT_FOUND) {
         bid = lastPos.load() / blockSize;
@@ -1855,6 +2243,174 @@ bid_t FileMgr::alloc_FileMgr(ErrLogCallback *log_callback) {
     return bid;
 }
 
+bid_t FileMgr::allocExtent_FileMgr(uint64_t nblocks, uint64_t *count_out,
+                                  ErrLogCallback *log_callback) {
+    acquireSpinLock();
+    bid_t bid = BLK_NOT_FOUND;
+    uint64_t count = 0;
+
+    // block reusing is not allowed for being compacted file
+    // for easy implementation.
+    if (getFileStatus() == FILE_NORMAL && fMgrSb) {
+        bid = fMgrSb->allocExtent(nblocks, &count);
+        if (bid != BLK_NOT_FOUND) {
+            markReusedBlocks(bid, count);
+        }
+    }
+    if (bid == BLK_NOT_FOUND) {
+        count = nblocks;
+        bid = lastPos.load() / blockSize;
+        lastPos.fetch_add(blockSize * count);
+    }
+
+    if (global_config.getNcacheBlock() <= 0) {
+        // if block cache is turned off, write the allocated blocks before use
+        uint8_t _buf = 0x0;
+        ssize_t rv = fMgrOps->pwrite(fopsHandle, &_buf, 1,
+                                     (bid + count) * blockSize - 1);
+        _log_errno_str(fopsHandle, fMgrOps, log_callback, (fdb_status) rv,
+                       "WRITE", fileName);
+    }
+    releaseSpinLock();
+
+    *count_out = count;
+    return bid;
+}
+
+bid_t FileMgr::allocIndex_FileMgr(ErrLogCallback *log_callback) {
+    uint64_t nblocks = fileConfig->getIndexBlockExtent();
+    uint64_t count;
+    bid_t bid;
+
+    if (nblocks <= 1) {
+        return alloc_FileMgr(log_callback);
+    }
+
+    spin_lock(&indexExtentLock);
+    if (indexExtentNext < indexExtentEnd) {
+        bid = indexExtentNext++;
+        spin_unlock(&indexExtentLock);
+        return bid;
+    }
+    spin_unlock(&indexExtentLock);
+
+    // the reserved extent is used up. Blocks of the new extent are not
+    // referenced by any header until they are handed out, so the rest of
+    // the extent remains writable across commits.
+    bid = allocExtent_FileMgr(nblocks, &count, log_callback);
+
+    spin_lock(&indexExtentLock);
+    indexExtentNext = bid + 1;
+    indexExtentEnd = bid + count;
+    spin_unlock(&indexExtentLock);
+
+    return bid;
+}
+
+bool FileMgr::isIndexExtentWritable(bid_t bid) {
+    bool ret;
+
+    if (!fileConfig || fileConfig->getIndexBlockExtent() <= 1) {
+        return false;
+    }
+    spin_lock(&indexExtentLock);
+    ret = (bid >= indexExtentCommit && bid < indexExtentCommitEnd);
+    spin_unlock(&indexExtentLock);
+    return ret;
+}
+
+bool FileMgr::addCheckpoint(const std::string& name,
+                            filemgr_header_revnum_t revnum,
+                            bid_t bid,
+                            filemgr_header_revnum_t wal_flush_revnum) {
+    struct filemgr_checkpoint checkpoint;
+    bool ret;
+
+    checkpoint.revnum = revnum;
+    checkpoint.bid = bid;
+    checkpoint.walFlushRevnum = wal_flush_revnum;
+
+    // grab the file lock first to get the consistent allocation state
+    acquireSpinLock();
+    spin_lock(&checkpointLock);
+    checkpoint.allocLimit = lastPos.load() / blockSize;
+    checkpoint.reuseSeqnum = reusedBlockCounter;
+    ret = checkpoints.insert(std::make_pair(name, checkpoint)).second;
+    numCheckpoints.store(checkpoints.size());
+    spin_unlock(&checkpointLock);
+    releaseSpinLock();
+
+    return ret;
+}
+
+bool FileMgr::removeCheckpoint(const std::string& name) {
+    bool ret;
+
+    spin_lock(&checkpointLock);
+    ret = checkpoints.erase(name) > 0;
+    numCheckpoints.store(checkpoints.size());
+    if (checkpoints.empty()) {
+        reusedBlocks.clear();
+    }
+    spin_unlock(&checkpointLock);
+
+    return ret;
+}
+
+bool FileMgr::getCheckpoint(const std::string& name,
+                            struct filemgr_checkpoint *checkpoint_out) {
+    bool ret = false;
+
+    spin_lock(&checkpointLock);
+    auto entry = checkpoints.find(name);
+    if (entry != checkpoints.end()) {
+        *checkpoint_out = entry->second;
+        ret = true;
+    }
+    spin_unlock(&checkpointLock);
+
+    return ret;
+}
+
+bool FileMgr::isCheckpointRevnum(filemgr_header_revnum_t revnum) {
+    bool ret = false;
+
+    if (!hasCheckpoints()) {
+        return false;
+    }
+    spin_lock(&checkpointLock);
+    for (auto &entry : checkpoints) {
+        if (entry.second.revnum == revnum) {
+            ret = true;
+            break;
+        }
+    }
+    spin_unlock(&checkpointLock);
+
+    return ret;
+}
+
+bool FileMgr::isBlockPinned_UNLOCKED(filemgr_header_revnum_t stale_revnum,
+                                     bid_t bid) {
+    for (auto &entry : checkpoints) {
+        struct filemgr_checkpoint *checkpoint = &entry.second;
+        if (stale_revnum <= checkpoint->walFlushRevnum ||
+            bid >= checkpoint->allocLimit) {
+            // already stale as of the pinned header, or
+            // allocated after the checkpoint
+            continue;
+        }
+        auto reused = reusedBlocks.find(bid);
+        if (reused != reusedBlocks.end() &&
+            reused->second > checkpoint->reuseSeqnum) {
+            // reused after the checkpoint
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
 // Note that both alloc_multiple & alloc_multiple_cond are not used in
 // the new version of DB file (with superblock support).
 void FileMgr::allocMultiple(int nblock, bid_t *begin,
@@ -1933,6 +2489,604 @@ bool FileMgr::invalidateBlock(bid_t bid) {
     return ret;
 }
 
+void *FileMgr::pinBlock(bid_t bid, BlockCacheItem **item,
+                        ErrLogCallback *log_callback) {
+    if (global_config.getNcacheBlock() <= 0 ||
+        bid * blockSize >= lastPos.load() || isWritable(bid)) {
+        // writable blocks can be modified by writers at any time
+        return NULL;
+    }
+
+    void *addr = BlockCacheManager::getInstance()->pin(this, bid, item);
+    if (!addr) {
+        // cache miss .. load the block into the cache and try again
+        void *buf = getTempBuf();
+        fdb_status fs = read_FileMgr(bid, buf, log_callback, true);
+        releaseTempBuf(buf);
+        if (fs == FDB_RESULT_SUCCESS) {
+            addr = BlockCacheManager::getInstance()->pin(this, bid, item);
+        }
+    }
+    return addr;
+}
+
+void *FileMgr::pinCachedBlock(bid_t bid, BlockCacheItem **item) {
+    if (global_config.getNcacheBlock() <= 0 ||
+        bid * blockSize >= lastPos.load() || isWritable(bid)) {
+        return NULL;
+    }
+    return BlockCacheManager::getInstance()->pin(this, bid, item);
+}
+
+void FileMgr::unpinBlock(BlockCacheItem *item) {
+    BlockCacheManager::getInstance()->unpin(item);
+}
+
+bool FileMgr::mapFile() {
+    if (isMapped()) {
+        return checkMapping();
+    }
+    if (fMgrOps != get_filemgr_ops()) {
+        // custom file operations .. the handle is not a file descriptor
+        return false;
+    }
+    if (isDirectIo()) {
+        // the mapping would cache the file in the page cache again
+        return false;
+    }
+
+    acquireSpinLock();
+    // only the committed region is mapped, as the blocks allocated after the
+    // last commit may not exist in the file yet.
+    uint64_t len = lastCommit.load();
+    len -= len % blockSize;
+    if (!isMapped() && !mmapBase && !mmapDisabled.load() && len > 0) {
+        void *addr = filemgr_map_file(fopsHandle, len);
+        if (addr) {
+            mmapBase = static_cast<uint8_t *>(addr);
+            mmapLen.store(len, std::memory_order_relaxed);
+            mmapAddr.store(mmapBase, std::memory_order_release);
+            if (mmapSeqScanners) {
+                filemgr_advise_map(addr, len, FILEMGR_MAP_ADVICE_SEQUENTIAL);
+            }
+        }
+    }
+    releaseSpinLock();
+    return isMapped();
+}
+
+void FileMgr::disableMapping() {
+    acquireSpinLock();
+    mmapDisabled.store(true);
+    mmapAddr.store(nullptr, std::memory_order_release);
+    releaseSpinLock();
+}
+
+bool FileMgr::checkMapping() {
+    if (!isMapped()) {
+        return false;
+    }
+    cs_off_t eof = fMgrOps->goto_eof(fopsHandle);
+    if (eof < 0 || (uint64_t)eof < mmapLen.load(std::memory_order_relaxed)) {
+        fdb_log(NULL, FDB_RESULT_READ_FAIL,
+                "The file '%s' is shorter than its memory mapping; the "
+                "mapping is no longer used", fileName);
+        acquireSpinLock();
+        mmapAddr.store(nullptr, std::memory_order_release);
+        releaseSpinLock();
+        return false;
+    }
+    return true;
+}
+
+void FileMgr::unmapFile() {
+    mmapAddr.store(nullptr);
+    if (mmapBase) {
+        filemgr_unmap_file(mmapBase, mmapLen.load());
+        mmapBase = nullptr;
+        mmapLen.store(0);
+    }
+    mmapDisabled.store(false);
+}
+
+void FileMgr::adviseSequentialScan(bool begin) {
+    acquireSpinLock();
+    uint8_t *addr = mmapAddr.load(std::memory_order_acquire);
+    if (begin) {
+        if (mmapSeqScanners++ == 0 && addr) {
+            filemgr_advise_map(addr, mmapLen.load(),
+                               FILEMGR_MAP_ADVICE_SEQUENTIAL);
+        }
+    } else if (mmapSeqScanners > 0) {
+        if (--mmapSeqScanners == 0 && addr) {
+            filemgr_advise_map(addr, mmapLen.load(),
+                               FILEMGR_MAP_ADVICE_NORMAL);
+        }
+    }
+    releaseSpinLock();
+}
+
+void FileMgr::prefetchMapped(uint64_t offset, uint64_t len) {
+    uint8_t *addr = mmapAddr.load(std::memory_order_acquire);
+    uint64_t map_len = mmapLen.load(std::memory_order_relaxed);
+    if (!addr || offset >= map_len) {
+        return;
+    }
+    if (offset + len > map_len) {
+        len = map_len - offset;
+    }
+    filemgr_advise_map(addr + offset, len, FILEMGR_MAP_ADVICE_WILLNEED);
+}
+
+size_t FileMgr::prefetchBlocks(const bid_t *bids, size_t num,
+                               struct async_io_handle *aio_handle,
+                               ErrLogCallback *log_callback) {
+    size_t i, num_cached = 0, num_advise = 0;
+    int num_sub, aio_size = 0;
+    uint64_t curr_pos = lastPos.load();
+    bid_t advise_bid = BLK_NOT_FOUND;
+    BlockCacheItem *item;
+
+    if (global_config.getNcacheBlock() <= 0 || isMapped()) {
+        return num;
+    }
+    if (fMgrEncryption.ops) {
+        // async reads don't go through the decryption in readBlock()
+        aio_handle = NULL;
+    }
+    if (aio_handle && aio_handle->num_inflight) {
+        // the buffers of the previous reads are reused
+        completeAsyncBlocks(aio_handle, true, log_callback);
+        if (aio_handle->num_inflight) {
+            aio_handle = NULL;
+        }
+    }
+
+    for (i = 0; i < num; ++i) {
+        bid_t bid = bids[i];
+        if (bid * blockSize >= curr_pos || isWritable(bid)) {
+            // uncommitted blocks are read through the regular path
+            ++num_cached;
+            continue;
+        }
+        if (BlockCacheManager::getInstance()->pin(this, bid, &item)) {
+            BlockCacheManager::getInstance()->unpin(item);
+            ++num_cached;
+            continue;
+        }
+        if (aio_handle && aio_size < (int) aio_handle->queue_depth) {
+            fMgrOps->aio_prep_read(fopsHandle, aio_handle, aio_size,
+                                   blockSize, bid * blockSize);
+            ++aio_size;
+            continue;
+        }
+        // merge consecutive blocks into a single hint
+        if (num_advise && bid == advise_bid + num_advise) {
+            ++num_advise;
+        } else {
+            if (num_advise) {
+                adviseBlocks(advise_bid, num_advise);
+            }
+            advise_bid = bid;
+            num_advise = 1;
+        }
+    }
+    if (num_advise) {
+        adviseBlocks(advise_bid, num_advise);
+    }
+
+    if (aio_size) {
+        num_sub = fMgrOps->aio_submit(fopsHandle, aio_handle, aio_size);
+        if (num_sub < 0) {
+            num_sub = 0;
+        }
+        aio_handle->num_inflight = num_sub;
+        // hint the requests that couldn't be submitted
+        for (i = num_sub; i < (size_t) aio_size; ++i) {
+            adviseBlocks(aio_handle->offset_array[i] / blockSize, 1);
+        }
+    }
+
+    return num_cached;
+}
+
+size_t FileMgr::completeAsyncBlocks(struct async_io_handle *aio_handle,
+                                    bool wait,
+                                    ErrLogCallback *log_callback) {
+    size_t num_done = 0;
+#if defined(_ASYNC_IO) && !defined(WIN32) && !defined(_WIN32)
+    BlockCacheItem *item;
+
+    while (aio_handle->num_inflight) {
+        int num_events = fMgrOps->aio_getevents(fopsHandle, aio_handle,
+                                                wait ? 1 : 0,
+                                                aio_handle->num_inflight,
+                                                wait ? (unsigned int) -1 : 0);
+        if (num_events < 0) {
+            _log_errno_str(fopsHandle, fMgrOps, log_callback,
+                           (fdb_status) num_events, "READ", fileName);
+            break;
+        }
+        if (num_events == 0) {
+            break;
+        }
+        aio_handle->num_inflight -= num_events;
+        num_done += num_events;
+
+        struct io_event *io_evt = aio_handle->events;
+        for (; num_events > 0; --num_events, ++io_evt) {
+            void *block = io_evt->obj->u.c.buf;
+            bid_t bid = *((uint64_t *) io_evt->data) / blockSize;
+            if (io_evt->res != blockSize) {
+                continue;
+            }
+#ifdef __CRC32
+            if (checkCRC32(block) != FDB_RESULT_SUCCESS) {
+                continue;
+            }
+#endif
+            // the block may have been reused or read by others since the
+            // read was submitted
+            if (isWritable(bid)) {
+                continue;
+            }
+            if (BlockCacheManager::getInstance()->pin(this, bid, &item)) {
+                BlockCacheManager::getInstance()->unpin(item);
+                continue;
+            }
+            BlockCacheManager::getInstance()->write(this, bid, block,
+                                                    BCACHE_REQ_CLEAN, false);
+        }
+    }
+#else
+    (void)aio_handle;
+    (void)wait;
+    (void)log_callback;
+#endif
+    return num_done;
+}
+
+void FileMgr::adviseBlocks(bid_t bid, size_t num) {
+    if (fMgrOps != get_filemgr_ops() || isDirectIo()) {
+        // custom file ops have no page cache to hint, and direct I/O
+        // bypasses it
+        return;
+    }
+    filemgr_advise_willneed(fopsHandle, bid * blockSize, num * blockSize);
+}
+
+#define FILEMGR_WARMUP_MAGIC (0xfdb0ca4eeaa5e7ffULL)
+#define FILEMGR_WARMUP_SCORE_SHIFT (56)
+#define FILEMGR_WARMUP_BID_MASK ((1ULL << FILEMGR_WARMUP_SCORE_SHIFT) - 1)
+
+// Header of a warm-up sidecar file, followed by the array of entries.
+// Each entry holds a block ID in the lower 56 bits and its cache score in
+// the upper 8 bits.
+struct filemgr_warmup_header {
+    uint64_t magic;
+    uint64_t num_entries;
+    uint32_t blocksize;
+    // checksum of the entries
+    uint32_t crc;
+};
+
+static std::string _filemgr_warmup_filename(const char *filename) {
+    return std::string(filename) + ".warmup";
+}
+
+// Sidecar file written by a background thread when a file is closed
+struct filemgr_warmup_save {
+    thread_t tid;
+    std::atomic<bool> done;
+    std::string path;
+    uint8_t *buf;
+    size_t len;
+};
+
+// Background writes of the warm-up sidecar files that are not joined yet
+static std::mutex warmupSaveLock;
+static std::vector<filemgr_warmup_save *> warmupSaves;
+// Serializes the writes of the sidecar files, which share their temporary
+// file names
+static std::mutex warmupWriteLock;
+
+static fdb_status _filemgr_write_warmup_file(const std::string &path,
+                                             const uint8_t *buf, size_t len,
+                                             ErrLogCallback *log_callback) {
+    fdb_fileops_handle fops_handle;
+    struct filemgr_ops *ops = get_filemgr_ops();
+    ssize_t ret;
+
+    std::lock_guard<std::mutex> lh(warmupWriteLock);
+
+    // write a temporary file first, and then replace the sidecar file
+    std::string tmp_path = path + ".tmp";
+    fdb_status status = FileMgr::fileOpen(tmp_path.c_str(), ops, &fops_handle,
+                                          O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (status != FDB_RESULT_SUCCESS) {
+        fdb_log(log_callback, status,
+                "Failed to create a cache warm-up file '%s'",
+                tmp_path.c_str());
+        return status;
+    }
+    ret = ops->pwrite(fops_handle, (void *)buf, len, 0);
+    if (ret == (ssize_t)len) {
+        ret = ops->fsync(fops_handle);
+    } else if (ret >= 0) {
+        ret = FDB_RESULT_WRITE_FAIL;
+    }
+    FileMgr::fileClose(ops, fops_handle);
+
+    if (ret < 0) {
+        remove(tmp_path.c_str());
+        fdb_log(log_callback, (fdb_status)ret,
+                "Failed to write a cache warm-up file '%s'",
+                tmp_path.c_str());
+        return (fdb_status)ret;
+    }
+    if (rename(tmp_path.c_str(), path.c_str()) < 0) {
+        remove(tmp_path.c_str());
+        fdb_log(log_callback, FDB_RESULT_FILE_RENAME_FAIL,
+                "Failed to rename a cache warm-up file '%s' to '%s'",
+                tmp_path.c_str(), path.c_str());
+        return FDB_RESULT_FILE_RENAME_FAIL;
+    }
+    return FDB_RESULT_SUCCESS;
+}
+
+static void *_filemgr_warmup_save_thread(void *voidargs) {
+    filemgr_warmup_save *save = (filemgr_warmup_save *)voidargs;
+    // the log callback of the closed handle may not be valid any more
+    _filemgr_write_warmup_file(save->path, save->buf, save->len, NULL);
+    free(save->buf);
+    save->buf = NULL;
+    save->done.store(true);
+    return NULL;
+}
+
+// Join the finished background writes, or all of them if 'wait' is set
+static void _filemgr_join_warmup_saves(bool wait) {
+    void *ret;
+    std::lock_guard<std::mutex> lh(warmupSaveLock);
+    auto it = warmupSaves.begin();
+    while (it != warmupSaves.end()) {
+        if (wait || (*it)->done.load()) {
+            thread_join((*it)->tid, &ret);
+            delete *it;
+            it = warmupSaves.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void FileMgr::waitWarmupSaves() {
+    _filemgr_join_warmup_saves(true);
+}
+
+fdb_status FileMgr::saveWarmupSet(const char *filename,
+                                  bool background,
+                                  ErrLogCallback *log_callback) {
+    std::vector<std::pair<bid_t, uint8_t> > blocks;
+    struct filemgr_warmup_header header;
+    size_t i, len;
+
+    if (global_config.getNcacheBlock() <= 0) {
+        return FDB_RESULT_SUCCESS;
+    }
+    BlockCacheManager::getInstance()->getResidentBlocks(this, blocks);
+
+    len = sizeof(header) + blocks.size() * sizeof(uint64_t);
+    uint8_t *buf = (uint8_t *)malloc(len);
+    if (!buf) {
+        return FDB_RESULT_ALLOC_FAIL;
+    }
+    uint64_t *entries = (uint64_t *)(buf + sizeof(header));
+    for (i = 0; i < blocks.size(); ++i) {
+        uint64_t entry = (blocks[i].first & FILEMGR_WARMUP_BID_MASK) |
+            ((uint64_t)blocks[i].second << FILEMGR_WARMUP_SCORE_SHIFT);
+        entries[i] = _endian_encode(entry);
+    }
+    header.magic = _endian_encode((uint64_t)FILEMGR_WARMUP_MAGIC);
+    header.num_entries = _endian_encode((uint64_t)blocks.size());
+    header.blocksize = _endian_encode((uint32_t)blockSize);
+    header.crc = _endian_encode(get_checksum((uint8_t *)entries,
+                                             len - sizeof(header)));
+    memcpy(buf, &header, sizeof(header));
+
+    std::string path = _filemgr_warmup_filename(filename ? filename
+                                                         : fileName);
+    if (!background) {
+        // the pending background writes are older than this one
+        waitWarmupSaves();
+        fdb_status status = _filemgr_write_warmup_file(path, buf, len,
+                                                       log_callback);
+        free(buf);
+        return status;
+    }
+
+    filemgr_warmup_save *save = new filemgr_warmup_save();
+    save->done.store(false);
+    save->path = path;
+    save->buf = buf;
+    save->len = len;
+    _filemgr_join_warmup_saves(false);
+    std::lock_guard<std::mutex> lh(warmupSaveLock);
+    thread_create(&save->tid, _filemgr_warmup_save_thread, save);
+    warmupSaves.push_back(save);
+    return FDB_RESULT_SUCCESS;
+}
+
+static bool _filemgr_read_warmup_file(const std::string &path,
+                                      uint32_t blocksize,
+                                      std::vector<uint64_t> &entries) {
+    struct filemgr_warmup_header header;
+    fdb_fileops_handle fops_handle;
+    struct filemgr_ops *ops = get_filemgr_ops();
+    ssize_t ret;
+    size_t i, len;
+    cs_off_t file_size;
+
+    if (FileMgr::fileOpen(path.c_str(), ops, &fops_handle,
+                          O_RDONLY, 0644) != FDB_RESULT_SUCCESS) {
+        return false;
+    }
+    file_size = ops->file_size(fops_handle, path.c_str());
+    ret = ops->pread(fops_handle, &header, sizeof(header), 0);
+    if (ret != (ssize_t)sizeof(header) ||
+        _endian_decode(header.magic) != FILEMGR_WARMUP_MAGIC ||
+        _endian_decode(header.blocksize) != blocksize) {
+        FileMgr::fileClose(ops, fops_handle);
+        return false;
+    }
+    len = _endian_decode(header.num_entries) * sizeof(uint64_t);
+    if (file_size < 0 || (uint64_t)file_size != sizeof(header) + len) {
+        FileMgr::fileClose(ops, fops_handle);
+        return false;
+    }
+    entries.resize(len / sizeof(uint64_t));
+    ret = len ? ops->pread(fops_handle, entries.data(), len, sizeof(header))
+              : 0;
+    FileMgr::fileClose(ops, fops_handle);
+    if (ret != (ssize_t)len ||
+        !perform_integrity_check((uint8_t *)entries.data(), len,
+                                 _endian_decode(header.crc), CRC_UNKNOWN)) {
+        entries.clear();
+        return false;
+    }
+    for (i = 0; i < entries.size(); ++i) {
+        entries[i] = _endian_decode(entries[i]);
+    }
+    return true;
+}
+
+static bool _filemgr_warmup_entry_cmp(uint64_t a, uint64_t b) {
+    uint64_t score_a = a >> FILEMGR_WARMUP_SCORE_SHIFT;
+    uint64_t score_b = b >> FILEMGR_WARMUP_SCORE_SHIFT;
+    if (score_a != score_b) {
+        // higher scores first
+        return score_a > score_b;
+    }
+    return (a & FILEMGR_WARMUP_BID_MASK) < (b & FILEMGR_WARMUP_BID_MASK);
+}
+
+bool FileMgr::loadWarmupSet(uint64_t duration) {
+    std::vector<uint64_t> entries;
+    std::vector<bid_t> bids;
+    struct timeval begin, cur, gap;
+    size_t i, j;
+    size_t max_blocks = FILEMGR_WARMUP_READ_UNIT / blockSize;
+    void *buf;
+
+    // the sidecar file may still be written by the last close
+    waitWarmupSaves();
+    if (global_config.getNcacheBlock() <= 0 || isMapped() ||
+        !_filemgr_read_warmup_file(_filemgr_warmup_filename(fileName),
+                                   blockSize, entries)) {
+        return false;
+    }
+    std::sort(entries.begin(), entries.end(), _filemgr_warmup_entry_cmp);
+
+    malloc_align(buf, FDB_SECTOR_SIZE, FILEMGR_WARMUP_READ_UNIT);
+    if (!buf) {
+        return true;
+    }
+    gettimeofday(&begin, NULL);
+    for (i = 0; i < entries.size(); i = j) {
+        uint64_t score = entries[i] >> FILEMGR_WARMUP_SCORE_SHIFT;
+        uint64_t bcache_free_space =
+            BlockCacheManager::getInstance()->getNumFreeBlocks() * blockSize;
+        gettimeofday(&cur, NULL);
+        gap = _utime_gap(begin, cur);
+        if (prefetchStatus.load() == FILEMGR_PREFETCH_ABORT ||
+            (duration && gap.tv_sec >= (int64_t)duration) ||
+            bcache_free_space < FILEMGR_WARMUP_READ_UNIT) {
+            break;
+        }
+
+        // merge the following blocks with the same score into a single read
+        // as long as they are close enough
+        bids.clear();
+        bids.push_back(entries[i] & FILEMGR_WARMUP_BID_MASK);
+        for (j = i + 1; j < entries.size(); ++j) {
+            bid_t bid = entries[j] & FILEMGR_WARMUP_BID_MASK;
+            if ((entries[j] >> FILEMGR_WARMUP_SCORE_SHIFT) != score ||
+                bid - bids.front() >= max_blocks ||
+                bid - bids.back() > FILEMGR_WARMUP_MAX_GAP + 1) {
+                break;
+            }
+            bids.push_back(bid);
+        }
+        warmupBlocks(bids.data(), bids.size(), buf);
+    }
+    free_align(buf);
+
+    return true;
+}
+
+size_t FileMgr::warmupBlocks(const bid_t *bids, size_t num, void *buf) {
+    size_t i, num_loaded = 0;
+    uint64_t curr_pos = lastPos.load();
+    std::vector<bid_t> to_load;
+    BlockCacheItem *item;
+
+    for (i = 0; i < num; ++i) {
+        bid_t bid = bids[i];
+        if ((bid + 1) * blockSize > curr_pos) {
+            // blocks that were truncated away are not loaded
+            break;
+        }
+        if (isWritable(bid)) {
+            // uncommitted blocks are read through the regular path
+            continue;
+        }
+        if (BlockCacheManager::getInstance()->pin(this, bid, &item)) {
+            BlockCacheManager::getInstance()->unpin(item);
+            continue;
+        }
+        to_load.push_back(bid);
+    }
+    if (to_load.empty()) {
+        return 0;
+    }
+    bid_t first = to_load.front();
+    unsigned num_blocks = to_load.back() - first + 1;
+    if (readBlocks(buf, num_blocks, first) != (ssize_t)num_blocks * blockSize) {
+        return 0;
+    }
+
+    for (i = 0; i < to_load.size(); ++i) {
+        bid_t bid = to_load[i];
+        void *block = (uint8_t *)buf + (bid - first) * blockSize;
+#ifdef __CRC32
+        if (checkCRC32(block) != FDB_RESULT_SUCCESS) {
+            continue;
+        }
+#endif
+        // the block may have been cached or become writable during the read
+        if (BlockCacheManager::getInstance()->writeIfAbsent(this, bid, block)) {
+            ++num_loaded;
+        }
+    }
+    return num_loaded;
+}
+
+void FileMgr::removeWarmupSet(const char *filename) {
+    // a pending write must not recreate the sidecar file
+    waitWarmupSaves();
+    std::string path = _filemgr_warmup_filename(filename);
+    if (doesFileExist(path.c_str()) == FDB_RESULT_SUCCESS) {
+        remove(path.c_str());
+    }
+}
+
+void FileMgr::removeSecondaryCache(const char *filename) {
+    SecondaryBlockCache *scache = SecondaryBlockCache::getInstance();
+    if (scache) {
+        scache->removeFile(filename);
+    }
+}
+
 bool FileMgr::isFullyResident() {
     bool ret = false;
     if (global_config.getNcacheBlock() > 0) {
@@ -1987,7 +3141,14 @@ fdb_status FileMgr::read_FileMgr(bid_t bid, void *buf,
         return FDB_RESULT_READ_FAIL;
     }
 
-    if (global_config.getNcacheBlock() > 0) {
+    // committed blocks in the memory-mapped range are read from the mapping
+    // without going through the block cache, to avoid caching them twice
+    // (i.e., in both the OS page cache and the block cache).
+    bool mapped = isMapped() &&
+                  pos + blockSize <= mmapLen.load(std::memory_order_relaxed) &&
+                  !isWritable(bid);
+
+    if (global_config.getNcacheBlock() > 0 && !mapped) {
         lock_no = bid % DLOCK_MAX;
         (void)lock_no;
 
@@ -2116,7 +3277,7 @@ fdb_status FileMgr::read_FileMgr(bid_t bid, void *buf,
 #endif //__FILEMGR_DATA_PARTIAL_LOCK
         }
     } else {
-        if (!read_on_cache_miss) {
+        if (!read_on_cache_miss && !mapped) {
             const char *msg = "Read error: BID %" _F64 " in a database file "
                               "'%s': block cache is not enabled.\n";
             fdb_log(log_callback, FDB_RESULT_READ_FAIL, msg, bid,
@@ -2178,7 +3339,7 @@ fdb_status FileMgr::writeOffset(bid_t bid, uint64_t offset, uint64_t len,
 
     if (fMgrSb && fMgrSb->bmpExists()) {
         // block reusing is enabled
-        if (!fMgrSb->isWritable(bid)) {
+        if (!fMgrSb->isWritable(bid) && !isIndexExtentWritable(bid)) {
             const char *msg = "Write error: trying to write at the offset "
                               "%" _F64 " that is not identified as a reusable "
                               "block in a database file '%s'";
@@ -2186,7 +3347,7 @@ fdb_status FileMgr::writeOffset(bid_t bid, uint64_t offset, uint64_t len,
                     fileName);
             return FDB_RESULT_WRITE_FAIL;
         }
-    } else if (pos < curr_commit_pos) {
+    } else if (pos < curr_commit_pos && !isIndexExtentWritable(bid)) {
         // stale blocks are not reused yet
         if (fMgrSb == NULL ||
             (fMgrSb && pos >= fMgrSb->getConfig().num_sb * blockSize)) {
@@ -2495,6 +3656,10 @@ fdb_status FileMgr::commitBid(bid_t bid, uint64_t bmp_revnum, bool sync,
         releaseTempBuf(buf);
     }
 
+    if (fMgrSb) {
+        // the extents skipped by the allocator are not writable any more
+        fMgrSb->releaseSkippedExtents();
+    }
     if (fMgrSb && fMgrSb->bmpExists() &&
         fMgrSb->getCurAllocBid() != BLK_NOT_FOUND &&
         fMgrStatus.load() == FILE_NORMAL) {
@@ -2504,6 +3669,13 @@ fdb_status FileMgr::commitBid(bid_t bid, uint64_t bmp_revnum, bool sync,
         lastCommit.store(lastPos.load());
     }
 
+    // index node blocks handed out so far are now referenced by the header,
+    // while the rest of the current index extent is still writable
+    spin_lock(&indexExtentLock);
+    indexExtentCommit = indexExtentNext;
+    indexExtentCommitEnd = indexExtentEnd;
+    spin_unlock(&indexExtentLock);
+
     if (fMgrSb) {
         // Since some more blocks may be allocated after the header block
         // (for storing BMP data or system docs for stale info)
@@ -2690,6 +3862,8 @@ void FileMgr::removePending(FileMgr *old_file,
         return;
     }
 
+    FileMgr::removeWarmupSet(old_file->fileName);
+
     spin_lock(&old_file->fMgrLock);
     if (old_file->refCount.load() > 0) {
         // delay removing
@@ -2785,6 +3959,8 @@ fdb_status FileMgr::destroyFile(std::string filename,
                 status = FDB_RESULT_FILE_REMOVE_FAIL;
             }
         }
+        FileMgr::removeWarmupSet(filename.c_str());
+        FileMgr::removeSecondaryCache(filename.c_str());
     } else { // file not in memory, read on-disk to destroy older versions..
         FileMgr disk_file;
         strcpy(disk_file.fileName, filename.c_str());
@@ -2877,6 +4053,8 @@ fdb_status FileMgr::destroyFile(std::string filename,
                             status = FDB_RESULT_FILE_REMOVE_FAIL;
                         }
                     }
+                    FileMgr::removeWarmupSet(filename.c_str());
+                    FileMgr::removeSecondaryCache(filename.c_str());
                 }
             }
         }
@@ -2941,11 +4119,13 @@ bool FileMgr::isInPlaceCompactionSet() {
 
 void FileMgr::mutexOpenlock(FileMgrConfig *config) {
     init(config);
+    FileMgrMap::get()->lockAllFileNames();
     spin_lock(&fileMgrOpenlock);
 }
 
 void FileMgr::mutexOpenunlock(void) {
     spin_unlock(&fileMgrOpenlock);
+    FileMgrMap::get()->unlockAllFileNames();
 }
 
 void FileMgr::mutexLock() {
@@ -3098,6 +4278,25 @@ bool FileMgr::fhandleRemove(void *fhandle) {
     return ret;
 }
 
+bool FileMgr::fhandleIsLast(void *fhandle) {
+    bool ret;
+    struct filemgr_fhandle_idx_node *item;
+    struct avl_node *a;
+
+    spin_lock(&handleIdxLock);
+
+    a = avl_first(&handleIdx);
+    if (a) {
+        item = _get_entry(a, struct filemgr_fhandle_idx_node, avl);
+        ret = item->fhandle == fhandle && !avl_next(a);
+    } else {
+        ret = true;
+    }
+
+    spin_unlock(&handleIdxLock);
+    return ret;
+}
+
 void FileMgr::dirtyUpdateInit() {
     avl_init(&dirtyUpdateIdx, NULL);
     spin_init(&dirtyUpdateLock);
@@ -3473,6 +4672,7 @@ const char* FileMgr::getLatencyStatName(fdb_latency_stat_type stat) {
         case FDB_LATENCY_WAL_COMMIT:    return "wal_commit      ";
         case FDB_LATENCY_WAL_FLUSH:     return "wal_flush       ";
         case FDB_LATENCY_WAL_RELEASE:   return "wal_releas_items";
+        case FDB_LATENCY_ITR_NEXT_BATCH: return "itr-next-batch  ";
     }
     return NULL;
 }
@@ -43,6 +43,7 @@
 #include "staleblock.h"
 
 #include <atomic>
+#include <map>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -61,7 +62,14 @@
 #define FILEMGR_CANCEL_COMPACTION 0x40 // Cancel the compaction
 #define FILEMGR_EXCL_CREATE 0x80 // fail open if file already exists
 
+// number of blocks read at once while searching for the last DB header
+#define FILEMGR_HDR_SCAN_BLOCKS (64)
+
+// number of locks that serialize opens of the same file name
+#define FILEMGR_OPEN_LOCK_STRIPES (256)
+
 class SuperblockBase;
+class SecondaryCacheFile;
 
 class FileMgrConfig {
 public:
@@ -72,7 +80,9 @@ public:
           num_wal_shards(DEFAULT_NUM_WAL_PARTITIONS),
           num_bcache_shards(DEFAULT_NUM_BCACHE_PARTITIONS),
           block_reusing_threshold(65/*default*/),
-          num_keeping_headers(5/*default*/)
+          num_keeping_headers(5/*default*/),
+          index_block_extent(0), warmup_cache(false),
+          compressed_cache_size(0), secondary_cache_size(0)
     {
         encryption_key.algorithm = FDB_ENCRYPTION_NONE;
         memset(encryption_key.bytes, 0, sizeof(encryption_key.bytes));
@@ -96,7 +106,9 @@ public:
           num_wal_shards(_num_wal_shards),
           num_bcache_shards(_num_bcache_shards),
           block_reusing_threshold(_block_reusing_threshold),
-          num_keeping_headers(_num_keeping_headers)
+          num_keeping_headers(_num_keeping_headers),
+          index_block_extent(0), warmup_cache(false),
+          compressed_cache_size(0), secondary_cache_size(0)
     {
         encryption_key.algorithm = _algorithm;
         memset(encryption_key.bytes,
@@ -119,6 +131,11 @@ public:
                                       std::memory_order_relaxed);
         num_keeping_headers.store(config.num_keeping_headers.load(),
                                   std::memory_order_relaxed);
+        index_block_extent = config.index_block_extent;
+        warmup_cache = config.warmup_cache;
+        compressed_cache_size = config.compressed_cache_size;
+        secondary_cache_path = config.secondary_cache_path;
+        secondary_cache_size = config.secondary_cache_size;
     }
 
     void setBlockSize(int to) {
@@ -183,6 +200,23 @@ public:
         num_keeping_headers.store(to, std::memory_order_relaxed);
     }
 
+    void setIndexBlockExtent(uint64_t to) {
+        index_block_extent = to;
+    }
+
+    void setWarmupCache(bool to) {
+        warmup_cache = to;
+    }
+
+    void setCompressedCacheSize(uint64_t to) {
+        compressed_cache_size = to;
+    }
+
+    void setSecondaryCache(const char *path, uint64_t size) {
+        secondary_cache_path = path ? path : "";
+        secondary_cache_size = size;
+    }
+
     int getBlockSize() const {
         return blocksize;
     }
@@ -231,6 +265,26 @@ public:
         return num_keeping_headers.load(std::memory_order_relaxed);
     }
 
+    uint64_t getIndexBlockExtent() const {
+        return index_block_extent;
+    }
+
+    bool getWarmupCache() const {
+        return warmup_cache;
+    }
+
+    uint64_t getCompressedCacheSize() const {
+        return compressed_cache_size;
+    }
+
+    const std::string &getSecondaryCachePath() const {
+        return secondary_cache_path;
+    }
+
+    uint64_t getSecondaryCacheSize() const {
+        return secondary_cache_size;
+    }
+
 private:
     int blocksize;
     int ncacheblock;
@@ -247,6 +301,15 @@ private:
     // Number of the last commit headders whose stale blocks should
     // be kept for snapshot readers.
     std::atomic<uint64_t> num_keeping_headers;
+    // Number of blocks reserved at once for index nodes (0: disabled)
+    uint64_t index_block_extent;
+    // Record and reload the blocks resident in the block cache
+    bool warmup_cache;
+    // Size of the compressed block cache tier in bytes (0: disabled)
+    uint64_t compressed_cache_size;
+    // Cache file of the secondary block cache (empty: disabled)
+    std::string secondary_cache_path;
+    uint64_t secondary_cache_size;
 };
 
 #ifndef _LATENCY_STATS
@@ -282,6 +345,9 @@ struct async_io_handle {
     size_t queue_depth;
     size_t block_size;
     fdb_fileops_handle fops_handle;
+    // number of reads submitted by FileMgr::prefetchBlocks() and not
+    // completed yet
+    size_t num_inflight;
 };
 
 typedef int filemgr_fs_type_t;
@@ -337,6 +403,20 @@ public:
        free callback function for each */
     void freeEntries(filemgr_factory_free_cb iter_callback);
 
+    /* Acquires the open lock of the given file name. Opens of files whose
+       names map to different locks proceed in parallel, so that loading
+       one file does not hold up opening the others */
+    void lockFileName(const std::string &filename);
+
+    /* Releases the open lock of the given file name */
+    void unlockFileName(const std::string &filename);
+
+    /* Acquires the open locks of all file names, in a fixed order */
+    void lockAllFileNames(void);
+
+    /* Releases the open locks of all file names */
+    void unlockAllFileNames(void);
+
     /* Returns a singleton instance for the class */
     static FileMgrMap* get(void);
 
@@ -348,6 +428,8 @@ private:
     spin_t fileMapLock;
     // Unordered map that maps filenames to FileMgr instances
     std::unordered_map<std::string, FileMgr *> fileMap;
+    // Open locks striped by the hash of a file name
+    std::mutex fileNameLocks[FILEMGR_OPEN_LOCK_STRIPES];
 
     // Singleton creation
     static std::mutex initGuard;
@@ -395,6 +477,7 @@ enum {
 class Wal;
 class KvsHeader;
 class FileBlockCache;
+class BlockCacheItem;
 
 typedef struct {
     mutex_t mutex;
@@ -449,6 +532,24 @@ struct filemgr_dirty_update_block {
     bool immutable;
 };
 
+/**
+ * Named checkpoint pinning a committed DB header, so that the blocks reachable
+ * from the header are not reused while the checkpoint exists.
+ */
+struct filemgr_checkpoint {
+    // revision number of the pinned header
+    filemgr_header_revnum_t revnum;
+    // BID of the pinned header
+    bid_t bid;
+    // revision number of the last WAL flushing header of the pinned header
+    // (0 if there is no such header)
+    filemgr_header_revnum_t walFlushRevnum;
+    // number of blocks in the file when the checkpoint was created
+    bid_t allocLimit;
+    // value of the reused block counter when the checkpoint was created
+    uint64_t reuseSeqnum;
+};
+
 class KvsStatOperations {
 public:
     KvsStatOperations(FileMgr *_file)
@@ -628,6 +729,32 @@ public:
         return fileConfig;
     }
 
+    /**
+     * Return true if the file is opened for direct I/O, bypassing the page
+     * cache of the OS.
+     */
+    bool isDirectIo() const {
+        return fileConfig->getFlag() & _ARCH_O_DIRECT;
+    }
+
+    /**
+     * Get a sector-aligned I/O buffer of a given size. Single-block buffers
+     * are taken from the I/O buffer pool, which is not trimmed until
+     * shutdown, so this is only for buffers released right after the I/O.
+     *
+     * @param nbytes Size of the buffer
+     * @return Pointer to the I/O buffer, or NULL if allocation fails.
+     */
+    static void* getAlignedBuf(size_t nbytes);
+
+    /**
+     * Release an I/O buffer returned by getAlignedBuf().
+     *
+     * @param buf Pointer to the I/O buffer
+     * @param nbytes Size of the buffer
+     */
+    static void releaseAlignedBuf(void *buf, size_t nbytes);
+
     void setNewFile(FileMgr *to) {
         newFile = to;
     }
@@ -656,6 +783,10 @@ public:
         return bCache.load(std::memory_order_relaxed);
     }
 
+    SecondaryCacheFile* getSecondaryCacheFile() {
+        return sCacheFile;
+    }
+
     fdb_txn* getGlobalTxn() {
         return &globalTxn;
     }
@@ -743,6 +874,33 @@ public:
 
     bid_t alloc_FileMgr(ErrLogCallback *log_callback);
 
+    /**
+     * Allocate up to the given number of consecutive blocks. Reusable blocks
+     * are taken from the largest nearby free extent in the superblock bitmap
+     * if block reusing is in progress, otherwise the blocks are appended at
+     * the end of the file.
+     *
+     * @param nblocks Number of blocks requested.
+     * @param count_out Pointer to the number of blocks actually allocated,
+     *        which is between 1 and nblocks.
+     * @param log_callback Pointer to the log callback function.
+     * @return ID of the first allocated block.
+     */
+    bid_t allocExtent_FileMgr(uint64_t nblocks, uint64_t *count_out,
+                              ErrLogCallback *log_callback);
+
+    /**
+     * Allocate a block for an index node. If index block extents are enabled,
+     * index nodes are handed out from an extent reserved for them, so that
+     * they are co-located instead of being interleaved with document blocks.
+     * The blocks of a reserved extent that are not handed out yet remain
+     * writable across commits.
+     *
+     * @param log_callback Pointer to the log callback function.
+     * @return ID of the allocated block.
+     */
+    bid_t allocIndex_FileMgr(ErrLogCallback *log_callback);
+
     void allocMultiple(int nblock, bid_t *begin,
                        bid_t *end, ErrLogCallback *log_callback);
 
@@ -764,6 +922,263 @@ public:
 
     ssize_t readBlock(void *buf, bid_t bid);
 
+    /**
+     * Read consecutive blocks from the file with a single read, decrypting
+     * them if necessary.
+     *
+     * @param buf Pointer to the buffer of at least 'num_blocks' blocks.
+     * @param num_blocks Number of blocks to be read.
+     * @param start_bid ID of the first block.
+     * @return Number of bytes read, or an error code.
+     */
+    ssize_t readBlocks(void *buf, unsigned num_blocks, bid_t start_bid);
+
+    /**
+     * Pin a committed block in the block cache so that its contents can be
+     * accessed in place without being copied. The block is read into the cache
+     * first if it is not resident yet.
+     *
+     * @param bid ID of the block to be pinned.
+     * @param item Pointer to the place where the pinned cache item is returned.
+     * @param log_callback Pointer to log callback function.
+     * @return Address of the pinned block, or NULL if the block cache is
+     *         disabled or the block is still writable.
+     */
+    void *pinBlock(bid_t bid, BlockCacheItem **item,
+                   ErrLogCallback *log_callback);
+
+    /**
+     * Same as pinBlock(), but the block is not read on a cache miss.
+     *
+     * @param bid ID of the block to be pinned.
+     * @param item Pointer to the place where the pinned cache item is returned.
+     * @return Address of the pinned block, or NULL if the block is not
+     *         cached or is still writable.
+     */
+    void *pinCachedBlock(bid_t bid, BlockCacheItem **item);
+
+    /**
+     * Release a block pinned by pinBlock(). This can be called even after
+     * the file that owned the block is closed.
+     *
+     * @param item Pointer to the cache item returned by pinBlock().
+     */
+    static void unpinBlock(BlockCacheItem *item);
+
+    /**
+     * Map the file into memory for read-only access, if it is not mapped yet.
+     * Once mapped, the committed blocks in the mapped range are read directly
+     * from the mapping, bypassing the block cache, until the file is closed.
+     * The blocks appended after the mapping are read in the regular way.
+     *
+     * The file is mapped only while all of its opens are read-only; once it
+     * is opened for writing, it is no longer read through the mapping until
+     * it is closed.
+     *
+     * @return True if the file is mapped.
+     */
+    bool mapFile();
+
+    /**
+     * Stop reading the file through its mapping, e.g., when the file is
+     * opened for writing. The mapping itself is released by unmapFile() when
+     * the file is closed, as other threads may still be reading from it.
+     */
+    void disableMapping();
+
+    /**
+     * Check if the file became shorter than its mapping (e.g., truncated by
+     * another process), and stop using the mapping if so, as accessing the
+     * mapped pages beyond the end of the file raises SIGBUS.
+     *
+     * @return True if the file is still mapped.
+     */
+    bool checkMapping();
+
+    /**
+     * Unmap the file. This should be called only when no one is accessing
+     * the file.
+     */
+    void unmapFile();
+
+    bool isMapped() const {
+        return mmapAddr.load(std::memory_order_acquire) != nullptr;
+    }
+
+    /**
+     * Notify that a reader starts (or stops) scanning the mapped file in
+     * the forward direction, so that the mapping is advised for sequential
+     * access while there is at least one forward scanner.
+     *
+     * @param begin True if a forward scan begins, false if it ends.
+     */
+    void adviseSequentialScan(bool begin);
+
+    /**
+     * Ask the OS to prefetch a region of the mapped file, which is going to
+     * be read soon (e.g., by a backward scan that the OS readahead does not
+     * detect).
+     *
+     * @param offset Start offset of the region.
+     * @param len Length of the region.
+     */
+    void prefetchMapped(uint64_t offset, uint64_t len);
+
+    /**
+     * Start loading the given committed blocks into the block cache if they
+     * are not cached yet, without waiting for the reads. If the async I/O
+     * handle is given, the missing blocks are read through async I/O and
+     * inserted into the block cache by completeAsyncBlocks(). The reads
+     * submitted through the handle before are completed first, as their
+     * buffers are reused. The missing blocks that are not submitted (all of
+     * them without the handle) are hinted to the OS to be read into the
+     * page cache. Read failures are ignored, as they are reported again by
+     * the actual read of the block.
+     *
+     * @param bids Array of block IDs, sorted in the ascending order.
+     * @param num Number of block IDs in the array.
+     * @param aio_handle Pointer to the initialized async I/O handle, or NULL.
+     * @param log_callback Pointer to the log callback function.
+     * @return Number of blocks that didn't need to be read from the file.
+     */
+    size_t prefetchBlocks(const bid_t *bids, size_t num,
+                          struct async_io_handle *aio_handle,
+                          ErrLogCallback *log_callback);
+
+    /**
+     * Load the blocks read by the async reads that prefetchBlocks()
+     * submitted through a given handle into the block cache.
+     *
+     * @param aio_handle Pointer to the async I/O handle.
+     * @param wait True to wait until all the submitted reads are completed,
+     *        false to load the blocks of the completed ones only.
+     * @param log_callback Pointer to the log callback function.
+     * @return Number of the reads completed.
+     */
+    size_t completeAsyncBlocks(struct async_io_handle *aio_handle, bool wait,
+                               ErrLogCallback *log_callback);
+
+    /**
+     * Record the IDs and cache scores of the blocks of this file that are
+     * resident in the block cache into the warm-up sidecar file. The previous
+     * sidecar file is replaced atomically.
+     *
+     * @param filename Name of the database file that the sidecar file is
+     *        named after, or NULL to use the name of this file.
+     * @param background Flag indicating if the sidecar file is written by a
+     *        background thread. Only the list of the resident blocks is
+     *        taken before returning.
+     * @param log_callback Pointer to the log callback function.
+     * @return FDB_RESULT_SUCCESS on success.
+     */
+    fdb_status saveWarmupSet(const char *filename,
+                             bool background,
+                             ErrLogCallback *log_callback);
+
+    /**
+     * Wait until all the warm-up sidecar files being written in the
+     * background are written.
+     */
+    static void waitWarmupSaves();
+
+    /**
+     * Reload the blocks recorded in the warm-up sidecar file into the block
+     * cache, in the descending order of their scores, and in the ascending
+     * order of their IDs for the same score. Nearby blocks are loaded by a
+     * single large read. The reload stops when the prefetch is aborted, when
+     * the block cache runs out of free blocks, or when the given duration
+     * has passed.
+     *
+     * @param duration Max duration of the reload in seconds (0: no limit).
+     * @return True if a valid sidecar file exists.
+     */
+    bool loadWarmupSet(uint64_t duration);
+
+    /**
+     * Remove the warm-up sidecar file of a given database file, if exists.
+     *
+     * @param filename Name of the database file.
+     */
+    static void removeWarmupSet(const char *filename);
+
+    /**
+     * Discard the blocks kept in the secondary block cache for a given
+     * database file that is closed.
+     *
+     * @param filename Name of the database file.
+     */
+    static void removeSecondaryCache(const char *filename);
+
+    /**
+     * Pin the given committed header under the given name.
+     *
+     * @param name Name of the checkpoint.
+     * @param revnum Revision number of the header to be pinned.
+     * @param bid BID of the header to be pinned.
+     * @param wal_flush_revnum Revision number of the last WAL flushing header
+     *        of the pinned header, or 0 if it does not exist.
+     * @return True if the checkpoint is created, false if a checkpoint with
+     *         the same name already exists.
+     */
+    bool addCheckpoint(const std::string& name,
+                       filemgr_header_revnum_t revnum,
+                       bid_t bid,
+                       filemgr_header_revnum_t wal_flush_revnum);
+
+    /**
+     * Unpin the header pinned by the given checkpoint.
+     *
+     * @param name Name of the checkpoint.
+     * @return True if the checkpoint is removed, false if it does not exist.
+     */
+    bool removeCheckpoint(const std::string& name);
+
+    /**
+     * Get the checkpoint of the given name.
+     *
+     * @param name Name of the checkpoint.
+     * @param checkpoint_out Pointer to the place where the checkpoint info
+     *        will be copied.
+     * @return True if the checkpoint exists.
+     */
+    bool getCheckpoint(const std::string& name,
+                       struct filemgr_checkpoint *checkpoint_out);
+
+    /**
+     * Check if the header with the given revision number is pinned by any
+     * checkpoint.
+     */
+    bool isCheckpointRevnum(filemgr_header_revnum_t revnum);
+
+    bool hasCheckpoints() const {
+        return numCheckpoints.load(std::memory_order_relaxed) > 0;
+    }
+
+    /**
+     * Check if the given block, which became stale by the commit of the
+     * given revision number, is still reachable from any pinned header and
+     * thus cannot be reused. A block is reachable from a pinned header if it
+     * was allocated before the checkpoint was created, and was not stale yet
+     * as of the last WAL flushing header of the pinned header.
+     *
+     * Caller should grab the checkpoint lock.
+     *
+     * @param stale_revnum Revision number of the commit that made the block
+     *        stale.
+     * @param bid BID of the block.
+     * @return True if the block is pinned.
+     */
+    bool isBlockPinned_UNLOCKED(filemgr_header_revnum_t stale_revnum,
+                                bid_t bid);
+
+    void acquireCheckpointLock() {
+        spin_lock(&checkpointLock);
+    }
+
+    void releaseCheckpointLock() {
+        spin_unlock(&checkpointLock);
+    }
+
     fdb_status writeOffset(bid_t bid, uint64_t offset,
                            uint64_t len, void *buf, bool final_write,
                            ErrLogCallback *log_callback);
@@ -773,8 +1188,30 @@ public:
 
     ssize_t writeBlocks(void *buf, unsigned num_blocks, bid_t start_bid);
 
+    /**
+     * Write consecutive blocks located in separate buffers (e.g., in the
+     * block cache) with vectored writes, without copying them into a
+     * single buffer.
+     *
+     * @param blocks Array of pointers to the blocks
+     * @param num_blocks Number of the blocks
+     * @param start_bid ID of the first block
+     * @return Number of bytes written, or an error code if the write fails.
+     */
+    ssize_t writeBlockVector(void * const *blocks, unsigned num_blocks,
+                             bid_t start_bid);
+
     int isWritable(bid_t bid);
 
+    /**
+     * Check if the given block belongs to the part of the extent reserved
+     * for index nodes that is not referenced by any committed header yet.
+     *
+     * @param bid ID of the block.
+     * @return True if the block is writable as a part of the index extent.
+     */
+    bool isIndexExtentWritable(bid_t bid);
+
     fdb_status commit_FileMgr(bool sync, ErrLogCallback *log_callback);
 
     /**
@@ -856,6 +1293,15 @@ public:
      */
     bool fhandleRemove(void *fhandle);
 
+    /**
+     * Check if the given FDB file handle is the only one in the superblock's
+     * global index.
+     *
+     * @param fhandle Pointer to FDB file handle.
+     * @return True if there is no other FDB file handle.
+     */
+    bool fhandleIsLast(void *fhandle);
+
     static void setCompactionState(FileMgr *old_file,
                                    FileMgr *new_file,
                                    file_status_t status);
@@ -880,6 +1326,10 @@ public:
 
     static uint64_t getBcacheUsedSpace(void);
 
+    static uint64_t getCompressedCacheUsedSpace(void);
+
+    static uint64_t getSecondaryCacheUsedSpace(void);
+
     /**
      * This is a helper function that does 'file open ops' on a file
      *
@@ -1126,6 +1576,16 @@ public:
 
 private:
 
+    /**
+     * Body of open(), invoked while holding the open lock of the file name.
+     * fileMgrOpenlock is held only while the map of opened files is looked
+     * up or updated, not while a new file is being loaded from disk.
+     */
+    static filemgr_open_result openFile(std::string filename,
+                                        struct filemgr_ops *ops,
+                                        FileMgrConfig *config,
+                                        ErrLogCallback *log_callback);
+
     /**
      * Update the previous / next file pointers for a given file
      */
@@ -1154,6 +1614,23 @@ private:
      */
     fdb_status readHeader(ErrLogCallback *log_callback);
 
+    /**
+     * Read a block for the backward DB header scan of readHeader(), through
+     * a buffer holding up to FILEMGR_HDR_SCAN_BLOCKS blocks that end at the
+     * block being read.
+     *
+     * @param buf Pointer to the buffer where the block is copied.
+     * @param bid ID of the block to be read.
+     * @param start_bid ID of the block where the scan started.
+     * @param scan_buf Pointer to the scan buffer, allocated on the first use.
+     * @param scan_begin Pointer to the first block ID in the scan buffer.
+     * @param scan_end Pointer to the last block ID in the scan buffer.
+     * @return Number of bytes read, or an error code.
+     */
+    ssize_t readHeaderBlock(void *buf, bid_t bid, bid_t start_bid,
+                            uint8_t **scan_buf,
+                            bid_t *scan_begin, bid_t *scan_end);
+
     /**
      * Load the superblock
      *
@@ -1167,11 +1644,35 @@ private:
      */
     void freeFileHandleIdx();
 
+    /**
+     * Remember the given reused blocks if any checkpoint exists, so that
+     * they are not regarded as a part of the headers pinned by the
+     * checkpoints. Should be called while holding the file's spin lock.
+     *
+     * @param bid ID of the first block.
+     * @param count Number of the blocks.
+     */
+    void markReusedBlocks(bid_t bid, uint64_t count);
+
     /**
      * Spawn a thread to prefetch index blocks from the file
      */
     void prefetch(ErrLogCallback *log_callback);
 
+    /**
+     * Load the given committed blocks into the block cache by reading the
+     * range from the first to the last block at once. The blocks that are
+     * already cached or not committed yet are skipped, and are checked again
+     * under the cache lock when the blocks read are cached.
+     *
+     * @param bids Array of block IDs, sorted in the ascending order and
+     *        spanning at most FILEMGR_WARMUP_READ_UNIT bytes.
+     * @param num Number of block IDs in the array.
+     * @param buf Aligned buffer of FILEMGR_WARMUP_READ_UNIT bytes.
+     * @return Number of blocks loaded into the block cache.
+     */
+    size_t warmupBlocks(const bid_t *bids, size_t num, void *buf);
+
     /**
      * CRC32 check for a given buffer
      *
@@ -1181,7 +1682,17 @@ private:
     fdb_status checkCRC32(void *buf);
 
     /**
-     * Get the I/O buffer available from the buffer pool
+     * Ask the OS to read the given run of consecutive blocks into the page
+     * cache in the background.
+     *
+     * @param bid ID of the first block.
+     * @param num Number of blocks.
+     */
+    void adviseBlocks(bid_t bid, size_t num);
+
+    /**
+     * Get the I/O buffer available from the buffer pool. Buffers released by
+     * the calling thread are reused first without grabbing the pool lock.
      */
     static void* getTempBuf();
 
@@ -1224,6 +1735,8 @@ private:
     FileMgr *prevFile;                // Pointer to prev file upon compaction
     std::string oldFileName;          // Old file name before compaction
     std::atomic<FileBlockCache *> bCache;
+    // Blocks of the file in the secondary block cache (NULL if disabled)
+    SecondaryCacheFile *sCacheFile;
     fdb_txn globalTxn;
     bool inPlaceCompaction;
     filemgr_fs_type_t fsType;
@@ -1276,6 +1789,43 @@ private:
     // Spin lock for file handle index
     spin_t handleIdxLock;
 
+    // Read-only memory mapping of the file that reads go through (NULL if
+    // not mapped, or if the mapping is disabled)
+    std::atomic<uint8_t *> mmapAddr;
+    // Address of the mapping, which is kept until the file is closed
+    uint8_t *mmapBase;
+    // Length of the mapping
+    std::atomic<uint64_t> mmapLen;
+    // Number of forward scanners over the mapping
+    uint32_t mmapSeqScanners;
+    // True if the file must not be read through a mapping (e.g., it is
+    // opened for writing)
+    std::atomic<bool> mmapDisabled;
+    // True if the file has been opened for writing since it was opened
+    // last, in which case its resident blocks are recorded when it is closed
+    std::atomic<bool> openedForWrite;
+
+    // Named checkpoints pinning committed headers
+    std::map<std::string, filemgr_checkpoint> checkpoints;
+    std::atomic<size_t> numCheckpoints;
+    // Reused blocks allocated while any checkpoint exists, and the value of
+    // the reused block counter at their allocation
+    std::unordered_map<bid_t, uint64_t> reusedBlocks;
+    uint64_t reusedBlockCounter;
+    // Spin lock for the checkpoint related variables above
+    spin_t checkpointLock;
+
+    // Next block to hand out and the end (exclusive) of the extent
+    // reserved for index nodes
+    bid_t indexExtentNext;
+    bid_t indexExtentEnd;
+    // Part of the index extent that was not handed out at the last commit.
+    // It is writable even though it precedes the last commit position.
+    bid_t indexExtentCommit;
+    bid_t indexExtentCommitEnd;
+    // Spin lock for the index extent variables above
+    spin_t indexExtentLock;
+
     // Global Atomic variable to track if filemgr's config has been initialized
     static std::atomic<bool> fileMgrInitialized;
     // Global mutex to synchronize the initialization of filemgr's configs
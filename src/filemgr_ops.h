@@ -34,6 +34,65 @@ static inline fdb_fileops_handle fd_to_handle(int fd) {
     return (fdb_fileops_handle)(intptr_t)fd;
 }
 
+/**
+ * Access pattern hints for a memory-mapped file.
+ */
+typedef enum {
+    FILEMGR_MAP_ADVICE_NORMAL,
+    FILEMGR_MAP_ADVICE_SEQUENTIAL,
+    FILEMGR_MAP_ADVICE_WILLNEED
+} filemgr_map_advice_t;
+
+/**
+ * Map the first 'length' bytes of a file opened by the default file
+ * operations (i.e., get_filemgr_ops()) into memory for read-only access.
+ *
+ * @param fops_handle File handle returned by the default open operation.
+ * @param length Number of bytes to be mapped.
+ * @return Address of the mapping, or NULL if it is not available.
+ */
+void *filemgr_map_file(fdb_fileops_handle fops_handle, size_t length);
+
+/**
+ * Unmap the memory mapped by filemgr_map_file().
+ */
+void filemgr_unmap_file(void *addr, size_t length);
+
+/**
+ * Give the OS a hint about the access pattern of a mapped region. The
+ * address is rounded down to the page boundary.
+ */
+void filemgr_advise_map(void *addr, size_t length,
+                        filemgr_map_advice_t advice);
+
+/**
+ * Ask the OS to read a region of a file opened by the default file
+ * operations (i.e., get_filemgr_ops()) into the page cache in the
+ * background. This is only a hint, and does nothing where the platform
+ * doesn't support it.
+ *
+ * @param fops_handle File handle returned by the default open operation.
+ * @param offset Offset to the beginning of the region.
+ * @param length Length of the region.
+ */
+void filemgr_advise_willneed(fdb_fileops_handle fops_handle,
+                             cs_off_t offset, size_t length);
+
+/**
+ * Write buffers of the same size to consecutive regions of a file opened by
+ * the default file operations (i.e., get_filemgr_ops()), submitting them
+ * together as vectored writes where the platform supports them.
+ *
+ * @param fops_handle File handle returned by the default open operation.
+ * @param bufs Array of pointers to the buffers to be written.
+ * @param num_bufs Number of the buffers.
+ * @param buf_len Size of each buffer.
+ * @param offset Offset in the file where the first buffer is written.
+ * @return Number of bytes written, or an error code if the write fails.
+ */
+fdb_ssize_t filemgr_pwritev(fdb_fileops_handle fops_handle, void * const *bufs,
+                            int num_bufs, size_t buf_len, cs_off_t offset);
+
 #ifdef __cplusplus
 }
 #endif
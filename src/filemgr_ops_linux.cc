@@ -16,6 +16,8 @@
  */
 
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <stdint.h>
 #include <fcntl.h>
@@ -223,7 +225,7 @@ int _filemgr_aio_prep_read(fdb_fileops_handle fops_handle,
     if (!aio_handle) {
         return FDB_RESULT_INVALID_ARGS;
     }
-    io_prep_pread(aio_handle->ioq[aio_idx], aio_handle->fd,
+    io_prep_pread(aio_handle->ioq[aio_idx], handle_to_fd(fops_handle),
                   aio_handle->aio_buf + (aio_idx * aio_handle->block_size),
                   aio_handle->block_size,
                   (offset / aio_handle->block_size) * aio_handle->block_size);
@@ -499,4 +501,112 @@ struct filemgr_ops * get_linux_filemgr_ops()
     return &linux_ops;
 }
 
+void *filemgr_map_file(fdb_fileops_handle fops_handle, size_t length)
+{
+    void *addr = mmap(NULL, length, PROT_READ, MAP_SHARED,
+                      handle_to_fd(fops_handle), 0);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+    return addr;
+}
+
+void filemgr_unmap_file(void *addr, size_t length)
+{
+    munmap(addr, length);
+}
+
+void filemgr_advise_map(void *addr, size_t length,
+                        filemgr_map_advice_t advice)
+{
+    static const uintptr_t page_mask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+    uintptr_t begin = (uintptr_t)addr & ~page_mask;
+    int os_advice;
+
+    switch (advice) {
+    case FILEMGR_MAP_ADVICE_SEQUENTIAL:
+        os_advice = MADV_SEQUENTIAL;
+        break;
+    case FILEMGR_MAP_ADVICE_WILLNEED:
+        os_advice = MADV_WILLNEED;
+        break;
+    default:
+        os_advice = MADV_NORMAL;
+        break;
+    }
+    // advice is only a hint .. ignore failures
+    (void)madvise((void *)begin, length + ((uintptr_t)addr - begin), os_advice);
+}
+
+void filemgr_advise_willneed(fdb_fileops_handle fops_handle,
+                             cs_off_t offset, size_t length)
+{
+#if defined(__linux__) || defined(__FreeBSD__)
+    // advice is only a hint .. ignore failures
+    (void)posix_fadvise(handle_to_fd(fops_handle), offset, length,
+                        POSIX_FADV_WILLNEED);
+#else
+    (void)fops_handle;
+    (void)offset;
+    (void)length;
+#endif
+}
+
+fdb_ssize_t filemgr_pwritev(fdb_fileops_handle fops_handle, void * const *bufs,
+                            int num_bufs, size_t buf_len, cs_off_t offset)
+{
+    ssize_t total = 0;
+#if defined(__linux__) || defined(__FreeBSD__)
+    struct iovec iov[FILEMGR_PWRITEV_MAX_BUFS];
+    // number of buffers entirely written, and the bytes written from the
+    // next buffer if the last write was partial
+    int done = 0;
+    size_t partial = 0;
+
+    while (done < num_bufs) {
+        int n = num_bufs - done;
+        if (n > FILEMGR_PWRITEV_MAX_BUFS) {
+            n = FILEMGR_PWRITEV_MAX_BUFS;
+        }
+        for (int i = 0; i < n; ++i) {
+            iov[i].iov_base = bufs[done + i];
+            iov[i].iov_len = buf_len;
+        }
+        iov[0].iov_base = (uint8_t *)iov[0].iov_base + partial;
+        iov[0].iov_len -= partial;
+
+        ssize_t rv;
+        do {
+            rv = pwritev(handle_to_fd(fops_handle), iov, n, offset + total);
+        } while (rv == -1 && errno == EINTR); // LCOV_EXCL_LINE
+
+        if (rv < 0) {
+            return (ssize_t) convert_errno_to_fdb_status(errno, // LCOV_EXCL_LINE
+                                                         FDB_RESULT_WRITE_FAIL);
+        }
+        if (rv == 0) {
+            break; // LCOV_EXCL_LINE
+        }
+        total += rv;
+        partial += rv;
+        done += partial / buf_len;
+        partial %= buf_len;
+    }
+#else
+    // pwritev() is not available .. write the buffers one by one
+    for (int i = 0; i < num_bufs; ++i) {
+        ssize_t rv = _filemgr_linux_pwrite(fops_handle, bufs[i], buf_len,
+                                           offset + total);
+        if (rv < 0) {
+            return rv;
+        }
+        total += rv;
+        if ((size_t)rv != buf_len) {
+            break;
+        }
+    }
+#endif
+    return total;
+}
+
 #endif
@@ -307,4 +307,55 @@ struct filemgr_ops * get_win_filemgr_ops()
     return &win_ops;
 }
 
+// Memory-mapped reads are not supported on Windows yet; the caller falls back
+// to the regular read path.
+void *filemgr_map_file(fdb_fileops_handle fops_handle, size_t length)
+{
+    (void)fops_handle;
+    (void)length;
+    return NULL;
+}
+
+void filemgr_unmap_file(void *addr, size_t length)
+{
+    (void)addr;
+    (void)length;
+}
+
+void filemgr_advise_map(void *addr, size_t length,
+                        filemgr_map_advice_t advice)
+{
+    (void)addr;
+    (void)length;
+    (void)advice;
+}
+
+void filemgr_advise_willneed(fdb_fileops_handle fops_handle,
+                             cs_off_t offset, size_t length)
+{
+    (void)fops_handle;
+    (void)offset;
+    (void)length;
+}
+
+// Vectored writes are not supported on Windows; the buffers are written
+// one by one.
+fdb_ssize_t filemgr_pwritev(fdb_fileops_handle fops_handle, void * const *bufs,
+                            int num_bufs, size_t buf_len, cs_off_t offset)
+{
+    ssize_t total = 0;
+    for (int i = 0; i < num_bufs; ++i) {
+        ssize_t rv = _filemgr_win_pwrite(fops_handle, bufs[i], buf_len,
+                                         offset + total);
+        if (rv < 0) {
+            return rv;
+        }
+        total += rv;
+        if ((size_t)rv != buf_len) {
+            break;
+        }
+    }
+    return total;
+}
+
 #endif
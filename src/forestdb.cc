@@ -24,6 +24,10 @@
 #include <sys/time.h>
 #endif
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include "libforestdb/forestdb.h"
 #include "fdb_internal.h"
 #include "file_handle.h"
@@ -38,6 +42,7 @@
 #include "btreeblock.h"
 #include "common.h"
 #include "wal.h"
+#include "arena.h"
 #include "filemgr_ops.h"
 #include "configuration.h"
 #include "internal_types.h"
@@ -61,6 +66,9 @@
 #endif
 #endif
 
+// number of blocks that WAL restore keeps loading ahead of its cursor
+#define FDB_RESTORE_PREFETCH_BLOCKS (256)
+
 
 static std::atomic<uint8_t> fdb_initialized(0);
 static volatile uint32_t fdb_open_inprog = 0;
@@ -298,6 +306,72 @@ void fdb_dummy_log_callback(int err_code, const char *err_msg, void *ctx_data)
     return;
 }
 
+struct _fdb_restore_prefetch {
+    struct async_io_handle *aio_handle;
+    bid_t *bids;
+    bid_t begin;
+    bid_t end;
+};
+
+// Load the blocks in front of the WAL restore cursor into the block cache.
+// The blocks are read concurrently through async I/O (or the OS readahead
+// for a mapped file), while the documents are still decoded and inserted
+// into the WAL one by one in the offset order.
+static void _fdb_restore_wal_prefetch(FdbKvsHandle *handle,
+                                      struct _fdb_restore_prefetch *pf,
+                                      uint64_t offset, uint64_t limit)
+{
+    FileMgr *file = handle->file;
+    uint32_t blocksize = file->getBlockSize();
+    bid_t cur = offset / blocksize;
+    bid_t last = (limit + blocksize - 1) / blocksize;
+    bid_t bid, from;
+    size_t num = 0;
+
+    if (pf->aio_handle && pf->aio_handle->num_inflight) {
+        // load the blocks read so far, before the cursor reaches them
+        file->completeAsyncBlocks(pf->aio_handle, false,
+                                  &handle->log_callback);
+    }
+    if (cur >= pf->begin && cur + FDB_RESTORE_PREFETCH_BLOCKS / 2 < pf->end) {
+        // enough blocks are loaded ahead
+        return;
+    }
+    from = (cur >= pf->begin && cur < pf->end) ? pf->end : cur;
+    if (cur + FDB_RESTORE_PREFETCH_BLOCKS < last) {
+        last = cur + FDB_RESTORE_PREFETCH_BLOCKS;
+    }
+    if (from >= last) {
+        return;
+    }
+
+    if (file->isMapped()) {
+        file->prefetchMapped(from * blocksize, (last - from) * blocksize);
+    } else {
+        if (!pf->bids) {
+            pf->bids = (bid_t *)malloc(sizeof(bid_t) *
+                                       FDB_RESTORE_PREFETCH_BLOCKS);
+            pf->aio_handle = (struct async_io_handle *)
+                             calloc(1, sizeof(struct async_io_handle));
+            pf->aio_handle->queue_depth = ASYNC_IO_QUEUE_DEPTH;
+            pf->aio_handle->block_size = blocksize;
+            pf->aio_handle->fops_handle = file->getFopsHandle();
+            if (file->getOps()->aio_init(file->getFopsHandle(),
+                                         pf->aio_handle) != FDB_RESULT_SUCCESS) {
+                free(pf->aio_handle);
+                pf->aio_handle = NULL;
+            }
+        }
+        for (bid = from; bid < last; ++bid) {
+            pf->bids[num++] = bid;
+        }
+        file->prefetchBlocks(pf->bids, num, pf->aio_handle,
+                             &handle->log_callback);
+    }
+    pf->begin = (cur >= pf->begin && cur < pf->end) ? pf->begin : cur;
+    pf->end = last;
+}
+
 INLINE void _fdb_restore_wal(FdbKvsHandle *handle,
                              fdb_restore_mode_t mode,
                              bid_t hdr_bid,
@@ -314,6 +388,7 @@ INLINE void _fdb_restore_wal(FdbKvsHandle *handle,
     uint64_t cur_bmp_revnum = (uint64_t)-1;
     bid_t next_doc_block = BLK_NOT_FOUND;
     struct _fdb_key_cmp_info cmp_info;
+    struct _fdb_restore_prefetch prefetch;
     Wal *wal = file->getWal();
     ErrLogCallback *log_callback;
 
@@ -357,6 +432,9 @@ INLINE void _fdb_restore_wal(FdbKvsHandle *handle,
     }
     cmp_info.kvs_config = handle->kvs_config;
     cmp_info.kvs = handle->kvs;
+    prefetch.aio_handle = NULL;
+    prefetch.bids = NULL;
+    prefetch.begin = prefetch.end = 0;
 
     start_bmp_revnum = _fdb_get_bmp_revnum(handle, last_wal_flush_hdr_bid);
     stop_bmp_revnum= _fdb_get_bmp_revnum(handle, hdr_bid);
@@ -399,6 +477,7 @@ INLINE void _fdb_restore_wal(FdbKvsHandle *handle,
             doc_scan_limit = filesize;
         }
 
+        _fdb_restore_wal_prefetch(handle, &prefetch, offset, doc_scan_limit);
         if (!handle->dhandle->checkBuffer_Docio(offset / blocksize,
                                 cur_bmp_revnum)) {
             // not a document block .. move to next block
@@ -558,6 +637,14 @@ INLINE void _fdb_restore_wal(FdbKvsHandle *handle,
         }
     } while(true);
 
+    if (prefetch.aio_handle) {
+        file->completeAsyncBlocks(prefetch.aio_handle, true,
+                                  &handle->log_callback);
+        file->getOps()->aio_destroy(file->getFopsHandle(), prefetch.aio_handle);
+        free(prefetch.aio_handle);
+    }
+    free(prefetch.bids);
+
     // wal commit
     if (!handle->shandle) {
         wal->commit_Wal(file->getGlobalTxn(), NULL, &handle->log_callback);
@@ -708,7 +795,8 @@ fdb_status fdb_init(fdb_config *config)
         // We temporarily disable validity checking of block cache size
         // on Android platform at this time.
         double ram_size = (double) get_memory_size();
-        if (ram_size * BCACHE_MEMORY_THRESHOLD < (double) _config.buffercache_size) {
+        if (ram_size * BCACHE_MEMORY_THRESHOLD <
+            (double) (_config.buffercache_size + _config.compressed_cache_size)) {
             spin_unlock(&initial_lock);
             return FDB_RESULT_TOO_BIG_BUFFER_CACHE;
         }
@@ -716,6 +804,9 @@ fdb_status fdb_init(fdb_config *config)
         // initialize file manager and block cache
         f_config.setBlockSize(_config.blocksize);
         f_config.setNcacheBlock(_config.buffercache_size / _config.blocksize);
+        f_config.setCompressedCacheSize(_config.compressed_cache_size);
+        f_config.setSecondaryCache(_config.secondary_cache_path,
+                                   _config.secondary_cache_size);
         f_config.setSeqtreeOpt(_config.seqtree_opt);
         FileMgr::init(&f_config);
         FileMgr::setLazyFileDeletion(true,
@@ -916,6 +1007,86 @@ fdb_status fdb_open_custom_cmp(fdb_file_handle **ptr_fhandle,
     return fs;
 }
 
+struct _fdb_open_many_args {
+    fdb_open_request *requests;
+    // indices of the requests in the order of their priorities
+    std::vector<size_t> order;
+    // position in 'order' of the next request to be opened
+    std::atomic<size_t> next;
+    fdb_open_callback_fn callback;
+    void *ctx;
+};
+
+static void *_fdb_open_many_thread(void *voidargs)
+{
+    struct _fdb_open_many_args *args = (struct _fdb_open_many_args *)voidargs;
+    size_t pos;
+
+    while ((pos = args->next.fetch_add(1)) < args->order.size()) {
+        size_t idx = args->order[pos];
+        fdb_open_request *req = &args->requests[idx];
+        req->status = fdb_open(&req->fhandle, req->filename, req->config);
+        if (args->callback) {
+            args->callback(req, idx, args->ctx);
+        }
+    }
+    return NULL;
+}
+
+LIBFDB_API
+fdb_status fdb_open_many(fdb_open_request *requests,
+                         size_t num_requests,
+                         size_t num_threads,
+                         fdb_open_callback_fn callback,
+                         void *ctx)
+{
+    struct _fdb_open_many_args args;
+    size_t i;
+
+    if (!requests && num_requests) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+    for (i = 0; i < num_requests; ++i) {
+        if (!requests[i].filename) {
+            return FDB_RESULT_INVALID_ARGS;
+        }
+    }
+    for (i = 0; i < num_requests; ++i) {
+        requests[i].fhandle = NULL;
+        requests[i].status = FDB_RESULT_SUCCESS;
+        args.order.push_back(i);
+    }
+    std::stable_sort(args.order.begin(), args.order.end(),
+                     [requests](size_t a, size_t b) {
+                         return requests[a].priority > requests[b].priority;
+                     });
+    args.requests = requests;
+    args.next = 0;
+    args.callback = callback;
+    args.ctx = ctx;
+
+    // the calling thread is also one of the threads opening files
+    if (num_threads > num_requests) {
+        num_threads = num_requests;
+    }
+    std::vector<thread_t> tids(num_threads > 1 ? num_threads - 1 : 0);
+    for (i = 0; i < tids.size(); ++i) {
+        thread_create(&tids[i], _fdb_open_many_thread, (void *)&args);
+    }
+    _fdb_open_many_thread((void *)&args);
+    for (i = 0; i < tids.size(); ++i) {
+        void *ret;
+        thread_join(tids[i], &ret);
+    }
+
+    for (i = 0; i < num_requests; ++i) {
+        if (requests[i].status != FDB_RESULT_SUCCESS) {
+            return requests[i].status;
+        }
+    }
+    return FDB_RESULT_SUCCESS;
+}
+
 fdb_status fdb_open_for_compactor(fdb_file_handle **ptr_fhandle,
                                   const char *filename,
                                   fdb_config *fconfig,
@@ -957,9 +1128,12 @@ fdb_status fdb_open_for_compactor(fdb_file_handle **ptr_fhandle,
     return fs;
 }
 
-LIBFDB_API
-fdb_status fdb_snapshot_open(FdbKvsHandle *handle_in,
-                             FdbKvsHandle **ptr_handle, fdb_seqnum_t seqnum)
+// If 'hdr_bid' is not BLK_NOT_FOUND, the snapshot is opened on the given
+// DB header (which should correspond to 'seqnum') without scanning the file.
+static fdb_status _fdb_snapshot_open(FdbKvsHandle *handle_in,
+                                     FdbKvsHandle **ptr_handle,
+                                     fdb_seqnum_t seqnum,
+                                     bid_t hdr_bid)
 {
 #ifdef _MEMPOOL
     mempool_init();
@@ -987,6 +1161,19 @@ fdb_snapshot_open_start:
         fdb_sync_db_header(handle_in);
         file = handle_in->file;
 
+        txn = handle_in->fhandle->getRootHandle()->txn;
+        if (txn && txn->write_buffer && list_begin(&txn->write_buffer->docs)) {
+            // spill the transaction's buffered updates into the WAL,
+            // so that they are visible to the snapshot
+            file->mutexLock();
+            fs = _fdb_flush_txn_buffer(handle_in, txn);
+            file->mutexUnlock();
+            if (fs != FDB_RESULT_SUCCESS) {
+                return fs;
+            }
+        }
+        txn = NULL;
+
         if (handle_in->kvs && handle_in->kvs->getKvsType() == KVS_SUB) {
             handle_in->seqnum = fdb_kvs_get_seqnum(file,
                                                    handle_in->kvs->getKvsId());
@@ -1013,6 +1200,13 @@ fdb_snapshot_open_start:
     handle->log_callback = handle_in->log_callback;
     handle->max_seqnum = seqnum;
     handle->fhandle = handle_in->fhandle;
+    if (hdr_bid != BLK_NOT_FOUND) {
+        handle->last_hdr_bid = hdr_bid; // do fast rewind
+    }
+    // clones of a checkpoint snapshot are on the same pinned header
+    handle->checkpoint_snapshot = (hdr_bid != BLK_NOT_FOUND) ||
+                                  (handle_in->shandle &&
+                                   handle_in->checkpoint_snapshot);
 
     config.flags |= FDB_OPEN_FLAG_RDONLY;
     // do not perform compaction for snapshot
@@ -1170,7 +1364,8 @@ fdb_snapshot_open_start:
         // calls _fdb_open, then it is possible that the snapshot's DB header
         // is only present in the new_file. So we must retry the snapshot
         // open attempt IFF _fdb_open indicates FDB_RESULT_NO_DB_INSTANCE..
-        if (fs == FDB_RESULT_NO_DB_INSTANCE && fMgrStatus == FILE_COMPACT_OLD) {
+        if (fs == FDB_RESULT_NO_DB_INSTANCE && fMgrStatus == FILE_COMPACT_OLD &&
+            hdr_bid == BLK_NOT_FOUND) {
             if (file->getFileStatus() == FILE_REMOVED_PENDING) {
                 goto fdb_snapshot_open_start;
             }
@@ -1187,6 +1382,172 @@ fdb_snapshot_open_start:
     return fs;
 }
 
+LIBFDB_API
+fdb_status fdb_snapshot_open(FdbKvsHandle *handle_in,
+                             FdbKvsHandle **ptr_handle, fdb_seqnum_t seqnum)
+{
+    return _fdb_snapshot_open(handle_in, ptr_handle, seqnum, BLK_NOT_FOUND);
+}
+
+LIBFDB_API
+fdb_status fdb_checkpoint_create(fdb_file_handle *fhandle, const char *name)
+{
+    FdbKvsHandle *handle;
+    FileMgr *file;
+    uint8_t header_buf[FDB_BLOCKSIZE];
+    size_t header_len;
+    bid_t hdr_bid;
+    filemgr_header_revnum_t revnum, wal_flush_revnum = 0;
+    uint64_t dummy64, last_wal_flush_hdr_bid;
+    char *compacted_filename;
+    fdb_status fs = FDB_RESULT_SUCCESS;
+
+    if (!fhandle) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+    if (!name) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    handle = fhandle->getRootHandle();
+    if (!handle->file) {
+        return FDB_RESULT_FILE_NOT_OPEN;
+    }
+
+    fdb_check_file_reopen(handle, NULL);
+    fdb_sync_db_header(handle);
+    file = handle->file;
+
+    // grab the file mutex so that no commit (and block reclaim) happens
+    // until the header is pinned.
+    file->mutexLock();
+    if (file->getFileStatus() != FILE_NORMAL || file->getNewFile()) {
+        // the file is being compacted, which discards checkpoints
+        file->mutexUnlock();
+        return FDB_RESULT_FAIL_BY_COMPACTION;
+    }
+    file->getHeader(header_buf, &header_len, &hdr_bid, NULL, &revnum);
+    if (header_len == 0 || hdr_bid == BLK_NOT_FOUND) {
+        file->mutexUnlock();
+        return FDB_RESULT_NO_DB_INSTANCE;
+    }
+
+    fdb_fetch_header(file->getVersion(), header_buf, &dummy64, &dummy64,
+                     &dummy64, &dummy64, &dummy64, &dummy64, &dummy64,
+                     &last_wal_flush_hdr_bid, &dummy64, &dummy64,
+                     &compacted_filename, NULL);
+    if (last_wal_flush_hdr_bid != BLK_NOT_FOUND) {
+        filemgr_magic_t magic;
+        fs = file->fetchHeader(last_wal_flush_hdr_bid, header_buf,
+                               &header_len, NULL, &wal_flush_revnum, NULL,
+                               &magic, NULL, &handle->log_callback);
+        if (fs != FDB_RESULT_SUCCESS || header_len == 0) {
+            file->mutexUnlock();
+            return (fs != FDB_RESULT_SUCCESS) ? fs : FDB_RESULT_NO_DB_INSTANCE;
+        }
+    }
+
+    if (!file->addCheckpoint(name, revnum, hdr_bid, wal_flush_revnum)) {
+        fs = FDB_RESULT_INVALID_ARGS;
+    }
+    file->mutexUnlock();
+
+    return fs;
+}
+
+LIBFDB_API
+fdb_status fdb_checkpoint_release(fdb_file_handle *fhandle, const char *name)
+{
+    FdbKvsHandle *handle;
+
+    if (!fhandle) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+    if (!name) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    handle = fhandle->getRootHandle();
+    if (!handle->file) {
+        return FDB_RESULT_FILE_NOT_OPEN;
+    }
+
+    fdb_check_file_reopen(handle, NULL);
+    // grab the file mutex so that the checkpoint is not released in the
+    // middle of a block reclaim that skipped the snapshots on it.
+    handle->file->mutexLock();
+    if (!handle->file->removeCheckpoint(name)) {
+        handle->file->mutexUnlock();
+        return FDB_RESULT_KEY_NOT_FOUND;
+    }
+    handle->file->mutexUnlock();
+    return FDB_RESULT_SUCCESS;
+}
+
+LIBFDB_API
+fdb_status fdb_snapshot_open_checkpoint(FdbKvsHandle *handle_in,
+                                        FdbKvsHandle **ptr_handle,
+                                        const char *name)
+{
+    struct filemgr_checkpoint checkpoint;
+    uint8_t header_buf[FDB_BLOCKSIZE];
+    size_t header_len;
+    uint64_t dummy64, kv_info_offset;
+    filemgr_magic_t version;
+    fdb_seqnum_t seqnum;
+    char *compacted_filename;
+    fdb_status fs;
+
+    if (!handle_in || !ptr_handle) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+    if (!name || handle_in->shandle) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    fdb_check_file_reopen(handle_in, NULL);
+    fdb_sync_db_header(handle_in);
+
+    if (!handle_in->file->getCheckpoint(name, &checkpoint)) {
+        return FDB_RESULT_KEY_NOT_FOUND;
+    }
+
+    // get the sequence number of the KV store as of the pinned header
+    fs = handle_in->file->fetchHeader(checkpoint.bid, header_buf, &header_len,
+                                      &seqnum, NULL, NULL, &version, NULL,
+                                      &handle_in->log_callback);
+    if (fs != FDB_RESULT_SUCCESS) {
+        return fs;
+    }
+    if (handle_in->kvs && handle_in->kvs->getKvsId() > 0) {
+        fdb_fetch_header(version, header_buf, &dummy64, &dummy64, &dummy64,
+                         &dummy64, &dummy64, &dummy64, &dummy64, &dummy64,
+                         &kv_info_offset, &dummy64, &compacted_filename, NULL);
+        seqnum = 0;
+        if (kv_info_offset != BLK_NOT_FOUND) {
+            KvsHeader *kv_header;
+            struct docio_object doc;
+
+            memset(&doc, 0, sizeof(struct docio_object));
+            if (handle_in->dhandle->readDoc_Docio(kv_info_offset,
+                                                  &doc, true) > 0) {
+                _fdb_kvs_header_create(&kv_header);
+                _fdb_kvs_header_import(kv_header, doc.body,
+                                       doc.length.bodylen, version, false);
+                seqnum = _fdb_kvs_get_seqnum(kv_header,
+                                             handle_in->kvs->getKvsId());
+                _fdb_kvs_header_free(kv_header);
+                free_docio_object(&doc, true, true, true);
+            }
+        }
+    }
+    if (seqnum == 0) {
+        return FDB_RESULT_NO_DB_INSTANCE;
+    }
+
+    return _fdb_snapshot_open(handle_in, ptr_handle, seqnum, checkpoint.bid);
+}
+
 static fdb_status _fdb_reset(FdbKvsHandle *handle, FdbKvsHandle *handle_in);
 
 LIBFDB_API
@@ -1490,6 +1851,8 @@ static void _fdb_init_file_config(const fdb_config *config,
     fconfig->setEncryptionKey(config->encryption_key);
     fconfig->setBlockReusingThreshold(config->block_reusing_threshold);
     fconfig->setNumKeepingHeaders(config->num_keeping_headers);
+    fconfig->setIndexBlockExtent(config->index_block_extent);
+    fconfig->setWarmupCache(config->warmup_cache_onopen);
 }
 
 fdb_status _fdb_clone_snapshot(FdbKvsHandle *handle_in,
@@ -1532,6 +1895,9 @@ fdb_status _fdb_clone_snapshot(FdbKvsHandle *handle_in,
     // set aux for cmp wrapping function
     handle_out->trie->setLeafHeightLimit(0xff);
     handle_out->trie->setLeafCmp(_fdb_custom_cmp_wrap);
+    handle_out->trie->setLeafPrefixCompression(
+        handle_out->config.key_prefix_compression,
+        handle_out->config.key_prefix_restart_interval);
 
     if (handle_out->kvs) {
         handle_out->trie->setMapFunction(fdb_kvs_find_cmp_chunk);
@@ -1598,6 +1964,31 @@ static void _fdb_cleanup_open_err(fdb_kvs_handle *handle)
                         handle->filename.c_str(), &handle->log_callback);
 }
 
+// Mark the file as containing B+tree nodes with compressed key prefixes, so
+// that older versions, which cannot read those nodes, refuse to open it.
+// The new magic number is written by the next commit.
+static void _fdb_upgrade_prefix_compression(FileMgr *file)
+{
+    file->acquireSpinLock();
+    if (!ver_prefix_compression_support(file->getVersion())) {
+        file->setVersion(FILEMGR_MAGIC_003);
+    }
+    file->releaseSpinLock();
+}
+
+// Mark the file as containing an HB+trie whose chunk size differs from the
+// configured one, so that older versions, which read the HB+trie with the
+// configured chunk size, refuse to open it.
+// The new magic number is written by the next commit.
+static void _fdb_upgrade_recorded_chunksize(FileMgr *file)
+{
+    file->acquireSpinLock();
+    if (!ver_recorded_chunksize_support(file->getVersion())) {
+        file->setVersion(FILEMGR_MAGIC_004);
+    }
+    file->releaseSpinLock();
+}
+
 fdb_status _fdb_open(FdbKvsHandle *handle,
                      const char *filename,
                      fdb_filename_mode_t filename_mode,
@@ -1611,6 +2002,7 @@ fdb_status _fdb_open(FdbKvsHandle *handle,
     fdb_seqnum_t seqnum = 0;
     filemgr_header_revnum_t header_revnum = 0;
     filemgr_header_revnum_t latest_header_revnum = 0;
+    bool pinned_snapshot = false;
     fdb_seqtree_opt_t seqtree_opt = config->seqtree_opt;
     uint64_t ndocs = 0;
     uint64_t ndeletes = 0;
@@ -1625,6 +2017,7 @@ fdb_status _fdb_open(FdbKvsHandle *handle,
     char *prev_filename = NULL;
     size_t header_len = 0;
     bool multi_kv_instances = config->multi_kv_instances;
+    uint16_t chunksize = config->chunksize;
     bool locked = false;
 
     uint64_t nlivenodes = 0;
@@ -1694,6 +2087,11 @@ fdb_status _fdb_open(FdbKvsHandle *handle,
     }
     handle->file = result.file;
 
+    if (config->flags & FDB_OPEN_FLAG_MMAP) {
+        // reads fall back to the regular path if the file can't be mapped
+        handle->file->mapFile();
+    }
+
     if (config->compaction_mode == FDB_COMPACTION_MANUAL &&
         strcmp(filename, actual_filename.c_str())) {
         // It is in-place compacted file if
@@ -1715,6 +2113,9 @@ fdb_status _fdb_open(FdbKvsHandle *handle,
     // If cloning from a snapshot handle, fdb_snapshot_open would have already
     // set handle->last_hdr_bid to the block id of required header, so rewind..
     if (handle->shandle && handle->last_hdr_bid) {
+        // A persisted snapshot with a known header (i.e., a checkpoint)
+        // does not need to scan the file to locate the header.
+        pinned_snapshot = (handle->max_seqnum != FDB_SNAPSHOT_INMEM);
         status = handle->file->fetchHeader(handle->last_hdr_bid,
                                            header_buf, &header_len, &seqnum,
                                            &latest_header_revnum, &deltasize,
@@ -1738,8 +2139,10 @@ fdb_status _fdb_open(FdbKvsHandle *handle,
 
     // fetch previous superblock bitmap info if exists
     // (this should be done after 'handle->dhandle' is initialized)
+    // (a lazy read-only open leaves it to the first read-write open)
     SuperblockBase *sb = handle->file->getSb();
-    if (sb) {
+    if (sb && (!(config->flags & FDB_OPEN_FLAG_LAZY) ||
+               !(config->flags & FDB_OPEN_FLAG_RDONLY))) {
         status = sb->readBmpDoc(handle);
         if (status != FDB_RESULT_SUCCESS) {
             delete handle->dhandle;
@@ -1797,6 +2200,11 @@ fdb_status _fdb_open(FdbKvsHandle *handle,
             } else {
                 multi_kv_instances = true;
             }
+            // use existing chunk size of the HB+trie
+            if (header_flags & FDB_FLAG_CHUNKSIZE_MASK) {
+                chunksize = (header_flags & FDB_FLAG_CHUNKSIZE_MASK) >>
+                            FDB_FLAG_CHUNKSIZE_SHIFT;
+            }
         }
 
         if (!header_len && stale_root_bid == BLK_NOT_FOUND) {
@@ -1831,11 +2239,23 @@ fdb_status _fdb_open(FdbKvsHandle *handle,
     handle->config = *config;
     handle->config.seqtree_opt = seqtree_opt;
     handle->config.multi_kv_instances = multi_kv_instances;
+    handle->config.chunksize = chunksize;
+    if (handle->file->getConfig()->getChunkSize() != chunksize) {
+        // the file was created with a chunk size different from the config
+        handle->file->getConfig()->setChunkSize(chunksize);
+    }
 
     if (handle->shandle && handle->max_seqnum == FDB_SNAPSHOT_INMEM) {
         // Either an in-memory snapshot or cloning from an existing snapshot..
         hdr_bid = 0; // This prevents _fdb_restore_wal() as incoming handle's
                      // *_open() should have already restored it
+    } else if (pinned_snapshot) {
+        // Persisted snapshot on a header pinned by a checkpoint. The header is
+        // already fetched above, and its blocks are protected from reusing
+        // regardless of the last block reclaim.
+        hdr_bid = handle->last_hdr_bid;
+        header_revnum = latest_header_revnum;
+        seqnum = handle->max_seqnum;
     } else { // Persisted snapshot or file rollback..
 
         // get the BID of the latest block
@@ -2140,7 +2560,7 @@ fdb_status _fdb_open(FdbKvsHandle *handle,
         return FDB_RESULT_OPEN_FAIL;
     }
 
-    handle->trie = new HBTrie(config->chunksize, OFFSET_SIZE,
+    handle->trie = new HBTrie(handle->config.chunksize, OFFSET_SIZE,
                               handle->file->getBlockSize(), trie_root_bid,
                               handle->bhandle,
                               (void *)handle->dhandle, _fdb_readkey_wrap);
@@ -2148,6 +2568,16 @@ fdb_status _fdb_open(FdbKvsHandle *handle,
     // set aux for cmp wrapping function
     handle->trie->setLeafHeightLimit(0xff);
     handle->trie->setLeafCmp(_fdb_custom_cmp_wrap);
+    handle->trie->setLeafPrefixCompression(config->key_prefix_compression,
+                                           config->key_prefix_restart_interval);
+    if (config->key_prefix_compression && !handle->shandle &&
+        !(config->flags & FDB_OPEN_FLAG_RDONLY)) {
+        _fdb_upgrade_prefix_compression(handle->file);
+    }
+    if (chunksize != config->chunksize && !handle->shandle &&
+        !(config->flags & FDB_OPEN_FLAG_RDONLY)) {
+        _fdb_upgrade_recorded_chunksize(handle->file);
+    }
 
     if (handle->kvs) {
         handle->trie->setMapFunction(fdb_kvs_find_cmp_chunk);
@@ -2196,10 +2626,13 @@ fdb_status _fdb_open(FdbKvsHandle *handle,
          } else {
             handle->staletree->initFromBid(handle->bhandle, stale_kv_ops,
                                            handle->config.blocksize, stale_root_bid);
-            // prefetch stale info into memory
+            // prefetch stale info into memory, unless it is deferred to
+            // the first commit.
             // (as stale_root_bid != BLK_NOT_FOUND,
             //  we don't need to worry about file's mutex.)
-            handle->file->getStaleData()->loadInmemStaleInfo(handle);
+            if (!(handle->config.flags & FDB_OPEN_FLAG_LAZY)) {
+                handle->file->getStaleData()->loadInmemStaleInfo(handle);
+            }
          }
     } else {
         handle->staletree = NULL;
@@ -2566,8 +2999,8 @@ INLINE void _fdb_wal_flush_seq_purge(void *dbhandle,
             delta *= handle->config.blocksize;
             delta_stat->deltasize += delta;
         }
+        // the entry itself is released when the WAL flush scratch arena is reset
         avl_remove(stale_seqnum_list, &seq_entry->avl_entry);
-        free(seq_entry);
     }
 }
 
@@ -2591,7 +3024,6 @@ INLINE void _fdb_wal_flush_kvs_delta_stats(FileMgr *file,
         file->getKvsStatOps()->statUpdateAttr(delta_stat->kv_id,
                               KVS_STAT_DELTASIZE, delta_stat->deltasize);
         avl_remove(kvs_delta_stats, &delta_stat->avl_entry);
-        free(delta_stat);
     }
 }
 
@@ -2632,7 +3064,8 @@ INLINE fdb_status _fdb_wal_flush_func(void *voidhandle,
                                     avl_entry);
     } else {
         kvs_delta_stat = (struct wal_kvs_delta_stat *)
-            calloc(1, sizeof(struct wal_kvs_delta_stat));
+            MemoryArena::getThreadArena()->allocate(
+                sizeof(struct wal_kvs_delta_stat));
         kvs_delta_stat->kv_id = kv_id;
         avl_insert(kvs_delta_stats, &kvs_delta_stat->avl_entry,
                    _kvs_delta_stat_cmp);
@@ -2731,7 +3164,8 @@ INLINE fdb_status _fdb_wal_flush_func(void *voidhandle,
             // Avoid duplicates (remove previous sequence number)
             if (handle->config.seqtree_opt == FDB_SEQTREE_USE) {
                 struct wal_stale_seq_entry *entry = (struct wal_stale_seq_entry *)
-                    calloc(1, sizeof(struct wal_stale_seq_entry));
+                    MemoryArena::getThreadArena()->allocate(
+                        sizeof(struct wal_stale_seq_entry));
                 entry->kv_id = kv_id;
                 entry->seqnum = _doc.seqnum;
                 avl_insert(stale_seqnum_list, &entry->avl_entry,
@@ -2783,7 +3217,8 @@ INLINE fdb_status _fdb_wal_flush_func(void *voidhandle,
             // remove sequence number for the removed doc
             if (handle->config.seqtree_opt == FDB_SEQTREE_USE) {
                 struct wal_stale_seq_entry *entry = (struct wal_stale_seq_entry *)
-                    calloc(1, sizeof(struct wal_stale_seq_entry));
+                    MemoryArena::getThreadArena()->allocate(
+                        sizeof(struct wal_stale_seq_entry));
                 entry->kv_id = kv_id;
                 entry->seqnum = _doc.seqnum;
                 avl_insert(stale_seqnum_list, &entry->avl_entry, _fdb_seq_entry_cmp);
@@ -2949,45 +3384,302 @@ fdb_status fdb_check_file_reopen(FdbKvsHandle *handle, file_status_t *status)
             handle->file->fhandleAdd(handle->fhandle);
         }
     }
-    if (status) {
-        *status = fMgrStatus;
+    if (status) {
+        *status = fMgrStatus;
+    }
+    return fs;
+}
+
+static void _fdb_sync_dirty_root(FdbKvsHandle *handle)
+{
+    bid_t dirty_idtree_root = BLK_NOT_FOUND;
+    bid_t dirty_seqtree_root = BLK_NOT_FOUND;
+
+    if (handle->shandle) {
+        // skip snapshot
+        return;
+    }
+
+    struct filemgr_dirty_update_node *dirty_update;
+    dirty_update = handle->file->dirtyUpdateGetLatest();
+    handle->bhandle->setDirtyUpdate(dirty_update);
+
+    if (dirty_update) {
+        FileMgr::dirtyUpdateGetRoot(dirty_update, &dirty_idtree_root,
+                                    &dirty_seqtree_root);
+        _fdb_import_dirty_root(handle, dirty_idtree_root, dirty_seqtree_root);
+        handle->bhandle->discardBlocks();
+    }
+
+    return;
+}
+
+static void _fdb_release_dirty_root(FdbKvsHandle *handle)
+{
+    if (!handle->shandle) {
+        struct filemgr_dirty_update_node *dirty_update;
+        dirty_update = handle->bhandle->getDirtyUpdate();
+        if (dirty_update) {
+            FileMgr::dirtyUpdateCloseNode(dirty_update);
+            handle->bhandle->clearDirtyUpdate();
+        }
+    }
+}
+
+// Find the offset of the most recent doc for a given key from the WAL or
+// the HB+trie. In multi KV instance mode, 'doc_kv' should contain the key
+// prefixed with the KV store ID. Caller should mark the handle busy.
+static fdb_status _fdb_find_offset(FdbKvsHandle *handle,
+                                   fdb_doc *doc,
+                                   fdb_doc *doc_kv,
+                                   uint64_t *offset,
+                                   bool *wal_deleted)
+{
+    FileMgr *wal_file = NULL;
+    struct _fdb_key_cmp_info cmp_info;
+    fdb_status wr;
+    hbtrie_result hr = HBTRIE_RESULT_FAIL;
+    fdb_txn *txn;
+
+    if (!handle->shandle) {
+        fdb_check_file_reopen(handle, NULL);
+
+        txn = handle->fhandle->getRootHandle()->txn;
+        if (!txn) {
+            txn = handle->file->getGlobalTxn();
+        }
+    } else {
+        txn = handle->shandle->snap_txn;
+    }
+
+    cmp_info.kvs_config = handle->kvs_config;
+    cmp_info.kvs = handle->kvs;
+    wal_file = handle->file;
+
+    if (handle->kvs) {
+        wr = wal_file->getWal()->find_Wal(txn, &cmp_info, handle->shandle, doc_kv,
+                                     offset);
+    } else {
+        wr = wal_file->getWal()->find_Wal(txn, &cmp_info, handle->shandle, doc,
+                                     offset);
+    }
+
+    if (!handle->shandle) {
+        fdb_sync_db_header(handle);
+    }
+
+    handle->op_stats->num_gets++;
+
+    if (wr == FDB_RESULT_KEY_NOT_FOUND) {
+        _fdb_sync_dirty_root(handle);
+
+        if (handle->kvs) {
+            hr = handle->trie->find(doc_kv->key, doc_kv->keylen, (void *)offset);
+        } else {
+            hr = handle->trie->find(doc->key, doc->keylen, (void *)offset);
+        }
+        handle->bhandle->flushBuffer();
+        *offset = _endian_decode(*offset);
+
+        _fdb_release_dirty_root(handle);
+    }
+
+    if (wr == FDB_RESULT_SUCCESS && *offset != BLK_NOT_FOUND) {
+        *wal_deleted = handle->kvs ? doc_kv->deleted : doc->deleted;
+        return FDB_RESULT_SUCCESS;
+    }
+    if (hr == HBTRIE_RESULT_SUCCESS) {
+        *wal_deleted = false;
+        return FDB_RESULT_SUCCESS;
+    }
+    return FDB_RESULT_KEY_NOT_FOUND;
+}
+
+// Retrieve the sequence number of the latest committed version of the given
+// key (0 if the key does not exist). Uncommitted transactional updates are
+// ignored, while non-transactional updates not committed yet are regarded as
+// the latest ones. The file mutex should be grabbed by the caller.
+static fdb_status _fdb_get_committed_seqnum(FdbKvsHandle *handle,
+                                            struct _fdb_key_cmp_info *cmp_info,
+                                            void *key, size_t keylen,
+                                            fdb_seqnum_t *seqnum)
+{
+    uint64_t offset;
+    fdb_doc doc;
+    fdb_status fs;
+    hbtrie_result hr;
+    struct docio_object _doc;
+
+    memset(&doc, 0x0, sizeof(doc));
+    doc.key = key;
+    doc.keylen = keylen;
+    doc.seqnum = SEQNUM_NOT_USED;
+    *seqnum = 0;
+
+    fs = handle->file->getWal()->find_Wal(handle->file->getGlobalTxn(),
+                                          cmp_info, NULL, &doc, &offset);
+    if (fs == FDB_RESULT_SUCCESS) {
+        *seqnum = doc.seqnum;
+        return FDB_RESULT_SUCCESS;
+    }
+
+    _fdb_sync_dirty_root(handle);
+    hr = handle->trie->find(key, keylen, (void *)&offset);
+    handle->bhandle->flushBuffer();
+    _fdb_release_dirty_root(handle);
+    if (hr != HBTRIE_RESULT_SUCCESS) {
+        return FDB_RESULT_SUCCESS;
+    }
+
+    memset(&_doc, 0x0, sizeof(_doc));
+    int64_t _offset = handle->dhandle->readDocKeyMeta_Docio(
+                                  _endian_decode(offset), &_doc, true);
+    if (_offset <= 0) {
+        return _offset < 0 ? (fdb_status)_offset : FDB_RESULT_READ_FAIL;
+    }
+    *seqnum = _doc.seqnum;
+    free_docio_object(&_doc, true, true, false);
+    return FDB_RESULT_SUCCESS;
+}
+
+// Check if any key read or written by the given optimistic transaction has
+// been committed by another writer since the transaction first accessed it.
+// The file mutex should be grabbed by the caller.
+fdb_status _fdb_validate_transaction(FdbKvsHandle *handle, fdb_txn *txn)
+{
+    struct _fdb_key_cmp_info cmp_info;
+    struct avl_node *a;
+    fdb_seqnum_t seqnum;
+    fdb_status fs;
+
+    if (!txn->key_versions) {
+        return FDB_RESULT_SUCCESS;
+    }
+
+    cmp_info.kvs_config = handle->kvs_config;
+    cmp_info.kvs = handle->kvs;
+    for (a = avl_first(txn->key_versions); a; a = avl_next(a)) {
+        struct txn_key_version *kv;
+        kv = _get_entry(a, struct txn_key_version, avl);
+        cmp_info.kvs_config.custom_cmp = kv->custom_cmp;
+        fs = _fdb_get_committed_seqnum(handle, &cmp_info,
+                                       kv->key, kv->keylen, &seqnum);
+        if (fs != FDB_RESULT_SUCCESS) {
+            return fs;
+        }
+        if (seqnum != kv->seqnum) {
+            return FDB_RESULT_TRANSACTION_CONFLICT;
+        }
+    }
+    return FDB_RESULT_SUCCESS;
+}
+
+// Append the documents in the transaction's write buffer to the file, and
+// insert them into the WAL as the transaction's items. The file mutex should
+// be grabbed by the caller.
+fdb_status _fdb_flush_txn_buffer(FdbKvsHandle *handle, fdb_txn *txn)
+{
+    struct _fdb_key_cmp_info cmp_info;
+    struct docio_object _doc;
+    struct list_elem *e;
+    fdb_doc wal_doc;
+    uint64_t offset;
+
+    if (!txn->write_buffer || !list_begin(&txn->write_buffer->docs)) {
+        return FDB_RESULT_SUCCESS;
+    }
+
+    cmp_info.kvs_config = handle->kvs_config;
+    cmp_info.kvs = handle->kvs;
+    // documents are appended back to back in the order of their updates
+    while ((e = list_begin(&txn->write_buffer->docs))) {
+        struct txn_buffered_doc *bdoc;
+        bdoc = _get_entry(e, struct txn_buffered_doc, le);
+
+        memset(&_doc, 0x0, sizeof(_doc));
+        _doc.length.keylen = bdoc->keylen;
+        _doc.length.metalen = bdoc->metalen;
+        _doc.length.bodylen = bdoc->bodylen;
+        _doc.key = bdoc->key;
+        _doc.meta = bdoc->meta;
+        _doc.body = bdoc->body;
+        _doc.seqnum = bdoc->seqnum;
+        _doc.timestamp = bdoc->timestamp;
+        offset = handle->dhandle->appendDoc_Docio(&_doc, bdoc->deleted, true);
+        if (offset == BLK_NOT_FOUND) {
+            return FDB_RESULT_WRITE_FAIL;
+        }
+
+        memset(&wal_doc, 0x0, sizeof(wal_doc));
+        wal_doc.key = bdoc->key;
+        wal_doc.keylen = bdoc->keylen;
+        wal_doc.seqnum = bdoc->seqnum;
+        wal_doc.deleted = bdoc->deleted;
+        wal_doc.size_ondisk = _fdb_get_docsize(_doc.length);
+        cmp_info.kvs_config.custom_cmp = bdoc->custom_cmp;
+        if (bdoc->deleted && !handle->config.purging_interval) {
+            handle->file->getWal()->immediateRemove_Wal(txn, &cmp_info,
+                                                        &wal_doc, offset,
+                                                        WAL_INS_WRITER);
+        } else {
+            handle->file->getWal()->insert_Wal(txn, &cmp_info, &wal_doc,
+                                               offset, WAL_INS_WRITER);
+        }
+        fdb_txn_buffer_remove(txn, bdoc);
+    }
+
+    if (handle->file->getWal()->getDirtyStatus_Wal() == FDB_WAL_CLEAN) {
+        handle->file->getWal()->setDirtyStatus_Wal(FDB_WAL_DIRTY);
+    }
+    return FDB_RESULT_SUCCESS;
+}
+
+// Retrieve a document from the transaction's write buffer
+static fdb_status _fdb_get_buffered(fdb_doc *doc, struct txn_buffered_doc *bdoc,
+                                    bool metaOnly)
+{
+    if (!metaOnly && bdoc->deleted) {
+        return FDB_RESULT_KEY_NOT_FOUND;
+    }
+
+    if (bdoc->metalen) {
+        if (!doc->meta) {
+            doc->meta = malloc(bdoc->metalen);
+        }
+        memcpy(doc->meta, bdoc->meta, bdoc->metalen);
+    }
+    if (!metaOnly && bdoc->bodylen) {
+        if (!doc->body) {
+            doc->body = malloc(bdoc->bodylen);
+        }
+        memcpy(doc->body, bdoc->body, bdoc->bodylen);
     }
-    return fs;
+    doc->seqnum = bdoc->seqnum;
+    doc->metalen = bdoc->metalen;
+    doc->bodylen = bdoc->bodylen;
+    doc->deleted = bdoc->deleted;
+    doc->size_ondisk = 0; // not written yet
+    doc->offset = BLK_NOT_FOUND;
+    return FDB_RESULT_SUCCESS;
 }
 
-static void _fdb_sync_dirty_root(FdbKvsHandle *handle)
+// Remember the version of a key read by an optimistic transaction
+static void _fdb_txn_track_read(FdbKvsHandle *handle, fdb_doc *doc_kv,
+                                fdb_seqnum_t seqnum)
 {
-    bid_t dirty_idtree_root = BLK_NOT_FOUND;
-    bid_t dirty_seqtree_root = BLK_NOT_FOUND;
+    fdb_txn *txn;
 
     if (handle->shandle) {
-        // skip snapshot
         return;
     }
-
-    struct filemgr_dirty_update_node *dirty_update;
-    dirty_update = handle->file->dirtyUpdateGetLatest();
-    handle->bhandle->setDirtyUpdate(dirty_update);
-
-    if (dirty_update) {
-        FileMgr::dirtyUpdateGetRoot(dirty_update, &dirty_idtree_root,
-                                    &dirty_seqtree_root);
-        _fdb_import_dirty_root(handle, dirty_idtree_root, dirty_seqtree_root);
-        handle->bhandle->discardBlocks();
+    txn = handle->fhandle->getRootHandle()->txn;
+    if (!txn || !txn->key_versions) {
+        return;
     }
-
-    return;
-}
-
-static void _fdb_release_dirty_root(FdbKvsHandle *handle)
-{
-    if (!handle->shandle) {
-        struct filemgr_dirty_update_node *dirty_update;
-        dirty_update = handle->bhandle->getDirtyUpdate();
-        if (dirty_update) {
-            FileMgr::dirtyUpdateCloseNode(dirty_update);
-            handle->bhandle->clearDirtyUpdate();
-        }
+    if (!fdb_txn_find_key(txn, doc_kv->key, doc_kv->keylen,
+                          handle->kvs_config.custom_cmp)) {
+        fdb_txn_add_key(txn, doc_kv->key, doc_kv->keylen, seqnum,
+                        handle->kvs_config.custom_cmp);
     }
 }
 
@@ -2997,12 +3689,8 @@ fdb_status _fdb_get(FdbKvsHandle *handle, fdb_doc *doc,
     uint64_t offset;
     struct docio_object _doc;
     DocioHandle *dhandle;
-    FileMgr *wal_file = NULL;
-    struct _fdb_key_cmp_info cmp_info;
-    fdb_status wr;
-    hbtrie_result hr = HBTRIE_RESULT_FAIL;
-    fdb_txn *txn;
     fdb_doc doc_kv;
+    bool wal_deleted = false;
     LATENCY_STAT_START();
 
     if (!handle) {
@@ -3033,51 +3721,25 @@ fdb_status _fdb_get(FdbKvsHandle *handle, fdb_doc *doc,
     }
 
     if (!handle->shandle) {
-        fdb_check_file_reopen(handle, NULL);
-
-        txn = handle->fhandle->getRootHandle()->txn;
-        if (!txn) {
-            txn = handle->file->getGlobalTxn();
-        }
-    } else {
-        txn = handle->shandle->snap_txn;
-    }
-
-    cmp_info.kvs_config = handle->kvs_config;
-    cmp_info.kvs = handle->kvs;
-    wal_file = handle->file;
-    dhandle = handle->dhandle;
-
-    if (handle->kvs) {
-        wr = wal_file->getWal()->find_Wal(txn, &cmp_info, handle->shandle, &doc_kv,
-                                     &offset);
-    } else {
-        wr = wal_file->getWal()->find_Wal(txn, &cmp_info, handle->shandle, doc,
-                                     &offset);
-    }
-
-    if (!handle->shandle) {
-        fdb_sync_db_header(handle);
-    }
-
-    handle->op_stats->num_gets++;
-
-    if (wr == FDB_RESULT_KEY_NOT_FOUND) {
-        _fdb_sync_dirty_root(handle);
-
-        if (handle->kvs) {
-            hr = handle->trie->find(doc_kv.key, doc_kv.keylen, (void *)&offset);
-        } else {
-            hr = handle->trie->find(doc->key, doc->keylen, (void *)&offset);
+        // updates of the current transaction not inserted into the WAL yet
+        fdb_txn *txn = handle->fhandle->getRootHandle()->txn;
+        if (txn && txn->write_buffer) {
+            struct txn_buffered_doc *bdoc;
+            bdoc = fdb_txn_buffer_find(txn, doc_kv.key, doc_kv.keylen,
+                                       handle->kvs_config.custom_cmp);
+            if (bdoc) {
+                fdb_status fs = _fdb_get_buffered(doc, bdoc, metaOnly);
+                cond = 1;
+                handle->handle_busy.compare_exchange_strong(cond, 0);
+                return fs;
+            }
         }
-        handle->bhandle->flushBuffer();
-        offset = _endian_decode(offset);
-
-        _fdb_release_dirty_root(handle);
     }
 
-    if ((wr == FDB_RESULT_SUCCESS && offset != BLK_NOT_FOUND) ||
-        hr == HBTRIE_RESULT_SUCCESS) {
+    if (_fdb_find_offset(handle, doc, &doc_kv, &offset,
+                         &wal_deleted) == FDB_RESULT_SUCCESS) {
+        // the file may be reopened during the lookup
+        dhandle = handle->dhandle;
 
         bool alloced_meta = doc->meta ? false : true;
         bool alloced_body = (metaOnly || doc->body) ? false : true;
@@ -3096,7 +3758,9 @@ fdb_status _fdb_get(FdbKvsHandle *handle, fdb_doc *doc,
         _doc.meta = doc->meta;
         _doc.body = doc->body;
 
-        if (!metaOnly && wr == FDB_RESULT_SUCCESS && doc->deleted) {
+        if (!metaOnly && wal_deleted) {
+            _fdb_txn_track_read(handle, &doc_kv,
+                                handle->kvs ? doc_kv.seqnum : doc->seqnum);
             cond = 1;
             handle->handle_busy.compare_exchange_strong(cond, 0);
             return FDB_RESULT_KEY_NOT_FOUND;
@@ -3117,6 +3781,7 @@ fdb_status _fdb_get(FdbKvsHandle *handle, fdb_doc *doc,
 
         if ((_doc.length.keylen != doc_kv.keylen) ||
             (!metaOnly && (_doc.length.flag & DOCIO_DELETED))) {
+            _fdb_txn_track_read(handle, &doc_kv, _doc.seqnum);
             free_docio_object(&_doc, false, alloced_meta, alloced_body);
             cond = 1;
             handle->handle_busy.compare_exchange_strong(cond, 0);
@@ -3131,6 +3796,7 @@ fdb_status _fdb_get(FdbKvsHandle *handle, fdb_doc *doc,
         doc->deleted = _doc.length.flag & DOCIO_DELETED;
         doc->size_ondisk = _fdb_get_docsize(_doc.length);
         doc->offset = offset;
+        _fdb_txn_track_read(handle, &doc_kv, _doc.seqnum);
 
         LATENCY_STAT_END(handle->file, FDB_LATENCY_GETS);
         cond = 1;
@@ -3138,6 +3804,7 @@ fdb_status _fdb_get(FdbKvsHandle *handle, fdb_doc *doc,
         return FDB_RESULT_SUCCESS;
     }
 
+    _fdb_txn_track_read(handle, &doc_kv, 0);
     cond = 1;
     handle->handle_busy.compare_exchange_strong(cond, 0);
     return FDB_RESULT_KEY_NOT_FOUND;
@@ -3149,6 +3816,163 @@ fdb_status fdb_get(FdbKvsHandle *handle, fdb_doc *doc)
     return _fdb_get(handle, doc, /*metaOnly*/false);
 }
 
+LIBFDB_API
+fdb_status fdb_get_pinned(FdbKvsHandle *handle,
+                          const void *key, size_t keylen,
+                          fdb_pinned_doc *pdoc)
+{
+    uint64_t offset;
+    struct docio_object _doc;
+    BlockCacheItem *item = NULL;
+    fdb_doc doc, doc_kv;
+    bool wal_deleted = false;
+    size_t key_offset = 0;
+    fdb_status fs;
+    LATENCY_STAT_START();
+
+    if (!handle) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+
+    if (!pdoc || !key || keylen == 0 || keylen > FDB_MAX_KEYLEN ||
+        (handle->kvs_config.custom_cmp &&
+            keylen > handle->config.blocksize - HBTRIE_HEADROOM)) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    uint8_t cond = 0;
+    if (!handle->handle_busy.compare_exchange_strong(cond, 1)) {
+        return FDB_RESULT_HANDLE_BUSY;
+    }
+
+    memset(&doc, 0x0, sizeof(doc));
+    doc.key = const_cast<void *>(key);
+    doc.keylen = keylen;
+    doc.seqnum = SEQNUM_NOT_USED;
+    doc_kv = doc;
+
+    if (handle->kvs) {
+        // multi KV instance mode
+        key_offset = handle->config.chunksize;
+        doc_kv.keylen = keylen + key_offset;
+        doc_kv.key = alca(uint8_t, doc_kv.keylen);
+        kvid2buf(key_offset, handle->kvs->getKvsId(), doc_kv.key);
+        memcpy((uint8_t*)doc_kv.key + key_offset, key, keylen);
+    }
+
+    if (!handle->shandle) {
+        // updates of the current transaction not inserted into the WAL yet
+        fdb_txn *txn = handle->fhandle->getRootHandle()->txn;
+        if (txn && txn->write_buffer) {
+            struct txn_buffered_doc *bdoc;
+            bdoc = fdb_txn_buffer_find(txn, doc_kv.key, doc_kv.keylen,
+                                       handle->kvs_config.custom_cmp);
+            if (bdoc) {
+                // not in any block .. return heap copies
+                fs = _fdb_get_buffered(&doc, bdoc, false);
+                if (fs == FDB_RESULT_SUCCESS) {
+                    void *key_copy = malloc(keylen);
+                    memcpy(key_copy, key, keylen);
+                    pdoc->key = key_copy;
+                    pdoc->keylen = keylen;
+                    pdoc->metalen = doc.metalen;
+                    pdoc->bodylen = doc.bodylen;
+                    pdoc->meta = doc.meta;
+                    pdoc->body = doc.body;
+                    pdoc->seqnum = doc.seqnum;
+                    pdoc->size_ondisk = doc.size_ondisk;
+                    pdoc->offset = doc.offset;
+                    pdoc->pinned_block = NULL;
+                }
+                cond = 1;
+                handle->handle_busy.compare_exchange_strong(cond, 0);
+                return fs;
+            }
+        }
+    }
+
+    fs = _fdb_find_offset(handle, &doc, &doc_kv, &offset, &wal_deleted);
+    if (fs != FDB_RESULT_SUCCESS || wal_deleted) {
+        if (fs != FDB_RESULT_SUCCESS) {
+            _fdb_txn_track_read(handle, &doc_kv, 0);
+        } else {
+            _fdb_txn_track_read(handle, &doc_kv,
+                                handle->kvs ? doc_kv.seqnum : doc.seqnum);
+        }
+        cond = 1;
+        handle->handle_busy.compare_exchange_strong(cond, 0);
+        return FDB_RESULT_KEY_NOT_FOUND;
+    }
+
+    memset(&_doc, 0x0, sizeof(_doc));
+    fs = handle->dhandle->pinDoc_Docio(offset, &_doc, &item);
+    if (fs == FDB_RESULT_SUCCESS) {
+        if (_doc.length.keylen != doc_kv.keylen ||
+            (_doc.length.flag & DOCIO_DELETED)) {
+            handle->dhandle->unpinDoc_Docio(item);
+            fs = FDB_RESULT_KEY_NOT_FOUND;
+        } else {
+            pdoc->key = (uint8_t*)_doc.key + key_offset;
+            pdoc->pinned_block = item;
+        }
+        _fdb_txn_track_read(handle, &doc_kv, _doc.seqnum);
+    } else if (fs == FDB_RESULT_READ_FAIL) {
+        // the doc can't be accessed in place .. read it into heap buffers
+        memset(&_doc, 0x0, sizeof(_doc));
+        int64_t _offset = handle->dhandle->readDoc_Docio(offset, &_doc, true);
+        if (_offset <= 0) {
+            fs = _offset < 0 ? (fdb_status)_offset : FDB_RESULT_KEY_NOT_FOUND;
+        } else if (_doc.length.keylen != doc_kv.keylen ||
+                   (_doc.length.flag & DOCIO_DELETED)) {
+            _fdb_txn_track_read(handle, &doc_kv, _doc.seqnum);
+            free_docio_object(&_doc, true, true, true);
+            fs = FDB_RESULT_KEY_NOT_FOUND;
+        } else {
+            _fdb_txn_track_read(handle, &doc_kv, _doc.seqnum);
+            if (key_offset) {
+                memmove(_doc.key, (uint8_t*)_doc.key + key_offset, keylen);
+            }
+            pdoc->key = _doc.key;
+            pdoc->pinned_block = NULL;
+            fs = FDB_RESULT_SUCCESS;
+        }
+    }
+
+    if (fs == FDB_RESULT_SUCCESS) {
+        pdoc->keylen = keylen;
+        pdoc->metalen = _doc.length.metalen;
+        pdoc->bodylen = _doc.length.bodylen;
+        pdoc->meta = _doc.meta;
+        pdoc->body = _doc.body;
+        pdoc->seqnum = _doc.seqnum;
+        pdoc->size_ondisk = _fdb_get_docsize(_doc.length);
+        pdoc->offset = offset;
+        LATENCY_STAT_END(handle->file, FDB_LATENCY_GETS);
+    }
+
+    cond = 1;
+    handle->handle_busy.compare_exchange_strong(cond, 0);
+    return fs;
+}
+
+LIBFDB_API
+fdb_status fdb_release(fdb_pinned_doc *pdoc)
+{
+    if (!pdoc) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    if (pdoc->pinned_block) {
+        FileMgr::unpinBlock(static_cast<BlockCacheItem *>(pdoc->pinned_block));
+    } else {
+        free(const_cast<void *>(pdoc->key));
+        free(const_cast<void *>(pdoc->meta));
+        free(const_cast<void *>(pdoc->body));
+    }
+    memset(pdoc, 0x0, sizeof(fdb_pinned_doc));
+    return FDB_RESULT_SUCCESS;
+}
+
 // search document metadata using key
 LIBFDB_API
 fdb_status fdb_get_metaonly(FdbKvsHandle *handle, fdb_doc *doc)
@@ -3193,6 +4017,18 @@ fdb_status _fdb_get_byseq(FdbKvsHandle *handle,
         fdb_check_file_reopen(handle, NULL);
 
         txn = handle->fhandle->getRootHandle()->txn;
+        if (txn && txn->write_buffer && list_begin(&txn->write_buffer->docs)) {
+            // buffered updates are not indexed by seqnum .. spill them into
+            // the WAL, so that they can be found below
+            handle->file->mutexLock();
+            wr = _fdb_flush_txn_buffer(handle, txn);
+            handle->file->mutexUnlock();
+            if (wr != FDB_RESULT_SUCCESS) {
+                cond = 1;
+                handle->handle_busy.compare_exchange_strong(cond, 0);
+                return wr;
+            }
+        }
         if (!txn) {
             txn = handle->file->getGlobalTxn();
         }
@@ -3286,6 +4122,14 @@ fdb_status _fdb_get_byseq(FdbKvsHandle *handle,
             return _offset < 0 ? (fdb_status)_offset : FDB_RESULT_KEY_NOT_FOUND;
         }
 
+        if (!metaOnly || doc->seqnum == _doc.seqnum) {
+            // the key of the doc is known now .. remember its version
+            fdb_doc doc_kv;
+            doc_kv.key = _doc.key;
+            doc_kv.keylen = _doc.length.keylen;
+            _fdb_txn_track_read(handle, &doc_kv, _doc.seqnum);
+        }
+
         if ((metaOnly && doc->seqnum != _doc.seqnum) ||
             (!metaOnly && (_doc.length.flag & DOCIO_DELETED))) {
             cond = 1;
@@ -3571,6 +4415,23 @@ fdb_set_start:
         goto fdb_set_start;
     }
 
+    if (txn && txn->key_versions &&
+        !fdb_txn_find_key(txn, _doc.key, _doc.length.keylen,
+                          handle->kvs_config.custom_cmp)) {
+        // remember the committed version that this update overwrites
+        fdb_seqnum_t prev_seqnum;
+        wr = _fdb_get_committed_seqnum(handle, &cmp_info, _doc.key,
+                                       _doc.length.keylen, &prev_seqnum);
+        if (wr != FDB_RESULT_SUCCESS) {
+            file->mutexUnlock();
+            cond = 1;
+            handle->handle_busy.compare_exchange_strong(cond, 0);
+            return wr;
+        }
+        fdb_txn_add_key(txn, _doc.key, _doc.length.keylen, prev_seqnum,
+                        handle->kvs_config.custom_cmp);
+    }
+
     if (sub_handle) {
         // multiple KV instance mode AND sub handle
         fdb_seqnum_t kv_seqnum = fdb_kvs_get_seqnum(file,
@@ -3618,6 +4479,26 @@ fdb_set_start:
         txn_enabled = true;
     }
 
+    if (txn && txn->write_buffer) {
+        // keep the update in the transaction's private buffer
+        fdb_txn_buffer_add(txn, &_doc, doc->deleted,
+                           handle->kvs_config.custom_cmp);
+        doc->size_ondisk = 0; // not written yet
+        doc->offset = BLK_NOT_FOUND;
+        if (txn->write_buffer->size > handle->config.txn_buffer_size) {
+            wr = _fdb_flush_txn_buffer(handle, txn);
+        }
+        file->mutexUnlock();
+
+        LATENCY_STAT_END(file, FDB_LATENCY_SETS);
+        if (!doc->deleted) {
+            handle->op_stats->num_sets++;
+        }
+        cond = 1;
+        handle->handle_busy.compare_exchange_strong(cond, 0);
+        return wr;
+    }
+
     offset = dhandle->appendDoc_Docio(&_doc, doc->deleted, txn_enabled);
     if (offset == BLK_NOT_FOUND) {
         file->mutexUnlock();
@@ -3794,6 +4675,9 @@ static uint64_t _fdb_export_header_flags(FdbKvsHandle *handle)
         // the default KVS is based on custom key order
         rv |= FDB_FLAG_ROOT_CUSTOM_CMP;
     }
+    // chunk size of the HB+trie
+    rv |= ((uint64_t)handle->trie->getChunkSize() << FDB_FLAG_CHUNKSIZE_SHIFT) &
+          FDB_FLAG_CHUNKSIZE_MASK;
     return rv;
 }
 
@@ -4056,6 +4940,13 @@ fdb_commit_start:
     handle->file->mutexLock();
     fdb_sync_db_header(handle);
 
+    if (handle->staletree) {
+        // stale info has not been loaded yet if all handles of the file
+        // were opened lazily; it should be loaded before gathering the
+        // stale regions of this commit.
+        handle->file->getStaleData()->loadInmemStaleInfo_UNLOCKED(handle);
+    }
+
     if (handle->file->isRollbackOn()) {
         handle->file->mutexUnlock();
         cond = 1;
@@ -4082,6 +4973,16 @@ fdb_commit_start:
     // commit wal
     if (txn) {
         // transactional updates
+        fs = _fdb_validate_transaction(handle, txn);
+        if (fs == FDB_RESULT_SUCCESS) {
+            fs = _fdb_flush_txn_buffer(handle, txn);
+        }
+        if (fs != FDB_RESULT_SUCCESS) {
+            handle->file->mutexUnlock();
+            cond = 1;
+            handle->handle_busy.compare_exchange_strong(cond, 0);
+            return fs;
+        }
         wr = handle->file->getWal()->commit_Wal(txn, _fdb_append_commit_mark,
                                            &handle->log_callback);
         if (wr != FDB_RESULT_SUCCESS) {
@@ -6490,6 +7391,10 @@ fdb_status _fdb_compact_file_checks(FdbKvsHandle *handle,
     if (handle->file->isRollbackOn()) {
         return FDB_RESULT_FAIL_BY_ROLLBACK;
     }
+    if (handle->file->hasCheckpoints()) {
+        // checkpoints are not carried over to the new file
+        return FDB_RESULT_CHECKPOINT_EXISTS;
+    }
 
     return FDB_RESULT_SUCCESS;
 }
@@ -6571,6 +7476,11 @@ static fdb_status _fdb_reset(FdbKvsHandle *handle, FdbKvsHandle *handle_in)
     } // LCOV_EXCL_STOP
 
     new_trie->setLeafCmp(_fdb_custom_cmp_wrap);
+    new_trie->setLeafPrefixCompression(handle->config.key_prefix_compression,
+                                       handle->config.key_prefix_restart_interval);
+    if (handle->config.key_prefix_compression) {
+        _fdb_upgrade_prefix_compression(handle->file);
+    }
     new_trie->setFlag(handle->trie->getFlag());
     new_trie->setLeafHeightLimit(handle->trie->getLeafHeightLimit());
     new_trie->setMapFunction(handle->trie->getMapFunction());
@@ -6688,6 +7598,58 @@ fdb_status _fdb_compact_file(FdbKvsHandle *handle,
                              bid_t marker_bid,
                              bool clone_docs);
 
+/**
+ * Choose the chunk size of the HB+trie for the compacted file, from the keys
+ * sampled (reservoir sampling) from the current HB+trie. At most
+ * ADAPTIVE_CHUNKSIZE_SCAN_LIMIT keys are scanned to bound the extra I/O.
+ */
+static uint16_t _fdb_compact_estimate_chunksize(FdbKvsHandle *handle)
+{
+    HBTrieIterator hbtrie_iterator;
+    std::vector<std::string> samples;
+    std::vector<const void *> keys;
+    std::vector<size_t> keylens;
+    uint8_t *keybuf = alca(uint8_t, HBTRIE_MAX_KEYLEN);
+    size_t keylen, i;
+    uint64_t offset, nscan = 0;
+    uint32_t rand_state = 0x9e3779b9;
+    KvsStat stat;
+
+    if (hbtrie_iterator.init(handle->trie, NULL, 0) != HBTRIE_RESULT_SUCCESS) {
+        return handle->trie->getChunkSize();
+    }
+    while (nscan < ADAPTIVE_CHUNKSIZE_SCAN_LIMIT &&
+           hbtrie_iterator.next(keybuf, keylen, (void*)&offset) ==
+           HBTRIE_RESULT_SUCCESS) {
+        if (samples.size() < ADAPTIVE_CHUNKSIZE_NUM_SAMPLES) {
+            samples.push_back(std::string((char*)keybuf, keylen));
+        } else {
+            // xorshift
+            rand_state ^= rand_state << 13;
+            rand_state ^= rand_state >> 17;
+            rand_state ^= rand_state << 5;
+            i = rand_state % (nscan + 1);
+            if (i < ADAPTIVE_CHUNKSIZE_NUM_SAMPLES) {
+                samples[i].assign((char*)keybuf, keylen);
+            }
+        }
+        ++nscan;
+    }
+    if (samples.empty()) {
+        return handle->trie->getChunkSize();
+    }
+
+    for (i = 0; i < samples.size(); ++i) {
+        keys.push_back(samples[i].data());
+        keylens.push_back(samples[i].size());
+    }
+    handle->file->getKvsStatOps()->statGet(0, &stat);
+
+    return HBTrie::estimateChunkSize(keys.data(), keylens.data(), keys.size(),
+                                     std::max(stat.ndocs, nscan),
+                                     handle->file->getBlockSize());
+}
+
 fdb_status fdb_compact_file(fdb_file_handle *fhandle,
                             const char *new_filename,
                             bool in_place_compaction,
@@ -6704,6 +7666,7 @@ fdb_status fdb_compact_file(fdb_file_handle *fhandle,
     BTree *new_staletree = NULL;
     HBTrie *new_seqtrie = NULL;
     FdbKvsHandle *handle = fhandle->getRootHandle();
+    uint16_t chunksize;
     fdb_status status;
     LATENCY_STAT_START();
 
@@ -6719,8 +7682,19 @@ fdb_status fdb_compact_file(fdb_file_handle *fhandle,
     // sync handle
     fdb_sync_db_header(handle);
 
+    // re-evaluate the chunk size as the trie is rebuilt from scratch
+    // (only in single KV instance mode with lexicographical key order,
+    //  as the chunk size is also the length of the KV store ID prefix of
+    //  each key in multi KV instance mode)
+    chunksize = handle->trie->getChunkSize();
+    if (handle->config.adaptive_chunksize && !handle->kvs &&
+        !(handle->fhandle->getFlags() & FHANDLE_ROOT_CUSTOM_CMP)) {
+        chunksize = _fdb_compact_estimate_chunksize(handle);
+    }
+
     // set filemgr configuration
     _fdb_init_file_config(&handle->config, &fconfig);
+    fconfig.setChunkSize(chunksize);
     fconfig.addOptions(FILEMGR_CREATE);
     fconfig.addOptions(FILEMGR_EXCL_CREATE); // fail if file already exists
     if (new_encryption_key) {
@@ -6758,12 +7732,22 @@ fdb_status fdb_compact_file(fdb_file_handle *fhandle,
                                   handle->config.compress_document_body,
                                   &handle->log_callback);
 
-    new_trie = new HBTrie(handle->trie->getChunkSize(),
+    new_trie = new HBTrie(chunksize,
                           handle->trie->getValueLen(),
                           new_file->getBlockSize(), BLK_NOT_FOUND,
                           new_bhandle, (void*)new_dhandle, _fdb_readkey_wrap);
 
     new_trie->setLeafCmp(_fdb_custom_cmp_wrap);
+    new_trie->setLeafPrefixCompression(handle->config.key_prefix_compression,
+                                       handle->config.key_prefix_restart_interval);
+    if (handle->config.key_prefix_compression) {
+        _fdb_upgrade_prefix_compression(new_file);
+    }
+    // the chunk size is kept across compactions, so is the upgrade
+    if (chunksize != handle->trie->getChunkSize() ||
+        ver_recorded_chunksize_support(handle->file->getVersion())) {
+        _fdb_upgrade_recorded_chunksize(new_file);
+    }
     // set aux
     new_trie->setFlag(handle->trie->getFlag());
     new_trie->setLeafHeightLimit(handle->trie->getLeafHeightLimit());
@@ -7112,6 +8096,7 @@ fdb_status _fdb_compact_file(FdbKvsHandle *handle,
 
     delete handle->trie;
     handle->trie = new_trie;
+    handle->config.chunksize = new_trie->getChunkSize();
 
     handle->config.encryption_key = new_file->getEncryption()->key;
 
@@ -7354,6 +8339,13 @@ fdb_status fdb_close(fdb_file_handle *fhandle)
     }
 
     fdb_status fs;
+    FileMgr *file = fhandle->getRootHandle()->file;
+    if (file && file->hasCheckpoints() && file->fhandleIsLast(fhandle)) {
+        // the last handle referring the file .. checkpoints are kept in
+        // memory only, so they should be released before the file is closed
+        return FDB_RESULT_CHECKPOINT_EXISTS;
+    }
+
     if (fhandle->getRootHandle()->config.auto_commit &&
         fhandle->getRootHandle()->file->getRefCount() == 1) {
         // auto commit mode & the last handle referring the file
@@ -7710,6 +8702,29 @@ size_t fdb_estimate_space_used_from(fdb_file_handle *fhandle,
     return ret;
 }
 
+LIBFDB_API
+fdb_status fdb_estimate_chunksize(const void **keys,
+                                  const size_t *keylens,
+                                  size_t num_keys,
+                                  uint64_t num_docs,
+                                  uint16_t *chunksize_out)
+{
+    size_t i;
+
+    if (!keys || !keylens || !num_keys || !chunksize_out) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+    for (i = 0; i < num_keys; ++i) {
+        if (!keys[i] || !keylens[i] || keylens[i] > FDB_MAX_KEYLEN) {
+            return FDB_RESULT_INVALID_ARGS;
+        }
+    }
+
+    *chunksize_out = HBTrie::estimateChunkSize(keys, keylens, num_keys,
+                                               num_docs, FDB_BLOCKSIZE);
+    return FDB_RESULT_SUCCESS;
+}
+
 LIBFDB_API
 fdb_status fdb_get_file_info(fdb_file_handle *fhandle, fdb_file_info *info)
 {
@@ -7974,6 +8989,38 @@ size_t fdb_get_buffer_cache_used() {
     return (size_t) FileMgr::getBcacheUsedSpace();
 }
 
+LIBFDB_API
+size_t fdb_get_compressed_cache_used() {
+    if (!fdb_initialized) {
+        return 0;
+    }
+
+    return (size_t) FileMgr::getCompressedCacheUsedSpace();
+}
+
+LIBFDB_API
+size_t fdb_get_secondary_cache_used() {
+    if (!fdb_initialized) {
+        return 0;
+    }
+
+    return (size_t) FileMgr::getSecondaryCacheUsedSpace();
+}
+
+LIBFDB_API
+fdb_status fdb_save_cache_warmup(fdb_file_handle *fhandle)
+{
+    if (!fhandle || !fhandle->getRootHandle()) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+
+    FdbKvsHandle *handle = fhandle->getRootHandle();
+    fdb_check_file_reopen(handle, NULL);
+
+    return handle->file->saveWarmupSet(NULL, false,
+                                       &handle->log_callback);
+}
+
 LIBFDB_API
 fdb_status fdb_cancel_compaction(fdb_file_handle *fhandle)
 {
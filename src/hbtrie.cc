@@ -19,11 +19,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "hbtrie.h"
 #include "list.h"
 #include "btree.h"
 #include "btree_kv.h"
 #include "btree_fast_str_kv.h"
+#include "btree_prefix_str_kv.h"
 #include "internal_types.h"
 
 #include "memleak.h"
@@ -179,7 +183,7 @@ void HBTrie::init(int _chunksize, int _valuelen, int _btree_nodesize, bid_t _roo
     BTreeKVOps *_btree_kv_ops, *_btree_leaf_kv_ops;
 
     _btree_kv_ops = new FixedKVOps(chunksize, valuelen);
-    _btree_leaf_kv_ops = new FastStrKVOps(chunksize, valuelen);
+    _btree_leaf_kv_ops = new PrefixStrKVOps(chunksize, valuelen);
 
     cmp_args.chunksize = _chunksize;
     cmp_args.aux = NULL;
@@ -191,6 +195,163 @@ void HBTrie::init(int _chunksize, int _valuelen, int _btree_nodesize, bid_t _roo
     allocLastMapChunk();
 }
 
+void HBTrie::setLeafPrefixCompression(bool enable, uint16_t restart_interval)
+{
+    static_cast<PrefixStrKVOps *>(btree_leaf_kv_ops)->
+        setPrefixCompression(enable, restart_interval);
+}
+
+// sample key used by HBTrie::estimateChunkSize()
+struct chunk_est_key {
+    const uint8_t *key;
+    size_t keylen;
+};
+
+struct chunk_est_ctx {
+    std::vector<struct chunk_est_key> keys;
+    size_t chunksize;
+    size_t fanout;
+    double scale;
+    double total_cost;
+};
+
+static bool _chunk_est_key_less(const struct chunk_est_key& a,
+                                const struct chunk_est_key& b)
+{
+    int cmp = memcmp(a.key, b.key, std::min(a.keylen, b.keylen));
+    return cmp < 0 || (cmp == 0 && a.keylen < b.keylen);
+}
+
+// check if two keys have the same chunk at the given offset.
+// Note that the keys are already known to share the first 'offset' bytes.
+static bool _chunk_est_same_chunk(const struct chunk_est_key& a,
+                                  const struct chunk_est_key& b,
+                                  size_t offset, size_t chunksize)
+{
+    size_t len_a = (a.keylen > offset) ? a.keylen - offset : 0;
+    size_t len_b = (b.keylen > offset) ? b.keylen - offset : 0;
+    len_a = std::min(len_a, chunksize);
+    len_b = std::min(len_b, chunksize);
+    return len_a == len_b && !memcmp(a.key + offset, b.key + offset, len_a);
+}
+
+static size_t _chunk_est_height(double nentry, size_t fanout)
+{
+    size_t height = 1;
+    double capacity = fanout;
+    while (capacity < nentry) {
+        capacity *= fanout;
+        ++height;
+    }
+    return height;
+}
+
+// accumulate the lookup cost of the keys in [lo, hi), which share the first
+// 'offset' bytes and whose lookups already visited 'cost' nodes.
+static void _chunk_est_visit(struct chunk_est_ctx *ctx, size_t lo, size_t hi,
+                             size_t offset, size_t cost)
+{
+    size_t i, begin, nchild, nsingle, height;
+    bool exhausted;
+
+    while (true) {
+        if (hi - lo == 1) {
+            // a unique key is found in the B+tree of the current level
+            ctx->total_cost += cost ? cost : 1;
+            return;
+        }
+
+        exhausted = true;
+        for (i = lo; i < hi; ++i) {
+            if (ctx->keys[i].keylen > offset) {
+                exhausted = false;
+                break;
+            }
+        }
+        if (exhausted) {
+            // duplicate sample keys
+            ctx->total_cost += (double)(cost ? cost : 1) * (hi - lo);
+            return;
+        }
+
+        nchild = nsingle = 0;
+        for (begin = lo, i = lo + 1; i <= hi; ++i) {
+            if (i == hi || !_chunk_est_same_chunk(ctx->keys[i-1], ctx->keys[i],
+                                                 offset, ctx->chunksize)) {
+                ++nchild;
+                if (i - begin == 1) {
+                    ++nsingle;
+                }
+                begin = i;
+            }
+        }
+
+        if (nchild > 1) {
+            break;
+        }
+        // the chunk is common to all keys, and skipped by the HB+trie
+        offset += ctx->chunksize;
+    }
+
+    // chunks that appear once in the sample are likely to be distinct in
+    // the whole key space as well
+    height = _chunk_est_height((nchild - nsingle) + nsingle * ctx->scale,
+                               ctx->fanout);
+    for (begin = lo, i = lo + 1; i <= hi; ++i) {
+        if (i == hi || !_chunk_est_same_chunk(ctx->keys[i-1], ctx->keys[i],
+                                             offset, ctx->chunksize)) {
+            _chunk_est_visit(ctx, begin, i, offset + ctx->chunksize,
+                             cost + height);
+            begin = i;
+        }
+    }
+}
+
+size_t HBTrie::estimateChunkSize(const void **keys,
+                                 const size_t *keylens,
+                                 size_t num_keys,
+                                 uint64_t num_total,
+                                 uint32_t nodesize)
+{
+    struct chunk_est_ctx ctx;
+    size_t i, chunksize;
+    size_t min_chunksize = std::max(sizeof(void *), (size_t)HBTRIE_MIN_CHUNKSIZE);
+    size_t best_chunksize = min_chunksize;
+    double best_cost = 0;
+
+    if (num_keys == 0) {
+        return best_chunksize;
+    }
+
+    ctx.keys.resize(num_keys);
+    for (i = 0; i < num_keys; ++i) {
+        ctx.keys[i].key = static_cast<const uint8_t *>(keys[i]);
+        ctx.keys[i].keylen = keylens[i];
+    }
+    std::sort(ctx.keys.begin(), ctx.keys.end(), _chunk_est_key_less);
+    ctx.scale = (num_total > num_keys) ? (double)num_total / num_keys : 1;
+
+    for (chunksize = min_chunksize; chunksize <= HBTRIE_MAX_CHUNKSIZE;
+         chunksize += HBTRIE_MIN_CHUNKSIZE) {
+        ctx.chunksize = chunksize;
+        ctx.fanout = (nodesize - sizeof(struct bnode)) /
+                     (chunksize + OFFSET_SIZE);
+        if (ctx.fanout < 2) {
+            break;
+        }
+        ctx.total_cost = 0;
+        _chunk_est_visit(&ctx, 0, num_keys, 0, 0);
+
+        // smaller chunk is preferred on a tie, as it makes the index smaller
+        if (chunksize == min_chunksize || ctx.total_cost < best_cost) {
+            best_cost = ctx.total_cost;
+            best_chunksize = chunksize;
+        }
+    }
+
+    return best_chunksize;
+}
+
 bool HBTrie::setLastMapChunk(void *key)
 {
     hbtrie_cmp_func *void_cmp;
@@ -1497,6 +1658,341 @@ size_t HBTrie::readKey(uint64_t offset, void *buf)
     return readkey(doc_handle, offset, buf);
 }
 
+typedef enum {
+    HBTRIE_SPLIT_DOC,       // a document
+    HBTRIE_SPLIT_NODE,      // a B+tree node in the trie
+    HBTRIE_SPLIT_SUBTRIE,   // the root B+tree of a sub-trie
+} hbtrie_split_type;
+
+struct hbtrie_split_item {
+    // (smallest) key covered by the item
+    std::string key;
+    // key prefix of the B+tree (NODE), or of the sub-trie (SUBTRIE)
+    std::string prefix;
+    // estimated share of keys covered by the item
+    double weight;
+    bid_t bid;
+    bool leaf;
+    hbtrie_split_type type;
+};
+
+struct hbtrie_split_ctx {
+    HBTrie *trie;
+    const std::string *prefix;
+    uint16_t level;
+    bool leaf;
+    uint8_t *keybuf;
+    uint8_t *valuebuf;
+    std::vector<struct hbtrie_split_item> *items;
+};
+
+static void _hbtrie_split_entry(void *key, void *value, void *ctx)
+{
+    struct hbtrie_split_ctx *sctx = (struct hbtrie_split_ctx *)ctx;
+    HBTrie *trie = sctx->trie;
+    struct hbtrie_split_item item;
+    size_t chunksize = trie->getChunkSize();
+    size_t len;
+    bid_t bid;
+
+    item.prefix = *sctx->prefix;
+    item.leaf = sctx->leaf;
+    item.weight = 0;
+    item.bid = BLK_NOT_FOUND;
+    item.type = HBTRIE_SPLIT_DOC;
+
+    if (sctx->leaf) {
+        // leaf B+tree: the rest of the key
+        trie->getBtreeLeafKvOps()->getVarKey(key, sctx->keybuf, len);
+        item.key = item.prefix;
+        item.key.append((char*)sctx->keybuf, len);
+    } else {
+        // exclude the zero padding so that the key is not greater than
+        // any key starting with this chunk.
+        for (len = chunksize; len > 0; --len) {
+            if (((uint8_t*)key)[len-1]) {
+                break;
+            }
+        }
+        item.key = item.prefix;
+        item.key.append((char*)key, len);
+    }
+
+    if (sctx->level > 1) {
+        // child node of the same B+tree
+        bid = trie->getBtreeKvOps()->value2bid(value);
+        item.bid = _endian_decode(bid);
+        item.type = HBTRIE_SPLIT_NODE;
+    } else if (!sctx->leaf && trie->valueIsMsbSet(value)) {
+        // root of a sub-trie
+        memcpy(sctx->valuebuf, value, trie->getValueLen());
+        trie->valueClearMsb(sctx->valuebuf);
+        bid = trie->getBtreeKvOps()->value2bid(sctx->valuebuf);
+        item.bid = _endian_decode(bid);
+        item.prefix.append((char*)key, chunksize);
+        item.type = HBTRIE_SPLIT_SUBTRIE;
+    }
+    sctx->items->push_back(item);
+}
+
+static bool _hbtrie_split_in_range(std::vector<struct hbtrie_split_item>& items,
+                                   size_t idx,
+                                   void *start_key, size_t start_keylen,
+                                   void *end_key, size_t end_keylen,
+                                   hbtrie_rawkey_cmp_func *cmp, void *ctx)
+{
+    std::string& key = items[idx].key;
+
+    if (end_key &&
+        cmp((void*)key.data(), key.size(), end_key, end_keylen, ctx) >= 0) {
+        return false;
+    }
+    if (start_key && idx + 1 < items.size()) {
+        // the item covers keys up to the key of the next item
+        std::string& next = items[idx+1].key;
+        if (cmp((void*)next.data(), next.size(),
+                start_key, start_keylen, ctx) <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// estimated share of keys that an item covers within the given range.
+// A document is either in the range or not, while a node crossing a boundary
+// of the range is assumed to cover half of its keys there.
+static double _hbtrie_split_weight(std::vector<struct hbtrie_split_item>& items,
+                                   size_t idx,
+                                   void *start_key, size_t start_keylen,
+                                   void *end_key, size_t end_keylen,
+                                   hbtrie_rawkey_cmp_func *cmp, void *ctx)
+{
+    std::string& key = items[idx].key;
+    bool partial = false;
+
+    if (!_hbtrie_split_in_range(items, idx, start_key, start_keylen,
+                                end_key, end_keylen, cmp, ctx)) {
+        return 0;
+    }
+    if (start_key &&
+        cmp((void*)key.data(), key.size(), start_key, start_keylen, ctx) < 0) {
+        if (items[idx].type == HBTRIE_SPLIT_DOC) {
+            return 0;
+        }
+        partial = true;
+    }
+    if (end_key && items[idx].type != HBTRIE_SPLIT_DOC) {
+        if (idx + 1 == items.size()) {
+            partial = true;
+        } else {
+            std::string& next = items[idx+1].key;
+            if (cmp((void*)next.data(), next.size(),
+                    end_key, end_keylen, ctx) > 0) {
+                partial = true;
+            }
+        }
+    }
+    return (partial) ? items[idx].weight / 2 : items[idx].weight;
+}
+
+hbtrie_result HBTrie::sampleRange(void *start_key, size_t start_keylen,
+                                  void *end_key, size_t end_keylen,
+                                  size_t target,
+                                  hbtrie_rawkey_cmp_func *cmp, void *ctx,
+                                  std::vector<struct hbtrie_split_item>& items)
+{
+    std::vector<struct hbtrie_split_item> children;
+    struct hbtrie_split_item root;
+    struct hbtrie_split_ctx sctx;
+    struct hbtrie_meta hbmeta;
+    struct btree_meta meta;
+    uint8_t *buf = alca(uint8_t, btree_nodesize);
+    uint8_t *keybuf = alca(uint8_t, HBTRIE_MAX_KEYLEN);
+    uint8_t *valuebuf = alca(uint8_t, valuelen);
+    size_t i, best, count, nread = 0;
+    btree_result br;
+
+    root.weight = 1.0;
+    root.bid = root_bid;
+    root.leaf = false;
+    root.type = HBTRIE_SPLIT_SUBTRIE;
+    items.push_back(root);
+    meta.data = buf;
+
+    // every expansion reads one node; bound the number of reads in case
+    // that most nodes have a single entry.
+    while (nread < target * 4) {
+        count = 0;
+        best = items.size();
+        for (i = 0; i < items.size(); ++i) {
+            if (!_hbtrie_split_in_range(items, i, start_key, start_keylen,
+                                        end_key, end_keylen, cmp, ctx)) {
+                continue;
+            }
+            ++count;
+            if (items[i].type != HBTRIE_SPLIT_DOC &&
+                (best == items.size() || items[i].weight > items[best].weight)) {
+                best = i;
+            }
+        }
+        if (count >= target || best == items.size()) {
+            break;
+        }
+
+        // replace the item by the entries of its node
+        struct hbtrie_split_item &item = items[best];
+        std::string prefix = item.prefix;
+        bool leaf = item.leaf;
+        BTree btree;
+
+        br = btree.initFromBid(btreeblk_handle,
+                               (leaf) ? btree_leaf_kv_ops : btree_kv_ops,
+                               btree_nodesize, item.bid);
+        if (br != BTREE_RESULT_SUCCESS) {
+            return HBTRIE_RESULT_FAIL;
+        }
+        btree.setAux(aux);
+        if (item.type == HBTRIE_SPLIT_SUBTRIE) {
+            meta.size = btree.readMeta(meta.data);
+            fetchMeta(meta.size, &hbmeta, meta.data);
+            if (_is_leaf_btree(hbmeta.chunkno)) {
+                leaf = true;
+                btree.setKVOps(btree_leaf_kv_ops);
+            }
+            if (hbmeta.prefix && hbmeta.prefix_len) {
+                // skipped common prefix
+                prefix.append((char*)hbmeta.prefix, hbmeta.prefix_len);
+            }
+        }
+
+        children.clear();
+        sctx.trie = this;
+        sctx.prefix = &prefix;
+        sctx.level = btree.getHeight();
+        sctx.leaf = leaf;
+        sctx.keybuf = keybuf;
+        sctx.valuebuf = valuebuf;
+        sctx.items = &children;
+        br = btree.readNodeEntries(item.bid, _hbtrie_split_entry, &sctx);
+        if (br != BTREE_RESULT_SUCCESS) {
+            return HBTRIE_RESULT_FAIL;
+        }
+        for (i = 0; i < children.size(); ++i) {
+            children[i].weight = item.weight / children.size();
+        }
+        if (!children.empty()) {
+            // the first entry covers the keys from the beginning of the node
+            children[0].key = item.key;
+        }
+        items.erase(items.begin() + best);
+        items.insert(items.begin() + best, children.begin(), children.end());
+        ++nread;
+    }
+
+    // leave only the share of each item within the range
+    children = items;
+    for (i = 0; i < items.size(); ++i) {
+        items[i].weight = _hbtrie_split_weight(children, i,
+                                               start_key, start_keylen,
+                                               end_key, end_keylen, cmp, ctx);
+    }
+
+    return HBTRIE_RESULT_SUCCESS;
+}
+
+hbtrie_result HBTrie::estimateSplitKeys(void *start_key, size_t start_keylen,
+                                        void *end_key, size_t end_keylen,
+                                        size_t num,
+                                        hbtrie_rawkey_cmp_func *cmp, void *ctx,
+                                        std::vector<std::string>& keys_out,
+                                        std::vector<double> *weights_out)
+{
+    std::vector<struct hbtrie_split_item> items;
+    size_t i;
+    double total, acc, last;
+    hbtrie_result hr;
+
+    if (num == 0) {
+        return HBTRIE_RESULT_FAIL;
+    }
+    if (num == 1 && !weights_out) {
+        return HBTRIE_RESULT_SUCCESS;
+    }
+    if (root_bid == BLK_NOT_FOUND) {
+        if (weights_out) {
+            weights_out->push_back(0);
+        }
+        return HBTRIE_RESULT_SUCCESS;
+    }
+
+    hr = sampleRange(start_key, start_keylen, end_key, end_keylen,
+                     (num == 1) ? HBTRIE_ESTIMATE_SAMPLES
+                                : num * HBTRIE_SPLIT_OVERSAMPLE,
+                     cmp, ctx, items);
+    if (hr != HBTRIE_RESULT_SUCCESS) {
+        return hr;
+    }
+
+    total = 0;
+    for (i = 0; i < items.size(); ++i) {
+        total += items[i].weight;
+    }
+
+    // choose the first key of the item where each sub-range begins
+    size_t k = 1;
+    acc = last = 0;
+    for (i = 0; i < items.size() && k < num; ++i) {
+        if (items[i].weight <= 0) {
+            continue;
+        }
+        if (acc >= total * k / num) {
+            std::string& key = items[i].key;
+            if ((!start_key ||
+                 cmp((void*)key.data(), key.size(),
+                     start_key, start_keylen, ctx) > 0) &&
+                (!end_key ||
+                 cmp((void*)key.data(), key.size(),
+                     end_key, end_keylen, ctx) < 0) &&
+                (keys_out.empty() ||
+                 cmp((void*)key.data(), key.size(),
+                     (void*)keys_out.back().data(), keys_out.back().size(),
+                     ctx) > 0)) {
+                keys_out.push_back(key);
+                if (weights_out) {
+                    weights_out->push_back(acc - last);
+                    last = acc;
+                }
+            }
+            while (k < num && acc >= total * k / num) {
+                ++k;
+            }
+        }
+        acc += items[i].weight;
+    }
+    if (weights_out) {
+        weights_out->push_back(total - last);
+    }
+
+    return HBTRIE_RESULT_SUCCESS;
+}
+
+hbtrie_result HBTrie::estimateRangeWeight(void *start_key, size_t start_keylen,
+                                          void *end_key, size_t end_keylen,
+                                          hbtrie_rawkey_cmp_func *cmp,
+                                          void *ctx, double *weight_out)
+{
+    std::vector<std::string> keys;
+    std::vector<double> weights;
+    hbtrie_result hr;
+
+    hr = estimateSplitKeys(start_key, start_keylen, end_key, end_keylen, 1,
+                           cmp, ctx, keys, &weights);
+    if (hr == HBTRIE_RESULT_SUCCESS) {
+        *weight_out = weights[0];
+    }
+    return hr;
+}
+
 
 HBTrieIterator::HBTrieIterator() :
     trie(), curkey(NULL), keylen(0), flags(0)
@@ -2188,6 +2684,28 @@ hbtrie_result HBTrieIterator::nextValueOnly(void *value_buf)
     return hr;
 }
 
+hbtrie_result HBTrieIterator::prevValueOnly(void *value_buf)
+{
+    size_t keylen_temp = 0;
+    hbtrie_result hr;
+
+    if (curkey == NULL) {
+        return HBTRIE_RESULT_FAIL;
+    }
+
+    struct list_elem *e = list_begin(&btreeit_list);
+    struct btreeit_item *item = NULL;
+    if (e) item = _get_entry(e, struct btreeit_item, le);
+
+    hr = _prev(item, NULL, keylen_temp, value_buf, HBTRIE_PREFIX_MATCH_ONLY);
+    if (hr != HBTRIE_RESULT_SUCCESS) {
+        // this iterator reaches the beginning of hb-trie
+        free(curkey);
+        curkey = NULL;
+    }
+    return hr;
+}
+
 // move iterator's cursor to the end of the key range.
 // hbtrie_prev() call after hbtrie_last() will return the last key.
 hbtrie_result HBTrieIterator::last()
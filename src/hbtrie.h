@@ -18,6 +18,9 @@
 #ifndef _JSAHN_HBTRIE_H
 #define _JSAHN_HBTRIE_H
 
+#include <string>
+#include <vector>
+
 #include "common.h"
 #include "btree.h"
 #include "list.h"
@@ -28,6 +31,14 @@ extern "C" {
 
 #define HBTRIE_MAX_KEYLEN (FDB_MAX_KEYLEN_INTERNAL+16)
 #define HBTRIE_HEADROOM (256)
+// number of index entries examined per sub-range when splitting a key range
+#define HBTRIE_SPLIT_OVERSAMPLE (8)
+// number of index entries sampled to estimate the size of a key range
+#define HBTRIE_ESTIMATE_SAMPLES (64)
+
+// range of the chunk size
+#define HBTRIE_MIN_CHUNKSIZE (4)
+#define HBTRIE_MAX_CHUNKSIZE (64)
 
 #define _len2chunk(len) (( (len) + (chunksize-1) ) / chunksize)
 
@@ -37,6 +48,9 @@ typedef size_t hbtrie_func_readkey(void *handle, uint64_t offset, void *buf);
 typedef int hbtrie_cmp_func(void *key1, void *key2, void* aux);
 // a function pointer to a routine that returns a function pointer
 typedef hbtrie_cmp_func *hbtrie_cmp_map(void *chunk, void *aux);
+// compares two raw keys in the order of the keys in the HB+trie
+typedef int hbtrie_rawkey_cmp_func(void *key1, size_t keylen1,
+                                   void *key2, size_t keylen2, void *ctx);
 
 typedef enum {
     /**
@@ -60,6 +74,7 @@ typedef enum {
 #define HBTRIE_FLAG_COMPACT (0x01)
 struct btree_blk_ops;
 struct btree_kv_ops;
+struct hbtrie_split_item;
 
 /**
  * HB+trie handle definition.
@@ -161,6 +176,41 @@ public:
         btree_leaf_kv_ops->setCmpFunc(_cmp);
     }
 
+    /**
+     * Enable or disable the key prefix compression of the nodes in leaf
+     * B+trees that are modified afterwards. Nodes in either format can be
+     * read regardless of this setting.
+     *
+     * @param enable Flag to enable the key prefix compression.
+     * @param restart_interval Restart interval of the delta encoding.
+     */
+    void setLeafPrefixCompression(bool enable, uint16_t restart_interval);
+
+    /**
+     * Estimate the chunk size that minimizes the average number of B+tree
+     * nodes visited by a lookup, for the key distribution represented by the
+     * given sample keys.
+     *
+     * Each candidate chunk size is evaluated by building the trie structure
+     * of the (sorted) sample keys: a chunk shared by all keys of a sub-trie
+     * is skipped, and every other level costs the height of a B+tree whose
+     * fanout is decided by the chunk size and the node size. Distinct chunks
+     * that appear only once in the sample are scaled up to the total number
+     * of keys.
+     *
+     * @param keys Array of sample keys.
+     * @param keylens Array of the lengths of the sample keys.
+     * @param num_keys Number of sample keys.
+     * @param num_total Total number of keys that the sample represents.
+     * @param nodesize B+tree node size.
+     * @return Estimated chunk size.
+     */
+    static size_t estimateChunkSize(const void **keys,
+                                    const size_t *keylens,
+                                    size_t num_keys,
+                                    uint64_t num_total,
+                                    uint32_t nodesize);
+
     void setMapFunction(hbtrie_cmp_map* _map_func) {
         map = _map_func;
     }
@@ -208,6 +258,61 @@ public:
      */
     size_t readKey(uint64_t offset, void *buf);
 
+    /**
+     * Estimate the keys that split the given key range into 'num' sub-ranges
+     * holding similar numbers of keys, by reading only a small number of
+     * index nodes. Starting from the root B+tree, the node (or sub-trie)
+     * covering the largest estimated share of the range is repeatedly
+     * replaced by its entries, each of which is assumed to cover an equal
+     * share of its parent, until about HBTRIE_SPLIT_OVERSAMPLE entries per
+     * sub-range are found. The split keys are then chosen from the first
+     * keys of these entries.
+     *
+     * @param start_key Start raw key of the range, or NULL for the smallest
+     *        key in the trie.
+     * @param start_keylen Length of the start key.
+     * @param end_key Raw key where the range ends (exclusively), or NULL for
+     *        the largest key in the trie.
+     * @param end_keylen Length of the end key.
+     * @param num Number of sub-ranges.
+     * @param cmp Function comparing two raw keys.
+     * @param ctx Context passed to 'cmp'.
+     * @param keys_out Reference to the vector where the split keys are
+     *        appended in ascending order. Each key is greater than the start
+     *        key and smaller than the end key, and the number of keys can be
+     *        smaller than 'num - 1' if the range is too small to be split.
+     * @param weights_out Pointer to the vector where the estimated share of
+     *        the keys in the trie covered by each sub-range is appended
+     *        (one more entry than the split keys), or NULL.
+     * @return HBTRIE_RESULT_SUCCESS on success.
+     */
+    hbtrie_result estimateSplitKeys(void *start_key, size_t start_keylen,
+                                    void *end_key, size_t end_keylen,
+                                    size_t num,
+                                    hbtrie_rawkey_cmp_func *cmp, void *ctx,
+                                    std::vector<std::string>& keys_out,
+                                    std::vector<double> *weights_out = NULL);
+
+    /**
+     * Estimate the share of the keys in the trie that belong to the given key
+     * range, by sampling about HBTRIE_ESTIMATE_SAMPLES index entries in the
+     * same way as estimateSplitKeys.
+     *
+     * @param start_key Start raw key of the range, or NULL.
+     * @param start_keylen Length of the start key.
+     * @param end_key Raw key where the range ends (exclusively), or NULL.
+     * @param end_keylen Length of the end key.
+     * @param cmp Function comparing two raw keys.
+     * @param ctx Context passed to 'cmp'.
+     * @param weight_out Pointer to the variable where the estimated share
+     *        (between 0 and 1) is returned.
+     * @return HBTRIE_RESULT_SUCCESS on success.
+     */
+    hbtrie_result estimateRangeWeight(void *start_key, size_t start_keylen,
+                                      void *end_key, size_t end_keylen,
+                                      hbtrie_rawkey_cmp_func *cmp, void *ctx,
+                                      double *weight_out);
+
 private:
     typedef enum {
         HBMETA_NORMAL,
@@ -301,6 +406,22 @@ private:
     hbtrie_result _find(void *key, int keylen, void *valuebuf,
                         struct list *btreelist, uint8_t flag);
 
+    /**
+     * Expand the index nodes covering the given key range, starting from the
+     * root B+tree, until about 'target' entries in the range are found.
+     *
+     * @param target Number of entries to be found in the range.
+     * @param items Reference to the vector where the entries are returned in
+     *        key order, with their estimated shares of the keys in the trie
+     *        that belong to the range.
+     * @return HBTRIE_RESULT_SUCCESS on success.
+     */
+    hbtrie_result sampleRange(void *start_key, size_t start_keylen,
+                              void *end_key, size_t end_keylen,
+                              size_t target,
+                              hbtrie_rawkey_cmp_func *cmp, void *ctx,
+                              std::vector<struct hbtrie_split_item>& items);
+
     hbtrie_result _remove(void *rawkey, int rawkeylen, uint8_t flag);
 
     /**
@@ -400,6 +521,13 @@ public:
      * @return HBTRIE_RESULT_SUCCESS on success.
      */
     hbtrie_result nextValueOnly(void *value_buf);
+    /**
+     * Get previous value only.
+     *
+     * @param value_buf Pointer to the buffer where value will be read.
+     * @return HBTRIE_RESULT_SUCCESS on success.
+     */
+    hbtrie_result prevValueOnly(void *value_buf);
     /**
      * Move the iterator cursor to the end of the key space.
      *
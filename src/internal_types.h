@@ -46,6 +46,20 @@ class WalItr;
 #define FDB_MAX_KEYLEN_INTERNAL (65520)
 
 // Versioning information...
+// Version 004 - HB+trie chunk size recorded in the DB header flags
+//               (FDB_FLAG_CHUNKSIZE_MASK), which differs from the configured
+//               one. Only the files whose chunk size is not taken from the
+//               config (e.g., chosen by adaptive compaction) are upgraded to
+//               this version, as older versions use the configured chunk size
+//               to read the HB+trie. The rest of the format is the same as
+//               version 003.
+#define FILEMGR_MAGIC_004 (UINT64_C(0xdeadcafebeefc004))
+// Version 003 - B+tree nodes with compressed key prefixes (BNODE_MASK_PREFIX).
+//               Only the files written with key_prefix_compression enabled are
+//               upgraded to this version, so that older versions, which cannot
+//               read those nodes, refuse to open them. The rest of the format
+//               is the same as version 002.
+#define FILEMGR_MAGIC_003 (UINT64_C(0xdeadcafebeefc003))
 // Version 002 - added stale-block tree info
 #define FILEMGR_MAGIC_002 (UINT64_C(0xdeadcafebeefc002))
 // Version 001 - added delta size to DB header and CRC-32C
@@ -55,7 +69,7 @@ class WalItr;
 //               unexpected behavior or crash, this magic number is no longer
 //               supported.)
 #define FILEMGR_MAGIC_000 (UINT64_C(0xdeadcafebeefbeef))
-#define FILEMGR_LATEST_MAGIC FILEMGR_MAGIC_002
+#define FILEMGR_LATEST_MAGIC FILEMGR_MAGIC_004
 
 
 /**
@@ -344,6 +358,96 @@ struct _fdb_transaction {
      * Pointer to transaction wrapper.
      */
     struct wal_txn_wrapper *wrapper;
+    /**
+     * Versions of the keys read or written by the transaction, used for
+     * conflict detection (FDB_ISOLATION_OPTIMISTIC only, NULL otherwise).
+     */
+    struct avl_tree *key_versions;
+    /**
+     * Private buffer of the updates not inserted into the WAL yet
+     * (NULL if write buffering is disabled).
+     */
+    struct txn_write_buffer *write_buffer;
+    /**
+     * Length of the KV store ID prefix of the keys in 'key_versions' and
+     * 'write_buffer' (0 if multi KV instance mode is disabled).
+     */
+    size_t kvid_len;
+};
+
+/**
+ * Document updated by a transaction and kept in its private write buffer.
+ */
+struct txn_buffered_doc {
+    /**
+     * AVL tree node in the buffer's key index.
+     */
+    struct avl_node avl;
+    /**
+     * List element in the buffer's update list.
+     */
+    struct list_elem le;
+    /**
+     * Key (including KV store ID prefix in multi KV instance mode).
+     */
+    void *key;
+    void *meta;
+    void *body;
+    size_t keylen;
+    size_t metalen;
+    size_t bodylen;
+    fdb_seqnum_t seqnum;
+    uint32_t timestamp;
+    bool deleted;
+    /**
+     * Custom compare function of the KV store that the key belongs to.
+     */
+    fdb_custom_cmp_variable custom_cmp;
+};
+
+/**
+ * Private write buffer of a transaction.
+ */
+struct txn_write_buffer {
+    /**
+     * Buffered documents indexed by key.
+     */
+    struct avl_tree key_index;
+    /**
+     * Buffered documents in the order of their last updates.
+     */
+    struct list docs;
+    /**
+     * Sum of the key, meta, and body sizes of the buffered documents.
+     */
+    uint64_t size;
+};
+
+/**
+ * Version of a key accessed by an optimistic transaction.
+ */
+struct txn_key_version {
+    /**
+     * AVL tree node in the transaction's key version tree.
+     */
+    struct avl_node avl;
+    /**
+     * Key (including KV store ID prefix in multi KV instance mode).
+     */
+    void *key;
+    /**
+     * Length of the key.
+     */
+    size_t keylen;
+    /**
+     * Sequence number of the committed version that the transaction saw
+     * when it first accessed the key (0 if the key did not exist).
+     */
+    fdb_seqnum_t seqnum;
+    /**
+     * Custom compare function of the KV store that the key belongs to.
+     */
+    fdb_custom_cmp_variable custom_cmp;
 };
 
 /* Global KV store header for each file
@@ -492,6 +596,9 @@ struct stale_regions {
 #define FDB_FLAG_SEQTREE_USE (0x1)
 #define FDB_FLAG_ROOT_INITIALIZED (0x2)
 #define FDB_FLAG_ROOT_CUSTOM_CMP (0x4)
+// HB+trie chunk size of the file (0: not recorded)
+#define FDB_FLAG_CHUNKSIZE_SHIFT (8)
+#define FDB_FLAG_CHUNKSIZE_MASK (0xff00)
 
 #ifdef __cplusplus
 }
@@ -20,6 +20,10 @@
 #include <string.h>
 #include <fcntl.h>
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include "libforestdb/forestdb.h"
 #include "fdb_internal.h"
 #include "hbtrie.h"
@@ -98,6 +102,40 @@ static int _fdb_key_cmp(fdb_iterator *iterator, void *key1, size_t keylen1,
     return cmp;
 }
 
+// compares two keys in the trie of the handle passed as 'ctx'. Unlike
+// _fdb_key_cmp(), a key consisting of a KV ID (or a part of it) only is
+// also allowed, and it is smaller than any other key of the KV store.
+static int _fdb_split_key_cmp(void *key1, size_t keylen1,
+                              void *key2, size_t keylen2, void *ctx)
+{
+    FdbKvsHandle *handle = (FdbKvsHandle *)ctx;
+    size_t size_chunk = handle->config.chunksize;
+    int cmp;
+
+    if (!handle->kvs_config.custom_cmp) {
+        return _fdb_keycmp(key1, keylen1, key2, keylen2);
+    }
+
+    if (handle->kvs) {
+        // multi KV instance mode
+        if (keylen1 <= size_chunk || keylen2 <= size_chunk) {
+            return _fdb_keycmp(key1, keylen1, key2, keylen2);
+        }
+        cmp = memcmp(key1, key2, size_chunk);
+        if (cmp != 0) {
+            return cmp;
+        }
+        return handle->kvs_config.custom_cmp(
+                   (uint8_t*)key1 + size_chunk, keylen1 - size_chunk,
+                   (uint8_t*)key2 + size_chunk, keylen2 - size_chunk);
+    }
+
+    if (keylen1 == 0 || keylen2 == 0) {
+        return (int)((int)keylen1 - (int)keylen2);
+    }
+    return handle->kvs_config.custom_cmp(key1, keylen1, key2, keylen2);
+}
+
 FdbIterator::FdbIterator(FdbKvsHandle *_handle,
                          bool snapshoted_handle,
                          const void *start_key,
@@ -107,10 +145,18 @@ FdbIterator::FdbIterator(FdbKvsHandle *_handle,
                          fdb_iterator_opt_t opt)
     : iterHandle(_handle), snapshotHandle(snapshoted_handle),
       seqtreeIterator(nullptr), seqtrieIterator(nullptr),
-      seqNum(0), iterOpt(opt), iterDirection(FDB_ITR_DIR_NONE),
+      seqNum(0), maxSeqVisited(0), iterOpt(opt), iterDirection(FDB_ITR_DIR_NONE),
       iterStatus(FDB_ITR_IDX), iterOffset(BLK_NOT_FOUND),
-      dHandle(nullptr), getOffset(0), iterType(FDB_ITR_REG)
+      dHandle(nullptr), getOffset(0), iterType(FDB_ITR_REG),
+      mmapSeqFile(nullptr), mmapLastOffset(BLK_NOT_FOUND),
+      mmapPrefetchPos(BLK_NOT_FOUND), raIterator(nullptr), raOffsets(nullptr),
+      raBids(nullptr), raKeyBuf(nullptr), raPending(0),
+      raAioHandle(nullptr), raRemaining(0),
+      raWindow(ITR_READAHEAD_MIN_WINDOW), raDirection(FDB_ITR_DIR_NONE),
+      raEnd(false), raAioFailed(false), filterFunc(nullptr),
+      filterCtx(nullptr)
 {
+    memset(&projection, 0, sizeof(projection));
     iterKey.data = (void*)malloc(FDB_MAX_KEYLEN_INTERNAL);
     // set to zero the first <chunksize> bytes
     memset(iterKey.data, 0x0, iterHandle->config.chunksize);
@@ -220,12 +266,20 @@ FdbIterator::FdbIterator(FdbKvsHandle *_handle,
                          fdb_iterator_opt_t opt)
     : iterHandle(_handle), snapshotHandle(snapshoted_handle),
       hbtrieIterator(nullptr), seqtreeIterator(nullptr),
-      seqtrieIterator(nullptr), seqNum(start_seq),
+      seqtrieIterator(nullptr), seqNum(start_seq), maxSeqVisited(0),
       startSeqnum(start_seq), iterOpt(opt), iterDirection(FDB_ITR_DIR_NONE),
       iterStatus(FDB_ITR_IDX), iterKey({nullptr, 0}),
       iterOffset(BLK_NOT_FOUND), dHandle(nullptr), getOffset(0),
-      iterType(FDB_ITR_SEQ)
+      iterType(FDB_ITR_SEQ), mmapSeqFile(nullptr),
+      mmapLastOffset(BLK_NOT_FOUND), mmapPrefetchPos(BLK_NOT_FOUND),
+      raIterator(nullptr), raOffsets(nullptr),
+      raBids(nullptr), raKeyBuf(nullptr), raPending(0),
+      raAioHandle(nullptr), raRemaining(0),
+      raWindow(ITR_READAHEAD_MIN_WINDOW), raDirection(FDB_ITR_DIR_NONE),
+      raEnd(false), raAioFailed(false), filterFunc(nullptr),
+      filterCtx(nullptr)
 {
+    memset(&projection, 0, sizeof(projection));
     // For easy API call, treat zero seq as 0xffff...
     // (because zero seq number is not used)
     if (end_seq == 0) {
@@ -305,6 +359,24 @@ FdbIterator::~FdbIterator()
         free(endKey.data);
     }
 
+    if (mmapSeqFile) {
+        mmapSeqFile->adviseSequentialScan(false);
+    }
+
+    resetReadAhead();
+    free(raOffsets);
+    free(raBids);
+    free(raKeyBuf);
+    if (raAioHandle) {
+        // the reads in flight use the buffers of the handle
+        iterHandle->file->completeAsyncBlocks(raAioHandle, true,
+                                              &iterHandle->log_callback);
+        iterHandle->file->getOps()->aio_destroy(
+                                    iterHandle->file->getFopsHandle(),
+                                    raAioHandle);
+        free(raAioHandle);
+    }
+
     // Decrement the iterator counter of the KV handle
     --iterHandle->num_iterators;
 
@@ -359,6 +431,8 @@ fdb_status FdbIterator::initIterator(FdbKvsHandle *handle,
         fdb_check_file_reopen(handle, NULL);
         fdb_sync_db_header(handle);
     }
+    // stop reading through the mapping if the file has been truncated
+    handle->file->checkMapping();
 
     LATENCY_STAT_START();
 
@@ -420,6 +494,8 @@ fdb_status FdbIterator::initSeqIterator(FdbKvsHandle *handle,
         fdb_check_file_reopen(handle, NULL);
         fdb_sync_db_header(handle);
     }
+    // stop reading through the mapping if the file has been truncated
+    handle->file->checkMapping();
 
     LATENCY_STAT_START();
 
@@ -504,6 +580,7 @@ fdb_status FdbIterator::seek(const void *seek_key,
     }
 
     iterHandle->op_stats->num_iterator_moves++;
+    resetReadAhead();
 
     if (iterHandle->kvs) {
         seek_keylen_kv = seek_keylen + size_chunk;
@@ -902,6 +979,12 @@ fetch_hbtrie:
         }
     }
 
+    if (dHandle && !next_op && filterFunc &&
+        checkFilter(dHandle, getOffset) != FDB_RESULT_SUCCESS) {
+        // the doc is skipped by the filter, move to the next one
+        next_op = (seek_pref == FDB_ITR_SEEK_HIGHER) ? 1 : -1;
+    }
+
     cond = 1;
     iterHandle->handle_busy.compare_exchange_strong(cond, 0);
     if (!dHandle) {
@@ -945,6 +1028,7 @@ fdb_status FdbIterator::seekToMin() {
     }
 
     // reset HB+trie iterator using start key
+    resetReadAhead();
     delete hbtrieIterator;
     hbtrieIterator = new HBTrieIterator(iterHandle->trie,
                                         startKey.data, startKey.len);
@@ -975,6 +1059,269 @@ fdb_status FdbIterator::seekToMax() {
     return ret;
 }
 
+void FdbIterator::adviseMappedAccess(fdb_iterator_dir_t dir) {
+    FileMgr *file = iterHandle->file;
+    uint64_t offset = getOffset;
+    uint64_t last = mmapLastOffset;
+
+    if (!file->isMapped()) {
+        return;
+    }
+    mmapLastOffset = offset;
+    if (last == BLK_NOT_FOUND) {
+        return;
+    }
+
+    // Hints are given only if consecutive docs are close to each other in
+    // the file (e.g., a compacted file scanned in the key order).
+    if (dir == FDB_ITR_FORWARD) {
+        if (!mmapSeqFile && offset > last &&
+            offset - last < ITR_MMAP_PREFETCH_SIZE) {
+            // OS readahead takes care of the forward scan
+            file->adviseSequentialScan(true);
+            mmapSeqFile = file;
+        }
+    } else {
+        if (mmapSeqFile) {
+            mmapSeqFile->adviseSequentialScan(false);
+            mmapSeqFile = nullptr;
+        }
+        if (offset < last && last - offset < ITR_MMAP_PREFETCH_SIZE &&
+            (mmapPrefetchPos == BLK_NOT_FOUND ||
+             offset < mmapPrefetchPos + ITR_MMAP_PREFETCH_SIZE / 2 ||
+             offset >= mmapPrefetchPos + 2 * ITR_MMAP_PREFETCH_SIZE)) {
+            // OS readahead doesn't work backward .. prefetch the region
+            // in front of the cursor
+            uint64_t begin = (offset > ITR_MMAP_PREFETCH_SIZE)
+                             ? offset - ITR_MMAP_PREFETCH_SIZE : 0;
+            file->prefetchMapped(begin, offset - begin);
+            mmapPrefetchPos = begin;
+        }
+    }
+}
+
+void FdbIterator::readAhead(itr_seek_t seek_type) {
+    FileMgr *file = iterHandle->file;
+    fdb_iterator_dir_t dir = (seek_type == ITR_SEEK_PREV) ? FDB_ITR_REVERSE
+                                                          : FDB_ITR_FORWARD;
+    size_t num = 0, num_bids, num_cached;
+    uint64_t offset;
+    hbtrie_result hr;
+
+    if (!iterHandle->config.iterator_readahead || file->isMapped()) {
+        return;
+    }
+    completeReadAhead();
+
+    if (raDirection != dir) {
+        if (raRemaining > raWindow / 2) {
+            // most of the docs read ahead were not used
+            raWindow = MAX(raWindow / 2, ITR_READAHEAD_MIN_WINDOW);
+        }
+        resetReadAhead();
+        raDirection = dir;
+    }
+    if (raRemaining) {
+        --raRemaining;
+    }
+    if (raEnd || raRemaining > raWindow / 2) {
+        // refill the window when half of it is consumed
+        return;
+    }
+
+    if (!raOffsets) {
+        raOffsets = (uint64_t *)malloc(sizeof(uint64_t) *
+                                       ITR_READAHEAD_MAX_WINDOW);
+    }
+    if (!raIterator) {
+        // start from the current position of the cursor
+        raIterator = new HBTrieIterator(iterHandle->trie,
+                                        iterKey.data, iterKey.len);
+    }
+
+    // keys are not fetched, as it requires reading the docs. Instead, the
+    // keys of the docs read ahead are checked against the range once their
+    // first blocks are cached.
+    while (num < raWindow - raRemaining) {
+        if (dir == FDB_ITR_REVERSE) {
+            hr = raIterator->prevValueOnly((void*)&offset);
+        } else {
+            hr = raIterator->nextValueOnly((void*)&offset);
+        }
+        iterHandle->bhandle->flushBuffer();
+        if (hr != HBTRIE_RESULT_SUCCESS) {
+            raEnd = true;
+            break;
+        }
+        raOffsets[num++] = _endian_decode(offset);
+    }
+    if (!num) {
+        return;
+    }
+    raRemaining += num;
+
+    num_cached = prefetchDocs(num, false, &num_bids);
+
+    // adapt the window to the hit ratio of the blocks read ahead
+    if (num_cached * 10 >= num_bids * 9) {
+        raWindow = MAX(raWindow / 2, ITR_READAHEAD_MIN_WINDOW);
+    } else if (num_cached * 2 <= num_bids) {
+        raWindow = MIN(raWindow * 2, ITR_READAHEAD_MAX_WINDOW);
+    }
+}
+
+size_t FdbIterator::prefetchDocs(size_t num, bool retry, size_t *num_bids) {
+    FileMgr *file = iterHandle->file;
+    DocioHandle *dhandle = iterHandle->dhandle;
+    size_t i, n = 0, num_pending = 0;
+    keylen_t keylen;
+    bid_t bid, last_bid;
+
+    if (!raBids) {
+        raBids = (bid_t *)malloc(sizeof(bid_t) * ITR_READAHEAD_MAX_BLOCKS);
+        raKeyBuf = malloc(FDB_MAX_KEYLEN_INTERNAL);
+    }
+
+    for (i = 0; i < num && n < ITR_READAHEAD_MAX_BLOCKS; ++i) {
+        bid = raOffsets[i] / file->getBlockSize();
+        if (dhandle->readCachedDocKey_Docio(raOffsets[i], &keylen, raKeyBuf,
+                                            &last_bid) == FDB_RESULT_SUCCESS) {
+            if (iterType != FDB_ITR_SEQ && isReadAheadEnd(raKeyBuf, keylen)) {
+                // the rest of the docs are out of the range, too
+                raEnd = true;
+                break;
+            }
+        } else if (retry) {
+            // the first block wasn't loaded
+            continue;
+        } else {
+            // the length of the doc is unknown until its first block is read
+            raOffsets[num_pending++] = raOffsets[i];
+            last_bid = bid;
+        }
+        for (; bid <= last_bid && n < ITR_READAHEAD_MAX_BLOCKS; ++bid) {
+            raBids[n++] = bid;
+        }
+    }
+
+    // read the blocks in the order of their positions in the file
+    std::sort(raBids, raBids + n);
+    *num_bids = std::unique(raBids, raBids + n) - raBids;
+
+    if (!raAioHandle && !raAioFailed) {
+        raAioHandle = (struct async_io_handle *)
+                      calloc(1, sizeof(struct async_io_handle));
+        raAioHandle->queue_depth = ASYNC_IO_QUEUE_DEPTH;
+        raAioHandle->block_size = file->getBlockSize();
+        raAioHandle->fops_handle = file->getFopsHandle();
+        if (file->getOps()->aio_init(file->getFopsHandle(),
+                                     raAioHandle) != FDB_RESULT_SUCCESS) {
+            free(raAioHandle);
+            raAioHandle = nullptr;
+            raAioFailed = true;
+        }
+    }
+    // without async I/O, it is unknown when the first blocks are loaded
+    raPending = raAioHandle ? num_pending : 0;
+
+    return file->prefetchBlocks(raBids, *num_bids, raAioHandle,
+                                &iterHandle->log_callback);
+}
+
+void FdbIterator::completeReadAhead() {
+    size_t num_bids;
+
+    if (!raAioHandle || !raAioHandle->num_inflight) {
+        return;
+    }
+    iterHandle->file->completeAsyncBlocks(raAioHandle, false,
+                                          &iterHandle->log_callback);
+    if (!raAioHandle->num_inflight && raPending) {
+        // the first blocks of the pending docs are loaded
+        prefetchDocs(raPending, true, &num_bids);
+    }
+}
+
+bool FdbIterator::isReadAheadEnd(void *key, size_t keylen) {
+    if (raDirection == FDB_ITR_REVERSE) {
+        return startKey.data &&
+               _fdb_key_cmp(this, key, keylen,
+                            startKey.data, startKey.len) < 0;
+    }
+    return endKey.data &&
+           _fdb_key_cmp(this, key, keylen, endKey.data, endKey.len) > 0;
+}
+
+void FdbIterator::prefetchSeq(size_t num_docs) {
+    FileMgr *file = iterHandle->file;
+    size_t size_id = sizeof(fdb_kvs_id_t);
+    size_t size_seq = sizeof(fdb_seqnum_t);
+    size_t num = 0, num_bids;
+    uint8_t *seq_kv;
+    size_t seq_kv_len;
+    fdb_seqnum_t seqnum, _seqnum;
+    fdb_kvs_id_t kv_id, _kv_id;
+    uint64_t offset;
+
+    if (iterType != FDB_ITR_SEQ || !num_docs || file->isMapped() ||
+        seqNum == SEQNUM_NOT_USED) {
+        return;
+    }
+    if (num_docs > ITR_READAHEAD_MAX_WINDOW) {
+        num_docs = ITR_READAHEAD_MAX_WINDOW;
+    }
+    if (!raOffsets) {
+        raOffsets = (uint64_t *)malloc(sizeof(uint64_t) *
+                                       ITR_READAHEAD_MAX_WINDOW);
+    }
+    completeReadAhead();
+
+    // a separate cursor starting from the current seqnum, so that the
+    // position of the iterator is not affected
+    _seqnum = _endian_encode(seqNum);
+    if (iterHandle->kvs) {
+        seq_kv = alca(uint8_t, size_id + size_seq);
+        _kv_id = _endian_encode(iterHandle->kvs->getKvsId());
+        memcpy(seq_kv, &_kv_id, size_id);
+        memcpy(seq_kv + size_id, &_seqnum, size_seq);
+        HBTrieIterator seq_itr(iterHandle->seqtrie, seq_kv, size_id + size_seq);
+        while (num < num_docs &&
+               seq_itr.next(seq_kv, seq_kv_len, (void *)&offset) ==
+               HBTRIE_RESULT_SUCCESS) {
+            buf2kvid(size_id, seq_kv, &kv_id);
+            memcpy(&seqnum, seq_kv + size_id, size_seq);
+            if (kv_id != iterHandle->kvs->getKvsId() ||
+                _endian_decode(seqnum) > endSeqnum) {
+                break;
+            }
+            raOffsets[num++] = _endian_decode(offset);
+        }
+    } else {
+        BTreeIterator seq_itr(iterHandle->seqtree, (void *)&_seqnum);
+        while (num < num_docs &&
+               seq_itr.next(&seqnum, (void *)&offset) == BTREE_RESULT_SUCCESS) {
+            if (_endian_decode(seqnum) > endSeqnum) {
+                break;
+            }
+            raOffsets[num++] = _endian_decode(offset);
+        }
+    }
+    iterHandle->bhandle->flushBuffer();
+
+    if (num) {
+        prefetchDocs(num, false, &num_bids);
+    }
+}
+
+void FdbIterator::resetReadAhead() {
+    delete raIterator;
+    raIterator = nullptr;
+    raRemaining = 0;
+    raPending = 0;
+    raDirection = FDB_ITR_DIR_NONE;
+    raEnd = false;
+}
+
 fdb_status FdbIterator::iterateToPrev() {
     fdb_status result = FDB_RESULT_SUCCESS;
     LATENCY_STAT_START();
@@ -991,6 +1338,7 @@ fdb_status FdbIterator::iterateToPrev() {
     }
     if (result == FDB_RESULT_SUCCESS) {
         iterDirection = FDB_ITR_REVERSE;
+        adviseMappedAccess(iterDirection);
     } else {
         dHandle = NULL; // fail FdbIterator::get() also
         if (iterDirection != FDB_ITR_DIR_NONE) {
@@ -1018,6 +1366,18 @@ fdb_status FdbIterator::iterateToNext() {
         return FDB_RESULT_HANDLE_BUSY;
     }
 
+    result = moveToNext();
+
+    cond = 1;
+    iterHandle->handle_busy.compare_exchange_strong(cond, 0);
+    iterHandle->op_stats->num_iterator_moves++;
+    LATENCY_STAT_END(iterHandle->file, FDB_LATENCY_ITR_NEXT);
+    return result;
+}
+
+fdb_status FdbIterator::moveToNext() {
+    fdb_status result = FDB_RESULT_SUCCESS;
+
     if (hbtrieIterator) {
         while ((result = iterate(ITR_SEEK_NEXT)) == FDB_RESULT_KEY_NOT_FOUND);
     } else {
@@ -1025,6 +1385,7 @@ fdb_status FdbIterator::iterateToNext() {
     }
     if (result == FDB_RESULT_SUCCESS) {
         iterDirection = FDB_ITR_FORWARD;
+        adviseMappedAccess(iterDirection);
     } else {
         dHandle = NULL; // fail FdbIterator::get() also
         if (iterDirection != FDB_ITR_DIR_NONE) {
@@ -1035,11 +1396,6 @@ fdb_status FdbIterator::iterateToNext() {
             }
         }
     }
-
-    cond = 1;
-    iterHandle->handle_busy.compare_exchange_strong(cond, 0);
-    iterHandle->op_stats->num_iterator_moves++;
-    LATENCY_STAT_END(iterHandle->file, FDB_LATENCY_ITR_NEXT);
     return result;
 }
 
@@ -1055,8 +1411,17 @@ fdb_status FdbIterator::get(fdb_doc **doc, bool metaOnly) {
     DocioHandle *dhandle;
     size_t size_chunk = iterHandle->config.chunksize;
     bool alloced_key, alloced_meta, alloced_body;
+    bool body_range = false;
     LATENCY_STAT_START();
 
+    if (!metaOnly) {
+        if (projection.mode == FDB_PROJECT_META_ONLY) {
+            metaOnly = true;
+        } else if (projection.mode == FDB_PROJECT_BODY_RANGE) {
+            body_range = true;
+        }
+    }
+
     dhandle = dHandle;
     if (!dhandle || getOffset == BLK_NOT_FOUND) {
         return FDB_RESULT_ITERATOR_FAIL;
@@ -1096,6 +1461,11 @@ fdb_status FdbIterator::get(fdb_doc **doc, bool metaOnly) {
     int64_t _offset = 0;
     if (metaOnly) {
         _offset = dhandle->readDocKeyMeta_Docio(offset, &_doc, true);
+    } else if (body_range) {
+        _offset = dhandle->readDocBodyRange_Docio(offset, &_doc,
+                                                  projection.body_offset,
+                                                  projection.body_length,
+                                                  true);
     } else {
         _offset = dhandle->readDoc_Docio(offset, &_doc, true);
     }
@@ -1149,6 +1519,196 @@ fdb_status FdbIterator::get(fdb_doc **doc, bool metaOnly) {
     return ret;
 }
 
+fdb_status FdbIterator::nextBatch(fdb_doc *docs, size_t max_docs,
+                                  void *buf, size_t bufsize,
+                                  size_t *num_docs) {
+    struct docio_object _doc;
+    struct docio_length length;
+    fdb_status ret = FDB_RESULT_SUCCESS;
+    fdb_status fs;
+    size_t size_chunk = iterHandle->config.chunksize;
+    size_t key_offset = iterHandle->kvs ? size_chunk : 0;
+    size_t count = 0, moves = 0, used = 0, docsize, bodylen;
+    uint8_t *ptr = (uint8_t *)buf;
+    int64_t _offset;
+    LATENCY_STAT_START();
+
+    *num_docs = 0;
+    if (!dHandle || getOffset == BLK_NOT_FOUND) {
+        return FDB_RESULT_ITERATOR_FAIL;
+    }
+
+    uint8_t cond = 0;
+    if (!iterHandle->handle_busy.compare_exchange_strong(cond, 1)) {
+        return FDB_RESULT_HANDLE_BUSY;
+    }
+
+    while (count < max_docs) {
+        if (!dHandle || getOffset == BLK_NOT_FOUND) {
+            // no more items
+            if (count == 0) {
+                ret = FDB_RESULT_ITERATOR_FAIL;
+            }
+            break;
+        }
+
+        // check if the item fits in the remaining buffer
+        fs = dHandle->readDocLength_Docio(&length, getOffset);
+        if (fs != FDB_RESULT_SUCCESS) {
+            if (count == 0) {
+                ret = fs;
+            }
+            break;
+        }
+        bodylen = length.bodylen;
+        if (projection.mode == FDB_PROJECT_META_ONLY) {
+            bodylen = 0;
+        } else if (projection.mode == FDB_PROJECT_BODY_RANGE) {
+            bodylen = (projection.body_offset < bodylen) ?
+                      bodylen - projection.body_offset : 0;
+            if (projection.body_length < bodylen) {
+                bodylen = projection.body_length;
+            }
+        }
+        docsize = length.keylen + length.metalen + bodylen;
+        if (used + docsize > bufsize) {
+            if (count == 0) {
+                ret = FDB_RESULT_ENOBUFS;
+            }
+            break;
+        }
+
+        _doc.key = ptr + used;
+        _doc.meta = ptr + used + length.keylen;
+        _doc.body = ptr + used + length.keylen + length.metalen;
+        if (projection.mode == FDB_PROJECT_META_ONLY) {
+            _offset = dHandle->readDocKeyMeta_Docio(getOffset, &_doc, true);
+        } else if (projection.mode == FDB_PROJECT_BODY_RANGE) {
+            _offset = dHandle->readDocBodyRange_Docio(getOffset, &_doc,
+                                                      projection.body_offset,
+                                                      projection.body_length,
+                                                      true);
+        } else {
+            _offset = dHandle->readDoc_Docio(getOffset, &_doc, true);
+        }
+        if (_offset <= 0) {
+            if (count == 0) {
+                ret = _offset < 0 ? (fdb_status) _offset
+                                  : FDB_RESULT_KEY_NOT_FOUND;
+            }
+            break;
+        }
+
+        if (!((_doc.length.flag & DOCIO_DELETED) &&
+              (iterOpt & FDB_ITR_NO_DELETES))) {
+            fdb_doc *doc = &docs[count++];
+
+            // eliminate KV ID from key
+            doc->key = (uint8_t*)_doc.key + key_offset;
+            doc->keylen = _doc.length.keylen - key_offset;
+            doc->metalen = _doc.length.metalen;
+            doc->meta = doc->metalen ? _doc.meta : NULL;
+            doc->bodylen = bodylen;
+            doc->body = doc->bodylen ? _doc.body : NULL;
+            doc->size_ondisk = _fdb_get_docsize(length);
+            doc->seqnum = _doc.seqnum;
+            doc->deleted = _doc.length.flag & DOCIO_DELETED;
+            doc->offset = getOffset;
+            doc->flags = 0;
+            used += docsize;
+        }
+
+        ++moves;
+        if (moveToNext() != FDB_RESULT_SUCCESS) {
+            break;
+        }
+    }
+
+    cond = 1;
+    iterHandle->handle_busy.compare_exchange_strong(cond, 0);
+    iterHandle->op_stats->num_iterator_gets += count;
+    iterHandle->op_stats->num_iterator_moves += moves;
+    LATENCY_STAT_END(iterHandle->file, FDB_LATENCY_ITR_NEXT_BATCH);
+
+    *num_docs = count;
+    return ret;
+}
+
+fdb_status FdbIterator::setFilter(fdb_iterator_filter_fn filter,
+                                  void *ctx) {
+    fdb_status fs;
+
+    filterFunc = filter;
+    filterCtx = ctx;
+    if (!filterFunc || !dHandle || getOffset == BLK_NOT_FOUND) {
+        return FDB_RESULT_SUCCESS;
+    }
+
+    // check the item that the iterator currently points to
+    uint8_t cond = 0;
+    if (!iterHandle->handle_busy.compare_exchange_strong(cond, 1)) {
+        return FDB_RESULT_HANDLE_BUSY;
+    }
+    fs = checkFilter(dHandle, getOffset);
+    cond = 1;
+    iterHandle->handle_busy.compare_exchange_strong(cond, 0);
+
+    if (fs != FDB_RESULT_KEY_NOT_FOUND) {
+        return fs;
+    }
+    if (iterDirection == FDB_ITR_REVERSE) {
+        return iterateToPrev();
+    }
+    return iterateToNext();
+}
+
+fdb_status FdbIterator::setProjection(const fdb_iterator_projection *proj) {
+    if (!proj) {
+        memset(&projection, 0, sizeof(projection));
+        return FDB_RESULT_SUCCESS;
+    }
+    if (proj->mode != FDB_PROJECT_ALL &&
+        proj->mode != FDB_PROJECT_META_ONLY &&
+        proj->mode != FDB_PROJECT_BODY_RANGE) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+    projection = *proj;
+    return FDB_RESULT_SUCCESS;
+}
+
+fdb_status FdbIterator::checkFilter(DocioHandle *dhandle, uint64_t offset) {
+    struct docio_object _doc;
+    fdb_doc doc;
+    fdb_filter_decision decision;
+    size_t key_offset = iterHandle->kvs ? iterHandle->config.chunksize : 0;
+    int64_t _offset;
+
+    memset(&_doc, 0x0, sizeof(struct docio_object));
+    _offset = dhandle->readDocKeyMeta_Docio(offset, &_doc, true);
+    if (_offset <= 0) {
+        return _offset < 0 ? (fdb_status)_offset : FDB_RESULT_KEY_NOT_FOUND;
+    }
+
+    memset(&doc, 0x0, sizeof(fdb_doc));
+    // eliminate KV ID from key
+    doc.key = (uint8_t*)_doc.key + key_offset;
+    doc.keylen = _doc.length.keylen - key_offset;
+    doc.meta = _doc.meta;
+    doc.metalen = _doc.length.metalen;
+    doc.bodylen = _doc.length.bodylen;
+    doc.size_ondisk = _fdb_get_docsize(_doc.length);
+    doc.seqnum = _doc.seqnum;
+    doc.deleted = _doc.length.flag & DOCIO_DELETED;
+    doc.offset = offset;
+
+    decision = filterFunc(iterHandle, &doc, filterCtx);
+    free(_doc.key);
+    free(_doc.meta);
+
+    return (decision == FDB_FILTER_ACCEPT) ? FDB_RESULT_SUCCESS
+                                           : FDB_RESULT_KEY_NOT_FOUND;
+}
+
 fdb_status FdbIterator::iterate(itr_seek_t seek_type) {
     int cmp;
     void *key;
@@ -1156,6 +1716,7 @@ fdb_status FdbIterator::iterate(itr_seek_t seek_type) {
     uint64_t offset;
     hbtrie_result hr = HBTRIE_RESULT_SUCCESS;
     DocioHandle *dhandle;
+    fdb_status fs;
     struct wal_item *snap_item = NULL;
 
     if (seek_type == ITR_SEEK_PREV && iterDirection != FDB_ITR_REVERSE) {
@@ -1215,6 +1776,9 @@ start:
             }
             iterHandle->bhandle->flushBuffer();
             iterOffset = _endian_decode(iterOffset);
+            if (hr == HBTRIE_RESULT_SUCCESS) {
+                readAhead(seek_type);
+            }
             if (!(iterOpt & FDB_ITR_NO_DELETES) ||
                   hr != HBTRIE_RESULT_SUCCESS) {
                 break;
@@ -1352,6 +1916,16 @@ start:
         }
     }
 
+    if (filterFunc) {
+        fs = checkFilter(dhandle, offset);
+        if (fs == FDB_RESULT_KEY_NOT_FOUND) {
+            // skipped by the filter
+            goto start;
+        } else if (fs != FDB_RESULT_SUCCESS) {
+            return fs;
+        }
+    }
+
     dHandle = dhandle; // store for FdbIterator::get()
     getOffset = offset; // store for FdbIterator::get()
 
@@ -1414,6 +1988,7 @@ fdb_status FdbIterator::seekToMaxKey() {
         return status;
     }
     iterDirection = FDB_ITR_REVERSE; // only reverse iteration possible
+    resetReadAhead();
 
     if (endKey.data && endKey.len == size_chunk) {
         // endKey exists but endKeylen == size_id
@@ -1530,6 +2105,7 @@ fdb_status FdbIterator::iterateSeqPrev() {
     hbtrie_result hr;
     struct docio_object _doc;
     DocioHandle *dhandle;
+    fdb_status fs;
     struct wal_item *snap_item = NULL;
     fdb_seqnum_t seqnum;
     fdb_kvs_id_t kv_id;
@@ -1538,6 +2114,9 @@ fdb_status FdbIterator::iterateSeqPrev() {
     size_seq = sizeof(fdb_seqnum_t);
     seq_kv = alca(uint8_t, size_id + size_seq);
 
+    // load the docs prefetched by prefetchSeq() so far
+    completeReadAhead();
+
     if (iterDirection != FDB_ITR_REVERSE) {
         if (iterStatus == FDB_ITR_IDX) {
             iterOffset = BLK_NOT_FOUND; // need to re-examine Trie/trees
@@ -1693,6 +2272,16 @@ start_seq:
         free(_doc.meta);
     }
 
+    if (filterFunc) {
+        fs = checkFilter(dhandle, offset);
+        if (fs == FDB_RESULT_KEY_NOT_FOUND) {
+            // skipped by the filter
+            goto start_seq;
+        } else if (fs != FDB_RESULT_SUCCESS) {
+            return fs;
+        }
+    }
+
     dHandle = dhandle; // store for FdbIterator::get()
     getOffset = offset; // store for FdbIterator::get()
 
@@ -1707,6 +2296,7 @@ fdb_status FdbIterator::iterateSeqNext() {
     hbtrie_result hr;
     struct docio_object _doc;
     DocioHandle *dhandle;
+    fdb_status fs;
     struct wal_item *snap_item = NULL;
     fdb_seqnum_t seqnum;
     fdb_kvs_id_t kv_id;
@@ -1715,6 +2305,9 @@ fdb_status FdbIterator::iterateSeqNext() {
     size_seq = sizeof(fdb_seqnum_t);
     seq_kv = alca(uint8_t, size_id + size_seq);
 
+    // load the docs prefetched by prefetchSeq() so far
+    completeReadAhead();
+
     if (iterDirection != FDB_ITR_FORWARD) {
         if (iterStatus == FDB_ITR_IDX) {
             iterOffset = BLK_NOT_FOUND; // need to re-examine Trie/trees
@@ -1756,6 +2349,9 @@ start_seq:
             if (seqnum > endSeqnum) {
                 return FDB_RESULT_ITERATOR_FAIL;
             }
+            if (seqnum > maxSeqVisited) {
+                maxSeqVisited = seqnum;
+            }
             offset = _endian_decode(offset);
             iterOffset = BLK_NOT_FOUND; // continue with B-tree
             iterStatus = FDB_ITR_IDX;
@@ -1778,6 +2374,11 @@ start_seq:
                 // get the current item of WAL tree
                 iterStatus = FDB_ITR_WAL;
                 snap_item = treeCursor;
+                if (snap_item->seqnum > maxSeqVisited &&
+                    snap_item->seqnum >= seqNum &&
+                    snap_item->seqnum <= endSeqnum) {
+                    maxSeqVisited = snap_item->seqnum;
+                }
                 uint8_t drop_logical_deletes =
                         (snap_item->action == WAL_ACT_LOGICAL_REMOVE) &&
                         (iterOpt & FDB_ITR_NO_DELETES);
@@ -1876,6 +2477,16 @@ start_seq:
         free(_doc.meta);
     }
 
+    if (filterFunc) {
+        fs = checkFilter(dhandle, offset);
+        if (fs == FDB_RESULT_KEY_NOT_FOUND) {
+            // skipped by the filter
+            goto start_seq;
+        } else if (fs != FDB_RESULT_SUCCESS) {
+            return fs;
+        }
+    }
+
     dHandle = dhandle; // store for FdbIterator::get()
     getOffset = offset; // store for FdbIterator::get()
 
@@ -1988,18 +2599,332 @@ fdb_status fdb_iterator_get_metaonly(fdb_iterator *iterator, fdb_doc **doc)
     return iterator->get(doc, /*metaOnly*/true);
 }
 
+LIBFDB_API
+fdb_status fdb_iterator_next_batch(fdb_iterator *iterator,
+                                   fdb_doc *docs,
+                                   size_t max_docs,
+                                   void *buf,
+                                   size_t bytes_budget,
+                                   size_t *num_docs)
+{
+    if (!iterator || !iterator->getHandle()) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+
+    if (!docs || !max_docs || !buf || !num_docs) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    return iterator->nextBatch(docs, max_docs, buf, bytes_budget, num_docs);
+}
+
+LIBFDB_API
+fdb_status fdb_iterator_set_filter(fdb_iterator *iterator,
+                                   fdb_iterator_filter_fn filter,
+                                   void *ctx)
+{
+    if (!iterator || !iterator->getHandle()) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+
+    return iterator->setFilter(filter, ctx);
+}
+
+LIBFDB_API
+fdb_status fdb_iterator_set_projection(fdb_iterator *iterator,
+                                       const fdb_iterator_projection *projection)
+{
+    if (!iterator || !iterator->getHandle()) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+
+    return iterator->setProjection(projection);
+}
+
 LIBFDB_API
 fdb_status fdb_iterator_close(fdb_iterator *iterator)
 {
     return FdbIterator::destroyIterator(iterator);
 }
 
+static void *_fdb_split_key_dup(const void *key, size_t keylen)
+{
+    void *buf = malloc(keylen);
+    memcpy(buf, key, keylen);
+    return buf;
+}
+
+// Estimate the keys splitting the given range into 'num_ranges' sub-ranges
+// and the share of the KV store's keys covered by each of the sub-ranges.
+static fdb_status _fdb_estimate_ranges(FdbKvsHandle *handle,
+                                       const void *start_key,
+                                       size_t start_keylen,
+                                       const void *end_key,
+                                       size_t end_keylen,
+                                       size_t num_ranges,
+                                       std::vector<std::string>& split_keys,
+                                       std::vector<double>& shares,
+                                       const char *op)
+{
+    if (!handle) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+
+    if (num_ranges == 0 ||
+        (start_key && !start_keylen) || (end_key && !end_keylen) ||
+        start_keylen > FDB_MAX_KEYLEN || end_keylen > FDB_MAX_KEYLEN ||
+        (handle->kvs_config.custom_cmp &&
+           (start_keylen > handle->config.blocksize - HBTRIE_HEADROOM ||
+            end_keylen > handle->config.blocksize - HBTRIE_HEADROOM))) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    if (!start_key) {
+        start_keylen = 0;
+    }
+    if (!end_key) {
+        end_keylen = 0;
+    }
+
+    // keys in the trie
+    size_t size_chunk = handle->config.chunksize;
+    uint8_t *trie_start = (uint8_t *)start_key;
+    uint8_t *trie_end = (uint8_t *)end_key;
+    size_t trie_start_len = start_keylen;
+    size_t trie_end_len = end_keylen;
+    uint8_t *kvs_start = NULL;
+    uint8_t *kvs_end = NULL;
+
+    if (handle->kvs) {
+        // multi KV instance mode .. prepend KV ID. A missing end key is
+        // replaced by the NULL key of the next KV ID, as the iterator does.
+        kvs_start = alca(uint8_t, size_chunk);
+        kvid2buf(size_chunk, handle->kvs->getKvsId(), kvs_start);
+        kvs_end = alca(uint8_t, size_chunk);
+        kvid2buf(size_chunk, handle->kvs->getKvsId() + 1, kvs_end);
+
+        trie_start = alca(uint8_t, size_chunk + start_keylen);
+        memcpy(trie_start, kvs_start, size_chunk);
+        if (start_key) {
+            memcpy(trie_start + size_chunk, start_key, start_keylen);
+        }
+        trie_start_len = size_chunk + start_keylen;
+
+        trie_end = alca(uint8_t, size_chunk + end_keylen);
+        if (end_key) {
+            memcpy(trie_end, kvs_start, size_chunk);
+            memcpy(trie_end + size_chunk, end_key, end_keylen);
+        } else {
+            memcpy(trie_end, kvs_end, size_chunk);
+        }
+        trie_end_len = size_chunk + end_keylen;
+    }
+
+    if (start_key && end_key &&
+        _fdb_split_key_cmp(trie_start, trie_start_len,
+                           trie_end, trie_end_len, handle) > 0) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    uint8_t cond = 0;
+    if (!handle->handle_busy.compare_exchange_strong(cond, 1)) {
+        return FDB_RESULT_HANDLE_BUSY;
+    }
+
+    if (!handle->shandle) {
+        fdb_check_file_reopen(handle, NULL);
+        fdb_sync_db_header(handle);
+    }
+
+    double kvs_weight = 1.0;
+    hbtrie_result hr;
+    hr = handle->trie->estimateSplitKeys(trie_start, trie_start_len,
+                                         trie_end, trie_end_len,
+                                         num_ranges, _fdb_split_key_cmp,
+                                         (void *)handle, split_keys,
+                                         &shares);
+    if (hr == HBTRIE_RESULT_SUCCESS && handle->kvs) {
+        // other KV stores share the trie, so scale the shares by
+        // the share of this KV store.
+        hr = handle->trie->estimateRangeWeight(kvs_start, size_chunk,
+                                               kvs_end, size_chunk,
+                                               _fdb_split_key_cmp,
+                                               (void *)handle, &kvs_weight);
+    }
+    handle->bhandle->flushBuffer();
+
+    cond = 1;
+    handle->handle_busy.compare_exchange_strong(cond, 0);
+
+    if (hr != HBTRIE_RESULT_SUCCESS) {
+        fdb_log(&handle->log_callback, FDB_RESULT_READ_FAIL,
+                "Failed to read the index of KV Store '%s' in a database "
+                "file '%s' while %s",
+                _fdb_kvs_get_name(handle, handle->file),
+                handle->file->getFileName(), op);
+        return FDB_RESULT_READ_FAIL;
+    }
+
+    for (size_t i = 0; i < shares.size(); ++i) {
+        if (kvs_weight <= 0) {
+            shares[i] = 0;
+        } else if (shares[i] >= kvs_weight) {
+            shares[i] = 1.0;
+        } else {
+            shares[i] /= kvs_weight;
+        }
+    }
+    if (handle->kvs) {
+        // strip the KV ID prefix
+        for (size_t i = 0; i < split_keys.size(); ++i) {
+            split_keys[i].erase(0, size_chunk);
+        }
+    }
+
+    return FDB_RESULT_SUCCESS;
+}
+
+LIBFDB_API
+fdb_status fdb_iterator_split(FdbKvsHandle *handle,
+                              const void *start_key,
+                              size_t start_keylen,
+                              const void *end_key,
+                              size_t end_keylen,
+                              size_t num_ranges,
+                              fdb_key_range **ranges,
+                              size_t *num_ranges_out)
+{
+    std::vector<std::string> split_keys;
+    std::vector<double> shares;
+    fdb_kvs_info info;
+    fdb_status fs;
+
+    if (!handle) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+    if (!ranges || !num_ranges_out) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    fs = fdb_get_kvs_info(handle, &info);
+    if (fs != FDB_RESULT_SUCCESS) {
+        return fs;
+    }
+    fs = _fdb_estimate_ranges(handle, start_key, start_keylen,
+                              end_key, end_keylen, num_ranges,
+                              split_keys, shares, "splitting a key range");
+    if (fs != FDB_RESULT_SUCCESS) {
+        return fs;
+    }
+
+    size_t i, num = split_keys.size() + 1;
+    fdb_key_range *arr = (fdb_key_range *)calloc(num, sizeof(fdb_key_range));
+
+    if (start_key) {
+        arr[0].start_key = _fdb_split_key_dup(start_key, start_keylen);
+        arr[0].start_keylen = start_keylen;
+    }
+    for (i = 0; i < split_keys.size(); ++i) {
+        const char *key = split_keys[i].data();
+        size_t keylen = split_keys[i].size();
+
+        arr[i].end_key = _fdb_split_key_dup(key, keylen);
+        arr[i].end_keylen = keylen;
+        arr[i+1].start_key = _fdb_split_key_dup(key, keylen);
+        arr[i+1].start_keylen = keylen;
+    }
+    if (end_key) {
+        arr[num-1].end_key = _fdb_split_key_dup(end_key, end_keylen);
+        arr[num-1].end_keylen = end_keylen;
+    }
+    for (i = 0; i < num && i < shares.size(); ++i) {
+        arr[i].num_docs = (uint64_t)(info.doc_count * shares[i] + 0.5);
+        arr[i].num_bytes = (uint64_t)(info.space_used * shares[i] + 0.5);
+    }
+
+    *ranges = arr;
+    *num_ranges_out = num;
+    return FDB_RESULT_SUCCESS;
+}
+
+LIBFDB_API
+fdb_status fdb_estimate_range(FdbKvsHandle *handle,
+                              const void *start_key,
+                              size_t start_keylen,
+                              const void *end_key,
+                              size_t end_keylen,
+                              uint64_t *num_docs,
+                              uint64_t *num_bytes)
+{
+    std::vector<std::string> split_keys;
+    std::vector<double> shares;
+    fdb_kvs_info info;
+    fdb_status fs;
+
+    if (!handle) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+    if (!num_docs && !num_bytes) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    fs = fdb_get_kvs_info(handle, &info);
+    if (fs != FDB_RESULT_SUCCESS) {
+        return fs;
+    }
+    fs = _fdb_estimate_ranges(handle, start_key, start_keylen,
+                              end_key, end_keylen, 1,
+                              split_keys, shares, "estimating a key range");
+    if (fs != FDB_RESULT_SUCCESS) {
+        return fs;
+    }
+
+    if (num_docs) {
+        *num_docs = (uint64_t)(info.doc_count * shares[0] + 0.5);
+    }
+    if (num_bytes) {
+        *num_bytes = (uint64_t)(info.space_used * shares[0] + 0.5);
+    }
+    return FDB_RESULT_SUCCESS;
+}
+
+LIBFDB_API
+fdb_status fdb_free_key_ranges(fdb_key_range *ranges, size_t num_ranges)
+{
+    size_t i;
+
+    if (!ranges) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    for (i = 0; i < num_ranges; ++i) {
+        free(ranges[i].start_key);
+        free(ranges[i].end_key);
+    }
+    free(ranges);
+
+    return FDB_RESULT_SUCCESS;
+}
+
 LIBFDB_API
 fdb_status fdb_changes_since(FdbKvsHandle *handle,
                              fdb_seqnum_t since,
                              fdb_iterator_opt_t opt,
                              fdb_changes_callback_fn callback,
                              void *ctx)
+{
+    return fdb_changes_since_filtered(handle, since, opt, NULL, NULL,
+                                      callback, ctx);
+}
+
+LIBFDB_API
+fdb_status fdb_changes_since_filtered(FdbKvsHandle *handle,
+                                      fdb_seqnum_t since,
+                                      fdb_iterator_opt_t opt,
+                                      fdb_iterator_filter_fn filter,
+                                      const fdb_iterator_projection *projection,
+                                      fdb_changes_callback_fn callback,
+                                      void *ctx)
 {
     if (!handle) {
         return FDB_RESULT_INVALID_HANDLE;
@@ -2027,6 +2952,17 @@ fdb_status fdb_changes_since(FdbKvsHandle *handle,
         return status;
     }
 
+    status = fdb_iterator_set_projection(iterator, projection);
+    if (status == FDB_RESULT_SUCCESS && filter) {
+        status = fdb_iterator_set_filter(iterator, filter, ctx);
+    }
+    if (status != FDB_RESULT_SUCCESS) {
+        fdb_iterator_close(iterator);
+        // no document passed the filter
+        return status == FDB_RESULT_ITERATOR_FAIL ? FDB_RESULT_SUCCESS
+                                                  : status;
+    }
+
     int result = 0;
     do {
         fdb_doc *doc = NULL;
@@ -2057,3 +2993,228 @@ fdb_status fdb_changes_since(FdbKvsHandle *handle,
 
     return status;
 }
+
+// (Re)open the sequence iterator of a changes feed cursor from its next
+// sequence number, over a new snapshot of the KV store
+static fdb_status _fdb_changes_cursor_reset(fdb_changes_cursor *cursor)
+{
+    fdb_status fs;
+
+    if (cursor->iterator) {
+        fdb_iterator_close(cursor->iterator);
+        cursor->iterator = NULL;
+    }
+
+    fs = fdb_iterator_sequence_init(cursor->handle, &cursor->iterator,
+                                    cursor->nextSeqnum, 0, cursor->opt);
+    if (fs != FDB_RESULT_SUCCESS) {
+        cursor->iterator = NULL;
+        return fs;
+    }
+    if (cursor->opt & FDB_ITR_NO_VALUES) {
+        fdb_iterator_projection projection;
+        projection.mode = FDB_PROJECT_META_ONLY;
+        projection.body_offset = 0;
+        projection.body_length = 0;
+        fs = fdb_iterator_set_projection(cursor->iterator, &projection);
+    }
+    return fs;
+}
+
+// Move the next sequence number of a changes feed cursor past the last
+// change visited by its iterator, once the iterator has visited all the
+// changes in its snapshot. The seqnums of the uncommitted transactional
+// updates are not visited, so they are still ahead of the cursor.
+static void _fdb_changes_cursor_skip_snapshot(fdb_changes_cursor *cursor)
+{
+    fdb_seqnum_t seqnum;
+
+    if (!cursor->iterator) {
+        return;
+    }
+    seqnum = cursor->iterator->getMaxSeqVisited();
+    if (cursor->nextSeqnum <= seqnum) {
+        cursor->nextSeqnum = seqnum + 1;
+    }
+}
+
+static fdb_status _fdb_changes_cursor_create(FdbKvsHandle *handle,
+                                             fdb_seqnum_t since,
+                                             fdb_iterator_opt_t opt,
+                                             fdb_changes_cursor **ptr_cursor)
+{
+    fdb_changes_cursor *cursor;
+    fdb_status fs;
+
+    cursor = (fdb_changes_cursor *)calloc(1, sizeof(fdb_changes_cursor));
+    cursor->handle = handle;
+    cursor->nextSeqnum = since;
+    cursor->opt = opt;
+
+    fs = _fdb_changes_cursor_reset(cursor);
+    if (fs != FDB_RESULT_SUCCESS) {
+        free(cursor);
+        return fs;
+    }
+    *ptr_cursor = cursor;
+    return FDB_RESULT_SUCCESS;
+}
+
+LIBFDB_API
+fdb_status fdb_changes_cursor_open(FdbKvsHandle *handle,
+                                   fdb_seqnum_t since,
+                                   fdb_iterator_opt_t opt,
+                                   fdb_changes_cursor **ptr_cursor)
+{
+    if (!handle) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+    if (!ptr_cursor) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    return _fdb_changes_cursor_create(handle, since, opt, ptr_cursor);
+}
+
+LIBFDB_API
+fdb_status fdb_changes_cursor_pull(fdb_changes_cursor *cursor,
+                                   fdb_doc *docs,
+                                   size_t max_docs,
+                                   void *buf,
+                                   size_t bufsize,
+                                   size_t *num_docs)
+{
+    fdb_seqnum_t seqnum;
+    fdb_status fs;
+
+    if (!cursor) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+    if (!docs || !max_docs || !buf || !num_docs) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    *num_docs = 0;
+    if (cursor->iterator) {
+        cursor->iterator->prefetchSeq(max_docs);
+        fs = cursor->iterator->nextBatch(docs, max_docs, buf, bufsize,
+                                         num_docs);
+    } else {
+        fs = FDB_RESULT_ITERATOR_FAIL;
+    }
+
+    if (fs == FDB_RESULT_ITERATOR_FAIL) {
+        // all the changes in the current snapshot were visited, including
+        // the deleted ones skipped by FDB_ITR_NO_DELETES ..
+        // move to a new snapshot only if there are newer changes
+        _fdb_changes_cursor_skip_snapshot(cursor);
+        fs = fdb_get_kvs_seqnum(cursor->handle, &seqnum);
+        if (fs != FDB_RESULT_SUCCESS) {
+            return fs;
+        }
+        if (seqnum < cursor->nextSeqnum) {
+            return FDB_RESULT_ITERATOR_FAIL;
+        }
+        fs = _fdb_changes_cursor_reset(cursor);
+        if (fs != FDB_RESULT_SUCCESS) {
+            return fs;
+        }
+        cursor->iterator->prefetchSeq(max_docs);
+        fs = cursor->iterator->nextBatch(docs, max_docs, buf, bufsize,
+                                         num_docs);
+        if (fs == FDB_RESULT_ITERATOR_FAIL) {
+            _fdb_changes_cursor_skip_snapshot(cursor);
+        }
+    }
+
+    if (fs == FDB_RESULT_SUCCESS) {
+        cursor->nextSeqnum = docs[*num_docs - 1].seqnum + 1;
+    }
+    return fs;
+}
+
+LIBFDB_API
+fdb_status fdb_changes_cursor_serialize(fdb_changes_cursor *cursor,
+                                        void *buf,
+                                        size_t bufsize,
+                                        size_t *len)
+{
+    uint8_t *ptr = (uint8_t *)buf;
+    uint32_t magic = _endian_encode((uint32_t)CHANGES_CURSOR_MAGIC);
+    fdb_kvs_id_t kv_id = 0;
+    fdb_seqnum_t seqnum;
+
+    if (!cursor) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+    if (!len) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    *len = CHANGES_CURSOR_SIZE;
+    if (!buf || bufsize < CHANGES_CURSOR_SIZE) {
+        return FDB_RESULT_ENOBUFS;
+    }
+
+    // [magic: 4][option: 1][padding: 3][KV store ID: 8][next seqnum: 8]
+    if (cursor->handle->kvs) {
+        kv_id = cursor->handle->kvs->getKvsId();
+    }
+    kv_id = _endian_encode(kv_id);
+    seqnum = _endian_encode(cursor->nextSeqnum);
+    memset(ptr, 0x0, CHANGES_CURSOR_SIZE);
+    memcpy(ptr, &magic, sizeof(magic));
+    ptr[4] = cursor->opt;
+    memcpy(ptr + 8, &kv_id, sizeof(kv_id));
+    memcpy(ptr + 16, &seqnum, sizeof(seqnum));
+
+    return FDB_RESULT_SUCCESS;
+}
+
+LIBFDB_API
+fdb_status fdb_changes_cursor_resume(FdbKvsHandle *handle,
+                                     const void *buf,
+                                     size_t len,
+                                     fdb_changes_cursor **ptr_cursor)
+{
+    const uint8_t *ptr = (const uint8_t *)buf;
+    uint32_t magic;
+    fdb_kvs_id_t kv_id, cur_kv_id = 0;
+    fdb_seqnum_t seqnum;
+
+    if (!handle) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+    if (!buf || len != CHANGES_CURSOR_SIZE || !ptr_cursor) {
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    memcpy(&magic, ptr, sizeof(magic));
+    memcpy(&kv_id, ptr + 8, sizeof(kv_id));
+    memcpy(&seqnum, ptr + 16, sizeof(seqnum));
+    if (handle->kvs) {
+        cur_kv_id = handle->kvs->getKvsId();
+    }
+    if (_endian_decode(magic) != CHANGES_CURSOR_MAGIC ||
+        _endian_decode(kv_id) != cur_kv_id) {
+        // not a cursor of this KV store
+        return FDB_RESULT_INVALID_ARGS;
+    }
+
+    return _fdb_changes_cursor_create(handle, _endian_decode(seqnum),
+                                      ptr[4], ptr_cursor);
+}
+
+LIBFDB_API
+fdb_status fdb_changes_cursor_close(fdb_changes_cursor *cursor)
+{
+    if (!cursor) {
+        return FDB_RESULT_INVALID_HANDLE;
+    }
+
+    if (cursor->iterator) {
+        fdb_iterator_close(cursor->iterator);
+    }
+    free(cursor);
+    return FDB_RESULT_SUCCESS;
+}
@@ -27,8 +27,10 @@ struct binary_key_t {
 
 struct avl_tree;
 struct avl_node;
+struct async_io_handle;
 
 class FdbKvsHandle;
+class FileMgr;
 class HBTrieIterator;
 class BTreeIterator;
 
@@ -105,6 +107,11 @@ public:
         return iterKey.data;
     }
 
+    /* Fetches the largest seqnum visited by the forward sequence scan */
+    fdb_seqnum_t getMaxSeqVisited() {
+        return maxSeqVisited;
+    }
+
     /* To initialize a regular iterator */
     static fdb_status initIterator(FdbKvsHandle *handle,
                                    fdb_iterator **ptr_iterator,
@@ -143,7 +150,41 @@ public:
     /* Gets the item pointed to by the iterator */
     fdb_status get(fdb_doc **doc, bool metaOnly);
 
+    /**
+     * Copy the items from the current position into the caller's buffer,
+     * moving the iterator forward after each item.
+     *
+     * @param docs Array of docs to be filled. Their key, meta, and body
+     *        pointers refer to the memory in 'buf'.
+     * @param max_docs Number of elements in 'docs'.
+     * @param buf Buffer where keys, metas, and bodies are copied.
+     * @param bufsize Size of 'buf'.
+     * @param num_docs Pointer to the variable where the number of items
+     *        filled is returned.
+     * @return FDB_RESULT_SUCCESS if at least one item is filled.
+     */
+    fdb_status nextBatch(fdb_doc *docs, size_t max_docs,
+                         void *buf, size_t bufsize, size_t *num_docs);
+
+    /* Sets the filter applied to the key and meta of each item */
+    fdb_status setFilter(fdb_iterator_filter_fn filter, void *ctx);
+
+    /* Sets the parts of the items returned by get() and nextBatch() */
+    fdb_status setProjection(const fdb_iterator_projection *projection);
+
+    /**
+     * Load the blocks of the next docs of a sequence iterator into the
+     * block cache, in the order of their positions in the file.
+     *
+     * @param num_docs Number of docs to be prefetched, starting from the
+     *        current one. Only the docs in the main index are prefetched.
+     */
+    void prefetchSeq(size_t num_docs);
+
 private:
+    /* Moves the iterator forward by one without taking the handle */
+    fdb_status moveToNext();
+
     /* Constructor for regular iterator */
     FdbIterator(FdbKvsHandle *_handle,
                 bool snapshoted_handle,
@@ -181,6 +222,37 @@ private:
     /* Operation for a sequence iterator to move forward */
     fdb_status iterateSeqNext();
 
+    /* Give access hints to the memory-mapped file based on the direction
+       of the last move and the offset of the current doc */
+    void adviseMappedAccess(fdb_iterator_dir_t dir);
+
+    /* Load the blocks of the docs ahead of the HB+Trie cursor into the
+       block cache, called whenever the cursor moves to the next key */
+    void readAhead(itr_seek_t seek_type);
+
+    /* Drop the read-ahead cursor when the HB+Trie cursor is repositioned */
+    void resetReadAhead();
+
+    /* Load the blocks of the first 'num' docs in raOffsets into the block
+       cache, without waiting for the reads. The whole blocks of a doc are
+       read if its first block is cached, otherwise the first block only, and
+       the doc is kept in raPending to read the rest after the block is
+       loaded ('retry' is set then). The number of the blocks that were
+       already cached is returned */
+    size_t prefetchDocs(size_t num, bool retry, size_t *num_bids);
+
+    /* Load the blocks read ahead by the completed async reads into the
+       block cache, without waiting for the others */
+    void completeReadAhead();
+
+    /* Check if a key read ahead is out of the iterator's range in the
+       direction of the read-ahead */
+    bool isReadAheadEnd(void *key, size_t keylen);
+
+    /* Apply the filter to the doc at the given offset, by reading its key
+       and meta only. Returns FDB_RESULT_KEY_NOT_FOUND if it is skipped */
+    fdb_status checkFilter(DocioHandle *dhandle, uint64_t offset);
+
     // ForestDB KV store handle
     FdbKvsHandle *iterHandle;
     // Was this iterator created on an pre-existing snapshot handle
@@ -193,6 +265,9 @@ private:
     HBTrieIterator *seqtrieIterator;
     // Current seqnum pointed by the iterator
     fdb_seqnum_t seqNum;
+    // Largest seqnum visited by the forward sequence scan, including the
+    // items skipped by the iterator option or the filter
+    fdb_seqnum_t maxSeqVisited;
     // WAL Iterator to iterate over the shared sharded global WAL
     WalItr *walIterator;
     // Cursor instance of WAL iterator
@@ -229,5 +304,59 @@ private:
     uint64_t getOffset;
     // Type of iterator
     fdb_iterator_type_t iterType;
+    // Memory-mapped file advised for this iterator's forward scan
+    FileMgr *mmapSeqFile;
+    // Doc offset of the previous move over a memory-mapped file
+    uint64_t mmapLastOffset;
+    // Lowest offset prefetched for the backward scan
+    uint64_t mmapPrefetchPos;
+    // HB+Trie iterator running ahead of the cursor for the read-ahead
+    HBTrieIterator *raIterator;
+    // Doc offsets collected by the read-ahead
+    uint64_t *raOffsets;
+    // Block IDs of the docs read ahead
+    bid_t *raBids;
+    // Buffer for the keys of the docs read ahead
+    void *raKeyBuf;
+    // Number of docs at the front of raOffsets whose blocks other than the
+    // first one will be read ahead after the first one is loaded
+    size_t raPending;
+    // Async I/O handle for the read-ahead, NULL if not supported
+    struct async_io_handle *raAioHandle;
+    // Number of docs read ahead that the cursor hasn't reached yet
+    size_t raRemaining;
+    // Current number of docs to read ahead
+    size_t raWindow;
+    // Direction of the read-ahead
+    fdb_iterator_dir_t raDirection;
+    // Whether the read-ahead iterator reached the end of the range
+    bool raEnd;
+    // Whether the async I/O handle failed to be initialized
+    bool raAioFailed;
+    // Filter applied to the key and meta of each item, NULL if not set
+    fdb_iterator_filter_fn filterFunc;
+    // Client context passed to the filter
+    void *filterCtx;
+    // Parts of the items returned by get() and nextBatch()
+    fdb_iterator_projection projection;
+};
+
+/**
+ * Changes feed cursor, which reads the changes of a KV store in batches
+ * over a sequence iterator that is kept open between the batches.
+ */
+struct FdbChangesCursor {
+    // KV store handle that the changes are read from
+    FdbKvsHandle *handle;
+    // Sequence iterator over the latest snapshot, NULL if not opened yet
+    fdb_iterator *iterator;
+    // Smallest sequence number that has not been visited yet, either
+    // returned or skipped
+    fdb_seqnum_t nextSeqnum;
+    // Iterator option
+    fdb_iterator_opt_t opt;
 };
 
+// Serialized form of a changes feed cursor
+#define CHANGES_CURSOR_MAGIC (0xfdbcc001)
+#define CHANGES_CURSOR_SIZE (24)
@@ -1287,7 +1287,7 @@ fdb_status _fdb_kvs_open(FdbKvsHandle *root_handle,
                            "Failed to open KV store '%s' because it doesn't exist.",
                            kvs_name ? kvs_name : DEFAULT_KVS_NAME);
         }
-        if (root_handle->config.flags == FDB_OPEN_FLAG_RDONLY) {
+        if (root_handle->config.flags & FDB_OPEN_FLAG_RDONLY) {
             return fdb_log(&root_handle->log_callback, FDB_RESULT_RONLY_VIOLATION,
                            "Failed to create KV store '%s' because the KV store's handle "
                            "is read-only.", kvs_name ? kvs_name : DEFAULT_KVS_NAME);
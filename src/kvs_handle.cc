@@ -31,7 +31,7 @@ FdbKvsHandle::FdbKvsHandle() :
     seqtree(NULL), file(NULL), dhandle(NULL), bhandle(NULL),
     fileops(NULL), log_callback(), cur_header_revnum(0), rollback_revnum(0),
     last_hdr_bid(0), last_wal_flush_hdr_bid(0), kv_info_offset(0), shandle(NULL),
-    seqnum(0), max_seqnum(0), txn(NULL), handle_busy(0), dirty_updates(0),
+    seqnum(0), max_seqnum(0), checkpoint_snapshot(false), txn(NULL), handle_busy(0), dirty_updates(0),
     node(NULL), num_iterators(0) {
 
     memset(&kvs_config, 0, sizeof(kvs_config));
@@ -157,6 +157,7 @@ void FdbKvsHandle::copyFromOtherHandle(const FdbKvsHandle& kv_handle) {
     shandle = kv_handle.shandle;
     seqnum = kv_handle.seqnum;
     max_seqnum = kv_handle.max_seqnum;
+    checkpoint_snapshot = kv_handle.checkpoint_snapshot;
     filename = kv_handle.filename;
     txn = kv_handle.txn;
 
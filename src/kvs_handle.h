@@ -153,6 +153,11 @@ public:
      * KV store's max sequence number for snapshot or rollback.
      */
     fdb_seqnum_t max_seqnum;
+    /**
+     * Flag that indicates whether this handle is a snapshot opened on a
+     * header pinned by a checkpoint.
+     */
+    bool checkpoint_snapshot;
     /**
      * Virtual filename (DB instance filename given by users).
      */
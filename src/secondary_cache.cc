@@ -0,0 +1,401 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+
+#include "secondary_cache.h"
+#include "filemgr_ops.h"
+#include "checksum.h"
+
+#include "memleak.h"
+
+std::atomic<SecondaryBlockCache *> SecondaryBlockCache::instance(nullptr);
+std::mutex SecondaryBlockCache::instanceMutex;
+
+// Blocks of a database file kept in the secondary block cache.
+class SecondaryCacheFile {
+public:
+    SecondaryCacheFile(const char *filename, uint64_t _id) :
+        fileName(filename), id(_id), revnum(0) { }
+
+    const std::string fileName;
+    // Unique ID that is not reused even after the instance is freed
+    const uint64_t id;
+    // Header revision number of the file when it was closed
+    filemgr_header_revnum_t revnum;
+};
+
+fdb_status SecondaryBlockCache::init(const std::string &path,
+                                     uint64_t size,
+                                     uint32_t blocksize) {
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    if (instance.load()) {
+        return FDB_RESULT_SUCCESS;
+    }
+
+    uint64_t num_slots = size / blocksize;
+    if (num_slots < SCACHE_NPARTITIONS) {
+        return FDB_RESULT_INVALID_CONFIG;
+    }
+
+    // the contents of the cache file are not valid any more, as the index
+    // of the cache is maintained in memory only.
+    struct filemgr_ops *ops = get_filemgr_ops();
+    fdb_fileops_handle handle = ops->constructor(ops->ctx);
+    fdb_status status = ops->open(path.c_str(), &handle,
+                                  O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (status != FDB_RESULT_SUCCESS) {
+        ops->destructor(handle);
+        return status;
+    }
+
+    instance.store(new SecondaryBlockCache(ops, handle, path, num_slots,
+                                           blocksize));
+    return FDB_RESULT_SUCCESS;
+}
+
+void SecondaryBlockCache::destroyInstance() {
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    SecondaryBlockCache *tmp = instance.load();
+    if (tmp) {
+        delete tmp;
+        instance = nullptr;
+    }
+}
+
+SecondaryBlockCache::SecondaryBlockCache(struct filemgr_ops *_ops,
+                                         fdb_fileops_handle handle,
+                                         const std::string &path,
+                                         uint64_t num_slots,
+                                         uint32_t blocksize) :
+    ops(_ops), fopsHandle(handle), cachePath(path), blockSize(blocksize),
+    numUsedSlots(0), nextFileId(0) {
+    uint64_t first_slot = 0;
+    for (size_t i = 0; i < SCACHE_NPARTITIONS; ++i) {
+        Partition *partition = new Partition();
+        uint64_t n = num_slots / SCACHE_NPARTITIONS;
+        if (i == SCACHE_NPARTITIONS - 1) {
+            n = num_slots - first_slot;
+        }
+        partition->slots.resize(n);
+        partition->firstSlot = first_slot;
+        first_slot += n;
+        partitions.push_back(partition);
+    }
+    spin_init(&filesLock);
+}
+
+SecondaryBlockCache::~SecondaryBlockCache() {
+    for (auto partition : partitions) {
+        delete partition;
+    }
+    for (auto sfile : allFiles) {
+        delete sfile;
+    }
+    spin_destroy(&filesLock);
+
+    ops->close(fopsHandle);
+    ops->destructor(fopsHandle);
+    remove(cachePath.c_str());
+}
+
+SecondaryBlockCache::Partition *SecondaryBlockCache::getPartition(
+                                                    SecondaryCacheFile *sfile,
+                                                    bid_t bid) {
+    return partitions[(bid + sfile->id) % SCACHE_NPARTITIONS];
+}
+
+void SecondaryBlockCache::freeSlot(Partition *partition, size_t slot_no) {
+    Slot &slot = partition->slots[slot_no];
+    auto file_entry = partition->index.find(slot.file);
+    if (file_entry != partition->index.end()) {
+        file_entry->second.erase(slot.bid);
+        if (file_entry->second.empty()) {
+            partition->index.erase(file_entry);
+        }
+    }
+    slot.file = NULL;
+    slot.bid = BLK_NOT_FOUND;
+    slot.state = SLOT_FREE;
+    slot.referenced = false;
+    // the completion of an in-flight read or write of the slot
+    // will notice this.
+    slot.gen++;
+    numUsedSlots--;
+}
+
+bool SecondaryBlockCache::checkAdmission(Partition *partition,
+                                         uint64_t key,
+                                         const void *block) {
+    uint8_t marker = *((const uint8_t *)block + blockSize - 1);
+    if (marker == BLK_MARKER_BNODE) {
+        // index nodes are always admitted
+        return true;
+    }
+    if (partition->ghostSet.erase(key)) {
+        // the block was rejected before, and has been read again since then
+        return true;
+    }
+    partition->ghostSet.insert(key);
+    partition->ghostQueue.push_back(key);
+    if (partition->ghostQueue.size() > partition->slots.size()) {
+        partition->ghostSet.erase(partition->ghostQueue.front());
+        partition->ghostQueue.pop_front();
+    }
+    return false;
+}
+
+size_t SecondaryBlockCache::chooseVictimSlot(Partition *partition) {
+    size_t num_slots = partition->slots.size();
+    // every referenced slot is visited at most twice
+    for (size_t i = 0; i < num_slots * 2; ++i) {
+        size_t slot_no = partition->clockHand;
+        Slot &slot = partition->slots[slot_no];
+        partition->clockHand = (slot_no + 1) % num_slots;
+
+        if (slot.state == SLOT_FREE) {
+            return slot_no;
+        }
+        if (slot.state == SLOT_WRITING) {
+            continue;
+        }
+        if (slot.referenced) {
+            // give second chance to the slot
+            slot.referenced = false;
+            continue;
+        }
+        freeSlot(partition, slot_no);
+        return slot_no;
+    }
+    // all the slots are being written
+    return num_slots;
+}
+
+SecondaryCacheFile *SecondaryBlockCache::attachFile(
+                                            const char *filename,
+                                            filemgr_header_revnum_t revnum,
+                                            bool empty) {
+    SecondaryCacheFile *sfile = NULL;
+    SecondaryCacheFile *stale = NULL;
+
+    spin_lock(&filesLock);
+    auto entry = closedFiles.find(std::string(filename));
+    if (entry != closedFiles.end()) {
+        if (!empty && entry->second->revnum == revnum) {
+            // the file has not been changed since it was closed
+            sfile = entry->second;
+        } else {
+            stale = entry->second;
+        }
+        closedFiles.erase(entry);
+    }
+    if (!sfile) {
+        sfile = new SecondaryCacheFile(filename, nextFileId++);
+        allFiles.insert(sfile);
+    }
+    spin_unlock(&filesLock);
+
+    if (stale) {
+        dropFile(stale);
+    }
+    return sfile;
+}
+
+void SecondaryBlockCache::detachFile(SecondaryCacheFile *sfile,
+                                     filemgr_header_revnum_t revnum,
+                                     bool removed) {
+    SecondaryCacheFile *stale = NULL;
+
+    if (removed) {
+        dropFile(sfile);
+        return;
+    }
+
+    spin_lock(&filesLock);
+    sfile->revnum = revnum;
+    auto entry = closedFiles.find(sfile->fileName);
+    if (entry != closedFiles.end()) {
+        stale = entry->second;
+        entry->second = sfile;
+    } else {
+        closedFiles.insert(std::make_pair(sfile->fileName, sfile));
+    }
+    spin_unlock(&filesLock);
+
+    if (stale) {
+        dropFile(stale);
+    }
+}
+
+void SecondaryBlockCache::removeFile(const char *filename) {
+    SecondaryCacheFile *sfile = NULL;
+
+    spin_lock(&filesLock);
+    auto entry = closedFiles.find(std::string(filename));
+    if (entry != closedFiles.end()) {
+        sfile = entry->second;
+        closedFiles.erase(entry);
+    }
+    spin_unlock(&filesLock);
+
+    if (sfile) {
+        dropFile(sfile);
+    }
+}
+
+void SecondaryBlockCache::dropFile(SecondaryCacheFile *sfile) {
+    for (auto partition : partitions) {
+        spin_lock(&partition->lock);
+        auto file_entry = partition->index.find(sfile);
+        if (file_entry != partition->index.end()) {
+            for (auto &block_entry : file_entry->second) {
+                Slot &slot = partition->slots[block_entry.second];
+                slot.file = NULL;
+                slot.bid = BLK_NOT_FOUND;
+                slot.state = SLOT_FREE;
+                slot.referenced = false;
+                slot.gen++;
+                numUsedSlots--;
+            }
+            partition->index.erase(file_entry);
+        }
+        spin_unlock(&partition->lock);
+    }
+
+    spin_lock(&filesLock);
+    allFiles.erase(sfile);
+    spin_unlock(&filesLock);
+    delete sfile;
+}
+
+bool SecondaryBlockCache::read(SecondaryCacheFile *sfile,
+                               bid_t bid,
+                               void *buf) {
+    Partition *partition = getPartition(sfile, bid);
+
+    spin_lock(&partition->lock);
+    auto file_entry = partition->index.find(sfile);
+    if (file_entry == partition->index.end()) {
+        spin_unlock(&partition->lock);
+        return false;
+    }
+    auto block_entry = file_entry->second.find(bid);
+    if (block_entry == file_entry->second.end() ||
+        partition->slots[block_entry->second].state != SLOT_VALID) {
+        spin_unlock(&partition->lock);
+        return false;
+    }
+    size_t slot_no = block_entry->second;
+    Slot &slot = partition->slots[slot_no];
+    slot.referenced = true;
+    uint64_t gen = slot.gen;
+    uint32_t crc = slot.crc;
+    spin_unlock(&partition->lock);
+
+    ssize_t r = ops->pread(fopsHandle, buf, blockSize,
+                           (partition->firstSlot + slot_no) * blockSize);
+    bool valid = r == (ssize_t)blockSize &&
+                 get_checksum(reinterpret_cast<const uint8_t *>(buf),
+                              blockSize) == crc;
+
+    spin_lock(&partition->lock);
+    if (partition->slots[slot_no].gen != gen) {
+        // the slot was reassigned while being read
+        valid = false;
+    } else if (!valid) {
+        // discard the broken copy
+        freeSlot(partition, slot_no);
+    }
+    spin_unlock(&partition->lock);
+    return valid;
+}
+
+void SecondaryBlockCache::admit(SecondaryCacheFile *sfile,
+                                bid_t bid,
+                                const void *block) {
+    Partition *partition = getPartition(sfile, bid);
+    uint64_t key = (sfile->id << 48) ^ bid;
+
+    spin_lock(&partition->lock);
+    auto file_entry = partition->index.find(sfile);
+    if (file_entry != partition->index.end()) {
+        auto block_entry = file_entry->second.find(bid);
+        if (block_entry != file_entry->second.end()) {
+            // already cached
+            partition->slots[block_entry->second].referenced = true;
+            spin_unlock(&partition->lock);
+            return;
+        }
+    }
+    if (!checkAdmission(partition, key, block)) {
+        spin_unlock(&partition->lock);
+        return;
+    }
+    size_t slot_no = chooseVictimSlot(partition);
+    if (slot_no == partition->slots.size()) {
+        spin_unlock(&partition->lock);
+        return;
+    }
+    Slot &slot = partition->slots[slot_no];
+    slot.file = sfile;
+    slot.bid = bid;
+    slot.state = SLOT_WRITING;
+    slot.referenced = false;
+    slot.gen++;
+    uint64_t gen = slot.gen;
+    partition->index[sfile][bid] = slot_no;
+    numUsedSlots++;
+    spin_unlock(&partition->lock);
+
+    uint32_t crc = get_checksum(reinterpret_cast<const uint8_t *>(block),
+                                blockSize);
+    ssize_t r = ops->pwrite(fopsHandle, const_cast<void *>(block), blockSize,
+                            (partition->firstSlot + slot_no) * blockSize);
+
+    spin_lock(&partition->lock);
+    if (partition->slots[slot_no].gen == gen) {
+        // not invalidated in the meantime
+        if (r == (ssize_t)blockSize) {
+            partition->slots[slot_no].crc = crc;
+            partition->slots[slot_no].state = SLOT_VALID;
+        } else {
+            freeSlot(partition, slot_no);
+        }
+    }
+    spin_unlock(&partition->lock);
+}
+
+void SecondaryBlockCache::invalidate(SecondaryCacheFile *sfile,
+                                     bid_t start_bid,
+                                     unsigned num_blocks) {
+    for (bid_t bid = start_bid; bid < start_bid + num_blocks; ++bid) {
+        Partition *partition = getPartition(sfile, bid);
+        spin_lock(&partition->lock);
+        auto file_entry = partition->index.find(sfile);
+        if (file_entry != partition->index.end()) {
+            auto block_entry = file_entry->second.find(bid);
+            if (block_entry != file_entry->second.end()) {
+                freeSlot(partition, block_entry->second);
+            }
+        }
+        spin_unlock(&partition->lock);
+    }
+}
@@ -0,0 +1,235 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "libforestdb/fdb_types.h"
+#include "libforestdb/fdb_errors.h"
+#include "common.h"
+#include "internal_types.h"
+
+class SecondaryCacheFile;
+
+/**
+ * Second-level block cache that keeps clean blocks evicted from the block
+ * cache in a local cache file (e.g., on a local SSD), so that a miss in the
+ * block cache of a file on slow storage is served from the cache file
+ * instead of the database file.
+ *
+ * The cache file is divided into block-sized slots, and only the index of the
+ * slots is maintained in memory. The slots are partitioned, and each
+ * partition replaces its slots by the CLOCK algorithm. Index nodes are
+ * admitted as soon as they are evicted from the block cache, while the other
+ * blocks are admitted only when they are evicted again after being read back
+ * (i.e., when they are found in the history of recently rejected blocks).
+ *
+ * Blocks are cached per file name. When a file is closed, the header revision
+ * number of the file is recorded, and its blocks are reused by the next open
+ * of the same file only if the revision number is still the same.
+ */
+class SecondaryBlockCache {
+public:
+    /**
+     * Instantiate the secondary block cache and create its cache file.
+     *
+     * @param path Path of the cache file
+     * @param size Size of the cache file in bytes
+     * @param blocksize Size of each block in the cache
+     * @return FDB_RESULT_SUCCESS on success.
+     */
+    static fdb_status init(const std::string &path,
+                           uint64_t size,
+                           uint32_t blocksize);
+
+    /**
+     * Get the singleton instance of the secondary block cache.
+     *
+     * @return Pointer to the secondary block cache, or NULL if it is disabled.
+     */
+    static SecondaryBlockCache* getInstance() {
+        return instance.load();
+    }
+
+    /**
+     * Remove the cache file and destroy the secondary block cache.
+     */
+    static void destroyInstance();
+
+    /**
+     * Start caching the blocks of a given file. The blocks cached for the
+     * file before it was closed last time are reused if the file has not
+     * been changed since then.
+     *
+     * @param filename Name of the database file
+     * @param revnum Revision number of the last header of the file
+     * @param empty True if the file doesn't have any block yet
+     * @return Pointer to the cache instance for the file
+     */
+    SecondaryCacheFile *attachFile(const char *filename,
+                                   filemgr_header_revnum_t revnum,
+                                   bool empty);
+
+    /**
+     * Stop caching the blocks of a given file as it is being closed.
+     *
+     * @param sfile Pointer to the cache instance for the file
+     * @param revnum Revision number of the last header of the file
+     * @param removed True if the file is being removed. The blocks of the
+     *        file are discarded in that case.
+     */
+    void detachFile(SecondaryCacheFile *sfile,
+                    filemgr_header_revnum_t revnum,
+                    bool removed);
+
+    /**
+     * Discard the blocks kept for a closed file.
+     *
+     * @param filename Name of the database file
+     */
+    void removeFile(const char *filename);
+
+    /**
+     * Read a given block from the cache file.
+     *
+     * @param sfile Pointer to the cache instance for the file
+     * @param bid ID of a block to be read
+     * @param buf Pointer to the read buffer
+     * @return True if the block was read from the cache file.
+     */
+    bool read(SecondaryCacheFile *sfile, bid_t bid, void *buf);
+
+    /**
+     * Offer a clean block evicted from the block cache. The block is written
+     * into the cache file if the admission policy accepts it.
+     *
+     * @param sfile Pointer to the cache instance for the file
+     * @param bid ID of the block
+     * @param block Pointer to the block contents
+     */
+    void admit(SecondaryCacheFile *sfile, bid_t bid, const void *block);
+
+    /**
+     * Discard the cached copies of consecutive blocks that are being
+     * overwritten in the database file.
+     *
+     * @param sfile Pointer to the cache instance for the file
+     * @param start_bid ID of the first block
+     * @param num_blocks Number of blocks
+     */
+    void invalidate(SecondaryCacheFile *sfile, bid_t start_bid,
+                    unsigned num_blocks);
+
+    /**
+     * Return the space of the cache file used by the cached blocks.
+     */
+    uint64_t getUsedSpace() const {
+        return numUsedSlots.load(std::memory_order_relaxed) * blockSize;
+    }
+
+private:
+    SecondaryBlockCache(struct filemgr_ops *ops, fdb_fileops_handle handle,
+                        const std::string &path, uint64_t num_slots,
+                        uint32_t blocksize);
+
+    ~SecondaryBlockCache();
+
+    enum slot_state_t {
+        SLOT_FREE,
+        SLOT_WRITING,
+        SLOT_VALID
+    };
+
+    struct Slot {
+        Slot() : file(NULL), bid(BLK_NOT_FOUND), crc(0), gen(0),
+                 state(SLOT_FREE), referenced(false) { }
+
+        SecondaryCacheFile *file;
+        bid_t bid;
+        // checksum of the block contents written in the slot
+        uint32_t crc;
+        // incremented whenever the slot is reassigned or invalidated
+        uint64_t gen;
+        slot_state_t state;
+        // reference bit for the CLOCK replacement
+        bool referenced;
+    };
+
+    struct Partition {
+        Partition() : clockHand(0) {
+            spin_init(&lock);
+        }
+
+        ~Partition() {
+            spin_destroy(&lock);
+        }
+
+        spin_t lock;
+        // Slots owned by this partition
+        std::vector<Slot> slots;
+        // Index of the first slot in the cache file
+        uint64_t firstSlot;
+        size_t clockHand;
+        // Slot numbers indexed by files and block IDs
+        std::unordered_map<SecondaryCacheFile *,
+                           std::unordered_map<bid_t, size_t> > index;
+        // History of the blocks rejected by the admission policy
+        std::unordered_set<uint64_t> ghostSet;
+        std::deque<uint64_t> ghostQueue;
+    };
+
+    Partition *getPartition(SecondaryCacheFile *sfile, bid_t bid);
+
+    // Caller should grab the partition lock.
+    void freeSlot(Partition *partition, size_t slot_no);
+
+    // Caller should grab the partition lock.
+    bool checkAdmission(Partition *partition, uint64_t key, const void *block);
+
+    // Caller should grab the partition lock.
+    size_t chooseVictimSlot(Partition *partition);
+
+    void dropFile(SecondaryCacheFile *sfile);
+
+    // Singleton instance and mutex guarding its creation
+    static std::atomic<SecondaryBlockCache *> instance;
+    static std::mutex instanceMutex;
+
+    struct filemgr_ops *ops;
+    fdb_fileops_handle fopsHandle;
+    std::string cachePath;
+    uint32_t blockSize;
+    std::vector<Partition *> partitions;
+    std::atomic<uint64_t> numUsedSlots;
+
+    // Caches of the closed files, indexed by file names
+    std::unordered_map<std::string, SecondaryCacheFile *> closedFiles;
+    // Caches of all the files, either opened or closed
+    std::unordered_set<SecondaryCacheFile *> allFiles;
+    // Lock for the file maps above and the file ID counter
+    spin_t filesLock;
+    uint64_t nextFileId;
+
+    DISALLOW_COPY_AND_ASSIGN(SecondaryBlockCache);
+};
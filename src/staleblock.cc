@@ -110,6 +110,19 @@ void StaleDataManager::addInmemStaleInfo(filemgr_header_revnum_t revnum,
 }
 
 void StaleDataManager::loadInmemStaleInfo(FdbKvsHandle *handle)
+{
+    if (staleInfoTreeLoaded.load()) {
+        // stale info is already loaded (fast screening without mutex)
+        return;
+    }
+
+    // should grab mutex to avoid race with other writer
+    file->mutexLock();
+    loadInmemStaleInfo_UNLOCKED(handle);
+    file->mutexUnlock();
+}
+
+void StaleDataManager::loadInmemStaleInfo_UNLOCKED(FdbKvsHandle *handle)
 {
     uint8_t keybuf[64];
     int64_t ret;
@@ -118,17 +131,11 @@ void StaleDataManager::loadInmemStaleInfo(FdbKvsHandle *handle)
     BTreeIterator *bit;
     btree_result br;
     struct docio_object doc;
-    bool expected = false;
 
-    if (!staleInfoTreeLoaded.compare_exchange_strong(expected, true)) {
-        // stale info is already loaded (fast screening without mutex)
+    if (staleInfoTreeLoaded.load()) {
         return;
     }
 
-    // first open of the DB file
-    // should grab mutex to avoid race with other writer
-    file->mutexLock();
-
     bit = new BTreeIterator(handle->staletree, NULL);
     do {
         br = bit->next((void*)&_revnum, (void*)&_offset);
@@ -172,7 +179,7 @@ void StaleDataManager::loadInmemStaleInfo(FdbKvsHandle *handle)
 
     delete bit;
 
-    file->mutexUnlock();
+    staleInfoTreeLoaded.store(true);
 }
 
 void StaleDataManager::gatherRegions(FdbKvsHandle *handle,
@@ -300,6 +307,28 @@ void StaleDataManager::gatherRegions(FdbKvsHandle *handle,
                 // do not remove the item
                 cur++;
             }
+
+            // regions excluded by checkpoints are also remaining ones. They
+            // are kept in 'pinnedList' in memory, and recorded in the same
+            // document so that they are reclaimed after the file is reopened.
+            for (auto &entry : pinnedList) {
+                if (handle->staletree) {
+                    count++;
+
+                    _pos = _endian_encode(entry.pos);
+                    _len = _endian_encode(entry.len);
+
+                    memcpy(buf + offset, &_pos, sizeof(_pos));
+                    offset += sizeof(_pos);
+                    memcpy(buf + offset, &_len, sizeof(_len));
+                    offset += sizeof(_len);
+
+                    if (offset + sizeof(_pos) + sizeof(_len) >= bufsize) {
+                        bufsize *= 2;
+                        buf = (uint8_t*)realloc(buf, bufsize);
+                    }
+                }
+            }
         } else {
             // gater from stale_list
             if ( e_last != staleList.end() ) {
@@ -365,7 +394,8 @@ void StaleDataManager::gatherRegions(FdbKvsHandle *handle,
             if (from_mergetree && first_loop) {
                 // if from_mergetree flag is set and this is the first loop,
                 // stale regions in this document are already in mergetree
-                // so skip adding them into in-memory stale info tree.
+                // (or pinnedList) so skip adding them into in-memory stale
+                // info tree.
 
                 // however, the system doc itself should be marked as stale
                 // when the doc is reclaimed, thus we instead add a dummy entry
@@ -484,12 +514,69 @@ void StaleDataManager::insertNmerge(std::map<uint64_t, stale_data*> *tree,
     }
 }
 
+void StaleDataManager::insertNmergeUnpinned(
+                                  std::map<uint64_t, stale_data*> *tree,
+                                  filemgr_header_revnum_t revnum,
+                                  uint64_t item_pos,
+                                  uint32_t item_len)
+{
+    if (!file->hasCheckpoints()) {
+        insertNmerge(tree, item_pos, item_len);
+        return;
+    }
+
+    // split the region into runs of pinned and unpinned blocks
+    uint64_t blocksize = file->getBlockSize();
+    uint64_t cur, next, end = item_pos + item_len;
+    uint64_t run_pos = item_pos;
+    bool pinned, run_pinned = false;
+    std::list<stale_pinned_data> runs;
+    struct stale_pinned_data run;
+
+    run.revnum = revnum;
+    file->acquireCheckpointLock();
+    for (cur = item_pos; cur < end; cur = next) {
+        next = (cur / blocksize + 1) * blocksize;
+        if (next > end) {
+            next = end;
+        }
+        pinned = file->isBlockPinned_UNLOCKED(revnum, cur / blocksize);
+        if (cur == item_pos) {
+            run_pinned = pinned;
+        } else if (pinned != run_pinned) {
+            run.pos = run_pos;
+            run.len = cur - run_pos;
+            if (run_pinned) {
+                pinnedList.push_back(run);
+            } else {
+                runs.push_back(run);
+            }
+            run_pos = cur;
+            run_pinned = pinned;
+        }
+    }
+    file->releaseCheckpointLock();
+
+    run.pos = run_pos;
+    run.len = end - run_pos;
+    if (run_pinned) {
+        pinnedList.push_back(run);
+    } else {
+        runs.push_back(run);
+    }
+
+    for (auto &entry : runs) {
+        insertNmerge(tree, entry.pos, entry.len);
+    }
+}
+
 // Parse & fetch stale regions from the buffer 'ctx', which is the body of
 // a stale info system document (from either in-memory stale-block-tree or
 // on-disk stale-block-tree). After fetching, insert those regions
 // into 'mergetree'.
 void StaleDataManager::fetchStaleInfoDoc(void *ctx,
                                   std::map<uint64_t, stale_data*> *mergetree,
+                                  filemgr_header_revnum_t revnum,
                                   uint64_t &prev_offset_out,
                                   uint64_t &prev_hdr_out)
 {
@@ -528,7 +615,7 @@ void StaleDataManager::fetchStaleInfoDoc(void *ctx,
         item_len = _endian_decode(item_len);
         pos += sizeof(item_len);
 
-        insertNmerge(mergetree, item_pos, item_len);
+        insertNmergeUnpinned(mergetree, revnum, item_pos, item_len);
     }
 }
 
@@ -569,6 +656,23 @@ reusable_block_list StaleDataManager::getReusableBlocks(FdbKvsHandle *handle,
                    calloc(max_revnum_array, sizeof(filemgr_header_revnum_t));
     n_revnums = 0;
 
+    if (!pinnedList.empty()) {
+        // retry the regions excluded by checkpoints at the last time,
+        // as some of them may have been released since then. Regions that
+        // became stale after the oldest active header are still needed by
+        // it, e.g., by a snapshot left open on a released checkpoint.
+        std::list<stale_pinned_data> pinned;
+        pinned.swap(pinnedList);
+        for (auto &entry : pinned) {
+            if (entry.revnum > revnum_upto) {
+                pinnedList.push_back(entry);
+                continue;
+            }
+            insertNmergeUnpinned(mergetree, entry.revnum,
+                                 entry.pos, entry.len);
+        }
+    }
+
     // remember the last stale list item to be preserved
     if ( staleList.empty() ) {
         last_stalelist = staleList.end();
@@ -647,14 +751,15 @@ reusable_block_list StaleDataManager::getReusableBlocks(FdbKvsHandle *handle,
                         }
 
                         // fetch the context
-                        fetchStaleInfoDoc(uncomp_buf, mergetree,
+                        fetchStaleInfoDoc(uncomp_buf, mergetree, revnum,
                                               prev_offset, prev_hdr);
                     } else {
-                        fetchStaleInfoDoc(entry->ctx, mergetree,
+                        fetchStaleInfoDoc(entry->ctx, mergetree, revnum,
                                               prev_offset, prev_hdr);
                     }
 #else
-                    fetchStaleInfoDoc(entry->ctx, mergetree, prev_offset, prev_hdr);
+                    fetchStaleInfoDoc(entry->ctx, mergetree, revnum,
+                                      prev_offset, prev_hdr);
 #endif
                 }
 
@@ -664,11 +769,14 @@ reusable_block_list StaleDataManager::getReusableBlocks(FdbKvsHandle *handle,
 
                 if (sr.n_regions > 1) {
                     for (i=0; i<sr.n_regions; ++i){
-                        insertNmerge(mergetree, sr.regions[i].pos, sr.regions[i].len);
+                        insertNmergeUnpinned(mergetree, revnum,
+                                             sr.regions[i].pos,
+                                             sr.regions[i].len);
                     }
                     free(sr.regions);
                 } else {
-                    insertNmerge(mergetree, sr.region.pos, sr.region.len);
+                    insertNmergeUnpinned(mergetree, revnum,
+                                         sr.region.pos, sr.region.len);
                 }
 
                 free(entry->ctx);
@@ -719,7 +827,8 @@ reusable_block_list StaleDataManager::getReusableBlocks(FdbKvsHandle *handle,
                     continue;
                 }
 
-                fetchStaleInfoDoc(doc.body, mergetree, prev_offset, prev_hdr);
+                fetchStaleInfoDoc(doc.body, mergetree, revnum,
+                                      prev_offset, prev_hdr);
 
                 // also insert/merge the system doc region
                 size_t length = _fdb_get_docsize(doc.length);
@@ -728,11 +837,14 @@ reusable_block_list StaleDataManager::getReusableBlocks(FdbKvsHandle *handle,
 
                 if (sr.n_regions > 1) {
                     for (i=0; i<sr.n_regions; ++i){
-                        insertNmerge(mergetree, sr.regions[i].pos, sr.regions[i].len);
+                        insertNmergeUnpinned(mergetree, revnum,
+                                             sr.regions[i].pos,
+                                             sr.regions[i].len);
                     }
                     free(sr.regions);
                 } else {
-                    insertNmerge(mergetree, sr.region.pos, sr.region.len);
+                    insertNmergeUnpinned(mergetree, revnum,
+                                         sr.region.pos, sr.region.len);
                 }
 
                 // We don't need to free 'meta' as it will be NULL.
@@ -43,6 +43,17 @@ typedef struct {
     bid_t bid;
 } stale_header_info;
 
+// stale region that cannot be reused yet, as it is still reachable
+// from a header pinned by a checkpoint
+struct stale_pinned_data {
+    // revision number of the commit that made the region stale
+    filemgr_header_revnum_t revnum;
+    // byte offset to the beginning of the region
+    uint64_t pos;
+    // length of the region
+    uint32_t len;
+};
+
 
 // in-memory structure for stale info
 // (corresponding to a system doc)
@@ -92,6 +103,7 @@ public:
         return ret;
     }
     virtual void loadInmemStaleInfo(FdbKvsHandle *handle) { }
+    virtual void loadInmemStaleInfo_UNLOCKED(FdbKvsHandle *handle) { }
 
     virtual void gatherRegions(FdbKvsHandle *handle,
                                filemgr_header_revnum_t revnum,
@@ -167,13 +179,23 @@ public:
                                                     size_t doclen);
 
     /**
-     * Load all system documents pointed to by stale tree into memory.
+     * Load all system documents pointed to by stale tree into memory,
+     * if they are not loaded yet.
      *
      * @param handle Pointer to ForestDB KV store handle.
      * @return void.
      */
     void loadInmemStaleInfo(FdbKvsHandle *handle);
 
+    /**
+     * Same as loadInmemStaleInfo, but the caller should hold the file's
+     * mutex, and the stale tree of the given handle should be up-to-date.
+     *
+     * @param handle Pointer to ForestDB KV store handle.
+     * @return void.
+     */
+    void loadInmemStaleInfo_UNLOCKED(FdbKvsHandle *handle);
+
     /**
      * Gather stale region info from stale list and store it as a system doc.
      *
@@ -252,6 +274,8 @@ private:
      *
      * @param ctx Stale data info, from the body of a system document.
      * @param mergetree Pointer to Merge tree.
+     * @param revnum Revision number of the commit corresponding to the stale
+     *        info.
      * @param prev_offset_out Reference to the place where previous system
      *        document offset will be stored.
      * @param prev_hdr_out Reference to the place where previous commit header BID
@@ -260,6 +284,7 @@ private:
      */
     void fetchStaleInfoDoc(void *ctx,
                            std::map<uint64_t, stale_data*> *mergetree,
+                           filemgr_header_revnum_t revnum,
                            uint64_t &prev_offset_out,
                            uint64_t &prev_hdr_out);
 
@@ -274,6 +299,21 @@ private:
                       uint64_t item_pos,
                       uint32_t item_len);
 
+    /**
+     * Insert the given region into the given tree and merge, except for the
+     * blocks still reachable from the headers pinned by checkpoints. Those
+     * blocks are kept in 'pinnedList' until they are unpinned.
+     *
+     * @param revnum Revision number of the commit that made the region stale.
+     * @param item_pos Byte offset to the beginning of the region.
+     * @param item_len Length of the region.
+     * @return void.
+     */
+    void insertNmergeUnpinned(std::map<uint64_t, stale_data*> *tree,
+                              filemgr_header_revnum_t revnum,
+                              uint64_t item_pos,
+                              uint32_t item_len);
+
     /**
      * Gather stale region info from stale list and store it as a system doc.
      *
@@ -300,6 +340,9 @@ private:
     void clearStaleList();
     void clearStaleInfoTree();
     void clearMergeTree();
+
+    // stale regions excluded from block reusing by checkpoints
+    std::list<stale_pinned_data> pinnedList;
 };
 
 #endif /* _FDB_STALEBLOCK_H */
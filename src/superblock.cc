@@ -147,6 +147,8 @@ void Superblock::_init(FileMgr *_file, struct sb_config sconfig) {
     rsvBmp = NULL;
     avl_init(&bmpIdx, NULL);
     spin_init(&lock);
+    freeExtentsRevnum = BLK_NOT_FOUND;
+    freeExtentsCursor = 0;
 }
 
 fdb_status Superblock::init(ErrLogCallback * log_callback)
@@ -694,6 +696,180 @@ sb_alloc_start_over:
     return ret;
 }
 
+void Superblock::updateFreeExtents()
+{
+    bid_t cur = curAllocBid.load();
+
+    if (freeExtentsRevnum != bmpRevnum) {
+        // bitmap has been changed .. rebuild the tree
+        uint64_t sb_bmp_size = bmpSize.load();
+        uint8_t *sb_bmp = bmp;
+        bid_t bid, run_begin = BLK_NOT_FOUND;
+
+        releaseSkippedExtents();
+        freeExtents.clear();
+        freeExtentsRevnum = bmpRevnum;
+        freeExtentsCursor = cur;
+        if (cur == BLK_NOT_FOUND) {
+            return;
+        }
+        for (bid = cur; bid < sb_bmp_size; ++bid) {
+            if (mod8(bid) == 0 && sb_bmp[div8(bid)] == 0) {
+                // skip a byte with no free block
+                if (run_begin != BLK_NOT_FOUND) {
+                    freeExtents[run_begin] = bid - run_begin;
+                    run_begin = BLK_NOT_FOUND;
+                }
+                bid += 7;
+                continue;
+            }
+            if (isBmpSet(sb_bmp, bid)) {
+                if (run_begin == BLK_NOT_FOUND) {
+                    run_begin = bid;
+                }
+            } else if (run_begin != BLK_NOT_FOUND) {
+                freeExtents[run_begin] = bid - run_begin;
+                run_begin = BLK_NOT_FOUND;
+            }
+        }
+        if (run_begin != BLK_NOT_FOUND) {
+            freeExtents[run_begin] = sb_bmp_size - run_begin;
+        }
+        return;
+    }
+
+    // drop the extents (or their front parts) allocated since the last call
+    auto it = freeExtents.lower_bound(freeExtentsCursor);
+    while (it != freeExtents.end()) {
+        if (cur == BLK_NOT_FOUND || it->first + it->second <= cur) {
+            it = freeExtents.erase(it);
+            continue;
+        }
+        if (it->first < cur) {
+            uint64_t len = it->first + it->second - cur;
+            freeExtents.erase(it);
+            freeExtents[cur] = len;
+        }
+        break;
+    }
+    freeExtentsCursor = cur;
+}
+
+void Superblock::releaseSkippedExtents()
+{
+    size_t blocksize = file->getBlockSize();
+    auto it = freeExtents.begin();
+    while (it != freeExtents.end() && it->first < freeExtentsCursor) {
+        file->addStaleBlock(it->first * blocksize, it->second * blocksize);
+        it = freeExtents.erase(it);
+    }
+}
+
+bid_t Superblock::allocExtent(uint64_t nblocks, uint64_t *count_out)
+{
+    bid_t bid, begin = BLK_NOT_FOUND, target = BLK_NOT_FOUND;
+    uint64_t count = 0;
+    uint64_t cur_bmp_revnum = bmpRevnum;
+    size_t blocksize = file->getBlockSize();
+
+    *count_out = 0;
+    if (nblocks == 0) {
+        return BLK_NOT_FOUND;
+    }
+    if (!bmpExists() || !bmp) {
+        // no bitmap .. all blocks are appended at the end of the file
+        numAlloc += nblocks;
+        return BLK_NOT_FOUND;
+    }
+
+    if (nblocks > 1) {
+        updateFreeExtents();
+
+        // use an extent skipped before if it can hold all the blocks
+        auto it = freeExtents.begin();
+        for (; it != freeExtents.end() && it->first < freeExtentsCursor;
+             ++it) {
+            if (it->second >= nblocks) {
+                begin = it->first;
+                if (it->second > nblocks) {
+                    freeExtents[begin + nblocks] = it->second - nblocks;
+                }
+                freeExtents.erase(begin);
+                numAlloc += nblocks;
+                *count_out = nblocks;
+                return begin;
+            }
+        }
+
+        // find the first extent that can hold all the blocks
+        uint64_t skippable = nblocks * SB_EXTENT_SKIP_RATIO;
+        for (; it != freeExtents.end(); ++it) {
+            if (it->second >= nblocks) {
+                target = it->first;
+                break;
+            }
+            if (it->second > skippable) {
+                break;
+            }
+            skippable -= it->second;
+        }
+    }
+
+    if (target != BLK_NOT_FOUND) {
+        // skip the free blocks in front of the target extent
+        while (curAllocBid.load() < target && bmpRevnum == cur_bmp_revnum) {
+            if (allocBlock() == BLK_NOT_FOUND) {
+                break;
+            }
+        }
+        if (bmpRevnum == cur_bmp_revnum) {
+            // the skipped extents stay in the free extent tree, behind the
+            // allocation cursor
+            freeExtentsCursor = curAllocBid.load();
+        } else {
+            // the cursor moved to another bitmap .. give the skipped blocks
+            // back to the stale block list
+            auto it = freeExtents.lower_bound(freeExtentsCursor);
+            while (it != freeExtents.end() && it->first < target) {
+                file->addStaleBlock(it->first * blocksize,
+                                    it->second * blocksize);
+                it = freeExtents.erase(it);
+            }
+        }
+    }
+
+    // allocate consecutive blocks from the current bitmap
+    while (count < nblocks) {
+        bid = curAllocBid.load();
+        if (bid == BLK_NOT_FOUND || bmpRevnum != cur_bmp_revnum ||
+            (count && bid != begin + count)) {
+            break;
+        }
+        bid = allocBlock();
+        if (bid == BLK_NOT_FOUND) {
+            break;
+        }
+        if (count == 0) {
+            begin = bid;
+        }
+        count++;
+    }
+
+    if (count == 0) {
+        // switch to the reserved bitmap if necessary
+        begin = allocBlock();
+        if (begin != BLK_NOT_FOUND) {
+            count = 1;
+        } else {
+            // the rest of the blocks are appended at the end of the file
+            numAlloc += nblocks - 1;
+        }
+    }
+
+    *count_out = count;
+    return begin;
+}
+
 bool Superblock::isWritable(bid_t bid)
 {
     if (bid < config.num_sb) {
@@ -708,6 +884,12 @@ bool Superblock::isWritable(bid_t bid)
     beginBmpBarrier();
 
     uint8_t *sb_bmp = bmp;
+    if (!sb_bmp) {
+        // the bitmap is not loaded by a lazy read-only open. It is loaded
+        // before any block is written, so no reusable block is writable yet.
+        endBmpBarrier();
+        return false;
+    }
     if (bmpRevnum == lw_bmp_revnum) {
         // Same bitmap revision number: there are 2 possible cases
         //
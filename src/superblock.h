@@ -27,6 +27,8 @@
 #include "atomic.h"
 #include "docio.h"
 
+#include <map>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -308,6 +310,13 @@ public:
         return BLK_NOT_FOUND;
     }
 
+    virtual bid_t allocExtent(uint64_t nblocks, uint64_t *count_out) {
+        *count_out = 0;
+        return BLK_NOT_FOUND;
+    }
+
+    virtual void releaseSkippedExtents() { }
+
     virtual bool isWritable(bid_t bid) {
         return false;
     }
@@ -506,6 +515,35 @@ public:
      */
     bid_t allocBlock();
 
+    /**
+     * Allocate consecutive free blocks by referring the bitmap in superblock.
+     * An extent skipped by an earlier call that can hold all the blocks is
+     * used first. Otherwise, if a free extent that can hold all the blocks is
+     * found after skipping at most SB_EXTENT_SKIP_RATIO free blocks per
+     * requested block, the allocation cursor moves to it, and the smaller
+     * extents in front of it are kept in the free extent tree for the later
+     * calls until the next commit. Otherwise, the blocks are allocated from
+     * the extent at the allocation cursor.
+     *
+     * @param nblocks Number of blocks requested.
+     * @param count_out Pointer to the number of blocks actually allocated,
+     *        which is at least 1 if any block is allocated, and at most
+     *        nblocks.
+     * @return ID of the first allocated block. BLK_NOT_FOUND if there is no
+     *         free block in the bitmap.
+     */
+    bid_t allocExtent(uint64_t nblocks, uint64_t *count_out);
+
+    /**
+     * Give the extents skipped by allocExtent() and not used yet back to the
+     * stale block list, so that they are reclaimed again by a later round of
+     * block reuse. This should be called on every commit, as the skipped
+     * blocks are no longer writable once a header is written after them.
+     *
+     * @return void.
+     */
+    void releaseSkippedExtents();
+
     /**
      * Investigate if the given block is writable.
      *
@@ -607,6 +645,31 @@ private:
     void _init(FileMgr *_file, struct sb_config sconfig);
     void _free();
 
+    /**
+     * Build the free extent tree from the current bitmap if the bitmap has
+     * changed, or drop the extents that the allocation cursor has allocated
+     * since the last call.
+     *
+     * @return void.
+     */
+    void updateFreeExtents();
+
+    /**
+     * Runs of free blocks in the current bitmap, indexed by their first BID.
+     * The runs in front of freeExtentsCursor were skipped by allocExtent()
+     * (i.e., passed by the allocation cursor without being used), and the
+     * others are located at or after the allocation cursor.
+     */
+    std::map<bid_t, uint64_t> freeExtents;
+    /**
+     * Revision number of the bitmap that the free extent tree is built from.
+     */
+    uint64_t freeExtentsRevnum;
+    /**
+     * Allocation cursor when the free extent tree was last updated.
+     */
+    bid_t freeExtentsCursor;
+
     /**
      * Write a superblock with the given ID.
      *
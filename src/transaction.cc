@@ -32,6 +32,180 @@
 // Global static variables
 static std::atomic<uint64_t> transaction_id(0); // unique & monotonically increasing
 
+// Compare the keys in the same order as the WAL does, i.e., by the KV store
+// ID first and then by the custom compare function of the KV store if any.
+static int _txn_keycmp(void *key1, size_t keylen1, void *key2, size_t keylen2,
+                       fdb_custom_cmp_variable custom_cmp, size_t kvid_len)
+{
+    if (custom_cmp) {
+        if (kvid_len) {
+            fdb_kvs_id_t id1, id2;
+            buf2kvid(kvid_len, key1, &id1);
+            buf2kvid(kvid_len, key2, &id2);
+            if (id1 != id2) {
+                return (id1 < id2) ? -1 : 1;
+            }
+        }
+        return custom_cmp((uint8_t*)key1 + kvid_len, keylen1 - kvid_len,
+                          (uint8_t*)key2 + kvid_len, keylen2 - kvid_len);
+    }
+
+    size_t len = (keylen1 < keylen2) ? keylen1 : keylen2;
+    int cmp = memcmp(key1, key2, len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (int)((int)keylen1 - (int)keylen2);
+}
+
+static int _txn_key_version_cmp(struct avl_node *a, struct avl_node *b,
+                                void *aux)
+{
+    fdb_txn *txn = (fdb_txn *)aux;
+    struct txn_key_version *aa, *bb;
+    aa = _get_entry(a, struct txn_key_version, avl);
+    bb = _get_entry(b, struct txn_key_version, avl);
+    return _txn_keycmp(aa->key, aa->keylen, bb->key, bb->keylen,
+                       aa->custom_cmp, txn->kvid_len);
+}
+
+static int _txn_buffered_doc_cmp(struct avl_node *a, struct avl_node *b,
+                                 void *aux)
+{
+    fdb_txn *txn = (fdb_txn *)aux;
+    struct txn_buffered_doc *aa, *bb;
+    aa = _get_entry(a, struct txn_buffered_doc, avl);
+    bb = _get_entry(b, struct txn_buffered_doc, avl);
+    return _txn_keycmp(aa->key, aa->keylen, bb->key, bb->keylen,
+                       aa->custom_cmp, txn->kvid_len);
+}
+
+struct txn_key_version *fdb_txn_find_key(fdb_txn *txn,
+                                         void *key, size_t keylen,
+                                         fdb_custom_cmp_variable custom_cmp)
+{
+    struct txn_key_version query;
+    struct avl_node *a;
+
+    query.key = key;
+    query.keylen = keylen;
+    query.custom_cmp = custom_cmp;
+    a = avl_search(txn->key_versions, &query.avl, _txn_key_version_cmp);
+    if (!a) {
+        return NULL;
+    }
+    return _get_entry(a, struct txn_key_version, avl);
+}
+
+void fdb_txn_add_key(fdb_txn *txn, void *key, size_t keylen,
+                     fdb_seqnum_t seqnum, fdb_custom_cmp_variable custom_cmp)
+{
+    struct txn_key_version *kv;
+
+    kv = (struct txn_key_version *)malloc(sizeof(struct txn_key_version));
+    kv->key = malloc(keylen);
+    memcpy(kv->key, key, keylen);
+    kv->keylen = keylen;
+    kv->seqnum = seqnum;
+    kv->custom_cmp = custom_cmp;
+    avl_insert(txn->key_versions, &kv->avl, _txn_key_version_cmp);
+}
+
+struct txn_buffered_doc *fdb_txn_buffer_find(fdb_txn *txn,
+                                             void *key, size_t keylen,
+                                             fdb_custom_cmp_variable custom_cmp)
+{
+    struct txn_buffered_doc query;
+    struct avl_node *a;
+
+    query.key = key;
+    query.keylen = keylen;
+    query.custom_cmp = custom_cmp;
+    a = avl_search(&txn->write_buffer->key_index, &query.avl,
+                   _txn_buffered_doc_cmp);
+    if (!a) {
+        return NULL;
+    }
+    return _get_entry(a, struct txn_buffered_doc, avl);
+}
+
+void fdb_txn_buffer_remove(fdb_txn *txn, struct txn_buffered_doc *bdoc)
+{
+    struct txn_write_buffer *buf = txn->write_buffer;
+
+    avl_remove(&buf->key_index, &bdoc->avl);
+    list_remove(&buf->docs, &bdoc->le);
+    buf->size -= bdoc->keylen + bdoc->metalen + bdoc->bodylen;
+    free(bdoc->key);
+    free(bdoc->meta);
+    free(bdoc->body);
+    free(bdoc);
+}
+
+void fdb_txn_buffer_add(fdb_txn *txn, struct docio_object *doc, bool deleted,
+                        fdb_custom_cmp_variable custom_cmp)
+{
+    struct txn_write_buffer *buf = txn->write_buffer;
+    struct txn_buffered_doc *bdoc;
+
+    // only the latest update of each key is kept
+    bdoc = fdb_txn_buffer_find(txn, doc->key, doc->length.keylen,
+                               custom_cmp);
+    if (bdoc) {
+        fdb_txn_buffer_remove(txn, bdoc);
+    }
+
+    bdoc = (struct txn_buffered_doc *)calloc(1, sizeof(struct txn_buffered_doc));
+    bdoc->keylen = doc->length.keylen;
+    bdoc->metalen = doc->length.metalen;
+    bdoc->bodylen = doc->length.bodylen;
+    bdoc->key = malloc(bdoc->keylen);
+    memcpy(bdoc->key, doc->key, bdoc->keylen);
+    if (bdoc->metalen) {
+        bdoc->meta = malloc(bdoc->metalen);
+        memcpy(bdoc->meta, doc->meta, bdoc->metalen);
+    }
+    if (bdoc->bodylen) {
+        bdoc->body = malloc(bdoc->bodylen);
+        memcpy(bdoc->body, doc->body, bdoc->bodylen);
+    }
+    bdoc->seqnum = doc->seqnum;
+    bdoc->timestamp = doc->timestamp;
+    bdoc->deleted = deleted;
+    bdoc->custom_cmp = custom_cmp;
+
+    avl_insert(&buf->key_index, &bdoc->avl, _txn_buffered_doc_cmp);
+    list_push_back(&buf->docs, &bdoc->le);
+    buf->size += bdoc->keylen + bdoc->metalen + bdoc->bodylen;
+}
+
+static void _fdb_txn_free(fdb_txn *txn)
+{
+    if (txn->write_buffer) {
+        struct list_elem *e;
+        while ((e = list_begin(&txn->write_buffer->docs))) {
+            fdb_txn_buffer_remove(txn, _get_entry(e, struct txn_buffered_doc,
+                                                  le));
+        }
+        free(txn->write_buffer);
+    }
+    if (txn->key_versions) {
+        struct avl_node *a = avl_first(txn->key_versions);
+        while (a) {
+            struct txn_key_version *kv;
+            kv = _get_entry(a, struct txn_key_version, avl);
+            a = avl_next(a);
+            avl_remove(txn->key_versions, &kv->avl);
+            free(kv->key);
+            free(kv);
+        }
+        free(txn->key_versions);
+    }
+    free(txn->items);
+    free(txn->wrapper);
+    free(txn);
+}
+
 LIBFDB_API
 fdb_status fdb_begin_transaction(fdb_file_handle *fhandle,
                                  fdb_isolation_level_t isolation_level)
@@ -100,7 +274,25 @@ fdb_status fdb_begin_transaction(fdb_file_handle *fhandle,
     handle->txn->prev_revnum = handle->cur_header_revnum;
     handle->txn->items = (struct list *)malloc(sizeof(struct list));
     handle->txn->isolation = isolation_level;
+    // keys of the multi KV instance mode are prefixed with the KV store ID
+    handle->txn->kvid_len = handle->kvs ? handle->config.chunksize : 0;
     list_init(handle->txn->items);
+    if (isolation_level == FDB_ISOLATION_OPTIMISTIC) {
+        handle->txn->key_versions = (struct avl_tree *)
+                                    malloc(sizeof(struct avl_tree));
+        avl_init(handle->txn->key_versions, handle->txn);
+    } else {
+        handle->txn->key_versions = NULL;
+    }
+    if (handle->config.txn_buffer_size) {
+        handle->txn->write_buffer = (struct txn_write_buffer *)
+                                    malloc(sizeof(struct txn_write_buffer));
+        avl_init(&handle->txn->write_buffer->key_index, handle->txn);
+        list_init(&handle->txn->write_buffer->docs);
+        handle->txn->write_buffer->size = 0;
+    } else {
+        handle->txn->write_buffer = NULL;
+    }
     file->getWal()->addTransaction_Wal(handle->txn);
 
     file->mutexUnlock();
@@ -163,9 +355,7 @@ fdb_status _fdb_abort_transaction(FdbKvsHandle *handle)
     file->getWal()->discardTxnEntries_Wal(handle->txn);
     file->getWal()->removeTransaction_Wal(handle->txn);
 
-    free(handle->txn->items);
-    free(handle->txn->wrapper);
-    free(handle->txn);
+    _fdb_txn_free(handle->txn);
     handle->txn = NULL;
 
     file->mutexUnlock();
@@ -199,7 +389,12 @@ fdb_status fdb_end_transaction(fdb_file_handle *fhandle,
     }
 
     fdb_status fs = FDB_RESULT_SUCCESS;
-    if (list_begin(handle->txn->items)) {
+    bool read_only = (list_begin(handle->txn->items) == NULL) &&
+                     (!handle->txn->write_buffer ||
+                      list_begin(&handle->txn->write_buffer->docs) == NULL);
+    if (!read_only) {
+        // optimistic transactions are validated, and the buffered updates
+        // are appended, as a part of the commit
         fs = _fdb_commit(handle, opt,
                          !(handle->config.durability_opt & FDB_DRB_ASYNC));
     }
@@ -221,14 +416,21 @@ fdb_status fdb_end_transaction(fdb_file_handle *fhandle,
             }
         } while (fstatus == FILE_REMOVED_PENDING);
 
+        if (read_only && handle->txn->key_versions) {
+            // nothing to commit, but the keys read by the transaction
+            // should still be unchanged
+            fs = _fdb_validate_transaction(handle, handle->txn);
+        }
+
         file->getWal()->removeTransaction_Wal(handle->txn);
 
-        free(handle->txn->items);
-        free(handle->txn->wrapper);
-        free(handle->txn);
+        _fdb_txn_free(handle->txn);
         handle->txn = NULL;
 
         file->mutexUnlock();
+    } else if (fs == FDB_RESULT_TRANSACTION_CONFLICT) {
+        // discard the transaction so that the caller can retry it
+        _fdb_abort_transaction(handle);
     }
 
     return fs;
@@ -24,6 +24,9 @@
 
 #include "filemgr.h"
 
+// Version of newly created files. Files are upgraded to FILEMGR_MAGIC_003
+// only when the key prefix compression is enabled, and to FILEMGR_MAGIC_004
+// only when their chunk size differs from the configured one.
 INLINE filemgr_magic_t ver_get_latest_magic() {
     return FILEMGR_MAGIC_002;
 }
@@ -33,6 +36,8 @@ bool ver_is_atleast_magic_001(filemgr_magic_t magic);
 bool ver_staletree_support(filemgr_magic_t magic);
 bool ver_superblock_support(filemgr_magic_t magic);
 bool ver_non_consecutive_doc(filemgr_magic_t magic);
+bool ver_prefix_compression_support(filemgr_magic_t magic);
+bool ver_recorded_chunksize_support(filemgr_magic_t magic);
 size_t ver_get_new_filename_off(filemgr_magic_t magic);
 
 /**
@@ -27,6 +27,7 @@
 #include "hash_functions.h"
 #include "fdb_internal.h"
 #include "iterator.h"
+#include "arena.h"
 
 #include "memleak.h"
 #include "time_utils.h"
@@ -329,8 +330,14 @@ struct snap_handle * Wal::_wal_fetch_snapshot(fdb_kvs_id_t kv_id,
                     kv_id, snap_flush_id, snap_id);
             }
         }
+        struct snap_handle *prev_snapshot = open_snapshot;
         open_snapshot = _wal_snapshot_create(kv_id, snap_id, snap_flush_id,
                                              key_cmp_info, kvs_snapshots);
+        if (prev_snapshot && !prev_snapshot->is_flushed) {
+            // write barrier only .. the new snapshot shares items with
+            // the previous one and all its previous snapshots
+            open_snapshot->num_prev_snaps = prev_snapshot->num_prev_snaps + 1;
+        }
         list_push_back(&kvs_snapshots->snap_list, &open_snapshot->snaplist_elem);
         kvs_snapshots->num_snaps++;
     }
@@ -420,19 +427,9 @@ fdb_status Wal::snapshotOpen_Wal(fdb_txn *txn,
         DBG("%s Persisted snapshot taken at %" _F64 " for kv id %" _F64 "\n",
             file->getFileName(), _shandle->seqnum, kv_id);
     } else { // Take a snapshot of the latest WAL state for this KV Store
-        // Bump up ref count on all past snapshots to prevent deletion!
-        int num_prev_snaps = 0;
-        struct list_elem *e = list_prev(&_shandle->snaplist_elem);
-        while (e) {
-            struct snap_handle *__shandle = _get_entry(e,
-                    struct snap_handle, snaplist_elem);
-            if (__shandle->snap_tag_idx <= _shandle->snap_stop_idx) {
-                    break;
-            }
-            __shandle->ref_cnt_kvs++;
-            num_prev_snaps++;
-            e = list_prev(e);
-        }
+        // Past snapshots sharing items with this snapshot are protected
+        // from deletion by registering it into 'open_snaps', so that
+        // they don't need to be visited here.
         if (_wal_snap_is_immutable(_shandle)) { // existing snapshot still open
             _shandle->ref_cnt_kvs++; // ..just Clone it
             DBG("%s Snapshot Clone %" _F64 " - %" _F64 " taken at %"
@@ -440,11 +437,10 @@ fdb_status Wal::snapshotOpen_Wal(fdb_txn *txn,
                 file->getFileName(), _shandle->snap_stop_idx,
                 _shandle->snap_tag_idx, _shandle->seqnum, kv_id,
                 _shandle->num_prev_snaps);
-            fdb_assert(_shandle->num_prev_snaps == num_prev_snaps,
-                       _shandle->num_prev_snaps, num_prev_snaps);
         } else { // make this snapshot of the WAL immutable..
-            _shandle->num_prev_snaps = num_prev_snaps;
             _wal_snapshot_init(_shandle, txn, seqnum);
+            open_snaps[std::make_pair(kv_id, _shandle->snap_tag_idx)] =
+                _shandle->snap_stop_idx;
             DBG("%s New Snapshot %" _F64 " - %" _F64 " taken at %"
                 _F64 " for kv id %" _F64 " prev_snaps=%d\n",
                 file->getFileName(), _shandle->snap_stop_idx,
@@ -627,7 +623,8 @@ inline fdb_status Wal::_insert_Wal(fdb_txn *txn,
         if (le == NULL) {
             // not exist
             // create new item
-            item = (struct wal_item *)calloc(1, sizeof(struct wal_item));
+            item = (struct wal_item *)
+                SlabAllocator::allocateZeroed(sizeof(struct wal_item));
 
             if (file->getKVHeader_UNLOCKED()) { // multi KV instance mode
                 item->flag |= WAL_ITEM_MULTI_KV_INS_MODE;
@@ -717,17 +714,18 @@ inline fdb_status Wal::_insert_Wal(fdb_txn *txn,
     } else {
         // not exist .. create new one
         // create new header and new item
-        header = (struct wal_item_header*)malloc(sizeof(struct wal_item_header));
+        header = (struct wal_item_header*)
+            SlabAllocator::allocate(sizeof(struct wal_item_header));
         list_init(&header->items);
         header->chunksize = file->getConfig()->getChunkSize();
         header->keylen = keylen;
-        header->key = (void *)malloc(header->keylen);
+        header->key = SlabAllocator::allocate(header->keylen);
         memcpy(header->key, key, header->keylen);
 
         avl_insert(&key_shards[shard_num]._map,
                    &header->avl_key, _wal_cmp_bykey);
 
-        item = (struct wal_item *)malloc(sizeof(struct wal_item));
+        item = (struct wal_item *)SlabAllocator::allocate(sizeof(struct wal_item));
         // entries inserted by compactor is already committed
         if (caller == WAL_INS_COMPACT_PHASE1) {
             item->flag = WAL_ITEM_COMMITTED;
@@ -1113,6 +1111,21 @@ fdb_status Wal::findWithKvid_Wal(fdb_txn *txn,
 
 // Pre-condition: writer lock (filemgr mutex) must be held for this call
 // Readers can interleave without lock
+bool Wal::_wal_snap_is_referenced(struct snap_handle *shandle)
+{
+    if (_wal_snap_is_immutable(shandle)) {
+        return true;
+    }
+    // The earliest open snapshot whose ID is not smaller than the given one
+    // shares the items of the given snapshot if both belong to the same WAL
+    // flush epoch (i.e., the given one was created after its stop ID).
+    auto entry = open_snaps.lower_bound(std::make_pair(shandle->id,
+                                                       shandle->snap_tag_idx));
+    return entry != open_snaps.end() &&
+           entry->first.first == shandle->id &&
+           entry->second < shandle->snap_tag_idx;
+}
+
 inline void Wal::_wal_free_item(struct wal_item *item, bool gotlock) {
     struct snap_handle *shandle = item->shandle;
     fdb_assert(!(item->flag & WAL_ITEM_IN_SNAP_TREE) ||
@@ -1121,8 +1134,19 @@ inline void Wal::_wal_free_item(struct wal_item *item, bool gotlock) {
         if (!gotlock) {
             spin_lock(&lock);
         }
-        fdb_assert(!_wal_snap_is_immutable(shandle), shandle->snap_tag_idx,
+        fdb_assert(!_wal_snap_is_referenced(shandle), shandle->snap_tag_idx,
                    shandle->snap_stop_idx);
+        // later snapshots of the same epoch do not share items with this
+        // snapshot anymore
+        for (struct list_elem *e = list_next(&shandle->snaplist_elem);
+             e; e = list_next(e)) {
+            struct snap_handle *_shandle = _get_entry(e, struct snap_handle,
+                                                      snaplist_elem);
+            if (_shandle->snap_stop_idx != shandle->snap_stop_idx) {
+                break;
+            }
+            _shandle->num_prev_snaps--;
+        }
         DBG("%s Last item removed from snapshot %" _F64 "-%" _F64 " %" _F64
                 " kv id %" _F64 ". Destroy snapshot handle..\n",
                 shandle->snap_txn && shandle->snap_txn->handle ?
@@ -1146,7 +1170,7 @@ inline void Wal::_wal_free_item(struct wal_item *item, bool gotlock) {
 #ifdef __DEBUG_WAL
     memset(item, 0, sizeof(struct wal_item));
 #endif // __DEBUG_WAL
-    free(item);
+    SlabAllocator::deallocate(item, sizeof(struct wal_item));
 }
 
 fdb_status Wal::migrateUncommittedTxns_Wal(void *dbhandle,
@@ -1222,7 +1246,7 @@ fdb_status Wal::migrateUncommittedTxns_Wal(void *dbhandle,
                                                           std::memory_order_relaxed);
                     }
                     // free item
-                    free(item);
+                    SlabAllocator::deallocate(item, sizeof(struct wal_item));
                     // free doc
                     free(doc.key);
                     free(doc.meta);
@@ -1242,8 +1266,9 @@ fdb_status Wal::migrateUncommittedTxns_Wal(void *dbhandle,
                            &header->avl_key);
                 mem_overhead += header->keylen + sizeof(struct wal_item_header);
                 // free key & header
-                free(header->key);
-                free(header);
+                SlabAllocator::deallocate(header->key, header->keylen);
+                SlabAllocator::deallocate(header,
+                                          sizeof(struct wal_item_header));
             } else {
                 node = avl_next(node);
             }
@@ -1348,7 +1373,7 @@ fdb_status Wal::commit_Wal(fdb_txn *txn, wal_commit_mark_func *func,
                 e2 = list_prev(e2);
                 spin_lock(&lock); // guard global snaplist from snapshot_open
                 can_overwrite = (item->shandle == _item->shandle ||
-                                 !_wal_snap_is_immutable(_item->shandle));
+                                 !_wal_snap_is_referenced(_item->shandle));
                 if (!can_overwrite) {
                     item = _item; // new covering item found
                     spin_unlock(&lock);
@@ -1500,7 +1525,10 @@ list_elem *Wal::_releaseItems_Wal(size_t shard_num, struct wal_item *item)
         kv_id = 0;
     }
     le = list_prev(le);
-    if (!_wal_snap_is_immutable(item->shandle)) {
+    spin_lock(&lock);
+    bool referenced = _wal_snap_is_referenced(item->shandle);
+    spin_unlock(&lock);
+    if (!referenced) {
         releaseItem_Wal(shard_num, kv_id, item);
         _mem_overhead += sizeof(struct wal_item);
         item = NULL;
@@ -1516,7 +1544,10 @@ list_elem *Wal::_releaseItems_Wal(size_t shard_num, struct wal_item *item)
             break;
         }
         le = list_prev(le);
-        if (!_wal_snap_is_immutable(sitem->shandle)) {
+        spin_lock(&lock);
+        referenced = _wal_snap_is_referenced(sitem->shandle);
+        spin_unlock(&lock);
+        if (!referenced) {
             releaseItem_Wal(shard_num, kv_id, sitem);
             _mem_overhead += sizeof(struct wal_item);
         } else {
@@ -1531,8 +1562,8 @@ list_elem *Wal::_releaseItems_Wal(size_t shard_num, struct wal_item *item)
         avl_remove(&key_shards[shard_num]._map,
                 &header->avl_key);
         _mem_overhead = sizeof(wal_item_header) + header->keylen;
-        free(header->key);
-        free(header);
+        SlabAllocator::deallocate(header->key, header->keylen);
+        SlabAllocator::deallocate(header, sizeof(struct wal_item_header));
         le = NULL;
     }
     mem_overhead.fetch_sub(_mem_overhead + sizeof(struct wal_item),
@@ -1824,6 +1855,9 @@ fdb_status Wal::_flush_Wal(void *dbhandle,
     seq_purge_func(dbhandle, &stale_seqnum_list, &kvs_delta_stats);
     // Update each KV store stats after WAL flush
     delta_stats_func(file, &kvs_delta_stats);
+    // All the entries of both lists have been consumed, so the scratch memory
+    // allocated by the callbacks can be released at once.
+    MemoryArena::getThreadArena()->reset();
 
     file->clearIoInprog();
     LATENCY_STAT_END(file, FDB_LATENCY_WAL_FLUSH);
@@ -1860,17 +1894,9 @@ fdb_status Wal::snapshotClone_Wal(struct snap_handle *shandle_in,
 {
     if (seqnum == FDB_SNAPSHOT_INMEM ||
         shandle_in->seqnum == seqnum) {
-        // Bump up ref count on all shared snapshots to prevent deletion!
-        struct snap_handle *shandle = shandle_in;
-        for (int i = 0;; ++i) {
-            shandle->ref_cnt_kvs++;
-            if (i < shandle_in->num_prev_snaps) {
-                struct list_elem *snap_elem = list_prev(&shandle->snaplist_elem);
-                shandle = _get_entry(snap_elem, struct snap_handle, snaplist_elem);
-            } else {
-                break;
-            }
-        }
+        // The source snapshot is open, so that the shared snapshots are
+        // already protected .. just bump up its ref count.
+        shandle_in->ref_cnt_kvs++;
         *shandle_out = shandle_in;
         return FDB_RESULT_SUCCESS;
     }
@@ -2126,24 +2152,21 @@ fdb_status Wal::snapshotClose_Wal(struct snap_handle *shandle)
     fdb_status fs = FDB_RESULT_SUCCESS;
     if (!shandle->is_persisted_snapshot &&
         shandle->snap_tag_idx) { // the KVS did have items in WAL..
-        struct snap_handle *_shandle = shandle;
         DBG("%s Close InMem Snapshot %" _F64 " - %" _F64 " taken at %"
                 _F64 " for kv id %" _F64 " prev_snaps=%d\n",
-                file->getFileName(), _shandle->snap_stop_idx,
-                _shandle->snap_tag_idx, _shandle->seqnum,
-                _shandle->kvs_snapshots->id,
-                _shandle->num_prev_snaps);
-        // Decrement ref counts on all the previous shared snapshots..
-        int num_prev_snaps = shandle->num_prev_snaps;
-        for (int idx = 0; idx < num_prev_snaps; ++idx) {
-            struct list_elem *snap_elem = list_prev(&_shandle->snaplist_elem);
-            _shandle = _get_entry(snap_elem, struct snap_handle, snaplist_elem);
-            fdb_assert(_shandle->ref_cnt_kvs, _shandle->ref_cnt_kvs, 1);
-            _shandle->ref_cnt_kvs--;
-        }
+                file->getFileName(), shandle->snap_stop_idx,
+                shandle->snap_tag_idx, shandle->seqnum,
+                shandle->kvs_snapshots->id,
+                shandle->num_prev_snaps);
         // Decrement ref count on current handle so it may be removed
+        // (along with the previous shared snapshots)
+        spin_lock(&lock);
         fdb_assert(shandle->ref_cnt_kvs, shandle->ref_cnt_kvs, 1);
-        shandle->ref_cnt_kvs--;
+        if (!(--shandle->ref_cnt_kvs)) {
+            open_snaps.erase(std::make_pair(shandle->id,
+                                            shandle->snap_tag_idx));
+        }
+        spin_unlock(&lock);
         return fs;
     } // ELSE persisted or un-shared snapshot ...
     if (!(--shandle->ref_cnt_kvs)) {
@@ -2869,8 +2892,9 @@ fdb_status Wal::discardTxnEntries_Wal(fdb_txn *txn)
             _mem_overhead += sizeof(struct wal_item_header) +
                              item->header->keylen;
             // free key and header
-            free(item->header->key);
-            free(item->header);
+            SlabAllocator::deallocate(item->header->key, item->header->keylen);
+            SlabAllocator::deallocate(item->header,
+                                      sizeof(struct wal_item_header));
         }
         // remove from txn's list
         e = list_remove(txn->items, e);
@@ -2885,7 +2909,7 @@ fdb_status Wal::discardTxnEntries_Wal(fdb_txn *txn)
         }
 
         // free
-        free(item);
+        SlabAllocator::deallocate(item, sizeof(struct wal_item));
         size--;
         _mem_overhead += sizeof(struct wal_item);
         spin_unlock(&key_shards[shard_num].lock);
@@ -2949,6 +2973,11 @@ fdb_status Wal::_close_Wal(wal_discard_t type, void *aux,
             avl_remove(&file->getWal()->wal_kvs_snap_tree,
                        &kvs_snapshots->avl_id);
             free(kvs_snapshots);
+            spin_lock(&lock);
+            open_snaps.erase(
+                open_snaps.lower_bound(std::make_pair(kv_id_req, 0)),
+                open_snaps.lower_bound(std::make_pair(kv_id_req + 1, 0)));
+            spin_unlock(&lock);
         } // done for specific kv store
     } else {
         // cleanup all snapshot handles not reclaimed by wal_flush
@@ -2980,6 +3009,9 @@ fdb_status Wal::_close_Wal(wal_discard_t type, void *aux,
             avl_remove(&wal_kvs_snap_tree, a);
             free(kvs_snapshots);
         } // done for all kv stores
+        spin_lock(&lock);
+        open_snaps.clear();
+        spin_unlock(&lock);
     }
 
     for (; i < num_shards; ++i) {
@@ -3038,7 +3070,7 @@ fdb_status Wal::_close_Wal(wal_discard_t type, void *aux,
                         }
                         num_flushable--;
                     }
-                    free(item);
+                    SlabAllocator::deallocate(item, sizeof(struct wal_item));
                     size--;
                     _mem_overhead += sizeof(struct wal_item);
                 } else {
@@ -3054,8 +3086,9 @@ fdb_status Wal::_close_Wal(wal_discard_t type, void *aux,
                            &header->avl_key);
                 _mem_overhead += sizeof(struct wal_item_header) +
                                  header->keylen;
-                free(header->key);
-                free(header);
+                SlabAllocator::deallocate(header->key, header->keylen);
+                SlabAllocator::deallocate(header,
+                                          sizeof(struct wal_item_header));
             }
         }
         spin_unlock(&key_shards[i].lock);
@@ -25,6 +25,9 @@
 #include "atomic.h"
 #include "libforestdb/fdb_errors.h"
 
+#include <map>
+#include <utility>
+
 typedef uint8_t wal_item_action;
 enum{
     WAL_ACT_INSERT,
@@ -84,7 +87,10 @@ struct snap_handle {
      */
     bool is_persisted_snapshot;
     /**
-     * Number of previous snapshots which share items with current snapshot.
+     * Number of previous snapshots which share items with current snapshot,
+     * i.e., the snapshots created since the last WAL flush that are still
+     * alive. It is maintained when snapshots are created and destroyed, so
+     * that opening a snapshot does not need to visit the previous ones.
      */
     int num_prev_snaps;
     /**
@@ -500,6 +506,14 @@ private:
         return shandle->ref_cnt_kvs.load();
     }
 
+    /**
+     * Check if the items of the given snapshot handle may be read by any
+     * open snapshot, either the snapshot itself or a later snapshot created
+     * before the next WAL flush, which shares the items with it.
+     * Caller should grab the WAL lock.
+     */
+    bool _wal_snap_is_referenced(struct snap_handle *shandle);
+
     struct snap_handle * _wal_fetch_snapshot(fdb_kvs_id_t kv_id,
                                              _fdb_key_cmp_info *key_cmp_info);
 
@@ -556,6 +570,9 @@ private:
     size_t num_shards;
     // Global shared WAL Snapshot Data
     struct avl_tree wal_kvs_snap_tree;
+    // Open shared snapshots indexed by {KV store ID, snapshot ID}, storing
+    // the snapshot stop ID (i.e., the last snapshot ID flushed before them)
+    std::map<std::pair<fdb_kvs_id_t, wal_snapid_t>, wal_snapid_t> open_snaps;
     spin_t lock;
     FileMgr *file;
     DISALLOW_COPY_AND_ASSIGN(Wal);
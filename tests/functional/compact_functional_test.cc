@@ -342,6 +342,176 @@ void compact_wo_reopen_test()
     TEST_RESULT("compaction without reopen test");
 }
 
+void compact_adaptive_chunksize_test()
+{
+    TEST_INIT();
+
+    memleak_start();
+
+    int i, j, r;
+    int n = 256;
+    fdb_file_handle *dbfile, *dbfile_other;
+    fdb_kvs_handle *db, *db_other;
+    fdb_doc *rdoc;
+    fdb_status status;
+    uint16_t chunksize;
+    char keys[256][33];
+    char bodybuf[256];
+    const void *keyptrs[256];
+    size_t keylens[256];
+
+    // remove previous compact_test files
+    r = system(SHELL_DEL" compact_test* > errorlog.txt");
+    (void)r;
+
+    // four 8-byte fields with four distinct values each
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < 4; ++j) {
+            memset(keys[i] + j * 8, 'a' + ((i >> (j * 2)) & 0x3), 8);
+        }
+        keys[i][32] = 0;
+        keyptrs[i] = keys[i];
+        keylens[i] = 32;
+    }
+    status = fdb_estimate_chunksize(keyptrs, keylens, n, n, &chunksize);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(chunksize == 16);
+    status = fdb_estimate_chunksize(keyptrs, keylens, 0, n, &chunksize);
+    TEST_CHK(status == FDB_RESULT_INVALID_ARGS);
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.buffercache_size = 0;
+    fconfig.wal_threshold = 1024;
+    fconfig.flags = FDB_OPEN_FLAG_CREATE;
+    fconfig.compaction_threshold = 0;
+    fconfig.multi_kv_instances = false;
+    fconfig.chunksize = 8;
+    fconfig.adaptive_chunksize = true;
+
+    fdb_open(&dbfile, "./compact_test1", &fconfig);
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    status = fdb_set_log_callback(db, logCallbackFunc,
+                                  (void *) "compact_adaptive_chunksize_test");
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_open(&dbfile_other, "./compact_test1", &fconfig);
+    fdb_kvs_open_default(dbfile_other, &db_other, &kvs_config);
+
+    for (i = 0; i < n; ++i) {
+        sprintf(bodybuf, "body%d", i);
+        status = fdb_set_kv(db, keys[i], 32, bodybuf, strlen(bodybuf) + 1);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_CHK(!strcmp(fdb_get_file_version(dbfile), "ForestDB v2.x format"));
+
+    // the new file is built with the chunk size chosen from the keys, and
+    // its version is bumped so that older versions, which would read it
+    // with the configured chunk size, refuse to open it
+    status = fdb_compact(dbfile, "./compact_test2");
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(!strcmp(fdb_get_file_version(dbfile),
+                     "ForestDB v2.x format with recorded chunk size"));
+
+    // both the compacting handle and the other handle (which reopens the
+    // new file) should use the new chunk size
+    for (i = 0; i < n; ++i) {
+        sprintf(bodybuf, "body%d", i);
+        fdb_doc_create(&rdoc, keys[i], 32, NULL, 0, NULL, 0);
+        status = fdb_get(db, rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        TEST_CMP(rdoc->body, bodybuf, rdoc->bodylen);
+        fdb_doc_free(rdoc);
+
+        fdb_doc_create(&rdoc, keys[i], 32, NULL, 0, NULL, 0);
+        status = fdb_get(db_other, rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        TEST_CMP(rdoc->body, bodybuf, rdoc->bodylen);
+        fdb_doc_free(rdoc);
+    }
+    fdb_kvs_close(db_other);
+    fdb_close(dbfile_other);
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+
+    // reopen with a different chunk size in the config, which is ignored
+    // for the existing file
+    fconfig.chunksize = 32;
+    fconfig.adaptive_chunksize = false;
+    fdb_open(&dbfile, "./compact_test2", &fconfig);
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    for (i = 0; i < n; i += 2) {
+        sprintf(bodybuf, "new_body%d", i);
+        status = fdb_set_kv(db, keys[i], 32, bodybuf, strlen(bodybuf) + 1);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+
+    // compaction without adaptive chunk size keeps the current one, and
+    // the new file keeps the bumped version
+    status = fdb_compact(dbfile, "./compact_test3");
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(!strcmp(fdb_get_file_version(dbfile),
+                     "ForestDB v2.x format with recorded chunk size"));
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+
+    fconfig.chunksize = 8;
+    fdb_open(&dbfile, "./compact_test3", &fconfig);
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_CHK(!strcmp(fdb_get_file_version(dbfile),
+                     "ForestDB v2.x format with recorded chunk size"));
+    for (i = 0; i < n; ++i) {
+        sprintf(bodybuf, (i % 2) ? "body%d" : "new_body%d", i);
+        fdb_doc_create(&rdoc, keys[i], 32, NULL, 0, NULL, 0);
+        status = fdb_get(db, rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        TEST_CMP(rdoc->body, bodybuf, rdoc->bodylen);
+        fdb_doc_free(rdoc);
+    }
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+
+    // a file created with the configured chunk size keeps the old version
+    // until it is opened for writes with another chunk size in the config
+    fconfig.chunksize = 16;
+    fdb_open(&dbfile, "./compact_test4", &fconfig);
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    fdb_set_kv(db, keys[0], 32, (void *)"body", 5);
+    fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    TEST_CHK(!strcmp(fdb_get_file_version(dbfile), "ForestDB v2.x format"));
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+
+    fconfig.chunksize = 8;
+    fdb_open(&dbfile, "./compact_test4", &fconfig);
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    fdb_set_kv(db, keys[1], 32, (void *)"body", 5);
+    fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+
+    fconfig.flags = FDB_OPEN_FLAG_RDONLY;
+    fdb_open(&dbfile, "./compact_test4", &fconfig);
+    TEST_CHK(!strcmp(fdb_get_file_version(dbfile),
+                     "ForestDB v2.x format with recorded chunk size"));
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    for (i = 0; i < 2; ++i) {
+        fdb_doc_create(&rdoc, keys[i], 32, NULL, 0, NULL, 0);
+        status = fdb_get(db, rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        fdb_doc_free(rdoc);
+    }
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+
+    fdb_shutdown();
+
+    memleak_end();
+
+    TEST_RESULT("compaction with adaptive chunk size test");
+}
+
 void compact_with_reopen_test()
 {
     TEST_INIT();
@@ -3686,6 +3856,7 @@ int main(){
     compaction_callback_test(false); // single kv instance mode
     compact_wo_reopen_test();
     compact_with_reopen_test();
+    compact_adaptive_chunksize_test();
 #if !defined(THREAD_SANITIZER)
     compact_reopen_with_iterator();
 #endif
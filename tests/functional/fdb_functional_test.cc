@@ -31,6 +31,7 @@
 #include "libforestdb/forestdb.h"
 #include "test.h"
 #include "internal_types.h"
+#include "forestdb_endian.h"
 #include "functional_util.h"
 
 void basic_test()
@@ -2566,6 +2567,170 @@ void custom_compare_variable_test()
     TEST_RESULT("custom compare function for variable length key test");
 }
 
+static int _cmp_lexicographic(void *key1, size_t keylen1,
+                              void *key2, size_t keylen2)
+{
+    int cmp = memcmp(key1, key2, MIN(keylen1, keylen2));
+    if (cmp == 0) {
+        return (int)keylen1 - (int)keylen2;
+    }
+    return cmp;
+}
+
+static void _verify_prefix_compression_docs(fdb_kvs_handle *db, int n,
+                                            bool *deleted)
+{
+    TEST_INIT();
+    int i, count;
+    char keybuf[256], bodybuf[256], prev_key[256];
+    size_t prev_keylen = 0;
+    fdb_doc *rdoc = NULL;
+    fdb_status status;
+    fdb_iterator *iterator;
+
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "tenant/8d2f3a10-55e4-4b8c-a1f7/doc/%08d", i);
+        fdb_doc_create(&rdoc, keybuf, strlen(keybuf), NULL, 0, NULL, 0);
+        status = fdb_get(db, rdoc);
+        if (deleted[i]) {
+            TEST_CHK(status == FDB_RESULT_KEY_NOT_FOUND);
+        } else {
+            TEST_CHK(status == FDB_RESULT_SUCCESS);
+            sprintf(bodybuf, "body %d", i);
+            TEST_CMP(rdoc->body, bodybuf, rdoc->bodylen);
+        }
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+    }
+
+    status = fdb_iterator_init(db, &iterator, NULL, 0, NULL, 0,
+                               FDB_ITR_NO_DELETES);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    count = 0;
+    do {
+        status = fdb_iterator_get(iterator, &rdoc);
+        if (status != FDB_RESULT_SUCCESS) {
+            break;
+        }
+        if (count) {
+            TEST_CHK(_cmp_lexicographic(prev_key, prev_keylen,
+                                        rdoc->key, rdoc->keylen) < 0);
+        }
+        prev_keylen = rdoc->keylen;
+        memcpy(prev_key, rdoc->key, rdoc->keylen);
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        count++;
+    } while (fdb_iterator_next(iterator) != FDB_RESULT_ITERATOR_FAIL);
+    fdb_iterator_close(iterator);
+
+    for (i = 0; i < n; ++i) {
+        count -= (deleted[i]) ? 0 : 1;
+    }
+    TEST_CHK(count == 0);
+}
+
+void custom_compare_prefix_compression_test()
+{
+    TEST_INIT();
+
+    memleak_start();
+
+    int i, r;
+    int n = 5000;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_doc *doc;
+    fdb_status status;
+    char keybuf[256], bodybuf[256];
+    bool *deleted = alca(bool, n);
+    const char *kvs_names[] = { "default" };
+    fdb_custom_cmp_variable functions[] = { _cmp_lexicographic };
+
+    r = system(SHELL_DEL" func_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.buffercache_size = 0;
+    fconfig.wal_threshold = 1024;
+    fconfig.compaction_threshold = 0;
+    fconfig.key_prefix_compression = true;
+    kvs_config.custom_cmp = _cmp_lexicographic;
+
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    // the file is marked so that older versions don't open it
+    TEST_CHK(!strcmp(fdb_get_file_version(dbfile),
+                     "ForestDB v2.x format with key prefix compression"));
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+
+    // insert keys sharing a long prefix in a random order
+    memset(deleted, 0, sizeof(bool) * n);
+    for (i = 0; i < n; ++i) {
+        int idx = (i * 7919) % n;
+        sprintf(keybuf, "tenant/8d2f3a10-55e4-4b8c-a1f7/doc/%08d", idx);
+        sprintf(bodybuf, "body %d", idx);
+        fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                       bodybuf, strlen(bodybuf) + 1);
+        status = fdb_set(db, doc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        fdb_doc_free(doc);
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    _verify_prefix_compression_docs(db, n, deleted);
+
+    // delete some of them
+    for (i = 0; i < n; i += 3) {
+        sprintf(keybuf, "tenant/8d2f3a10-55e4-4b8c-a1f7/doc/%08d", i);
+        status = fdb_del_kv(db, keybuf, strlen(keybuf));
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        deleted[i] = true;
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    _verify_prefix_compression_docs(db, n, deleted);
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+
+    // reopen without the compression; both formats should be readable
+    fconfig.key_prefix_compression = false;
+    status = fdb_open_custom_cmp(&dbfile, "./func_test1", &fconfig,
+                                 1, (char **)kvs_names, functions);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    // compressed nodes may still exist
+    TEST_CHK(!strcmp(fdb_get_file_version(dbfile),
+                     "ForestDB v2.x format with key prefix compression"));
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    _verify_prefix_compression_docs(db, n, deleted);
+
+    for (i = 0; i < n; i += 3) {
+        sprintf(keybuf, "tenant/8d2f3a10-55e4-4b8c-a1f7/doc/%08d", i);
+        sprintf(bodybuf, "body %d", i);
+        fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                       bodybuf, strlen(bodybuf) + 1);
+        status = fdb_set(db, doc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        fdb_doc_free(doc);
+        deleted[i] = false;
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    _verify_prefix_compression_docs(db, n, deleted);
+
+    status = fdb_compact(dbfile, "./func_test2");
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    _verify_prefix_compression_docs(db, n, deleted);
+    // all the nodes are rewritten without the compression
+    TEST_CHK(!strcmp(fdb_get_file_version(dbfile), "ForestDB v2.x format"));
+
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    memleak_end();
+
+    TEST_RESULT("custom compare function with key prefix compression test");
+}
+
 const int kcmp_offset = 100;
 static int _cmp_dups(void *a, size_t len_a, void *b, size_t len_b)
 {
@@ -3181,6 +3346,146 @@ void read_doc_by_offset_test()
     TEST_RESULT("read_doc_by_offset test");
 }
 
+void pinned_get_test(bool multi_kv)
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r;
+    int n = 100;
+    size_t large_bodylen = 8192;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_doc **doc = alca(fdb_doc*, n);
+    fdb_pinned_doc pdoc;
+    fdb_status status;
+    char *large_body;
+
+    char keybuf[256], metabuf[256], bodybuf[256];
+
+    // remove previous func_test files
+    r = system(SHELL_DEL" func_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.buffercache_size = 1024*1024;
+    fconfig.wal_threshold = 1024;
+    fconfig.flags = FDB_OPEN_FLAG_CREATE;
+    fconfig.compaction_threshold = 0;
+
+    // open db
+    fdb_open(&dbfile, "./func_test1", &fconfig);
+    if (multi_kv) {
+        fdb_kvs_open(dbfile, &db, "kv1", &kvs_config);
+    } else {
+        fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    }
+    status = fdb_set_log_callback(db, logCallbackFunc,
+                                  (void *) "pinned_get_test");
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // insert documents, the last one doesn't fit into a single block
+    large_body = (char *)malloc(large_bodylen);
+    memset(large_body, 'x', large_bodylen);
+    for (i=0;i<n;++i){
+        sprintf(keybuf, "key%d", i);
+        sprintf(metabuf, "meta%d", i);
+        sprintf(bodybuf, "body%d", i);
+        if (i == n-1) {
+            fdb_doc_create(&doc[i], (void*)keybuf, strlen(keybuf),
+                (void*)metabuf, strlen(metabuf), large_body, large_bodylen);
+        } else {
+            fdb_doc_create(&doc[i], (void*)keybuf, strlen(keybuf),
+                (void*)metabuf, strlen(metabuf), (void*)bodybuf,
+                strlen(bodybuf));
+        }
+        fdb_set(db, doc[i]);
+    }
+    free(large_body);
+
+    // uncommitted docs are read through the heap copy
+    status = fdb_get_pinned(db, doc[0]->key, doc[0]->keylen, &pdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(pdoc.key, doc[0]->key, pdoc.keylen);
+    TEST_CMP(pdoc.body, doc[0]->body, pdoc.bodylen);
+    status = fdb_release(&pdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // commit
+    fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+
+    // remove document #10
+    status = fdb_del(db, doc[10]);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+
+    // pin a document and keep it while reading others
+    fdb_pinned_doc pdoc0;
+    status = fdb_get_pinned(db, doc[0]->key, doc[0]->keylen, &pdoc0);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(pdoc0.pinned_block != NULL);
+
+    for (i=0;i<n;++i){
+        status = fdb_get_pinned(db, doc[i]->key, doc[i]->keylen, &pdoc);
+        if (i == 10) {
+            TEST_CHK(status == FDB_RESULT_KEY_NOT_FOUND);
+            continue;
+        }
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        TEST_CHK(pdoc.keylen == doc[i]->keylen);
+        TEST_CMP(pdoc.key, doc[i]->key, pdoc.keylen);
+        TEST_CHK(pdoc.metalen == doc[i]->metalen);
+        TEST_CMP(pdoc.meta, doc[i]->meta, pdoc.metalen);
+        TEST_CHK(pdoc.bodylen == doc[i]->bodylen);
+        TEST_CMP(pdoc.body, doc[i]->body, pdoc.bodylen);
+        if (i == n-1) {
+            // spans multiple blocks
+            TEST_CHK(pdoc.pinned_block == NULL);
+        }
+        status = fdb_release(&pdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+    }
+
+    // the pinned doc stays intact across compaction
+    status = fdb_compact(dbfile, (char *) "./func_test2");
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(pdoc0.key, doc[0]->key, pdoc0.keylen);
+    TEST_CMP(pdoc0.meta, doc[0]->meta, pdoc0.metalen);
+    TEST_CMP(pdoc0.body, doc[0]->body, pdoc0.bodylen);
+    status = fdb_release(&pdoc0);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    status = fdb_get_pinned(db, doc[1]->key, doc[1]->keylen, &pdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(pdoc.body, doc[1]->body, pdoc.bodylen);
+    status = fdb_release(&pdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    status = fdb_get_pinned(db, NULL, 0, &pdoc);
+    TEST_CHK(status == FDB_RESULT_INVALID_ARGS);
+    status = fdb_release(NULL);
+    TEST_CHK(status == FDB_RESULT_INVALID_ARGS);
+
+    // free all documents
+    for (i=0;i<n;++i){
+        fdb_doc_free(doc[i]);
+    }
+
+    // close db file
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+
+    // free all resources
+    fdb_shutdown();
+
+    memleak_end();
+
+    sprintf(bodybuf, "pinned get test %s", multi_kv ? "multiple kv mode:"
+                                                   : "single kv mode:");
+    TEST_RESULT(bodybuf);
+}
+
 void purge_logically_deleted_doc_test()
 {
     TEST_INIT();
@@ -4249,96 +4554,766 @@ void open_multi_files_kvs_test()
     TEST_RESULT("open multi files kvs test");
 }
 
-void get_byoffset_diff_kvs_test()
-{
-    TEST_INIT();
-    memleak_start();
-    int r;
-    uint64_t offset2;
-    fdb_file_handle *dbfile;
-    fdb_kvs_handle *db, *db2;
-    fdb_doc *rdoc;
-    fdb_status status;
-    char keybuf[256], bodybuf[256];
-
-    // remove previous func_test test files
-    r = system(SHELL_DEL" func_test* > errorlog.txt");
-    (void)r;
-
-    fdb_config fconfig = fdb_get_default_config();
-    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
-
-    status = fdb_open(&dbfile, "./func_test1", &fconfig);
-    TEST_CHK(status == FDB_RESULT_SUCCESS);
-    status = fdb_kvs_open(dbfile, &db, "db", &kvs_config);
-    TEST_CHK(status == FDB_RESULT_SUCCESS);
-    status = fdb_kvs_open(dbfile, &db2, "db2", &kvs_config);
-    TEST_CHK(status == FDB_RESULT_SUCCESS);
-
-    sprintf(keybuf, "key%d", 0);
-    sprintf(bodybuf, "body%d", 0);
-    fdb_doc_create(&rdoc, keybuf, strlen(keybuf), NULL, 0,
-                   bodybuf, strlen(bodybuf)+1);
-
-    // set kv
-    status = fdb_set(db, rdoc);
-    TEST_CHK(status == FDB_RESULT_SUCCESS);
-    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
-    TEST_CHK(status == FDB_RESULT_SUCCESS);
-
-    // set kv2
-    sprintf((char *)rdoc->body, "bOdy%d", 0);
-    status = fdb_set(db2, rdoc);
-    TEST_CHK(status == FDB_RESULT_SUCCESS);
-    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
-    TEST_CHK(status == FDB_RESULT_SUCCESS);
-
-    // save offsets
-    status = fdb_get_metaonly(db, rdoc);
-    TEST_CHK(status == FDB_RESULT_SUCCESS);
-    status = fdb_get_metaonly(db2, rdoc);
-    TEST_CHK(status == FDB_RESULT_SUCCESS);
-    offset2=rdoc->offset;
-
-    // attempt to get key by offset belonging to different kvs
-    rdoc->offset = offset2;
-    status = fdb_get_byoffset(db, rdoc);
-    TEST_CHK(status == FDB_RESULT_KEY_NOT_FOUND);
+struct open_many_ctx {
+    std::atomic<size_t> num_opened;
+    size_t open_order[16];
+};
 
-    fdb_close(dbfile);
-    fdb_doc_free(rdoc);
-    fdb_shutdown();
-    memleak_end();
-    TEST_RESULT("get byoffset diff kvs");
+static void open_many_cb(fdb_open_request *request, size_t index, void *ctx)
+{
+    struct open_many_ctx *octx = (struct open_many_ctx *)ctx;
+    (void)request;
+    octx->open_order[index] = octx->num_opened++;
 }
 
-
-void rekey_test()
+void open_many_test()
 {
     TEST_INIT();
-
     memleak_start();
 
     int i, r;
-    int n = 10;
-    size_t valuelen;
-    void *value;
+    int n_files = 16;
+    char keybuf[256], bodybuf[256];
+    char fnames[16][256];
     fdb_file_handle *dbfile;
     fdb_kvs_handle *db;
+    fdb_open_request requests[16];
+    struct open_many_ctx octx;
     fdb_status status;
+    void *value;
+    size_t valuelen;
 
-    char keybuf[256], bodybuf[256], temp[256];
-
-    // remove previous func_test files
     r = system(SHELL_DEL" func_test* > errorlog.txt");
     (void)r;
 
     fdb_config fconfig = fdb_get_default_config();
     fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
     fconfig.wal_threshold = 1024;
-    fconfig.flags = FDB_OPEN_FLAG_CREATE;
-    fconfig.purging_interval = 0;
-    fconfig.compaction_threshold = 0;
+    fconfig.compaction_mode = FDB_COMPACTION_MANUAL;
+
+    // the last files are left with uncommitted WAL entries to be recovered
+    for (i = 0; i < n_files; ++i) {
+        sprintf(fnames[i], "func_test%d", i);
+        fdb_open(&dbfile, fnames[i], &fconfig);
+        fdb_kvs_open_default(dbfile, &db, &kvs_config);
+        sprintf(keybuf, "key%d", i);
+        sprintf(bodybuf, "body%d", i);
+        fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, strlen(bodybuf));
+        fdb_commit(dbfile, i < n_files / 2 ? FDB_COMMIT_MANUAL_WAL_FLUSH
+                                           : FDB_COMMIT_NORMAL);
+        fdb_kvs_close(db);
+        fdb_close(dbfile);
+    }
+    fdb_shutdown();
+
+    // a single thread opens the files strictly in the order of priorities
+    for (i = 0; i < n_files; ++i) {
+        requests[i].filename = fnames[i];
+        requests[i].config = &fconfig;
+        requests[i].priority = i % 4;
+    }
+    octx.num_opened = 0;
+    status = fdb_open_many(requests, n_files, 1, open_many_cb, &octx);
+    TEST_STATUS(status);
+    TEST_CHK(octx.num_opened == (size_t)n_files);
+    for (i = 0; i < n_files; ++i) {
+        TEST_CHK(requests[i].status == FDB_RESULT_SUCCESS);
+        // priority 3: files 3, 7, 11, 15 first, and so on
+        TEST_CHK(octx.open_order[i] ==
+                 (size_t)((3 - i % 4) * (n_files / 4) + i / 4));
+        fdb_close(requests[i].fhandle);
+    }
+    fdb_shutdown();
+
+    // multiple threads, with a missing file opened in read-only mode
+    fconfig.flags = FDB_OPEN_FLAG_RDONLY;
+    requests[5].filename = "func_test_missing";
+    octx.num_opened = 0;
+    status = fdb_open_many(requests, n_files, 4, open_many_cb, &octx);
+    TEST_CHK(status == FDB_RESULT_NO_SUCH_FILE);
+    TEST_CHK(octx.num_opened == (size_t)n_files);
+    for (i = 0; i < n_files; ++i) {
+        if (i == 5) {
+            TEST_CHK(requests[i].status == FDB_RESULT_NO_SUCH_FILE);
+            TEST_CHK(requests[i].fhandle == NULL);
+            continue;
+        }
+        TEST_CHK(requests[i].status == FDB_RESULT_SUCCESS);
+        fdb_kvs_open_default(requests[i].fhandle, &db, &kvs_config);
+        sprintf(keybuf, "key%d", i);
+        sprintf(bodybuf, "body%d", i);
+        status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+        TEST_STATUS(status);
+        TEST_CMP(value, bodybuf, valuelen);
+        fdb_free_block(value);
+        fdb_kvs_close(db);
+        fdb_close(requests[i].fhandle);
+    }
+
+    requests[5].filename = NULL;
+    status = fdb_open_many(requests, n_files, 4, NULL, NULL);
+    TEST_CHK(status == FDB_RESULT_INVALID_ARGS);
+
+    fdb_shutdown();
+
+    memleak_end();
+    TEST_RESULT("open many files test");
+}
+
+// count the index node blocks in the file, and the number of the runs
+// of consecutive index node blocks
+static void count_index_block_runs(const char *filename,
+                                   int *nblocks, int *nruns) {
+    uint8_t marker;
+    bool prev_index = false;
+    bid_t bid = 0;
+    FILE *fp = fopen(filename, "rb");
+
+    *nblocks = *nruns = 0;
+    if (!fp) {
+        return;
+    }
+    while (fseek(fp, (bid + 1) * FDB_BLOCKSIZE - 1, SEEK_SET) == 0 &&
+           fread(&marker, 1, 1, fp) == 1) {
+        if (marker == BLK_MARKER_BNODE) {
+            (*nblocks)++;
+            if (!prev_index) {
+                (*nruns)++;
+            }
+            prev_index = true;
+        } else {
+            prev_index = false;
+        }
+        bid++;
+    }
+    fclose(fp);
+}
+
+void index_block_extent_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, j, r, c;
+    int n_commits = 30, n_docs = 40;
+    int nblocks[2], nruns[2];
+    uint32_t extents[2] = {0, 64};
+    char keybuf[256], bodybuf[256];
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_file_info file_info;
+    fdb_status status;
+    void *value;
+    size_t valuelen;
+
+    r = system(SHELL_DEL" func_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.wal_threshold = 1024;
+    fconfig.compaction_mode = FDB_COMPACTION_MANUAL;
+
+    // the same workload without and with index block extents
+    for (c = 0; c < 2; ++c) {
+        char fname[256];
+        sprintf(fname, "func_test%d", c);
+        fconfig.index_block_extent = extents[c];
+
+        status = fdb_open(&dbfile, fname, &fconfig);
+        TEST_STATUS(status);
+        status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+        TEST_STATUS(status);
+
+        // each commit updates a few index nodes spread over the tree, and
+        // the documents of the next commit are appended after them
+        for (i = 0; i < n_commits; ++i) {
+            for (j = 0; j < n_docs; ++j) {
+                sprintf(keybuf, "key%03d_%04d", j, i);
+                sprintf(bodybuf, "body%d_%d", i, j);
+                status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                                    bodybuf, strlen(bodybuf) + 1);
+                TEST_STATUS(status);
+            }
+            status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+            TEST_STATUS(status);
+        }
+        fdb_close(dbfile);
+
+        count_index_block_runs(fname, &nblocks[c], &nruns[c]);
+        TEST_CHK(nblocks[c] > 0);
+    }
+
+    // index nodes of every commit are separated by documents and headers
+    // without extents, while they are co-located with extents
+    TEST_CHK(nruns[0] >= n_commits);
+    TEST_CHK(nruns[1] * 4 <= nruns[0]);
+
+    // the index is intact after reopening the file and after compaction
+    for (c = 0; c < 2; ++c) {
+        status = fdb_open(&dbfile, "func_test1", &fconfig);
+        TEST_STATUS(status);
+        status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+        TEST_STATUS(status);
+
+        for (i = 0; i < n_commits; ++i) {
+            for (j = 0; j < n_docs; ++j) {
+                sprintf(keybuf, "key%03d_%04d", j, i);
+                sprintf(bodybuf, "body%d_%d", i, j);
+                status = fdb_get_kv(db, keybuf, strlen(keybuf),
+                                    &value, &valuelen);
+                TEST_STATUS(status);
+                TEST_CMP(value, bodybuf, valuelen);
+                fdb_free_block(value);
+            }
+        }
+        fdb_get_file_info(dbfile, &file_info);
+        TEST_CHK(file_info.doc_count == (uint64_t)n_commits * n_docs);
+
+        if (c == 0) {
+            status = fdb_compact(dbfile, NULL);
+            TEST_STATUS(status);
+        }
+        fdb_close(dbfile);
+    }
+
+    fdb_shutdown();
+
+    memleak_end();
+    TEST_RESULT("index block extent test");
+}
+
+void cache_warmup_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r;
+    int n = 2000, n_hot = 100;
+    char keybuf[256], bodybuf[1024];
+    size_t hot_cache_used, cache_used;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_status status;
+    void *value;
+    size_t valuelen;
+    FILE *fp;
+
+    r = system(SHELL_DEL" func_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.compaction_mode = FDB_COMPACTION_MANUAL;
+    fconfig.prefetch_duration = 0;
+
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_STATUS(status);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        memset(bodybuf, 'a' + i % 26, sizeof(bodybuf));
+        sprintf(bodybuf, "body%06d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, sizeof(bodybuf));
+        TEST_STATUS(status);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+    fdb_close(dbfile);
+    TEST_CHK(fdb_get_buffer_cache_used() == 0);
+
+    // the blocks of the hot documents are recorded when the file is closed
+    fconfig.warmup_cache_onopen = true;
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_STATUS(status);
+    for (i = 0; i < n_hot; ++i) {
+        sprintf(keybuf, "key%06d", i * (n / n_hot));
+        status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+        TEST_STATUS(status);
+        fdb_free_block(value);
+    }
+    hot_cache_used = fdb_get_buffer_cache_used();
+    fdb_close(dbfile);
+    TEST_CHK(fdb_get_buffer_cache_used() == 0);
+    // the sidecar file is written in the background
+    fdb_shutdown();
+    fp = fopen("./func_test1.warmup", "rb");
+    TEST_CHK(fp != NULL);
+    fclose(fp);
+
+    // the same blocks are reloaded in the background on the next open
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_STATUS(status);
+    for (i = 0; i < 500; ++i) {
+        if (fdb_get_buffer_cache_used() >= hot_cache_used) {
+            break;
+        }
+        usleep(10000);
+    }
+    cache_used = fdb_get_buffer_cache_used();
+    TEST_CHK(cache_used == hot_cache_used);
+    for (i = 0; i < n_hot; ++i) {
+        sprintf(keybuf, "key%06d", i * (n / n_hot));
+        sprintf(bodybuf, "body%06d", i * (n / n_hot));
+        status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+        TEST_STATUS(status);
+        TEST_CMP(value, bodybuf, strlen(bodybuf) + 1);
+        fdb_free_block(value);
+    }
+    // all of them were already cached
+    TEST_CHK(fdb_get_buffer_cache_used() == cache_used);
+
+    status = fdb_save_cache_warmup(dbfile);
+    TEST_STATUS(status);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    // a corrupted sidecar file is ignored
+    fp = fopen("./func_test1.warmup", "r+b");
+    TEST_CHK(fp != NULL);
+    fseek(fp, 40, SEEK_SET);
+    fputc(0xff, fp);
+    fclose(fp);
+    fconfig.warmup_cache_onopen = false;
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    fdb_close(dbfile);
+    fconfig.warmup_cache_onopen = true;
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_STATUS(status);
+    usleep(100000);
+    TEST_CHK(fdb_get_buffer_cache_used() < hot_cache_used);
+    sprintf(keybuf, "key%06d", n - 1);
+    status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+    TEST_STATUS(status);
+    fdb_free_block(value);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    // a read-only open does not record its resident blocks
+    r = system(SHELL_DEL" func_test1.warmup > errorlog.txt");
+    (void)r;
+    fconfig.flags = FDB_OPEN_FLAG_RDONLY;
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_STATUS(status);
+    status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+    TEST_STATUS(status);
+    fdb_free_block(value);
+    fdb_close(dbfile);
+    fdb_shutdown();
+    fp = fopen("./func_test1.warmup", "rb");
+    TEST_CHK(fp == NULL);
+    fconfig.flags = 0;
+
+    // the sidecar file is removed together with the database file, even if
+    // it is still being written by the last close
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    fdb_close(dbfile);
+    status = fdb_destroy("./func_test1", &fconfig);
+    TEST_STATUS(status);
+    fp = fopen("./func_test1.warmup", "rb");
+    TEST_CHK(fp == NULL);
+
+    fdb_shutdown();
+
+    memleak_end();
+    TEST_RESULT("cache warm-up test");
+}
+
+void compressed_cache_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r;
+    int n = 2000;
+    char keybuf[256], bodybuf[1024];
+    size_t comp_cache_used;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_status status;
+    void *value;
+    size_t valuelen;
+
+    r = system(SHELL_DEL" func_test* > errorlog.txt");
+    (void)r;
+
+    // a buffer cache much smaller than the file, so that most of the blocks
+    // are evicted into the compressed block cache
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.buffercache_size = 64 * fconfig.blocksize;
+    fconfig.compressed_cache_size = 16 * 1024 * 1024;
+    fconfig.compaction_mode = FDB_COMPACTION_MANUAL;
+
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_STATUS(status);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        memset(bodybuf, 'a' + i % 26, sizeof(bodybuf));
+        sprintf(bodybuf, "body%06d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, sizeof(bodybuf));
+        TEST_STATUS(status);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+    comp_cache_used = fdb_get_compressed_cache_used();
+    TEST_CHK(comp_cache_used > 0);
+    TEST_CHK(comp_cache_used < fconfig.compressed_cache_size);
+
+    // read all the documents twice; blocks move back and forth between
+    // the buffer cache and the compressed block cache
+    for (r = 0; r < 2; ++r) {
+        for (i = 0; i < n; ++i) {
+            sprintf(keybuf, "key%06d", i);
+            sprintf(bodybuf, "body%06d", i);
+            status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+            TEST_STATUS(status);
+            TEST_CHK(valuelen == sizeof(bodybuf));
+            TEST_CMP(value, bodybuf, strlen(bodybuf) + 1);
+            fdb_free_block(value);
+        }
+        TEST_CHK(fdb_get_compressed_cache_used() > 0);
+    }
+
+    // updated documents are not served from stale compressed blocks
+    for (i = 0; i < n; i += 2) {
+        sprintf(keybuf, "key%06d", i);
+        memset(bodybuf, 'z', sizeof(bodybuf));
+        sprintf(bodybuf, "updated%06d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, sizeof(bodybuf));
+        TEST_STATUS(status);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        if (i % 2) {
+            sprintf(bodybuf, "body%06d", i);
+        } else {
+            sprintf(bodybuf, "updated%06d", i);
+        }
+        status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+        TEST_STATUS(status);
+        TEST_CMP(value, bodybuf, strlen(bodybuf) + 1);
+        fdb_free_block(value);
+    }
+
+    // the compressed blocks of a file are dropped when the file is closed
+    fdb_close(dbfile);
+    TEST_CHK(fdb_get_compressed_cache_used() == 0);
+
+    fdb_shutdown();
+
+    memleak_end();
+    TEST_RESULT("compressed block cache test");
+}
+
+void secondary_cache_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r;
+    int n = 2000;
+    char keybuf[256], bodybuf[1024];
+    size_t scache_used;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_status status;
+    void *value;
+    size_t valuelen;
+    FILE *fp;
+
+    r = system(SHELL_DEL" func_test* > errorlog.txt");
+    (void)r;
+
+    // a buffer cache much smaller than the file, so that most of the blocks
+    // are evicted into the secondary block cache
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.buffercache_size = 64 * fconfig.blocksize;
+    fconfig.secondary_cache_path = "./func_test_scache";
+    fconfig.secondary_cache_size = 16 * 1024 * 1024;
+    fconfig.compaction_mode = FDB_COMPACTION_MANUAL;
+
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_STATUS(status);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        memset(bodybuf, 'a' + i % 26, sizeof(bodybuf));
+        sprintf(bodybuf, "body%06d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, sizeof(bodybuf));
+        TEST_STATUS(status);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+    // index nodes are admitted as soon as they are evicted
+    TEST_CHK(fdb_get_secondary_cache_used() > 0);
+
+    // document blocks are admitted when they are evicted again
+    scache_used = fdb_get_secondary_cache_used();
+    for (r = 0; r < 2; ++r) {
+        for (i = 0; i < n; ++i) {
+            sprintf(keybuf, "key%06d", i);
+            sprintf(bodybuf, "body%06d", i);
+            status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+            TEST_STATUS(status);
+            TEST_CHK(valuelen == sizeof(bodybuf));
+            TEST_CMP(value, bodybuf, strlen(bodybuf) + 1);
+            fdb_free_block(value);
+        }
+    }
+    TEST_CHK(fdb_get_secondary_cache_used() > scache_used);
+
+    // updated documents are not served from stale cached blocks
+    for (i = 0; i < n; i += 2) {
+        sprintf(keybuf, "key%06d", i);
+        memset(bodybuf, 'z', sizeof(bodybuf));
+        sprintf(bodybuf, "updated%06d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, sizeof(bodybuf));
+        TEST_STATUS(status);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        if (i % 2) {
+            sprintf(bodybuf, "body%06d", i);
+        } else {
+            sprintf(bodybuf, "updated%06d", i);
+        }
+        status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+        TEST_STATUS(status);
+        TEST_CMP(value, bodybuf, strlen(bodybuf) + 1);
+        fdb_free_block(value);
+    }
+    fdb_close(dbfile);
+
+    // the cached blocks are kept for the closed file, and reused when the
+    // unchanged file is opened again
+    scache_used = fdb_get_secondary_cache_used();
+    TEST_CHK(scache_used > 0);
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_STATUS(status);
+    TEST_CHK(fdb_get_secondary_cache_used() == scache_used);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        if (i % 2) {
+            sprintf(bodybuf, "body%06d", i);
+        } else {
+            sprintf(bodybuf, "updated%06d", i);
+        }
+        status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+        TEST_STATUS(status);
+        TEST_CMP(value, bodybuf, strlen(bodybuf) + 1);
+        fdb_free_block(value);
+    }
+    fdb_close(dbfile);
+
+    // the cached blocks are discarded together with the database file
+    status = fdb_destroy("./func_test1", &fconfig);
+    TEST_STATUS(status);
+    TEST_CHK(fdb_get_secondary_cache_used() == 0);
+
+    // the cache file is removed on shutdown
+    fdb_shutdown();
+    fp = fopen("./func_test_scache", "rb");
+    TEST_CHK(fp == NULL);
+
+    memleak_end();
+    TEST_RESULT("secondary block cache test");
+}
+
+void direct_io_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r;
+    int n = 3000;
+    char keybuf[256], bodybuf[512];
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_status status;
+    fdb_file_info info;
+    void *value;
+    size_t valuelen;
+
+    r = system(SHELL_DEL" func_test* > errorlog.txt");
+    (void)r;
+
+    // a buffer cache smaller than the file, so that blocks are evicted and
+    // read back from the file through direct I/O
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.buffercache_size = 128 * fconfig.blocksize;
+    fconfig.durability_opt = FDB_DRB_ODIRECT;
+    fconfig.compaction_mode = FDB_COMPACTION_MANUAL;
+
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_STATUS(status);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        memset(bodybuf, 'a' + i % 26, sizeof(bodybuf));
+        sprintf(bodybuf, "body%06d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, sizeof(bodybuf));
+        TEST_STATUS(status);
+        if (i % 1000 == 999) {
+            status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+            TEST_STATUS(status);
+        }
+    }
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d", i);
+        status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+        TEST_STATUS(status);
+        TEST_CHK(valuelen == sizeof(bodybuf));
+        TEST_CMP(value, bodybuf, strlen(bodybuf) + 1);
+        fdb_free_block(value);
+    }
+    fdb_close(dbfile);
+
+    // reopen and compact the file, and then verify all the documents
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_STATUS(status);
+    status = fdb_compact(dbfile, "./func_test2");
+    TEST_STATUS(status);
+    status = fdb_get_file_info(dbfile, &info);
+    TEST_STATUS(status);
+    TEST_CHK(info.doc_count == (uint64_t)n);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d", i);
+        status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+        TEST_STATUS(status);
+        TEST_CMP(value, bodybuf, strlen(bodybuf) + 1);
+        fdb_free_block(value);
+    }
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    memleak_end();
+    TEST_RESULT("direct I/O test");
+}
+
+void get_byoffset_diff_kvs_test()
+{
+    TEST_INIT();
+    memleak_start();
+    int r;
+    uint64_t offset2;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db, *db2;
+    fdb_doc *rdoc;
+    fdb_status status;
+    char keybuf[256], bodybuf[256];
+
+    // remove previous func_test test files
+    r = system(SHELL_DEL" func_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_kvs_open(dbfile, &db, "db", &kvs_config);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_kvs_open(dbfile, &db2, "db2", &kvs_config);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    sprintf(keybuf, "key%d", 0);
+    sprintf(bodybuf, "body%d", 0);
+    fdb_doc_create(&rdoc, keybuf, strlen(keybuf), NULL, 0,
+                   bodybuf, strlen(bodybuf)+1);
+
+    // set kv
+    status = fdb_set(db, rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // set kv2
+    sprintf((char *)rdoc->body, "bOdy%d", 0);
+    status = fdb_set(db2, rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // save offsets
+    status = fdb_get_metaonly(db, rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_get_metaonly(db2, rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    offset2=rdoc->offset;
+
+    // attempt to get key by offset belonging to different kvs
+    rdoc->offset = offset2;
+    status = fdb_get_byoffset(db, rdoc);
+    TEST_CHK(status == FDB_RESULT_KEY_NOT_FOUND);
+
+    fdb_close(dbfile);
+    fdb_doc_free(rdoc);
+    fdb_shutdown();
+    memleak_end();
+    TEST_RESULT("get byoffset diff kvs");
+}
+
+
+void rekey_test()
+{
+    TEST_INIT();
+
+    memleak_start();
+
+    int i, r;
+    int n = 10;
+    size_t valuelen;
+    void *value;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_status status;
+
+    char keybuf[256], bodybuf[256], temp[256];
+
+    // remove previous func_test files
+    r = system(SHELL_DEL" func_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.wal_threshold = 1024;
+    fconfig.flags = FDB_OPEN_FLAG_CREATE;
+    fconfig.purging_interval = 0;
+    fconfig.compaction_threshold = 0;
 
     fconfig.encryption_key.algorithm = -1; // Bogus encryption
     memset(fconfig.encryption_key.bytes, 0x42, sizeof(fconfig.encryption_key.bytes));
@@ -5084,6 +6059,213 @@ void changes_since_test(const char *kvs) {
     }
 }
 
+void changes_cursor_test(const char *kvs) {
+    TEST_INIT();
+    memleak_start();
+
+    int r;
+    size_t i, num, len, n = 20;
+    fdb_status status;
+    fdb_file_handle *dbfile = NULL;
+    fdb_kvs_handle *db = NULL;
+    fdb_file_handle *dbfile_txn;
+    fdb_kvs_handle *db_txn;
+    fdb_changes_cursor *cursor;
+    fdb_doc docs[6];
+    char buf[1024], state[64];
+    char keybuf[64], bodybuf[64];
+    fdb_config fconfig = fdb_get_default_config();
+    fconfig.seqtree_opt = FDB_SEQTREE_USE;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+
+    r = system(SHELL_DEL" func_test* > errorlog.txt");
+    (void)r;
+
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    if (kvs) {
+        status = fdb_kvs_open(dbfile, &db, kvs, &kvs_config);
+    } else {
+        status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    }
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    for (i = 1; i <= n; ++i) {
+        sprintf(keybuf, "key%lu", i);
+        sprintf(bodybuf, "body%lu", i);
+        fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, strlen(bodybuf));
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    status = fdb_changes_cursor_open(NULL, 1, FDB_ITR_NONE, &cursor);
+    TEST_CHK(status == FDB_RESULT_INVALID_HANDLE);
+    status = fdb_changes_cursor_open(db, 1, FDB_ITR_NONE, &cursor);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // pull all the changes in batches
+    size_t total = 0;
+    while ((status = fdb_changes_cursor_pull(cursor, docs, 6, buf, sizeof(buf),
+                                             &num)) == FDB_RESULT_SUCCESS) {
+        TEST_CHK(num == 6 || total + num == n);
+        for (i = 0; i < num; ++i, ++total) {
+            sprintf(keybuf, "key%lu", total + 1);
+            sprintf(bodybuf, "body%lu", total + 1);
+            TEST_CHK(docs[i].seqnum == total + 1);
+            TEST_CHK(docs[i].keylen == strlen(keybuf));
+            TEST_CMP(docs[i].key, keybuf, docs[i].keylen);
+            TEST_CMP(docs[i].body, bodybuf, docs[i].bodylen);
+        }
+    }
+    TEST_CHK(status == FDB_RESULT_ITERATOR_FAIL);
+    TEST_CHK(total == n);
+
+    // new changes (still in WAL) are picked up by the next pull
+    for (i = 1; i <= 5; ++i) {
+        sprintf(keybuf, "key%lu", i);
+        sprintf(bodybuf, "body%lu_new", i);
+        fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, strlen(bodybuf));
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_changes_cursor_pull(cursor, docs, 6, buf, sizeof(buf), &num);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num == 5);
+    for (i = 0; i < num; ++i) {
+        sprintf(keybuf, "key%lu", i + 1);
+        TEST_CHK(docs[i].seqnum == n + i + 1);
+        TEST_CMP(docs[i].key, keybuf, docs[i].keylen);
+    }
+    status = fdb_changes_cursor_pull(cursor, docs, 6, buf, sizeof(buf), &num);
+    TEST_CHK(status == FDB_RESULT_ITERATOR_FAIL);
+
+    // serialize the cursor and resume after reopening the file
+    status = fdb_changes_cursor_serialize(cursor, state, 4, &len);
+    TEST_CHK(status == FDB_RESULT_ENOBUFS);
+    TEST_CHK(len > 4 && len <= sizeof(state));
+    status = fdb_changes_cursor_serialize(cursor, state, sizeof(state), &len);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_changes_cursor_close(cursor);
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    if (kvs) {
+        status = fdb_kvs_open(dbfile, &db, kvs, &kvs_config);
+    } else {
+        status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    }
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_set_kv(db, (void *)"key21", 5, (void *)"body21", 6);
+    fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+
+    state[0] ^= 0xff;
+    status = fdb_changes_cursor_resume(db, state, len, &cursor);
+    TEST_CHK(status == FDB_RESULT_INVALID_ARGS);
+    state[0] ^= 0xff;
+    status = fdb_changes_cursor_resume(db, state, len, &cursor);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_changes_cursor_pull(cursor, docs, 6, buf, sizeof(buf), &num);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num == 1);
+    TEST_CHK(docs[0].seqnum == n + 6);
+    TEST_CMP(docs[0].key, "key21", docs[0].keylen);
+    fdb_changes_cursor_close(cursor);
+
+    // keys and metadata only
+    status = fdb_changes_cursor_open(db, n, FDB_ITR_NO_VALUES, &cursor);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_changes_cursor_pull(cursor, docs, 6, buf, sizeof(buf), &num);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num == 6);
+    TEST_CHK(docs[0].seqnum == n);
+    for (i = 0; i < num; ++i) {
+        TEST_CHK(docs[i].bodylen == 0);
+    }
+    // the buffer is too small for a single doc
+    fdb_changes_cursor_close(cursor);
+    status = fdb_changes_cursor_open(db, 1, FDB_ITR_NONE, &cursor);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_changes_cursor_pull(cursor, docs, 6, buf, 4, &num);
+    TEST_CHK(status == FDB_RESULT_ENOBUFS);
+    TEST_CHK(num == 0);
+    fdb_changes_cursor_close(cursor);
+
+    // trailing deletes skipped by FDB_ITR_NO_DELETES are still consumed
+    status = fdb_changes_cursor_open(db, n + 6, FDB_ITR_NO_DELETES, &cursor);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_del_kv(db, (void *)"key1", 4);
+    fdb_del_kv(db, (void *)"key2", 4);
+    fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    total = 0;
+    while ((status = fdb_changes_cursor_pull(cursor, docs, 6, buf, sizeof(buf),
+                                             &num)) == FDB_RESULT_SUCCESS) {
+        for (i = 0; i < num; ++i, ++total) {
+            TEST_CHK(docs[i].deleted == false);
+            TEST_CHK(docs[i].seqnum == n + 6);
+        }
+    }
+    TEST_CHK(status == FDB_RESULT_ITERATOR_FAIL);
+    TEST_CHK(total == 1);
+    status = fdb_changes_cursor_serialize(cursor, state, sizeof(state), &len);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_seqnum_t next_seqnum;
+    memcpy(&next_seqnum, state + len - sizeof(next_seqnum),
+           sizeof(next_seqnum));
+    TEST_CHK(_endian_decode(next_seqnum) == n + 9);
+    // idle polls don't move the cursor back
+    status = fdb_changes_cursor_pull(cursor, docs, 6, buf, sizeof(buf), &num);
+    TEST_CHK(status == FDB_RESULT_ITERATOR_FAIL);
+    fdb_set_kv(db, (void *)"key22", 5, (void *)"body22", 6);
+    fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    status = fdb_changes_cursor_pull(cursor, docs, 6, buf, sizeof(buf), &num);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num == 1);
+    TEST_CHK(docs[0].seqnum == n + 9);
+    TEST_CMP(docs[0].key, "key22", docs[0].keylen);
+
+    // an update of an open transaction is delivered once it is committed
+    status = fdb_open(&dbfile_txn, "./func_test1", &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    if (kvs) {
+        status = fdb_kvs_open(dbfile_txn, &db_txn, kvs, &kvs_config);
+    } else {
+        status = fdb_kvs_open_default(dbfile_txn, &db_txn, &kvs_config);
+    }
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_begin_transaction(dbfile_txn, FDB_ISOLATION_READ_COMMITTED);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_set_kv(db_txn, (void *)"key23", 5, (void *)"body23", 6);
+    status = fdb_changes_cursor_pull(cursor, docs, 6, buf, sizeof(buf), &num);
+    TEST_CHK(status == FDB_RESULT_ITERATOR_FAIL);
+    status = fdb_end_transaction(dbfile_txn, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    // the other handle's snapshots see the committed update once it is
+    // flushed from the WAL
+    status = fdb_commit(dbfile_txn, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_changes_cursor_pull(cursor, docs, 6, buf, sizeof(buf), &num);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num == 1);
+    TEST_CHK(docs[0].seqnum == n + 10);
+    TEST_CMP(docs[0].key, "key23", docs[0].keylen);
+    fdb_changes_cursor_close(cursor);
+    fdb_kvs_close(db_txn);
+    fdb_close(dbfile_txn);
+
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    memleak_end();
+    if (kvs) {
+        TEST_RESULT("changes feed cursor test with regular kvs");
+    } else {
+        TEST_RESULT("changes feed cursor test with default kvs");
+    }
+}
+
 void kvs_deletion_without_commit()
 {
 
@@ -5236,6 +6418,185 @@ void latency_stats_histogram_test() {
     TEST_RESULT("latency stats with histogram test");
 }
 
+static void _verify_mmap_docs(fdb_kvs_handle *db, int n)
+{
+    TEST_INIT();
+
+    int i;
+    fdb_doc *doc;
+    fdb_iterator *it;
+    fdb_status status;
+    char keybuf[256], bodybuf[256];
+
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d", i);
+        fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0, NULL, 0);
+        status = fdb_get(db, doc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        TEST_CMP(doc->body, bodybuf, doc->bodylen);
+        fdb_doc_free(doc);
+    }
+
+    // forward scan
+    status = fdb_iterator_init(db, &it, NULL, 0, NULL, 0, FDB_ITR_NONE);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    i = 0;
+    do {
+        doc = NULL;
+        status = fdb_iterator_get(it, &doc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        sprintf(keybuf, "key%06d", i);
+        TEST_CMP(doc->key, keybuf, doc->keylen);
+        fdb_doc_free(doc);
+        ++i;
+    } while (fdb_iterator_next(it) == FDB_RESULT_SUCCESS);
+    TEST_CHK(i == n);
+
+    // backward scan
+    i = n - 1;
+    status = fdb_iterator_seek_to_max(it);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    do {
+        doc = NULL;
+        status = fdb_iterator_get(it, &doc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        sprintf(keybuf, "key%06d", i);
+        TEST_CMP(doc->key, keybuf, doc->keylen);
+        fdb_doc_free(doc);
+        --i;
+    } while (fdb_iterator_prev(it) == FDB_RESULT_SUCCESS);
+    TEST_CHK(i == -1);
+    fdb_iterator_close(it);
+}
+
+void mmap_read_only_test()
+{
+    TEST_INIT();
+
+    memleak_start();
+
+    int i, r;
+    int n = 5000;
+    fdb_file_handle *dbfile, *dbfile_rdonly;
+    fdb_kvs_handle *db, *db_rdonly;
+    fdb_doc *doc;
+    fdb_iterator *it;
+    fdb_file_info file_info;
+    fdb_status status;
+    char keybuf[256], bodybuf[256];
+
+    r = system(SHELL_DEL" func_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.buffercache_size = 16777216;
+    fconfig.wal_threshold = 1024;
+    fconfig.compaction_threshold = 0;
+
+    // the flag is only allowed in read-only mode
+    fconfig.flags = FDB_OPEN_FLAG_CREATE | FDB_OPEN_FLAG_MMAP;
+    status = fdb_open(&dbfile, "./func_test1", &fconfig);
+    TEST_CHK(status == FDB_RESULT_INVALID_CONFIG);
+
+    fconfig.flags = FDB_OPEN_FLAG_CREATE;
+    fdb_open(&dbfile, "./func_test1", &fconfig);
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, strlen(bodybuf));
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    status = fdb_compact(dbfile, "./func_test2");
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    // reads from the mapping don't populate the block cache
+    fconfig.flags = FDB_OPEN_FLAG_RDONLY | FDB_OPEN_FLAG_MMAP;
+    status = fdb_open(&dbfile_rdonly, "./func_test2", &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_kvs_open_default(dbfile_rdonly, &db_rdonly, &kvs_config);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    _verify_mmap_docs(db_rdonly, n);
+    TEST_CHK(fdb_get_buffer_cache_used() == 0);
+
+    status = fdb_set_kv(db_rdonly, "key", 3, "body", 4);
+    TEST_CHK(status == FDB_RESULT_RONLY_VIOLATION);
+
+    // a writer sharing the mapped file appends new blocks beyond the mapping
+    fconfig.flags = 0;
+    fdb_open(&dbfile, "./func_test2", &fconfig);
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    for (i = n; i < n * 2; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, strlen(bodybuf));
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    _verify_mmap_docs(db, n * 2);
+    _verify_mmap_docs(db_rdonly, n * 2);
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+
+    fdb_kvs_close(db_rdonly);
+    fdb_close(dbfile_rdonly);
+
+    // the regular read-only mode caches the blocks
+    fconfig.flags = FDB_OPEN_FLAG_RDONLY;
+    fdb_open(&dbfile_rdonly, "./func_test2", &fconfig);
+    fdb_kvs_open_default(dbfile_rdonly, &db_rdonly, &kvs_config);
+    fdb_doc_create(&doc, "key000000", 9, NULL, 0, NULL, 0);
+    status = fdb_get(db_rdonly, doc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_doc_free(doc);
+    TEST_CHK(fdb_get_buffer_cache_used() > 0);
+    fdb_kvs_close(db_rdonly);
+    fdb_close(dbfile_rdonly);
+    fdb_shutdown();
+
+#if !defined(WIN32) && !defined(_WIN32)
+    // the mapping is no longer used once the file is truncated (here, its
+    // last DB header block is cut off), and the remaining blocks are read
+    // in the regular way
+    fconfig.flags = FDB_OPEN_FLAG_RDONLY | FDB_OPEN_FLAG_MMAP;
+    fdb_open(&dbfile_rdonly, "./func_test2", &fconfig);
+    fdb_kvs_open_default(dbfile_rdonly, &db_rdonly, &kvs_config);
+    TEST_CHK(fdb_get_buffer_cache_used() == 0);
+    fdb_get_file_info(dbfile_rdonly, &file_info);
+    r = truncate("./func_test2", file_info.file_size - fconfig.blocksize);
+    TEST_CHK(r == 0);
+    status = fdb_iterator_init(db_rdonly, &it, NULL, 0, NULL, 0,
+                               FDB_ITR_NONE);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    i = 0;
+    do {
+        doc = NULL;
+        status = fdb_iterator_get(it, &doc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        fdb_doc_free(doc);
+        ++i;
+    } while (fdb_iterator_next(it) == FDB_RESULT_SUCCESS);
+    TEST_CHK(i == n * 2);
+    fdb_iterator_close(it);
+    TEST_CHK(fdb_get_buffer_cache_used() > 0);
+    fdb_kvs_close(db_rdonly);
+    fdb_close(dbfile_rdonly);
+    fdb_shutdown();
+#endif
+
+    memleak_end();
+
+    TEST_RESULT("memory-mapped read-only mode test");
+}
+
 int main(){
     basic_test();
     init_test();
@@ -5256,9 +6617,11 @@ int main(){
     seq_tree_exception_test();
     wal_commit_test();
     incomplete_block_test();
+    mmap_read_only_test();
     custom_compare_primitive_test();
     custom_compare_dups_test();
     custom_compare_variable_test();
+    custom_compare_prefix_compression_test();
     custom_compare_commit_compact(false);
     custom_compare_commit_compact(true);
     custom_seqnum_test(true); // multi-kv
@@ -5273,6 +6636,8 @@ int main(){
 #endif
     doc_compression_test();
     read_doc_by_offset_test();
+    pinned_get_test(false);
+    pinned_get_test(true);
     api_wrapper_test();
     flush_before_commit_test();
     flush_before_commit_multi_writers_test();
@@ -5286,6 +6651,12 @@ int main(){
     operational_stats_test(false);
     operational_stats_test(true);
     open_multi_files_kvs_test();
+    open_many_test();
+    index_block_extent_test();
+    cache_warmup_test();
+    compressed_cache_test();
+    secondary_cache_test();
+    direct_io_test();
     rekey_test();
     invalid_get_byoffset_test();
     dirty_index_consistency_test();
@@ -5299,6 +6670,8 @@ int main(){
     available_rollback_seqno_test("kvs");
     changes_since_test(NULL);
     changes_since_test("kvs");
+    changes_cursor_test(NULL);
+    changes_cursor_test("kvs");
 
     latency_stats_histogram_test();
 
@@ -27,6 +27,7 @@
 #include "libforestdb/forestdb.h"
 #include "test.h"
 
+#include "arch.h"
 #include "internal_types.h"
 #include "functional_util.h"
 
@@ -4228,6 +4229,1010 @@ void iterator_seek_to_min_key_with_deletes_test() {
 
     TEST_RESULT("iterator seek to max test");
 }
+void iterator_readahead_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r, count, n = 5000;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db, *db2;
+    fdb_iterator *it;
+    fdb_doc *rdoc = NULL;
+    fdb_status status;
+    char keybuf[256], bodybuf[256];
+    char bigbody[10000];
+
+    r = system(SHELL_DEL" iterator_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.buffercache_size = 16777216;
+    fconfig.wal_threshold = 4096;
+    fconfig.compaction_threshold = 0;
+
+    fdb_open(&dbfile, "./iterator_test1", &fconfig);
+    fdb_kvs_open(dbfile, &db, "kv1", &kvs_config);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d_%0180d", i, 0);
+        fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, strlen(bodybuf));
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+
+    // every 7th doc is deleted, and every 5th doc is updated in WAL
+    for (i = 0; i < n; i += 7) {
+        sprintf(keybuf, "key%06d", i);
+        fdb_del_kv(db, keybuf, strlen(keybuf));
+    }
+    for (i = 0; i < n; i += 5) {
+        if (i % 7 == 0) {
+            continue;
+        }
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "BODY%06d", i);
+        fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, strlen(bodybuf));
+    }
+    fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    // start with the cold cache
+    fdb_shutdown();
+
+    fconfig.iterator_readahead = true;
+    fdb_open(&dbfile, "./iterator_test1", &fconfig);
+    fdb_kvs_open(dbfile, &db, "kv1", &kvs_config);
+
+    // full scan in both directions
+    status = fdb_iterator_init(db, &it, NULL, 0, NULL, 0,
+                               FDB_ITR_NO_DELETES);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    i = 0;
+    count = 0;
+    do {
+        status = fdb_iterator_get(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        if (i % 7 == 0) {
+            ++i;
+        }
+        sprintf(keybuf, "key%06d", i);
+        TEST_CMP(rdoc->key, keybuf, rdoc->keylen);
+        if (i % 5 == 0) {
+            sprintf(bodybuf, "BODY%06d", i);
+        } else {
+            sprintf(bodybuf, "body%06d_%0180d", i, 0);
+        }
+        TEST_CMP(rdoc->body, bodybuf, rdoc->bodylen);
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        ++i;
+        ++count;
+    } while (fdb_iterator_next(it) == FDB_RESULT_SUCCESS);
+    TEST_CHK(count == n - (n + 6) / 7);
+
+    count = 0;
+    status = fdb_iterator_seek_to_max(it);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    i = n - 1;
+    do {
+        status = fdb_iterator_get(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        if (i % 7 == 0) {
+            --i;
+        }
+        sprintf(keybuf, "key%06d", i);
+        TEST_CMP(rdoc->key, keybuf, rdoc->keylen);
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        --i;
+        ++count;
+    } while (fdb_iterator_prev(it) == FDB_RESULT_SUCCESS);
+    TEST_CHK(count == n - (n + 6) / 7);
+    fdb_iterator_close(it);
+
+    // the blocks read ahead are cached
+    TEST_CHK(fdb_get_buffer_cache_used() > 0);
+
+    // range scan turning around in the middle, and seek
+    status = fdb_iterator_init(db, &it, "key001000", 9, "key001999", 9,
+                               FDB_ITR_NO_DELETES);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    for (i = 1000; i < 1500; ++i) {
+        if (i % 7 == 0) {
+            continue;
+        }
+        status = fdb_iterator_get(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        sprintf(keybuf, "key%06d", i);
+        TEST_CMP(rdoc->key, keybuf, rdoc->keylen);
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        status = fdb_iterator_next(it);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+    }
+    for (i = 1499; i >= 1000; --i) {
+        if (i % 7 == 0) {
+            continue;
+        }
+        status = fdb_iterator_prev(it);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        status = fdb_iterator_get(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        sprintf(keybuf, "key%06d", i);
+        TEST_CMP(rdoc->key, keybuf, rdoc->keylen);
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+    }
+    status = fdb_iterator_prev(it);
+    TEST_CHK(status == FDB_RESULT_ITERATOR_FAIL);
+
+    status = fdb_iterator_seek(it, "key001800", 9, FDB_ITR_SEEK_HIGHER);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    i = 1800;
+    count = 0;
+    do {
+        status = fdb_iterator_get(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        if (i % 7 == 0) {
+            ++i;
+        }
+        sprintf(keybuf, "key%06d", i);
+        TEST_CMP(rdoc->key, keybuf, rdoc->keylen);
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        ++i;
+        ++count;
+    } while (fdb_iterator_next(it) == FDB_RESULT_SUCCESS);
+    TEST_CHK(count == 200 - 28);
+    fdb_iterator_close(it);
+
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    // bodies spanning multiple blocks, next to another KV store
+    fconfig.iterator_readahead = false;
+    fdb_open(&dbfile, "./iterator_test2", &fconfig);
+    fdb_kvs_open(dbfile, &db, "kv1", &kvs_config);
+    fdb_kvs_open(dbfile, &db2, "kv2", &kvs_config);
+    for (i = 0; i < 100; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        memset(bigbody, 'a' + i % 26, sizeof(bigbody));
+        fdb_set_kv(db, keybuf, strlen(keybuf), bigbody, sizeof(bigbody));
+        sprintf(bodybuf, "kv2_body%06d", i);
+        fdb_set_kv(db2, keybuf, strlen(keybuf), bodybuf, strlen(bodybuf));
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    fdb_kvs_close(db2);
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    fconfig.iterator_readahead = true;
+    fdb_open(&dbfile, "./iterator_test2", &fconfig);
+    fdb_kvs_open(dbfile, &db, "kv1", &kvs_config);
+    status = fdb_iterator_init(db, &it, NULL, 0, NULL, 0,
+                               FDB_ITR_NO_DELETES);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    i = 0;
+    do {
+        status = fdb_iterator_get(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        sprintf(keybuf, "key%06d", i);
+        TEST_CMP(rdoc->key, keybuf, rdoc->keylen);
+        memset(bigbody, 'a' + i % 26, sizeof(bigbody));
+        TEST_CHK(rdoc->bodylen == sizeof(bigbody));
+        TEST_CMP(rdoc->body, bigbody, rdoc->bodylen);
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        ++i;
+    } while (fdb_iterator_next(it) == FDB_RESULT_SUCCESS);
+    TEST_CHK(i == 100);
+
+    i = 99;
+    status = fdb_iterator_seek_to_max(it);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    do {
+        status = fdb_iterator_get(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        sprintf(keybuf, "key%06d", i);
+        TEST_CMP(rdoc->key, keybuf, rdoc->keylen);
+        TEST_CHK(rdoc->bodylen == sizeof(bigbody));
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        --i;
+    } while (fdb_iterator_prev(it) == FDB_RESULT_SUCCESS);
+    TEST_CHK(i == -1);
+    fdb_iterator_close(it);
+
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    memleak_end();
+
+    TEST_RESULT("iterator read-ahead test");
+}
+
+static int _iterator_split_reverse_cmp(void *key1, size_t keylen1,
+                                       void *key2, size_t keylen2)
+{
+    size_t len = MIN(keylen1, keylen2);
+    int cmp = memcmp(key2, key1, len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (int)((int)keylen2 - (int)keylen1);
+}
+
+struct split_scan_args {
+    fdb_kvs_handle *snap;
+    fdb_seqnum_t seqnum;
+    fdb_key_range *range;
+    bool last;
+    int count;
+    int first;
+    int prev;
+    bool ok;
+};
+
+static void *_iterator_split_scan(void *voidargs)
+{
+    struct split_scan_args *args = (struct split_scan_args *)voidargs;
+    fdb_kvs_handle *clone;
+    fdb_iterator *it;
+    fdb_doc *rdoc = NULL;
+    fdb_status status;
+    fdb_iterator_opt_t opt = FDB_ITR_NONE;
+    char keybuf[256];
+    int num;
+
+    args->count = 0;
+    args->first = args->prev = -1;
+    args->ok = true;
+
+    if (!args->last) {
+        opt |= FDB_ITR_SKIP_MAX_KEY;
+    }
+    // each thread scans its own clone of the snapshot
+    status = fdb_snapshot_open(args->snap, &clone, args->seqnum);
+    if (status != FDB_RESULT_SUCCESS) {
+        args->ok = false;
+        return NULL;
+    }
+    status = fdb_iterator_init(clone, &it,
+                               args->range->start_key,
+                               args->range->start_keylen,
+                               args->range->end_key,
+                               args->range->end_keylen, opt);
+    if (status != FDB_RESULT_SUCCESS) {
+        args->ok = false;
+        fdb_kvs_close(clone);
+        return NULL;
+    }
+    do {
+        status = fdb_iterator_get(it, &rdoc);
+        if (status != FDB_RESULT_SUCCESS) {
+            break;
+        }
+        memcpy(keybuf, rdoc->key, rdoc->keylen);
+        keybuf[rdoc->keylen] = 0;
+        num = atoi(keybuf + 3);
+        if (args->first < 0) {
+            args->first = num;
+        }
+        args->prev = num;
+        args->count++;
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+    } while (fdb_iterator_next(it) != FDB_RESULT_ITERATOR_FAIL);
+    fdb_iterator_close(it);
+    fdb_kvs_close(clone);
+    return NULL;
+}
+
+// scan the ranges in parallel, and check that the keys from 'first' to
+// 'last' (in the iteration order) are covered exactly once.
+static bool _iterator_split_verify(fdb_kvs_handle *snap, fdb_seqnum_t seqnum,
+                                   fdb_key_range *ranges, size_t num_ranges,
+                                   int first, int last, int *max_count)
+{
+    struct split_scan_args *args = alca(struct split_scan_args, num_ranges);
+    thread_t *tid = alca(thread_t, num_ranges);
+    void *ret;
+    int step = (last >= first) ? 1 : -1;
+    int expected = first;
+    size_t i;
+
+    for (i = 0; i < num_ranges; ++i) {
+        args[i].snap = snap;
+        args[i].seqnum = seqnum;
+        args[i].range = &ranges[i];
+        args[i].last = (i + 1 == num_ranges);
+        thread_create(&tid[i], _iterator_split_scan, &args[i]);
+    }
+    for (i = 0; i < num_ranges; ++i) {
+        thread_join(tid[i], &ret);
+    }
+
+    *max_count = 0;
+    for (i = 0; i < num_ranges; ++i) {
+        if (!args[i].ok) {
+            return false;
+        }
+        if (args[i].count == 0) {
+            continue;
+        }
+        // the keys are consecutive
+        if (args[i].first != expected ||
+            (args[i].prev - args[i].first) * step + 1 != args[i].count) {
+            return false;
+        }
+        expected = args[i].prev + step;
+        if (args[i].count > *max_count) {
+            *max_count = args[i].count;
+        }
+    }
+    return expected == last + step;
+}
+
+void iterator_split_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r, n = 20000, max_count;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db, *db_rev, *snap, *snap_rev;
+    fdb_key_range *ranges;
+    size_t num_ranges;
+    fdb_seqnum_t seqnum, seqnum_rev;
+    fdb_status status;
+    char keybuf[256], bodybuf[256];
+    char start[] = "key005000", end[] = "key014999";
+
+    r = system(SHELL_DEL" iterator_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.wal_threshold = 1024;
+    fconfig.compaction_threshold = 0;
+
+    fdb_open(&dbfile, "./iterator_test1", &fconfig);
+    fdb_kvs_open(dbfile, &db, "kv1", &kvs_config);
+    kvs_config.custom_cmp = _iterator_split_reverse_cmp;
+    fdb_kvs_open(dbfile, &db_rev, "kv_rev", &kvs_config);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d", i);
+        fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, strlen(bodybuf));
+        if (i % 4 == 0) {
+            sprintf(keybuf, "key%06d", i / 4);
+            fdb_set_kv(db_rev, keybuf, strlen(keybuf),
+                       bodybuf, strlen(bodybuf));
+        }
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+
+    fdb_get_kvs_seqnum(db, &seqnum);
+    status = fdb_snapshot_open(db, &snap, seqnum);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // invalid arguments
+    status = fdb_iterator_split(snap, NULL, 0, NULL, 0, 0,
+                                &ranges, &num_ranges);
+    TEST_CHK(status == FDB_RESULT_INVALID_ARGS);
+    status = fdb_iterator_split(snap, end, strlen(end), start, strlen(start),
+                                4, &ranges, &num_ranges);
+    TEST_CHK(status == FDB_RESULT_INVALID_ARGS);
+
+    // a single range is the whole range
+    status = fdb_iterator_split(snap, NULL, 0, NULL, 0, 1,
+                                &ranges, &num_ranges);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_ranges == 1);
+    TEST_CHK(ranges[0].start_key == NULL && ranges[0].end_key == NULL);
+    fdb_free_key_ranges(ranges, num_ranges);
+
+    // whole key space
+    status = fdb_iterator_split(snap, NULL, 0, NULL, 0, 8,
+                                &ranges, &num_ranges);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_ranges == 8);
+    TEST_CHK(ranges[0].start_key == NULL);
+    TEST_CHK(ranges[num_ranges-1].end_key == NULL);
+    TEST_CHK(_iterator_split_verify(snap, seqnum, ranges, num_ranges,
+                                    0, n-1, &max_count));
+    // roughly balanced
+    TEST_CHK(max_count < 2 * n / 8);
+    fdb_free_key_ranges(ranges, num_ranges);
+
+    // sub range
+    status = fdb_iterator_split(snap, start, strlen(start), end, strlen(end),
+                                4, &ranges, &num_ranges);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_ranges == 4);
+    TEST_CMP(ranges[0].start_key, start, ranges[0].start_keylen);
+    TEST_CMP(ranges[num_ranges-1].end_key, end,
+             ranges[num_ranges-1].end_keylen);
+    TEST_CHK(_iterator_split_verify(snap, seqnum, ranges, num_ranges,
+                                    5000, 14999, &max_count));
+    TEST_CHK(max_count < 2 * 10000 / 4);
+    fdb_free_key_ranges(ranges, num_ranges);
+
+    // a range with a few keys cannot be split into many sub ranges
+    sprintf(keybuf, "key%06d", 100);
+    sprintf(bodybuf, "key%06d", 102);
+    status = fdb_iterator_split(snap, keybuf, strlen(keybuf),
+                                bodybuf, strlen(bodybuf), 16,
+                                &ranges, &num_ranges);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_ranges >= 1 && num_ranges <= 3);
+    TEST_CHK(_iterator_split_verify(snap, seqnum, ranges, num_ranges,
+                                    100, 102, &max_count));
+    fdb_free_key_ranges(ranges, num_ranges);
+
+    // custom order
+    fdb_get_kvs_seqnum(db_rev, &seqnum_rev);
+    status = fdb_snapshot_open(db_rev, &snap_rev, seqnum_rev);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_iterator_split(snap_rev, NULL, 0, NULL, 0, 4,
+                                &ranges, &num_ranges);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_ranges > 1);
+    TEST_CHK(_iterator_split_verify(snap_rev, seqnum_rev, ranges, num_ranges,
+                                    n/4 - 1, 0, &max_count));
+    fdb_free_key_ranges(ranges, num_ranges);
+
+    fdb_kvs_close(snap_rev);
+    fdb_kvs_close(snap);
+    fdb_kvs_close(db_rev);
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    memleak_end();
+    TEST_RESULT("iterator split test");
+}
+
+void iterator_estimate_range_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r, n = 20000;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db, *db2, *db_empty;
+    fdb_kvs_info info;
+    fdb_key_range *ranges;
+    size_t num_ranges;
+    uint64_t num_docs, num_bytes, sum_docs;
+    fdb_status status;
+    char keybuf[256], bodybuf[256];
+    char start[] = "key005000", end[] = "key015000";
+
+    r = system(SHELL_DEL" iterator_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.wal_threshold = 1024;
+    fconfig.compaction_threshold = 0;
+
+    fdb_open(&dbfile, "./iterator_test1", &fconfig);
+    fdb_kvs_open(dbfile, &db, "kv1", &kvs_config);
+    fdb_kvs_open(dbfile, &db2, "kv2", &kvs_config);
+    fdb_kvs_open(dbfile, &db_empty, "kv_empty", &kvs_config);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d", i);
+        fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, strlen(bodybuf));
+        if (i % 4 == 0) {
+            // another KV store sharing the index
+            fdb_set_kv(db2, keybuf, strlen(keybuf),
+                       bodybuf, strlen(bodybuf));
+        }
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+
+    // invalid arguments
+    status = fdb_estimate_range(db, NULL, 0, NULL, 0, NULL, NULL);
+    TEST_CHK(status == FDB_RESULT_INVALID_ARGS);
+    status = fdb_estimate_range(db, end, strlen(end), start, strlen(start),
+                                &num_docs, NULL);
+    TEST_CHK(status == FDB_RESULT_INVALID_ARGS);
+
+    // the whole KV store
+    fdb_get_kvs_info(db, &info);
+    status = fdb_estimate_range(db, NULL, 0, NULL, 0, &num_docs, &num_bytes);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_docs == info.doc_count);
+    TEST_CHK(num_bytes == info.space_used);
+
+    // half of the keys
+    status = fdb_estimate_range(db, start, strlen(start), end, strlen(end),
+                                &num_docs, &num_bytes);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_docs > 10000 * 3 / 4 && num_docs < 10000 * 5 / 4);
+    TEST_CHK(num_bytes > info.space_used * 3 / 8 &&
+             num_bytes < info.space_used * 5 / 8);
+
+    // a few keys
+    sprintf(keybuf, "key%06d", 100);
+    sprintf(bodybuf, "key%06d", 103);
+    status = fdb_estimate_range(db, keybuf, strlen(keybuf),
+                                bodybuf, strlen(bodybuf), &num_docs, NULL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_docs < 100);
+
+    // no keys
+    status = fdb_estimate_range(db, "zzz", 3, NULL, 0, &num_docs, NULL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_docs < 100);
+    status = fdb_estimate_range(db_empty, NULL, 0, NULL, 0, &num_docs, NULL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_docs == 0);
+
+    // the other KV store is estimated independently
+    status = fdb_estimate_range(db2, start, strlen(start), end, strlen(end),
+                                &num_docs, NULL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_docs > 2500 * 3 / 4 && num_docs < 2500 * 5 / 4);
+
+    // key quantiles: each sub range holds about a quarter of the keys
+    status = fdb_iterator_split(db, NULL, 0, NULL, 0, 4,
+                                &ranges, &num_ranges);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(num_ranges == 4);
+    sum_docs = 0;
+    for (i = 0; i < (int)num_ranges; ++i) {
+        TEST_CHK(ranges[i].num_docs > n / 8 && ranges[i].num_docs < n / 2);
+        TEST_CHK(ranges[i].num_bytes > 0);
+        sum_docs += ranges[i].num_docs;
+    }
+    TEST_CHK(sum_docs + num_ranges >= (uint64_t)n &&
+             sum_docs <= (uint64_t)n + num_ranges);
+    fdb_free_key_ranges(ranges, num_ranges);
+
+    fdb_kvs_close(db_empty);
+    fdb_kvs_close(db2);
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    memleak_end();
+    TEST_RESULT("iterator estimate range test");
+}
+
+void iterator_next_batch_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r, n = 1000, expected;
+    size_t j, num_docs;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_iterator *it;
+    fdb_doc docs[64], *rdoc = NULL;
+    fdb_status status;
+    char keybuf[256], metabuf[256], bodybuf[256];
+    char *buf = (char *)malloc(4096);
+
+    r = system(SHELL_DEL" iterator_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.seqtree_opt = FDB_SEQTREE_USE;
+    fconfig.wal_threshold = 256;
+    fconfig.compaction_threshold = 0;
+
+    fdb_open(&dbfile, "./iterator_test1", &fconfig);
+    fdb_kvs_open(dbfile, &db, "kv1", &kvs_config);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(metabuf, "meta%d", i);
+        sprintf(bodybuf, "body%0*d", 10 + i % 50, i);
+        fdb_doc *doc;
+        fdb_doc_create(&doc, keybuf, strlen(keybuf), metabuf, strlen(metabuf),
+                       bodybuf, strlen(bodybuf));
+        fdb_set(db, doc);
+        fdb_doc_free(doc);
+    }
+    fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    // every 10th doc is deleted in WAL
+    for (i = 0; i < n; i += 10) {
+        sprintf(keybuf, "key%06d", i);
+        fdb_del_kv(db, keybuf, strlen(keybuf));
+    }
+    fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+
+    status = fdb_iterator_init(db, &it, NULL, 0, NULL, 0,
+                               FDB_ITR_NO_DELETES);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // too small buffer
+    status = fdb_iterator_next_batch(it, docs, 64, buf, 8, &num_docs);
+    TEST_CHK(status == FDB_RESULT_ENOBUFS);
+    TEST_CHK(num_docs == 0);
+
+    expected = 1;
+    while (true) {
+        status = fdb_iterator_next_batch(it, docs, 64, buf, 4096, &num_docs);
+        if (status != FDB_RESULT_SUCCESS) {
+            break;
+        }
+        TEST_CHK(num_docs > 0 && num_docs <= 64);
+        for (j = 0; j < num_docs; ++j) {
+            if (expected % 10 == 0) {
+                ++expected;
+            }
+            sprintf(keybuf, "key%06d", expected);
+            sprintf(metabuf, "meta%d", expected);
+            sprintf(bodybuf, "body%0*d", 10 + expected % 50, expected);
+            TEST_CHK(docs[j].keylen == strlen(keybuf));
+            TEST_CMP(docs[j].key, keybuf, docs[j].keylen);
+            TEST_CHK(docs[j].metalen == strlen(metabuf));
+            TEST_CMP(docs[j].meta, metabuf, docs[j].metalen);
+            TEST_CHK(docs[j].bodylen == strlen(bodybuf));
+            TEST_CMP(docs[j].body, bodybuf, docs[j].bodylen);
+            TEST_CHK(!docs[j].deleted);
+            ++expected;
+        }
+        if (expected == 301) {
+            // the iterator points to the next doc
+            status = fdb_iterator_get(it, &rdoc);
+            TEST_CHK(status == FDB_RESULT_SUCCESS);
+            TEST_CMP(rdoc->key, "key000301", rdoc->keylen);
+            fdb_doc_free(rdoc);
+            rdoc = NULL;
+        }
+        // mix with the single step API
+        if (expected == 501) {
+            status = fdb_iterator_next(it);
+            TEST_CHK(status == FDB_RESULT_SUCCESS);
+            expected = 502;
+        }
+    }
+    TEST_CHK(status == FDB_RESULT_ITERATOR_FAIL);
+    TEST_CHK(expected == n);
+    fdb_iterator_close(it);
+
+    // sequence iterator returns the same docs as the single step API
+    status = fdb_iterator_sequence_init(db, &it, 0, 0, FDB_ITR_NONE);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    expected = 0;
+    do {
+        if (fdb_iterator_get(it, &rdoc) == FDB_RESULT_SUCCESS) {
+            ++expected;
+            fdb_doc_free(rdoc);
+            rdoc = NULL;
+        }
+    } while (fdb_iterator_next(it) == FDB_RESULT_SUCCESS);
+    fdb_iterator_close(it);
+
+    status = fdb_iterator_sequence_init(db, &it, 0, 0, FDB_ITR_NONE);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    while (fdb_iterator_next_batch(it, docs, 64, buf, 4096,
+                                   &num_docs) == FDB_RESULT_SUCCESS) {
+        for (j = 0; j < num_docs; ++j) {
+            TEST_CHK(docs[j].seqnum > 0);
+            --expected;
+        }
+    }
+    TEST_CHK(expected == 0);
+    fdb_iterator_close(it);
+
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+    free(buf);
+
+    memleak_end();
+    TEST_RESULT("iterator next batch test");
+}
+
+struct filter_test_ctx {
+    int calls;
+    int accepted;
+};
+
+static fdb_filter_decision _filter_test_cb(fdb_kvs_handle *handle,
+                                           fdb_doc *doc, void *ctx)
+{
+    struct filter_test_ctx *fctx = (struct filter_test_ctx *)ctx;
+    (void)handle;
+    fctx->calls++;
+    // only the value should not be read
+    if (doc->body || !doc->keylen || !doc->metalen || !doc->bodylen) {
+        return FDB_FILTER_SKIP;
+    }
+    // meta "m<i>:<flag>", accept the docs with flag 1
+    if (((char *)doc->meta)[doc->metalen - 1] == '1') {
+        fctx->accepted++;
+        return FDB_FILTER_ACCEPT;
+    }
+    return FDB_FILTER_SKIP;
+}
+
+struct changes_filter_test_ctx {
+    struct filter_test_ctx filter;
+    int count;
+};
+
+static fdb_filter_decision _filter_test_changes_filter(fdb_kvs_handle *handle,
+                                                       fdb_doc *doc,
+                                                       void *ctx)
+{
+    struct changes_filter_test_ctx *cctx =
+        (struct changes_filter_test_ctx *)ctx;
+    return _filter_test_cb(handle, doc, &cctx->filter);
+}
+
+static int _filter_test_changes_cb(fdb_kvs_handle *handle,
+                                   fdb_doc *doc, void *ctx)
+{
+    struct changes_filter_test_ctx *cctx =
+        (struct changes_filter_test_ctx *)ctx;
+    char keybuf[256], bodybuf[256];
+    int i = (int)doc->seqnum - 1;
+    (void)handle;
+
+    sprintf(keybuf, "key%06d", i);
+    sprintf(bodybuf, "body%04d%060d", i, i);
+    if (i % 10 != 3 || doc->keylen != strlen(keybuf) ||
+        memcmp(doc->key, keybuf, doc->keylen) ||
+        doc->bodylen != 8 || memcmp(doc->body, bodybuf + 4, 8)) {
+        return FDB_CHANGES_CANCEL;
+    }
+    cctx->count++;
+    return FDB_CHANGES_CLEAN;
+}
+
+void iterator_filter_projection_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r, n = 1000, count;
+    size_t j, num_docs;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_iterator *it;
+    fdb_doc *doc, *rdoc = NULL, docs[64];
+    fdb_status status;
+    fdb_iterator_projection proj;
+    struct filter_test_ctx fctx;
+    struct changes_filter_test_ctx cctx;
+    char keybuf[256], metabuf[256], bodybuf[256];
+    char *buf = (char *)malloc(4096);
+
+    r = system(SHELL_DEL" iterator_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.seqtree_opt = FDB_SEQTREE_USE;
+    fconfig.wal_threshold = 1024;
+    fconfig.compaction_threshold = 0;
+
+    fdb_open(&dbfile, "./iterator_test1", &fconfig);
+    fdb_kvs_open(dbfile, &db, "kv1", &kvs_config);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(metabuf, "m%d:%d", i, (i % 10 == 3) ? 1 : 0);
+        sprintf(bodybuf, "body%04d%060d", i, i);
+        fdb_doc_create(&doc, keybuf, strlen(keybuf), metabuf, strlen(metabuf),
+                       bodybuf, strlen(bodybuf));
+        fdb_set(db, doc);
+        fdb_doc_free(doc);
+        if (i == n / 2) {
+            // the first half in HB+trie, the other half in WAL
+            fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        }
+    }
+    fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+
+    // forward iteration with the filter
+    memset(&fctx, 0, sizeof(fctx));
+    status = fdb_iterator_init(db, &it, NULL, 0, NULL, 0, FDB_ITR_NONE);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    // the current doc (key000000) is skipped
+    status = fdb_iterator_set_filter(it, _filter_test_cb, &fctx);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    count = 0;
+    do {
+        status = fdb_iterator_get(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        sprintf(keybuf, "key%06d", count * 10 + 3);
+        sprintf(bodybuf, "body%04d%060d", count * 10 + 3, count * 10 + 3);
+        TEST_CMP(rdoc->key, keybuf, rdoc->keylen);
+        TEST_CHK(rdoc->bodylen == strlen(bodybuf));
+        TEST_CMP(rdoc->body, bodybuf, rdoc->bodylen);
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        ++count;
+    } while (fdb_iterator_next(it) == FDB_RESULT_SUCCESS);
+    TEST_CHK(count == n / 10);
+    TEST_CHK(fctx.accepted == n / 10);
+    TEST_CHK(fctx.calls >= n);
+
+    // seek lands on the next accepted doc in the seek direction
+    status = fdb_iterator_seek(it, "key000500", 9, FDB_ITR_SEEK_HIGHER);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_iterator_get(it, &rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(rdoc->key, "key000503", rdoc->keylen);
+    fdb_doc_free(rdoc);
+    rdoc = NULL;
+    status = fdb_iterator_seek(it, "key000500", 9, FDB_ITR_SEEK_LOWER);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_iterator_get(it, &rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(rdoc->key, "key000493", rdoc->keylen);
+    fdb_doc_free(rdoc);
+    rdoc = NULL;
+    status = fdb_iterator_prev(it);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_iterator_get(it, &rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(rdoc->key, "key000483", rdoc->keylen);
+    fdb_doc_free(rdoc);
+    rdoc = NULL;
+    status = fdb_iterator_seek_to_max(it);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_iterator_get(it, &rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(rdoc->key, "key000993", rdoc->keylen);
+    fdb_doc_free(rdoc);
+    rdoc = NULL;
+
+    // projection of a body range
+    proj.mode = FDB_PROJECT_BODY_RANGE;
+    proj.body_offset = 4;
+    proj.body_length = 8;
+    status = fdb_iterator_set_projection(it, &proj);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_iterator_seek_to_min(it);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_iterator_get(it, &rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(rdoc->key, "key000003", rdoc->keylen);
+    TEST_CHK(rdoc->bodylen == 8);
+    TEST_CMP(rdoc->body, "0003000000", rdoc->bodylen);
+    fdb_doc_free(rdoc);
+    rdoc = NULL;
+
+    // range beyond the end of the body
+    proj.body_offset = 66;
+    proj.body_length = 100;
+    fdb_iterator_set_projection(it, &proj);
+    status = fdb_iterator_get(it, &rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(rdoc->bodylen == 2);
+    TEST_CMP(rdoc->body, "03", rdoc->bodylen);
+    fdb_doc_free(rdoc);
+    rdoc = NULL;
+    proj.body_offset = 100;
+    fdb_iterator_set_projection(it, &proj);
+    status = fdb_iterator_get(it, &rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(rdoc->bodylen == 0);
+    fdb_doc_free(rdoc);
+    rdoc = NULL;
+
+    if (sizeof(size_t) > sizeof(uint32_t)) {
+        // offsets and lengths wider than 32 bits are not truncated
+        proj.body_offset = (size_t)(((uint64_t)1 << 32) + 4);
+        proj.body_length = 8;
+        fdb_iterator_set_projection(it, &proj);
+        status = fdb_iterator_get(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        TEST_CHK(rdoc->bodylen == 0);
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        proj.body_offset = 4;
+        proj.body_length = (size_t)(((uint64_t)1 << 32) + 2);
+        fdb_iterator_set_projection(it, &proj);
+        status = fdb_iterator_get(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        sprintf(bodybuf, "body%04d%060d", 3, 3);
+        TEST_CHK(rdoc->bodylen == 64);
+        TEST_CMP(rdoc->body, bodybuf + 4, rdoc->bodylen);
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        status = fdb_iterator_next_batch(it, docs, 64, buf, 4096, &num_docs);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        for (j = 0; j < num_docs; ++j) {
+            i = j * 10 + 3;
+            sprintf(bodybuf, "body%04d%060d", i, i);
+            TEST_CHK(docs[j].bodylen == 64);
+            TEST_CMP(docs[j].body, bodybuf + 4, docs[j].bodylen);
+        }
+        fdb_iterator_seek_to_min(it);
+    }
+
+    // meta only
+    proj.mode = FDB_PROJECT_META_ONLY;
+    fdb_iterator_set_projection(it, &proj);
+    status = fdb_iterator_get(it, &rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(rdoc->meta, "m3:1", rdoc->metalen);
+    TEST_CHK(rdoc->body == NULL);
+    fdb_doc_free(rdoc);
+    rdoc = NULL;
+
+    // batch read with the filter and the projection
+    proj.mode = FDB_PROJECT_BODY_RANGE;
+    proj.body_offset = 4;
+    proj.body_length = 8;
+    fdb_iterator_set_projection(it, &proj);
+    count = 0;
+    while (fdb_iterator_next_batch(it, docs, 64, buf, 4096,
+                                   &num_docs) == FDB_RESULT_SUCCESS) {
+        for (j = 0; j < num_docs; ++j) {
+            i = count * 10 + 3;
+            sprintf(keybuf, "key%06d", i);
+            sprintf(bodybuf, "body%04d%060d", i, i);
+            TEST_CMP(docs[j].key, keybuf, docs[j].keylen);
+            TEST_CHK(docs[j].bodylen == 8);
+            TEST_CMP(docs[j].body, bodybuf + 4, docs[j].bodylen);
+            ++count;
+        }
+    }
+    TEST_CHK(count == n / 10);
+
+    // removing the filter and the projection
+    fdb_iterator_set_filter(it, NULL, NULL);
+    fdb_iterator_set_projection(it, NULL);
+    status = fdb_iterator_seek_to_min(it);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_iterator_get(it, &rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(rdoc->key, "key000000", rdoc->keylen);
+    TEST_CHK(rdoc->bodylen == 68);
+    fdb_doc_free(rdoc);
+    rdoc = NULL;
+    fdb_iterator_close(it);
+
+    // sequence iterator with the filter
+    memset(&fctx, 0, sizeof(fctx));
+    status = fdb_iterator_sequence_init(db, &it, 0, 0, FDB_ITR_NONE);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_iterator_set_filter(it, _filter_test_cb, &fctx);
+    count = 0;
+    do {
+        status = fdb_iterator_get_metaonly(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        TEST_CHK(rdoc->seqnum == (fdb_seqnum_t)(count * 10 + 4));
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        ++count;
+    } while (fdb_iterator_next(it) == FDB_RESULT_SUCCESS);
+    TEST_CHK(count == n / 10);
+    fdb_iterator_close(it);
+
+    // changes feed with the filter and the projection
+    memset(&cctx, 0, sizeof(cctx));
+    status = fdb_changes_since_filtered(db, 0, FDB_ITR_NONE,
+                                        _filter_test_changes_filter, &proj,
+                                        _filter_test_changes_cb, &cctx);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(cctx.count == n / 10);
+    TEST_CHK(cctx.filter.accepted == n / 10);
+
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+    free(buf);
+
+    memleak_end();
+    TEST_RESULT("iterator filter and projection test");
+}
+
 int main(){
     iterator_test();
     iterator_with_concurrent_updates_test();
@@ -4263,5 +5268,10 @@ int main(){
     iterator_init_using_substring_test();
     iterator_seek_to_max_key_with_deletes_test();
     iterator_seek_to_min_key_with_deletes_test();
+    iterator_readahead_test();
+    iterator_split_test();
+    iterator_estimate_range_test();
+    iterator_next_batch_test();
+    iterator_filter_projection_test();
     return 0;
 }
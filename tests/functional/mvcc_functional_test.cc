@@ -20,6 +20,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
+#include <ctype.h>
 #include<mutex>
 #if !defined(WIN32) && !defined(_WIN32)
 #include <unistd.h>
@@ -353,6 +354,147 @@ void crash_recovery_test(bool walflush)
     }
 }
 
+void crash_recovery_long_tail_test()
+{
+    TEST_INIT();
+
+    memleak_start();
+
+    int i, r;
+    int n = 3000;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_doc *rdoc;
+    fdb_file_info file_info;
+    fdb_kvs_info kvs_info;
+    uint64_t hdr_bid;
+    FILE *fp;
+    const char *test_file = "./mvcc_test1";
+    fdb_status status;
+
+    char keybuf[256], bodybuf[1024];
+
+    // remove previous mvcc_test files
+    r = system(SHELL_DEL" mvcc_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.wal_threshold = 8192;
+    fconfig.compaction_threshold = 0;
+
+    fdb_open(&dbfile, test_file, &fconfig);
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+
+    // the first version of documents is reflected in the index
+    memset(bodybuf, 'a', 512);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d_v1", i);
+        bodybuf[strlen(bodybuf)] = 'a';
+        fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, 512);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // the second version stays in the WAL section spanning hundreds of blocks
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d_v2", i);
+        bodybuf[strlen(bodybuf)] = 'a';
+        fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, 512);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    status = fdb_get_file_info(dbfile, &file_info);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(file_info.file_size > 256 * fconfig.blocksize);
+    // the last block is the DB header of the last commit
+    hdr_bid = file_info.file_size / fconfig.blocksize - 1;
+
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    // simulate a crash that left many blocks after the last header, so that
+    // the header search has to go through several chunks of blocks.
+    fp = fopen(test_file, "ab");
+    TEST_CHK(fp != NULL);
+    memset(bodybuf, 0, sizeof(bodybuf));
+    for (i = 0; i < 200 * 4; ++i) {
+        TEST_CHK(fwrite(bodybuf, 1, fconfig.blocksize / 4, fp) ==
+                 fconfig.blocksize / 4);
+    }
+    // and a non block-aligned tail
+    TEST_CHK(fwrite(bodybuf, 1, 100, fp) == 100);
+    fclose(fp);
+
+    status = fdb_open(&dbfile, test_file, &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    status = fdb_get_kvs_info(db, &kvs_info);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(kvs_info.last_seqnum == (fdb_seqnum_t)n * 2);
+
+    // every document is restored with its latest version
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d_v2", i);
+        fdb_doc_create(&rdoc, keybuf, strlen(keybuf), NULL, 0, NULL, 0);
+        status = fdb_get(db, rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        TEST_CHK(rdoc->bodylen == 512);
+        TEST_CMP(rdoc->body, bodybuf, strlen(bodybuf));
+        fdb_doc_free(rdoc);
+    }
+
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    // corrupt the last DB header, so that the header search goes backward
+    // through the WAL section down to the header of the previous commit.
+    fp = fopen(test_file, "r+b");
+    TEST_CHK(fp != NULL);
+    fseek(fp, (hdr_bid + 1) * fconfig.blocksize - 1, SEEK_SET);
+    TEST_CHK(fwrite(bodybuf, 1, 1, fp) == 1);
+    fclose(fp);
+
+    status = fdb_open(&dbfile, test_file, &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    status = fdb_get_kvs_info(db, &kvs_info);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(kvs_info.last_seqnum == (fdb_seqnum_t)n);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%06d_v1", i);
+        fdb_doc_create(&rdoc, keybuf, strlen(keybuf), NULL, 0, NULL, 0);
+        status = fdb_get(db, rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        TEST_CMP(rdoc->body, bodybuf, strlen(bodybuf));
+        fdb_doc_free(rdoc);
+    }
+
+    // the file is writable again
+    sprintf(keybuf, "key%06d", n);
+    fdb_set_kv(db, keybuf, strlen(keybuf), (void*)"new", 3);
+    status = fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    fdb_kvs_close(db);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    memleak_end();
+    TEST_RESULT("crash recovery long tail test");
+}
+
 void snapshot_test()
 {
     TEST_INIT();
@@ -1229,6 +1371,164 @@ void in_memory_snapshot_cleanup_test()
     TEST_RESULT("in-memory snapshot cleanup test");
 }
 
+/*
+ * Open a number of in-memory snapshots interleaved with updates, so that
+ * each snapshot shares WAL items with all its previous snapshots, and verify
+ * that they keep their own versions while other snapshots are closed and
+ * the WAL is flushed.
+ */
+static void _check_snapshot_generation(fdb_kvs_handle *snap, int gen,
+                                       int nkeys, bool iterate)
+{
+    TEST_INIT();
+    int i, latest;
+    char keybuf[32], bodybuf[32];
+    void *value;
+    size_t valuelen;
+    fdb_status status;
+
+    for (i = 0; i < nkeys; ++i) {
+        sprintf(keybuf, "key%04d", i);
+        status = fdb_get_kv(snap, keybuf, strlen(keybuf), &value, &valuelen);
+        if (i > gen) {
+            TEST_CHK(status == FDB_RESULT_KEY_NOT_FOUND);
+            continue;
+        }
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        latest = gen - ((gen - i) % nkeys);
+        sprintf(bodybuf, "body%d", latest);
+        TEST_CHK(valuelen == strlen(bodybuf));
+        TEST_CMP(value, bodybuf, valuelen);
+        fdb_free_block(value);
+    }
+
+    if (iterate) {
+        fdb_iterator *it;
+        fdb_doc *rdoc = NULL;
+        int count = 0;
+        status = fdb_iterator_init(snap, &it, NULL, 0, NULL, 0, FDB_ITR_NONE);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        do {
+            status = fdb_iterator_get(it, &rdoc);
+            TEST_CHK(status == FDB_RESULT_SUCCESS);
+            latest = gen - ((gen - count) % nkeys);
+            sprintf(bodybuf, "body%d", latest);
+            TEST_CMP(rdoc->body, bodybuf, rdoc->bodylen);
+            fdb_doc_free(rdoc);
+            rdoc = NULL;
+            count++;
+        } while (fdb_iterator_next(it) == FDB_RESULT_SUCCESS);
+        fdb_iterator_close(it);
+        TEST_CHK(count == (gen + 1 < nkeys ? gen + 1 : nkeys));
+    }
+}
+
+void in_memory_snapshot_generations_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r;
+    int nkeys = 16, nsnaps = 256;
+    char keybuf[32], bodybuf[32];
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_kvs_handle *snaps[256], *clone;
+    fdb_status status;
+
+    r = system(SHELL_DEL" mvcc_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.wal_threshold = 4096;
+    fconfig.flags = FDB_OPEN_FLAG_CREATE;
+    fconfig.compaction_threshold = 0;
+
+    status = fdb_open(&dbfile, "./mvcc_test1", &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_kvs_open(dbfile, &db, "db", &kvs_config);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // each snapshot becomes a new WAL snapshot generation
+    for (i = 0; i < nsnaps; ++i) {
+        sprintf(keybuf, "key%04d", i % nkeys);
+        sprintf(bodybuf, "body%d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, strlen(bodybuf));
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        status = fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        status = fdb_snapshot_open(db, &snaps[i], FDB_SNAPSHOT_INMEM);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+    }
+
+    for (i = 0; i < nsnaps; ++i) {
+        _check_snapshot_generation(snaps[i], i, nkeys, i % 64 == 0);
+    }
+
+    // a clone shares the generation of its source
+    status = fdb_snapshot_open(snaps[100], &clone, FDB_SNAPSHOT_INMEM);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // close the odd snapshots (including the source of the clone)
+    for (i = nsnaps - 1; i >= 0; --i) {
+        if (i % 2 || i == 100) {
+            status = fdb_kvs_close(snaps[i]);
+            TEST_CHK(status == FDB_RESULT_SUCCESS);
+            snaps[i] = NULL;
+        }
+    }
+
+    // overwrite all keys, so that unreferenced versions are de-duplicated
+    for (i = nsnaps; i < nsnaps + nkeys; ++i) {
+        sprintf(keybuf, "key%04d", i % nkeys);
+        sprintf(bodybuf, "body%d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, strlen(bodybuf));
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    _check_snapshot_generation(clone, 100, nkeys, true);
+    for (i = 0; i < nsnaps; ++i) {
+        if (snaps[i]) {
+            _check_snapshot_generation(snaps[i], i, nkeys, i % 64 == 0);
+        }
+    }
+
+    // WAL flush should not release the items shared by open snapshots
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    _check_snapshot_generation(clone, 100, nkeys, true);
+    for (i = 0; i < nsnaps; ++i) {
+        if (snaps[i]) {
+            _check_snapshot_generation(snaps[i], i, nkeys, i % 64 == 0);
+            status = fdb_kvs_close(snaps[i]);
+            TEST_CHK(status == FDB_RESULT_SUCCESS);
+        }
+    }
+    status = fdb_kvs_close(clone);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // the remaining items are released by the next WAL flush
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    _check_snapshot_generation(db, nsnaps + nkeys - 1, nkeys, false);
+
+    status = fdb_kvs_close(db);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_close(dbfile);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_shutdown();
+
+    memleak_end();
+    TEST_RESULT("in-memory snapshot generations test");
+}
+
 void in_memory_snapshot_on_dirty_hbtrie_test()
 {
     TEST_INIT();
@@ -3493,6 +3793,411 @@ void transaction_simple_api_test()
     TEST_RESULT("transaction simple API test");
 }
 
+static void _txn_check_value(fdb_kvs_handle *kv, const char *key,
+                             const char *expected)
+{
+    TEST_INIT();
+    void *value;
+    size_t valuelen;
+    fdb_status status;
+
+    status = fdb_get_kv(kv, (void *)key, strlen(key), &value, &valuelen);
+    if (!expected) {
+        TEST_CHK(status == FDB_RESULT_KEY_NOT_FOUND);
+        return;
+    }
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(valuelen == strlen(expected));
+    TEST_CMP(value, expected, valuelen);
+    fdb_free_block(value);
+}
+
+// case-insensitive custom compare function
+static int _txn_cmp_nocase(void *key1, size_t keylen1,
+                           void *key2, size_t keylen2)
+{
+    size_t i, len = (keylen1 < keylen2) ? keylen1 : keylen2;
+    for (i = 0; i < len; ++i) {
+        int c1 = tolower(((uint8_t *)key1)[i]);
+        int c2 = tolower(((uint8_t *)key2)[i]);
+        if (c1 != c2) {
+            return c1 - c2;
+        }
+    }
+    return (int)keylen1 - (int)keylen2;
+}
+
+void transaction_optimistic_conflict_test()
+{
+    TEST_INIT();
+
+    memleak_start();
+
+    int r;
+    fdb_file_handle *dbfile1, *dbfile2;
+    fdb_kvs_handle *a1, *b1, *a2, *b2;
+    fdb_status status;
+
+    // remove previous mvcc_test files
+    r = system(SHELL_DEL" mvcc_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.wal_threshold = 1024;
+    fconfig.flags = FDB_OPEN_FLAG_CREATE;
+    fconfig.compaction_threshold = 0;
+    fconfig.seqtree_opt = FDB_SEQTREE_USE;
+
+    // two writers, each updating two KV stores
+    status = fdb_open(&dbfile1, "./mvcc_test1", &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_open(&dbfile2, "./mvcc_test1", &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_kvs_open(dbfile1, &a1, "a", &kvs_config);
+    fdb_kvs_open(dbfile1, &b1, "b", &kvs_config);
+    fdb_kvs_open(dbfile2, &a2, "a", &kvs_config);
+    fdb_kvs_open(dbfile2, &b2, "b", &kvs_config);
+
+    fdb_set_kv(a1, (void *)"k1", 2, (void *)"v1", 2);
+    fdb_set_kv(a1, (void *)"k2", 2, (void *)"v2", 2);
+    fdb_set_kv(b1, (void *)"k3", 2, (void *)"v3", 2);
+    status = fdb_commit(dbfile1, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    // read-write conflict across KV stores
+    status = fdb_begin_transaction(dbfile1, FDB_ISOLATION_OPTIMISTIC);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_begin_transaction(dbfile2, FDB_ISOLATION_OPTIMISTIC);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    _txn_check_value(a1, "k1", "v1");
+    fdb_set_kv(b1, (void *)"k3", 2, (void *)"v3_txn1", 7);
+    fdb_set_kv(a2, (void *)"k1", 2, (void *)"v1_txn2", 7);
+    status = fdb_end_transaction(dbfile2, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_end_transaction(dbfile1, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_TRANSACTION_CONFLICT);
+    // the conflicting transaction is aborted
+    _txn_check_value(b1, "k3", "v3");
+    _txn_check_value(b2, "k3", "v3");
+
+    // retry
+    status = fdb_begin_transaction(dbfile1, FDB_ISOLATION_OPTIMISTIC);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    _txn_check_value(a1, "k1", "v1_txn2");
+    fdb_set_kv(b1, (void *)"k3", 2, (void *)"v3_txn1", 7);
+    // own updates are not conflicts
+    _txn_check_value(b1, "k3", "v3_txn1");
+    status = fdb_end_transaction(dbfile1, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    _txn_check_value(b2, "k3", "v3_txn1");
+
+    // write-write conflict on a blind write
+    fdb_begin_transaction(dbfile1, FDB_ISOLATION_OPTIMISTIC);
+    fdb_begin_transaction(dbfile2, FDB_ISOLATION_OPTIMISTIC);
+    fdb_set_kv(a1, (void *)"k2", 2, (void *)"v2_txn1", 7);
+    fdb_set_kv(a2, (void *)"k2", 2, (void *)"v2_txn2", 7);
+    status = fdb_end_transaction(dbfile2, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_end_transaction(dbfile1, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_TRANSACTION_CONFLICT);
+    _txn_check_value(a1, "k2", "v2_txn2");
+
+    // disjoint key sets do not conflict
+    fdb_begin_transaction(dbfile1, FDB_ISOLATION_OPTIMISTIC);
+    fdb_begin_transaction(dbfile2, FDB_ISOLATION_OPTIMISTIC);
+    _txn_check_value(a1, "k4", NULL);
+    fdb_set_kv(a1, (void *)"k4", 2, (void *)"v4", 2);
+    fdb_set_kv(b2, (void *)"k5", 2, (void *)"v5", 2);
+    status = fdb_end_transaction(dbfile2, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_end_transaction(dbfile1, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    _txn_check_value(a2, "k4", "v4");
+    _txn_check_value(b1, "k5", "v5");
+
+    // a missing key inserted by a non-transactional writer, validated
+    // after the WAL has been flushed into the main index
+    fdb_begin_transaction(dbfile1, FDB_ISOLATION_OPTIMISTIC);
+    _txn_check_value(a1, "k6", NULL);
+    _txn_check_value(a1, "k1", "v1_txn2");
+    fdb_set_kv(a2, (void *)"k6", 2, (void *)"v6", 2);
+    status = fdb_commit(dbfile2, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_end_transaction(dbfile1, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_TRANSACTION_CONFLICT);
+
+    // unrelated WAL flush does not cause a conflict
+    fdb_begin_transaction(dbfile1, FDB_ISOLATION_OPTIMISTIC);
+    _txn_check_value(a1, "k1", "v1_txn2");
+    _txn_check_value(b1, "k5", "v5");
+    fdb_del_kv(a1, (void *)"k2", 2);
+    fdb_set_kv(a2, (void *)"k7", 2, (void *)"v7", 2);
+    status = fdb_commit(dbfile2, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_end_transaction(dbfile1, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    _txn_check_value(a2, "k2", NULL);
+
+    // reads by sequence number are validated as well
+    fdb_doc *rdoc;
+    fdb_doc_create(&rdoc, "k1", 2, NULL, 0, NULL, 0);
+    status = fdb_get_metaonly(a2, rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_seqnum_t k1_seqnum = rdoc->seqnum;
+    fdb_doc_free(rdoc);
+    fdb_begin_transaction(dbfile1, FDB_ISOLATION_OPTIMISTIC);
+    fdb_doc_create(&rdoc, NULL, 0, NULL, 0, NULL, 0);
+    rdoc->seqnum = k1_seqnum;
+    status = fdb_get_byseq(a1, rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(rdoc->key, "k1", 2);
+    fdb_doc_free(rdoc);
+    fdb_set_kv(b1, (void *)"k3", 2, (void *)"v3_seq", 6);
+    fdb_set_kv(a2, (void *)"k1", 2, (void *)"v1_seq", 6);
+    status = fdb_commit(dbfile2, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_end_transaction(dbfile1, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_TRANSACTION_CONFLICT);
+    _txn_check_value(b2, "k3", "v3_txn1");
+
+    // and so are pinned reads
+    fdb_pinned_doc pdoc;
+    fdb_begin_transaction(dbfile1, FDB_ISOLATION_OPTIMISTIC);
+    status = fdb_get_pinned(a1, "k1", 2, &pdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(pdoc.body, "v1_seq", 6);
+    fdb_release(&pdoc);
+    fdb_set_kv(b1, (void *)"k3", 2, (void *)"v3_pin", 6);
+    fdb_set_kv(a2, (void *)"k1", 2, (void *)"v1_pin", 6);
+    status = fdb_commit(dbfile2, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_end_transaction(dbfile1, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_TRANSACTION_CONFLICT);
+    _txn_check_value(b2, "k3", "v3_txn1");
+
+    // read committed transactions are not validated
+    fdb_begin_transaction(dbfile1, FDB_ISOLATION_READ_COMMITTED);
+    _txn_check_value(a1, "k1", "v1_pin");
+    fdb_set_kv(b1, (void *)"k3", 2, (void *)"v3_rc", 5);
+    fdb_set_kv(a2, (void *)"k1", 2, (void *)"v1_rc", 5);
+    fdb_commit(dbfile2, FDB_COMMIT_NORMAL);
+    status = fdb_end_transaction(dbfile1, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+
+    fdb_close(dbfile1);
+    fdb_close(dbfile2);
+    fdb_shutdown();
+
+    memleak_end();
+
+    TEST_RESULT("transaction optimistic conflict test");
+}
+
+void transaction_write_buffer_test()
+{
+    TEST_INIT();
+
+    memleak_start();
+
+    int i, r, count;
+    int n = 100;
+    char keybuf[256], bodybuf[256];
+    fdb_file_handle *dbfile, *dbfile_txn;
+    fdb_kvs_handle *db, *db_txn;
+    fdb_iterator *it;
+    fdb_doc *rdoc = NULL;
+    fdb_pinned_doc pdoc;
+    fdb_file_info info;
+    uint64_t file_size;
+    fdb_seqnum_t seqnum;
+    fdb_status status;
+
+    // remove previous mvcc_test files
+    r = system(SHELL_DEL" mvcc_test* > errorlog.txt");
+    (void)r;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fconfig.wal_threshold = 1024;
+    fconfig.flags = FDB_OPEN_FLAG_CREATE;
+    fconfig.compaction_threshold = 0;
+    fconfig.txn_buffer_size = 4096;
+    fconfig.seqtree_opt = FDB_SEQTREE_USE;
+
+    status = fdb_open(&dbfile, "./mvcc_test1", &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_open(&dbfile_txn, "./mvcc_test1", &fconfig);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_kvs_open(dbfile, &db, "db", &kvs_config);
+    fdb_kvs_open(dbfile_txn, &db_txn, "db", &kvs_config);
+
+    fdb_set_kv(db, (void *)"key0", 4, (void *)"body0", 5);
+    status = fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_get_file_info(dbfile, &info);
+    file_size = info.file_size;
+
+    // small transaction: nothing is written until it is committed
+    status = fdb_begin_transaction(dbfile_txn, FDB_ISOLATION_READ_COMMITTED);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    for (i = 0; i < 10; ++i) {
+        sprintf(keybuf, "key%d", i);
+        sprintf(bodybuf, "body%d_txn", i);
+        status = fdb_set_kv(db_txn, keybuf, strlen(keybuf),
+                            bodybuf, strlen(bodybuf));
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+    }
+    fdb_del_kv(db_txn, (void *)"key1", 4);
+    fdb_get_file_info(dbfile, &info);
+    TEST_CHK(info.file_size == file_size);
+
+    // the transaction sees its own updates, the others do not
+    _txn_check_value(db_txn, "key0", "body0_txn");
+    _txn_check_value(db_txn, "key1", NULL);
+    _txn_check_value(db_txn, "key2", "body2_txn");
+    _txn_check_value(db, "key0", "body0");
+    _txn_check_value(db, "key2", NULL);
+    status = fdb_doc_create(&rdoc, "key3", 4, NULL, 0, NULL, 0);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    status = fdb_get_metaonly(db_txn, rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(rdoc->bodylen == strlen("body3_txn"));
+    fdb_doc_free(rdoc);
+    rdoc = NULL;
+    status = fdb_get_pinned(db_txn, "key2", 4, &pdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CHK(pdoc.pinned_block == NULL);
+    TEST_CMP(pdoc.body, "body2_txn", pdoc.bodylen);
+    fdb_release(&pdoc);
+    status = fdb_get_pinned(db_txn, "key1", 4, &pdoc);
+    TEST_CHK(status == FDB_RESULT_KEY_NOT_FOUND);
+    status = fdb_get_pinned(db, "key2", 4, &pdoc);
+    TEST_CHK(status == FDB_RESULT_KEY_NOT_FOUND);
+
+    // aborted updates leave nothing behind
+    status = fdb_abort_transaction(dbfile_txn);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    fdb_get_file_info(dbfile, &info);
+    TEST_CHK(info.file_size == file_size);
+    _txn_check_value(db_txn, "key0", "body0");
+    _txn_check_value(db_txn, "key2", NULL);
+
+    // committed updates
+    fdb_begin_transaction(dbfile_txn, FDB_ISOLATION_READ_COMMITTED);
+    for (i = 0; i < 10; ++i) {
+        sprintf(keybuf, "key%d", i);
+        sprintf(bodybuf, "body%d_txn", i);
+        fdb_set_kv(db_txn, keybuf, strlen(keybuf), bodybuf, strlen(bodybuf));
+    }
+    fdb_del_kv(db_txn, (void *)"key1", 4);
+    status = fdb_end_transaction(dbfile_txn, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    _txn_check_value(db, "key0", "body0_txn");
+    _txn_check_value(db, "key1", NULL);
+    _txn_check_value(db, "key9", "body9_txn");
+
+    // reads by seqnum see the buffered updates as well
+    fdb_begin_transaction(dbfile_txn, FDB_ISOLATION_READ_COMMITTED);
+    fdb_set_kv(db_txn, (void *)"key2", 4, (void *)"body2_seq", 9);
+    status = fdb_get_pinned(db_txn, "key2", 4, &pdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    seqnum = pdoc.seqnum;
+    fdb_release(&pdoc);
+    fdb_doc_create(&rdoc, NULL, 0, NULL, 0, NULL, 0);
+    rdoc->seqnum = seqnum;
+    status = fdb_get_byseq(db_txn, rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(rdoc->key, "key2", rdoc->keylen);
+    TEST_CMP(rdoc->body, "body2_seq", rdoc->bodylen);
+    fdb_doc_free(rdoc);
+    fdb_doc_create(&rdoc, NULL, 0, NULL, 0, NULL, 0);
+    rdoc->seqnum = seqnum;
+    status = fdb_get_metaonly_byseq(db_txn, rdoc);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    TEST_CMP(rdoc->key, "key2", rdoc->keylen);
+    TEST_CHK(rdoc->bodylen == 9);
+    fdb_doc_free(rdoc);
+    rdoc = NULL;
+    _txn_check_value(db_txn, "key2", "body2_seq");
+    _txn_check_value(db, "key2", "body2_txn");
+    status = fdb_abort_transaction(dbfile_txn);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    _txn_check_value(db, "key2", "body2_txn");
+
+    // large transaction spills into the WAL
+    fdb_get_file_info(dbfile, &info);
+    file_size = info.file_size;
+    fdb_begin_transaction(dbfile_txn, FDB_ISOLATION_READ_COMMITTED);
+    memset(bodybuf, 'x', 100);
+    for (i = 0; i < n; ++i) {
+        sprintf(keybuf, "big%03d", i);
+        sprintf(bodybuf, "%03d", i);
+        bodybuf[3] = 'x';
+        bodybuf[100] = 0;
+        status = fdb_set_kv(db_txn, keybuf, strlen(keybuf),
+                            bodybuf, strlen(bodybuf));
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+    }
+    fdb_get_file_info(dbfile, &info);
+    TEST_CHK(info.file_size > file_size);
+    _txn_check_value(db, "big000", NULL);
+
+    // iterators see all the updates, whether spilled or buffered
+    status = fdb_iterator_init(db_txn, &it, "big000", 6, "big999", 6,
+                               FDB_ITR_NONE);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    count = 0;
+    do {
+        status = fdb_iterator_get(it, &rdoc);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        sprintf(keybuf, "big%03d", count);
+        TEST_CMP(rdoc->key, keybuf, rdoc->keylen);
+        TEST_CHK(rdoc->bodylen == 100);
+        fdb_doc_free(rdoc);
+        rdoc = NULL;
+        count++;
+    } while (fdb_iterator_next(it) == FDB_RESULT_SUCCESS);
+    fdb_iterator_close(it);
+    TEST_CHK(count == n);
+
+    status = fdb_end_transaction(dbfile_txn, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    for (i = 0; i < n; ++i) {
+        void *value;
+        size_t valuelen;
+        sprintf(keybuf, "big%03d", i);
+        status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+        TEST_CHK(status == FDB_RESULT_SUCCESS);
+        TEST_CHK(valuelen == 100);
+        fdb_free_block(value);
+    }
+
+    // buffered keys are compared by the custom compare function of their
+    // KV store
+    kvs_config.custom_cmp = _txn_cmp_nocase;
+    fdb_kvs_open(dbfile, &db, "nocase", &kvs_config);
+    fdb_kvs_open(dbfile_txn, &db_txn, "nocase", &kvs_config);
+    fdb_set_kv(db, (void *)"KEY0", 4, (void *)"body0", 5);
+    fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    fdb_begin_transaction(dbfile_txn, FDB_ISOLATION_READ_COMMITTED);
+    fdb_set_kv(db_txn, (void *)"key0", 4, (void *)"body0_txn", 9);
+    _txn_check_value(db_txn, "Key0", "body0_txn");
+    fdb_set_kv(db_txn, (void *)"kEY0", 4, (void *)"body0_txn2", 10);
+    _txn_check_value(db_txn, "KEY0", "body0_txn2");
+    status = fdb_end_transaction(dbfile_txn, FDB_COMMIT_NORMAL);
+    TEST_CHK(status == FDB_RESULT_SUCCESS);
+    _txn_check_value(db, "key0", "body0_txn2");
+
+    fdb_close(dbfile);
+    fdb_close(dbfile_txn);
+    fdb_shutdown();
+
+    memleak_end();
+
+    TEST_RESULT("transaction write buffer test");
+}
+
 void *in_memory_snapshot_thread(void *args)
 {
 
@@ -5349,9 +6054,11 @@ void drop_kv_on_snap_iterator_test(){
 }
 
 int main(){
+    transaction_write_buffer_test(); return 0; // TMP
 
     concurrent_writer_iterator_test();
     in_memory_snapshot_cleanup_test();
+    in_memory_snapshot_generations_test();
     drop_kv_on_snap_iterator_test();
     rollback_secondary_kvs();
     multi_version_test();
@@ -5359,6 +6066,7 @@ int main(){
     crash_recovery_test(true);
     crash_recovery_test(false);
 #endif
+    crash_recovery_long_tail_test();
     snapshot_test();
     in_memory_snapshot_rollback_test();
     in_memory_snapshot_test();
@@ -5381,6 +6089,8 @@ int main(){
     rollback_ncommits();
     transaction_test();
     transaction_simple_api_test();
+    transaction_optimistic_conflict_test();
+    transaction_write_buffer_test();
     transaction_in_memory_snapshot_test();
     rollback_prior_to_ops(true); // wal commit
     rollback_prior_to_ops(false); // normal commit
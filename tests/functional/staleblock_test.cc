@@ -1696,6 +1696,714 @@ void reclaim_rollback_point_test() {
     TEST_RESULT("reclaim rollback point test");
 }
 
+/*
+ * checkpoint_reuse_test:
+ *     keep a snapshot of an old header open while all documents are
+ *     overwritten repeatedly, where the snapshot is opened either on a
+ *     checkpoint or by its sequence number. Only the blocks reachable from
+ *     the checkpoint should be excluded from block reusing, so that the file
+ *     does not grow as much as with the regular snapshot, while the snapshot
+ *     data remains unaffected.
+ */
+static uint64_t checkpoint_reuse_run(bool use_checkpoint) {
+    TEST_INIT();
+
+    int i, j, r;
+    int ndocs = 10000, nrounds = 12;
+    char keybuf[32];
+    char bodybuf[512];
+    void *rvalue;
+    size_t rvalue_len;
+    fdb_status status;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db, *snap_db;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_kvs_info kvs_info;
+    fdb_file_info file_info;
+    fdb_seqnum_t pinned_seqnum;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fconfig.compaction_threshold = 0;
+    fconfig.block_reusing_threshold = 65;
+    fconfig.num_keeping_headers = 1;
+
+    r = system(SHELL_DEL" staleblktest* > errorlog.txt");
+    (void)r;
+
+    status = fdb_open(&dbfile, "./staleblktest1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open(dbfile, &db, "db", &kvs_config);
+    TEST_STATUS(status);
+
+    // grow the file beyond SB_MIN_BLOCK_REUSING_FILESIZE
+    for (j = 0; j < 4; ++j) {
+        for (i = 0; i < ndocs; ++i) {
+            sprintf(keybuf, "key%06d", i);
+            sprintf(bodybuf, "body%d_%d", j, i);
+            fillstr(bodybuf + strlen(bodybuf), 'x', 400);
+            status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                                bodybuf, strlen(bodybuf) + 1);
+            TEST_STATUS(status);
+        }
+        status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        TEST_STATUS(status);
+    }
+
+    status = fdb_get_kvs_info(db, &kvs_info);
+    TEST_STATUS(status);
+    pinned_seqnum = kvs_info.last_seqnum;
+
+    if (use_checkpoint) {
+        status = fdb_checkpoint_create(dbfile, "backup");
+        TEST_STATUS(status);
+        // duplicated name is not allowed
+        status = fdb_checkpoint_create(dbfile, "backup");
+        TEST_CHK(status == FDB_RESULT_INVALID_ARGS);
+        status = fdb_snapshot_open_checkpoint(db, &snap_db, "unknown");
+        TEST_CHK(status == FDB_RESULT_KEY_NOT_FOUND);
+        status = fdb_snapshot_open_checkpoint(db, &snap_db, "backup");
+        TEST_STATUS(status);
+    } else {
+        status = fdb_snapshot_open(db, &snap_db, pinned_seqnum);
+        TEST_STATUS(status);
+    }
+
+    // overwrite all documents repeatedly
+    for (j = 4; j < 4 + nrounds; ++j) {
+        for (i = 0; i < ndocs; ++i) {
+            sprintf(keybuf, "key%06d", i);
+            sprintf(bodybuf, "body%d_%d", j, i);
+            fillstr(bodybuf + strlen(bodybuf), 'x', 400);
+            status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                                bodybuf, strlen(bodybuf) + 1);
+            TEST_STATUS(status);
+        }
+        status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        TEST_STATUS(status);
+    }
+
+    // snapshot data should remain unaffected
+    status = fdb_get_kvs_info(snap_db, &kvs_info);
+    TEST_STATUS(status);
+    TEST_CHK(kvs_info.last_seqnum == pinned_seqnum);
+    for (i = 0; i < ndocs; i += 7) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%d_%d", 3, i);
+        fillstr(bodybuf + strlen(bodybuf), 'x', 400);
+        status = fdb_get_kv(snap_db, keybuf, strlen(keybuf),
+                            &rvalue, &rvalue_len);
+        TEST_STATUS(status);
+        TEST_CMP(rvalue, bodybuf, rvalue_len);
+        fdb_free_block(rvalue);
+    }
+
+    status = fdb_get_file_info(dbfile, &file_info);
+    TEST_STATUS(status);
+
+    status = fdb_kvs_close(snap_db);
+    TEST_STATUS(status);
+    if (use_checkpoint) {
+        status = fdb_checkpoint_release(dbfile, "backup");
+        TEST_STATUS(status);
+        status = fdb_checkpoint_release(dbfile, "backup");
+        TEST_CHK(status == FDB_RESULT_KEY_NOT_FOUND);
+        status = fdb_snapshot_open_checkpoint(db, &snap_db, "backup");
+        TEST_CHK(status == FDB_RESULT_KEY_NOT_FOUND);
+    }
+
+    // the latest data should be intact
+    for (i = 0; i < ndocs; i += 7) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%d_%d", 3 + nrounds, i);
+        fillstr(bodybuf + strlen(bodybuf), 'x', 400);
+        status = fdb_get_kv(db, keybuf, strlen(keybuf),
+                            &rvalue, &rvalue_len);
+        TEST_STATUS(status);
+        TEST_CMP(rvalue, bodybuf, rvalue_len);
+        fdb_free_block(rvalue);
+    }
+
+    status = fdb_kvs_close(db);
+    TEST_STATUS(status);
+    status = fdb_close(dbfile);
+    TEST_STATUS(status);
+    fdb_shutdown();
+
+    return file_info.file_size;
+}
+
+void checkpoint_reuse_test() {
+    TEST_INIT();
+    memleak_start();
+
+    uint64_t checkpoint_size, snapshot_size;
+
+    checkpoint_size = checkpoint_reuse_run(true);
+    snapshot_size = checkpoint_reuse_run(false);
+    // the regular snapshot disables block reusing for all blocks
+    // that became stale after its header
+    TEST_CHK(checkpoint_size * 3 < snapshot_size * 2);
+
+    memleak_end();
+    TEST_RESULT("checkpoint reuse test");
+}
+
+/*
+ * checkpoint_release_snapshot_test:
+ *     open a regular snapshot and a checkpoint snapshot on the same pinned
+ *     header, and release the checkpoint while both are still open. Blocks
+ *     reachable from the header should not be reused until the snapshots
+ *     are closed, even though all documents are overwritten repeatedly.
+ */
+void checkpoint_release_snapshot_test() {
+    TEST_INIT();
+    memleak_start();
+
+    int i, j, r;
+    int ndocs = 10000, nrounds = 8;
+    char keybuf[32];
+    char bodybuf[512];
+    void *rvalue;
+    size_t rvalue_len;
+    fdb_status status;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db, *snap_db, *cp_snap_db;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_kvs_info kvs_info;
+    fdb_seqnum_t pinned_seqnum;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fconfig.compaction_threshold = 0;
+    fconfig.block_reusing_threshold = 65;
+    fconfig.num_keeping_headers = 1;
+
+    r = system(SHELL_DEL" staleblktest* > errorlog.txt");
+    (void)r;
+
+    status = fdb_open(&dbfile, "./staleblktest1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open(dbfile, &db, "db", &kvs_config);
+    TEST_STATUS(status);
+
+    // grow the file beyond SB_MIN_BLOCK_REUSING_FILESIZE
+    for (j = 0; j < 4; ++j) {
+        for (i = 0; i < ndocs; ++i) {
+            sprintf(keybuf, "key%06d", i);
+            sprintf(bodybuf, "body%d_%d", j, i);
+            fillstr(bodybuf + strlen(bodybuf), 'x', 400);
+            status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                                bodybuf, strlen(bodybuf) + 1);
+            TEST_STATUS(status);
+        }
+        status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        TEST_STATUS(status);
+    }
+
+    status = fdb_get_kvs_info(db, &kvs_info);
+    TEST_STATUS(status);
+    pinned_seqnum = kvs_info.last_seqnum;
+
+    status = fdb_checkpoint_create(dbfile, "backup");
+    TEST_STATUS(status);
+    status = fdb_snapshot_open(db, &snap_db, pinned_seqnum);
+    TEST_STATUS(status);
+    status = fdb_snapshot_open_checkpoint(db, &cp_snap_db, "backup");
+    TEST_STATUS(status);
+
+    // overwrite all documents repeatedly, and release the checkpoint
+    // in the middle
+    for (j = 4; j < 4 + nrounds; ++j) {
+        if (j == 4 + nrounds / 2) {
+            status = fdb_checkpoint_release(dbfile, "backup");
+            TEST_STATUS(status);
+        }
+        for (i = 0; i < ndocs; ++i) {
+            sprintf(keybuf, "key%06d", i);
+            sprintf(bodybuf, "body%d_%d", j, i);
+            fillstr(bodybuf + strlen(bodybuf), 'x', 400);
+            status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                                bodybuf, strlen(bodybuf) + 1);
+            TEST_STATUS(status);
+        }
+        status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        TEST_STATUS(status);
+    }
+
+    // both snapshots should remain unaffected
+    for (i = 0; i < ndocs; i += 7) {
+        sprintf(keybuf, "key%06d", i);
+        sprintf(bodybuf, "body%d_%d", 3, i);
+        fillstr(bodybuf + strlen(bodybuf), 'x', 400);
+        status = fdb_get_kv(snap_db, keybuf, strlen(keybuf),
+                            &rvalue, &rvalue_len);
+        TEST_STATUS(status);
+        TEST_CMP(rvalue, bodybuf, rvalue_len);
+        fdb_free_block(rvalue);
+        status = fdb_get_kv(cp_snap_db, keybuf, strlen(keybuf),
+                            &rvalue, &rvalue_len);
+        TEST_STATUS(status);
+        TEST_CMP(rvalue, bodybuf, rvalue_len);
+        fdb_free_block(rvalue);
+    }
+
+    status = fdb_kvs_close(snap_db);
+    TEST_STATUS(status);
+    status = fdb_kvs_close(cp_snap_db);
+    TEST_STATUS(status);
+    status = fdb_kvs_close(db);
+    TEST_STATUS(status);
+    status = fdb_close(dbfile);
+    TEST_STATUS(status);
+    fdb_shutdown();
+
+    memleak_end();
+    TEST_RESULT("checkpoint release with open snapshots test");
+}
+
+void lazy_open_test() {
+    TEST_INIT();
+    memleak_start();
+
+    int i, r;
+    int nheaders = 10;
+    const int kv = 512;
+    char keybuf[kv];
+    char bodybuf[kv];
+    void *value;
+    size_t valuelen;
+    uint64_t filesize;
+
+    fdb_status status;
+    fdb_file_handle *dbfile, *dbfile_ro;
+    fdb_kvs_handle *db, *db_ro;
+    fdb_file_info file_info;
+
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_config fconfig = fdb_get_default_config();
+    fconfig.compaction_threshold = 0;
+    fconfig.block_reusing_threshold = 65;
+    fconfig.num_keeping_headers = nheaders;
+
+    // remove previous staleblktest files
+    r = system(SHELL_DEL" staleblktest* > errorlog.txt");
+    (void)r;
+
+    fdb_open(&dbfile, "./staleblktest1", &fconfig);
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+
+    // overwrite a key until exceeding SB_MIN_BLOCK_REUSING_FILESIZE,
+    // so that most of the file becomes stale by this commit
+    fillstr(keybuf, 'k', kv);
+    fillstr(bodybuf, 'a', kv);
+    do {
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, strlen(bodybuf));
+        TEST_STATUS(status);
+        status = fdb_get_file_info(dbfile, &file_info);
+        TEST_STATUS(status);
+    } while (file_info.file_size < SB_MIN_BLOCK_REUSING_FILESIZE);
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    // lazy read-only open: documents are read without loading the bitmap
+    // and the stale-block info
+    fconfig.flags = FDB_OPEN_FLAG_RDONLY | FDB_OPEN_FLAG_LAZY;
+    status = fdb_open(&dbfile_ro, "./staleblktest1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile_ro, &db_ro, &kvs_config);
+    TEST_STATUS(status);
+    status = fdb_get_kv(db_ro, keybuf, strlen(keybuf), &value, &valuelen);
+    TEST_STATUS(status);
+    TEST_CMP(value, bodybuf, valuelen);
+    fdb_free_block(value);
+
+    // lazy read-write open of the same file
+    fconfig.flags = FDB_OPEN_FLAG_LAZY;
+    status = fdb_open(&dbfile, "./staleblktest1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open_default(dbfile, &db, &kvs_config);
+    TEST_STATUS(status);
+    status = fdb_get_file_info(dbfile, &file_info);
+    TEST_STATUS(status);
+    filesize = file_info.file_size;
+
+    // the first commit loads the stale-block info, so that the stale blocks
+    // of the commit before the open become reusable once
+    // 'num_keeping_headers' headers are written after it.
+    for (i = 0; i < nheaders + 1; ++i) {
+        sprintf(bodybuf, "body%d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, strlen(bodybuf));
+        TEST_STATUS(status);
+        status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        TEST_STATUS(status);
+    }
+
+    // rewrite about half of the file size. Its commit reclaims the stale
+    // blocks, which then absorb most of the next rewrite.
+    fillstr(bodybuf, 'b', kv);
+    for (i = 0; i < (int)(filesize / 2 / kv); ++i) {
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, strlen(bodybuf));
+        TEST_STATUS(status);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+    TEST_CHK(db->file->getSb()->bmpExists());
+    status = fdb_get_file_info(dbfile, &file_info);
+    TEST_STATUS(status);
+    filesize = file_info.file_size;
+
+    fillstr(bodybuf, 'c', kv);
+    for (i = 0; i < (int)(filesize / 4 / kv); ++i) {
+        status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                            bodybuf, strlen(bodybuf));
+        TEST_STATUS(status);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+    status = fdb_get_file_info(dbfile, &file_info);
+    TEST_STATUS(status);
+    // (only a few new blocks, e.g., for index nodes, are appended)
+    TEST_CHK(file_info.file_size < filesize + filesize / 8);
+
+    // the read-only handle reads the document written into a reused block
+    status = fdb_get_kv(db_ro, keybuf, strlen(keybuf), &value, &valuelen);
+    TEST_STATUS(status);
+    TEST_CMP(value, bodybuf, valuelen);
+    fdb_free_block(value);
+    fdb_kvs_close(db_ro);
+    fdb_close(dbfile_ro);
+
+    status = fdb_close(dbfile);
+    TEST_STATUS(status);
+    status = fdb_shutdown();
+    TEST_STATUS(status);
+
+    memleak_end();
+    TEST_RESULT("lazy open test");
+}
+
+// count the non-consecutive links among the blocks holding the first
+// 'len' bytes of the document at 'offset'
+static int count_doc_block_jumps(FILE *fp, uint64_t offset, size_t len) {
+    struct docblk_meta meta;
+    size_t blocksize = FDB_BLOCKSIZE;
+    bid_t bid = offset / blocksize;
+    size_t nlinks = (offset % blocksize + len) / (blocksize - DOCBLK_META_SIZE);
+    size_t i;
+    int jumps = 0;
+
+    for (i = 0; i < nlinks; ++i) {
+        fseek(fp, (bid + 1) * blocksize - DOCBLK_META_SIZE, SEEK_SET);
+        if (fread(&meta, sizeof(meta), 1, fp) != 1) {
+            return -1;
+        }
+        bid_t next_bid = _endian_decode(meta.next_bid);
+        if (next_bid != bid + 1) {
+            jumps++;
+        }
+        bid = next_bid;
+    }
+    return jumps;
+}
+
+void extent_reuse_test() {
+    TEST_INIT();
+    memleak_start();
+
+    int i, r, ndocs, nbig = 40;
+    int nheaders = 10;
+    int jumps, total_jumps = 0, nreused = 0;
+    int nmid = 40, nskipped = 0;
+    const size_t small_len = 8000, mid_len = 9000, big_len = 40000;
+    char keybuf[256];
+    char *bodybuf = (char *)malloc(big_len + 1);
+    bid_t eof_bid, cur_bid;
+
+    fdb_status status;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_file_info file_info;
+    fdb_doc *doc;
+    FILE *fp;
+
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_config fconfig = fdb_get_default_config();
+    fconfig.compaction_threshold = 0;
+    fconfig.block_reusing_threshold = 20;
+    fconfig.num_keeping_headers = nheaders;
+
+    // remove previous staleblktest files
+    r = system(SHELL_DEL" staleblktest* > errorlog.txt");
+    (void)r;
+
+    fdb_open(&dbfile, "./staleblktest1", &fconfig);
+    fdb_kvs_open_default(dbfile, &db, &kvs_config);
+
+    // documents spanning about two blocks each
+    fillstr(bodybuf, 'a', small_len);
+    i = 0;
+    do {
+        sprintf(keybuf, "key%06d", i++);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, small_len);
+        TEST_STATUS(status);
+        status = fdb_get_file_info(dbfile, &file_info);
+        TEST_STATUS(status);
+    } while (file_info.file_size < SB_MIN_BLOCK_REUSING_FILESIZE);
+    ndocs = i;
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+
+    // satisfy reuse constraints
+    for (i = 0; i < nheaders + 1; ++i) {
+        status = fdb_set_kv(db, "dummy", 5, "body", 4);
+        TEST_STATUS(status);
+        status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        TEST_STATUS(status);
+    }
+
+    // in every group of 16 documents, every other document of the first
+    // half leaves a small hole, and the second half leaves a large hole
+    fillstr(bodybuf, 'b', small_len);
+    for (i = 0; i < ndocs * 3 / 4; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        if (i % 16 < 8) {
+            if (i % 2 == 0) {
+                status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                                    bodybuf, small_len);
+                TEST_STATUS(status);
+            }
+        } else {
+            status = fdb_del_kv(db, keybuf, strlen(keybuf));
+            TEST_STATUS(status);
+        }
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+
+    // the holes become reusable once 'num_keeping_headers' headers are
+    // written after them, and are reclaimed by the next commit that
+    // writes more than SB_SYNC_PERIOD bytes
+    for (i = 0; i < nheaders + 1; ++i) {
+        status = fdb_set_kv(db, "dummy", 5, "body", 4);
+        TEST_STATUS(status);
+        status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        TEST_STATUS(status);
+    }
+    fillstr(bodybuf, 'c', small_len);
+    for (i = ndocs * 3 / 4; i < ndocs; ++i) {
+        sprintf(keybuf, "key%06d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, small_len);
+        TEST_STATUS(status);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+    TEST_CHK(db->file->getSb()->bmpExists());
+    eof_bid = db->file->getPos() / FDB_BLOCKSIZE;
+
+    // large documents are written into consecutive reused blocks
+    fillstr(bodybuf, 'd', big_len);
+    for (i = 0; i < nbig; ++i) {
+        sprintf(keybuf, "big%06d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, big_len);
+        TEST_STATUS(status);
+    }
+
+    // smaller documents written before the commit use the holes skipped
+    // by the large ones
+    cur_bid = db->file->getSb()->getCurAllocBid();
+    fillstr(bodybuf, 'e', mid_len);
+    for (i = 0; i < nmid; ++i) {
+        sprintf(keybuf, "mid%06d", i);
+        status = fdb_set_kv(db, keybuf, strlen(keybuf), bodybuf, mid_len);
+        TEST_STATUS(status);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    TEST_STATUS(status);
+    for (i = 0; i < nmid; ++i) {
+        sprintf(keybuf, "mid%06d", i);
+        fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0, NULL, 0);
+        status = fdb_get_metaonly(db, doc);
+        TEST_STATUS(status);
+        if (doc->offset / FDB_BLOCKSIZE < cur_bid) {
+            nskipped++;
+        }
+        fdb_doc_free(doc);
+    }
+    TEST_CHK(nskipped >= nmid / 4);
+    fillstr(bodybuf, 'd', big_len);
+
+    fp = fopen("./staleblktest1", "rb");
+    TEST_CHK(fp != NULL);
+    for (i = 0; i < nbig; ++i) {
+        sprintf(keybuf, "big%06d", i);
+        fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0, NULL, 0);
+        status = fdb_get_metaonly(db, doc);
+        TEST_STATUS(status);
+        if (doc->offset / FDB_BLOCKSIZE < eof_bid) {
+            nreused++;
+        }
+        jumps = count_doc_block_jumps(fp, doc->offset, big_len);
+        TEST_CHK(jumps >= 0);
+        total_jumps += jumps;
+        fdb_doc_free(doc);
+    }
+    fclose(fp);
+    TEST_CHK(nreused > 0);
+    // at most one jump per document, from the block where the previous
+    // document ends
+    TEST_CHK(total_jumps <= nbig);
+
+    // verify the documents
+    for (i = 0; i < nbig; ++i) {
+        void *value;
+        size_t valuelen;
+        sprintf(keybuf, "big%06d", i);
+        status = fdb_get_kv(db, keybuf, strlen(keybuf), &value, &valuelen);
+        TEST_STATUS(status);
+        TEST_CHK(valuelen == big_len);
+        TEST_CMP(value, bodybuf, valuelen);
+        fdb_free_block(value);
+    }
+
+    status = fdb_close(dbfile);
+    TEST_STATUS(status);
+    status = fdb_shutdown();
+    TEST_STATUS(status);
+    free(bodybuf);
+
+    memleak_end();
+    TEST_RESULT("extent reuse test");
+}
+
+/*
+ * checkpoint_close_test:
+ *     a file with checkpoints cannot be compacted, and its last file handle
+ *     cannot be closed until the checkpoints are released. Blocks excluded
+ *     from reusing by the checkpoint should be reused after the file is
+ *     reopened, so that overwriting all documents does not grow the file.
+ */
+void checkpoint_close_test() {
+    TEST_INIT();
+    memleak_start();
+
+    int i, j, r;
+    int ndocs = 10000, nrounds = 8;
+    char keybuf[32];
+    char bodybuf[512];
+    fdb_status status;
+    fdb_file_handle *dbfile, *dbfile2;
+    fdb_kvs_handle *db;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_file_info file_info;
+    uint64_t file_size;
+
+    fdb_config fconfig = fdb_get_default_config();
+    fconfig.compaction_threshold = 0;
+    fconfig.block_reusing_threshold = 65;
+    fconfig.num_keeping_headers = 1;
+
+    r = system(SHELL_DEL" staleblktest* > errorlog.txt");
+    (void)r;
+
+    status = fdb_open(&dbfile, "./staleblktest1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open(dbfile, &db, "db", &kvs_config);
+    TEST_STATUS(status);
+
+    // grow the file beyond SB_MIN_BLOCK_REUSING_FILESIZE
+    for (j = 0; j < 4; ++j) {
+        for (i = 0; i < ndocs; ++i) {
+            sprintf(keybuf, "key%06d", i);
+            sprintf(bodybuf, "body%d_%d", j, i);
+            fillstr(bodybuf + strlen(bodybuf), 'x', 400);
+            status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                                bodybuf, strlen(bodybuf) + 1);
+            TEST_STATUS(status);
+        }
+        status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        TEST_STATUS(status);
+    }
+
+    status = fdb_checkpoint_create(dbfile, "backup");
+    TEST_STATUS(status);
+
+    // overwrite all documents while the checkpoint pins the header
+    for (j = 4; j < 4 + nrounds; ++j) {
+        for (i = 0; i < ndocs; ++i) {
+            sprintf(keybuf, "key%06d", i);
+            sprintf(bodybuf, "body%d_%d", j, i);
+            fillstr(bodybuf + strlen(bodybuf), 'x', 400);
+            status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                                bodybuf, strlen(bodybuf) + 1);
+            TEST_STATUS(status);
+        }
+        status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        TEST_STATUS(status);
+    }
+
+    // checkpoints are not carried over to the compacted file
+    status = fdb_compact(dbfile, "./staleblktest2");
+    TEST_CHK(status == FDB_RESULT_CHECKPOINT_EXISTS);
+
+    // closing a handle other than the last one is allowed
+    status = fdb_open(&dbfile2, "./staleblktest1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_close(db);
+    TEST_STATUS(status);
+    status = fdb_close(dbfile);
+    TEST_STATUS(status);
+
+    // but the last one should release the checkpoint first
+    status = fdb_close(dbfile2);
+    TEST_CHK(status == FDB_RESULT_CHECKPOINT_EXISTS);
+    status = fdb_checkpoint_release(dbfile2, "backup");
+    TEST_STATUS(status);
+    status = fdb_get_file_info(dbfile2, &file_info);
+    TEST_STATUS(status);
+    file_size = file_info.file_size;
+    status = fdb_close(dbfile2);
+    TEST_STATUS(status);
+
+    // reopen and overwrite all documents again
+    status = fdb_open(&dbfile, "./staleblktest1", &fconfig);
+    TEST_STATUS(status);
+    status = fdb_kvs_open(dbfile, &db, "db", &kvs_config);
+    TEST_STATUS(status);
+    for (j = 4 + nrounds; j < 4 + nrounds * 2; ++j) {
+        for (i = 0; i < ndocs; ++i) {
+            sprintf(keybuf, "key%06d", i);
+            sprintf(bodybuf, "body%d_%d", j, i);
+            fillstr(bodybuf + strlen(bodybuf), 'x', 400);
+            status = fdb_set_kv(db, keybuf, strlen(keybuf),
+                                bodybuf, strlen(bodybuf) + 1);
+            TEST_STATUS(status);
+        }
+        status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        TEST_STATUS(status);
+    }
+
+    // the blocks pinned before should have been reused
+    status = fdb_get_file_info(dbfile, &file_info);
+    TEST_STATUS(status);
+    TEST_CHK(file_info.file_size <= file_size);
+
+    status = fdb_compact(dbfile, "./staleblktest2");
+    TEST_STATUS(status);
+
+    status = fdb_kvs_close(db);
+    TEST_STATUS(status);
+    status = fdb_close(dbfile);
+    TEST_STATUS(status);
+    fdb_shutdown();
+
+    memleak_end();
+    TEST_RESULT("checkpoint close and compaction test");
+}
+
 int main() {
 
     /* Test resuse of stale blocks with block_reusing_threshold
@@ -1740,5 +2448,20 @@ int main() {
 
     reclaim_rollback_point_test();
 
+    /* Test block reusing while a snapshot is opened on a checkpoint */
+    checkpoint_reuse_test();
+
+    /* Test releasing a checkpoint while snapshots are opened on it */
+    checkpoint_release_snapshot_test();
+
+    /* Test closing and compacting a file with checkpoints */
+    checkpoint_close_test();
+
+    /* Test block reusing on a file opened lazily */
+    lazy_open_test();
+
+    /* Test extent allocation of large documents in reused blocks */
+    extent_reuse_test();
+
     return 0;
 }
@@ -0,0 +1,139 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "arena.h"
+#include "test.h"
+#include "common.h"
+
+void slab_basic_test()
+{
+    TEST_INIT();
+
+    int i;
+    size_t sizes[] = {1, 16, 17, 100, 200, 512, 513, 4096};
+    size_t n = sizeof(sizes) / sizeof(size_t);
+    void **ptrs = alca(void *, n);
+
+    for (i = 0; i < (int)n; ++i) {
+        ptrs[i] = SlabAllocator::allocateZeroed(sizes[i]);
+        TEST_CHK(ptrs[i] != NULL);
+        TEST_CHK(((uint8_t *)ptrs[i])[sizes[i] - 1] == 0);
+        memset(ptrs[i], 'a' + i, sizes[i]);
+    }
+    for (i = 0; i < (int)n; ++i) {
+        TEST_CHK(((uint8_t *)ptrs[i])[0] == 'a' + i);
+        TEST_CHK(((uint8_t *)ptrs[i])[sizes[i] - 1] == 'a' + i);
+        SlabAllocator::deallocate(ptrs[i], sizes[i]);
+    }
+
+    // freed objects are reused by the same size class
+    void *ptr = SlabAllocator::allocate(100);
+    SlabAllocator::deallocate(ptr, 100);
+    TEST_CHK(SlabAllocator::allocate(120) == ptr);
+    SlabAllocator::deallocate(ptr, 120);
+
+    // a lot of objects beyond the cache limit
+    void *objs[10000];
+    for (i = 0; i < 10000; ++i) {
+        objs[i] = SlabAllocator::allocate(64);
+    }
+    for (i = 0; i < 10000; ++i) {
+        SlabAllocator::deallocate(objs[i], 64);
+    }
+    SlabAllocator::releaseThreadCache();
+
+    TEST_RESULT("slab allocator basic test");
+}
+
+static void *_slab_free_thread(void *voidargs)
+{
+    void **objs = (void **)voidargs;
+    for (int i = 0; i < 1000; ++i) {
+        SlabAllocator::deallocate(objs[i], 256);
+    }
+    return NULL;
+}
+
+void slab_cross_thread_test()
+{
+    TEST_INIT();
+
+    int i;
+    void *objs[1000];
+    pthread_t tid;
+    void *ret;
+
+    // objects allocated by this thread are freed by another thread
+    for (i = 0; i < 1000; ++i) {
+        objs[i] = SlabAllocator::allocate(256);
+        memset(objs[i], 'x', 256);
+    }
+    pthread_create(&tid, NULL, _slab_free_thread, (void *)objs);
+    pthread_join(tid, &ret);
+
+    TEST_RESULT("slab allocator cross thread test");
+}
+
+void arena_test()
+{
+    TEST_INIT();
+
+    int i;
+    MemoryArena arena(1024);
+    uint64_t *small[1000];
+
+    for (int round = 0; round < 3; ++round) {
+        for (i = 0; i < 1000; ++i) {
+            small[i] = (uint64_t *)arena.allocate(sizeof(uint64_t) * 3);
+            TEST_CHK(((uintptr_t)small[i] & 0x7) == 0);
+            TEST_CHK(small[i][0] == 0 && small[i][2] == 0);
+            small[i][0] = small[i][2] = i;
+        }
+        // large objects get dedicated chunks
+        uint8_t *large = (uint8_t *)arena.allocate(10000);
+        memset(large, 0xff, 10000);
+        uint8_t *next = (uint8_t *)arena.allocate(5);
+        TEST_CHK(next[0] == 0 && next[4] == 0);
+
+        for (i = 0; i < 1000; ++i) {
+            TEST_CHK(small[i][0] == (uint64_t)i);
+            TEST_CHK(small[i][2] == (uint64_t)i);
+        }
+        arena.reset();
+    }
+
+    MemoryArena *tarena = MemoryArena::getThreadArena();
+    TEST_CHK(tarena == MemoryArena::getThreadArena());
+    TEST_CHK(tarena->allocate(16) != NULL);
+    MemoryArena::releaseThreadArena();
+
+    TEST_RESULT("memory arena test");
+}
+
+int main()
+{
+    slab_basic_test();
+    slab_cross_thread_test();
+    arena_test();
+
+    return 0;
+}
@@ -0,0 +1,374 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "btree.h"
+#include "btree_fast_str_kv.h"
+#include "btree_prefix_str_kv.h"
+#include "test.h"
+#include "common.h"
+#include "memleak.h"
+#include "option.h"
+
+static struct bnode* dummy_node()
+{
+    struct bnode *node;
+    node = (struct bnode*)malloc(sizeof(bnode) + FDB_BLOCKSIZE);
+    memset(node, 0, sizeof(bnode) + FDB_BLOCKSIZE);
+    node->kvsize = sizeof(void *)<<8 | sizeof(uint64_t);
+    node->data = (uint8_t *)node + sizeof(bnode);
+    return node;
+}
+
+static std::string make_key(int i)
+{
+    char buf[64];
+    sprintf(buf, "tenant/5f0c3e2a-9b1d-4c7e/doc/%06d", i);
+    return std::string(buf);
+}
+
+// verify that the node has exactly the same entries as the model.
+static bool verify_node(BTreeKVOps *ops, struct bnode *node,
+                        std::vector<std::string>& keys,
+                        std::vector<uint64_t>& values)
+{
+    void *k = NULL;
+    uint64_t v;
+    bool ok = true;
+    char buf[256];
+    size_t len;
+
+    if (node->nentry != keys.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < keys.size() && ok; ++i) {
+        ops->getKV(node, i, &k, &v);
+        ops->getVarKey(&k, buf, len);
+        if (len != keys[i].size() || memcmp(buf, keys[i].data(), len) ||
+            v != values[i]) {
+            ok = false;
+        }
+    }
+    ops->freeVarKey(&k);
+    return ok;
+}
+
+static void set_var_key(BTreeKVOps *ops, void *k, const std::string& key)
+{
+    ops->freeVarKey(k);
+    ops->setVarKey(k, (void*)key.data(), key.size());
+}
+
+void prefix_kv_append_test(uint16_t restart_interval)
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, n = 64;
+    void *k = NULL;
+    uint64_t v;
+    struct bnode *node = dummy_node();
+    struct bnode *legacy = dummy_node();
+    PrefixStrKVOps ops(8, 8);
+    FastStrKVOps legacy_ops(8, 8);
+    std::vector<std::string> keys;
+    std::vector<uint64_t> values;
+    char name[64];
+
+    ops.setPrefixCompression(true, restart_interval);
+
+    for (i = 0; i < n; ++i) {
+        keys.push_back(make_key(i));
+        values.push_back(i * 10);
+        set_var_key(&ops, &k, keys[i]);
+        v = values[i];
+        ops.setKV(node, i, &k, &v);
+        node->nentry++;
+        legacy_ops.setKV(legacy, i, &k, &v);
+        legacy->nentry++;
+    }
+    ops.freeVarKey(&k);
+
+    TEST_CHK(node->flag & BNODE_MASK_PREFIX);
+    TEST_CHK(verify_node(&ops, node, keys, values));
+    // the compressed node should be much smaller
+    TEST_CHK(ops.getDataSize(node, NULL, NULL, NULL, 0) * 2 <
+             legacy_ops.getDataSize(legacy, NULL, NULL, NULL, 0));
+
+    free(node);
+    free(legacy);
+    memleak_end();
+    sprintf(name, "prefix kv append test (restart interval %d)",
+            (int)restart_interval);
+    TEST_RESULT(name);
+}
+
+void prefix_kv_ins_remove_test(uint16_t restart_interval)
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, r, n = 400;
+    size_t idx, bound, size;
+    void *k = NULL;
+    uint64_t v;
+    struct bnode *node = dummy_node();
+    PrefixStrKVOps ops(8, 8);
+    std::vector<std::string> keys;
+    std::vector<uint64_t> values;
+    std::vector<std::string>::iterator it;
+    char name[64];
+
+    ops.setPrefixCompression(true, restart_interval);
+    srand(0x1234);
+
+    for (i = 0; i < n; ++i) {
+        r = rand();
+        std::string key = make_key(r % 1000);
+        // vary the key length and the common prefix
+        key.resize(key.size() - (r % 7));
+        if (r % 5 == 0) {
+            key[r % 10] = 'a' + (r % 26);
+        }
+        it = std::lower_bound(keys.begin(), keys.end(), key);
+        idx = it - keys.begin();
+        set_var_key(&ops, &k, key);
+        v = r;
+
+        if (it != keys.end() && *it == key) {
+            if (r % 2) {
+                // update
+                ops.setKV(node, idx, &k, &v);
+                values[idx] = v;
+            } else {
+                // remove
+                ops.insKV(node, idx, NULL, NULL);
+                node->nentry--;
+                keys.erase(it);
+                values.erase(values.begin() + idx);
+            }
+        } else {
+            bound = sizeof(struct bnode) +
+                    ops.getDataSize(node, NULL, &k, &v, 1);
+            if (bound > FDB_BLOCKSIZE) {
+                continue;
+            }
+            if (idx < node->nentry) {
+                ops.insKV(node, idx, &k, &v);
+            } else {
+                ops.setKV(node, idx, &k, &v);
+            }
+            node->nentry++;
+            keys.insert(it, key);
+            values.insert(values.begin() + idx, v);
+
+            // the estimated size should not be smaller than the actual size
+            size = sizeof(struct bnode) +
+                   ops.getDataSize(node, NULL, NULL, NULL, 0);
+            TEST_CHK(size <= bound);
+        }
+        TEST_CHK(verify_node(&ops, node, keys, values));
+    }
+    ops.freeVarKey(&k);
+
+    free(node);
+    memleak_end();
+    sprintf(name, "prefix kv insert/remove test (restart interval %d)",
+            (int)restart_interval);
+    TEST_RESULT(name);
+}
+
+void prefix_kv_update_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, n = 40;
+    void *k = NULL;
+    uint64_t v;
+    size_t size;
+    struct bnode *node = dummy_node();
+    PrefixStrKVOps ops(8, 8);
+    std::vector<std::string> keys;
+    std::vector<uint64_t> values;
+
+    ops.setPrefixCompression(true, 4);
+
+    for (i = 0; i < n; ++i) {
+        keys.push_back(make_key(i * 3));
+        values.push_back(i);
+        set_var_key(&ops, &k, keys[i]);
+        v = i;
+        ops.setKV(node, i, &k, &v);
+        node->nentry++;
+    }
+    size = ops.getDataSize(node, NULL, NULL, NULL, 0);
+
+    // updating the values keeps the encoding of the keys
+    for (i = n - 1; i >= 0; --i) {
+        values[i] = i * 1000;
+        set_var_key(&ops, &k, keys[i]);
+        v = values[i];
+        ops.setKV(node, i, &k, &v);
+        TEST_CHK(verify_node(&ops, node, keys, values));
+    }
+    TEST_CHK(ops.getDataSize(node, NULL, NULL, NULL, 0) == size);
+
+    // replacing the smallest key (e.g., by BTree::insert()) changes it
+    keys[0] = "tenant/0";
+    values[0] = 7;
+    set_var_key(&ops, &k, keys[0]);
+    v = values[0];
+    ops.setKV(node, 0, &k, &v);
+    TEST_CHK(verify_node(&ops, node, keys, values));
+    TEST_CHK(ops.getDataSize(node, NULL, NULL, NULL, 0) != size);
+    ops.freeVarKey(&k);
+
+    free(node);
+    memleak_end();
+    TEST_RESULT("prefix kv update test");
+}
+
+void prefix_kv_copy_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, n = 50, half = 20;
+    void *k = NULL;
+    uint64_t v;
+    struct bnode *node = dummy_node();
+    struct bnode *node_dst = dummy_node();
+    PrefixStrKVOps ops(8, 8);
+    std::vector<std::string> keys, keys_dst;
+    std::vector<uint64_t> values, values_dst;
+
+    ops.setPrefixCompression(true, 4);
+
+    for (i = 0; i < n; ++i) {
+        keys.push_back(make_key(i * 37));
+        values.push_back(i);
+        set_var_key(&ops, &k, keys[i]);
+        v = i;
+        ops.setKV(node, i, &k, &v);
+        node->nentry++;
+    }
+    ops.freeVarKey(&k);
+
+    // split the node in the same way as BTree::splitNode()
+    ops.copyKV(node_dst, node, 0, half, n - half);
+    node_dst->nentry = n - half;
+    ops.copyKV(node, node, 0, 0, half);
+    node->nentry = half;
+
+    keys_dst.assign(keys.begin() + half, keys.end());
+    values_dst.assign(values.begin() + half, values.end());
+    keys.resize(half);
+    values.resize(half);
+    TEST_CHK(verify_node(&ops, node, keys, values));
+    TEST_CHK(verify_node(&ops, node_dst, keys_dst, values_dst));
+
+    // the splitter is the first key of the right node
+    ops.getNthSplitter(node, node_dst, &k);
+    char buf[256];
+    size_t len;
+    ops.getVarKey(&k, buf, len);
+    TEST_CHK(len == keys_dst[0].size());
+    TEST_CMP(buf, keys_dst[0].data(), len);
+    ops.freeVarKey(&k);
+
+    free(node);
+    free(node_dst);
+    memleak_end();
+    TEST_RESULT("prefix kv copy test");
+}
+
+void prefix_kv_compatibility_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, n = 30;
+    void *k = NULL;
+    uint64_t v;
+    struct bnode *node = dummy_node();
+    PrefixStrKVOps ops(8, 8);
+    FastStrKVOps legacy_ops(8, 8);
+    std::vector<std::string> keys;
+    std::vector<uint64_t> values;
+
+    // node written in the existing format
+    for (i = 0; i < n; ++i) {
+        keys.push_back(make_key(i * 2));
+        values.push_back(i);
+        set_var_key(&legacy_ops, &k, keys[i]);
+        v = i;
+        legacy_ops.setKV(node, i, &k, &v);
+        node->nentry++;
+    }
+    TEST_CHK(!(node->flag & BNODE_MASK_PREFIX));
+    TEST_CHK(verify_node(&ops, node, keys, values));
+
+    // modifying it with the compression converts the node
+    ops.setPrefixCompression(true, 8);
+    keys.insert(keys.begin() + 1, make_key(1));
+    values.insert(values.begin() + 1, 100);
+    set_var_key(&ops, &k, keys[1]);
+    v = 100;
+    ops.insKV(node, 1, &k, &v);
+    node->nentry++;
+    TEST_CHK(node->flag & BNODE_MASK_PREFIX);
+    TEST_CHK(verify_node(&ops, node, keys, values));
+
+    // modifying it without the compression converts the node back
+    ops.setPrefixCompression(false, 0);
+    keys.erase(keys.begin() + 2);
+    values.erase(values.begin() + 2);
+    ops.insKV(node, 2, NULL, NULL);
+    node->nentry--;
+    TEST_CHK(!(node->flag & BNODE_MASK_PREFIX));
+    TEST_CHK(verify_node(&legacy_ops, node, keys, values));
+    TEST_CHK(verify_node(&ops, node, keys, values));
+    ops.freeVarKey(&k);
+
+    free(node);
+    memleak_end();
+    TEST_RESULT("prefix kv compatibility test");
+}
+
+int main()
+{
+    prefix_kv_append_test(0);
+    prefix_kv_append_test(16);
+    prefix_kv_ins_remove_test(0);
+    prefix_kv_ins_remove_test(1);
+    prefix_kv_ins_remove_test(4);
+    prefix_kv_ins_remove_test(16);
+    prefix_kv_update_test();
+    prefix_kv_copy_test();
+    prefix_kv_compatibility_test();
+
+    return 0;
+}
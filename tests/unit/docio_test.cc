@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "blockcache.h"
 #include "docio.h"
 #include "filemgr.h"
 #include "filemgr_ops.h"
@@ -115,6 +116,88 @@ void basic_test()
     TEST_RESULT("basic test");
 }
 
+void read_cached_key_test()
+{
+    TEST_INIT();
+
+    uint64_t offset[3];
+    int r;
+    int blocksize = 4096;
+    FileMgr *file;
+    char keybuf[256];
+    char metabuf[256];
+    char bodybuf[10000];
+    char rkeybuf[256];
+    keylen_t keylen;
+    bid_t last_bid;
+    fdb_status fs;
+    struct docio_object doc;
+    FileMgrConfig config(blocksize, 1024, 0, 0, FILEMGR_CREATE,
+                         FDB_SEQTREE_NOT_USE, 0, 8, 0, FDB_ENCRYPTION_NONE,
+                         0x00, 0, 0);
+    std::string fname("./docio_testfile");
+
+    memset(&doc, 0, sizeof(doc));
+    doc.key = (void*)keybuf;
+    doc.meta = (void*)metabuf;
+    doc.body = (void*)bodybuf;
+    memset(bodybuf, 'x', sizeof(bodybuf));
+
+    // re-initialize the block cache with this test's block size
+    FileMgr::shutdown();
+    r = system(SHELL_DEL " docio_testfile");
+    (void)r;
+    filemgr_open_result result = FileMgr::open(fname, get_filemgr_ops(),
+                                               &config, NULL);
+    file = result.file;
+    DocioHandle *handle = new DocioHandle(file, false, NULL);
+
+    // small docs around a doc whose body spans multiple blocks
+    for (int i = 0; i < 3; ++i) {
+        sprintf(keybuf, "key%d", i);
+        doc.length.keylen = strlen(keybuf) + 1;
+        strcpy(metabuf, "meta");
+        doc.length.metalen = strlen(metabuf) + 1;
+        doc.length.bodylen = (i == 1) ? sizeof(bodybuf) : 16;
+        offset[i] = handle->appendDoc_Docio(&doc, 0, 0);
+    }
+    file->commit_FileMgr(true, NULL);
+
+    // the blocks written are cached
+    fs = handle->readCachedDocKey_Docio(offset[0], &keylen, rkeybuf,
+                                        &last_bid);
+    TEST_CHK(fs == FDB_RESULT_SUCCESS);
+    TEST_CHK(keylen == 5 && !strcmp(rkeybuf, "key0"));
+    TEST_CHK(last_bid == offset[0] / blocksize);
+
+    fs = handle->readCachedDocKey_Docio(offset[1], &keylen, rkeybuf,
+                                        &last_bid);
+    TEST_CHK(fs == FDB_RESULT_SUCCESS);
+    TEST_CHK(keylen == 5 && !strcmp(rkeybuf, "key1"));
+    TEST_CHK(last_bid >= offset[1] / blocksize + 2);
+    TEST_CHK(last_bid == (offset[2] - 1) / blocksize);
+
+    // nothing is read from the file on a cache miss
+    BlockCacheManager::getInstance()->removeCleanBlocks(file);
+    fs = handle->readCachedDocKey_Docio(offset[2], &keylen, rkeybuf,
+                                        &last_bid);
+    TEST_CHK(fs != FDB_RESULT_SUCCESS);
+
+    fs = handle->readDocKey_Docio(offset[2], &keylen, rkeybuf);
+    TEST_CHK(fs == FDB_RESULT_SUCCESS);
+    fs = handle->readCachedDocKey_Docio(offset[2], &keylen, rkeybuf,
+                                        &last_bid);
+    TEST_CHK(fs == FDB_RESULT_SUCCESS);
+    TEST_CHK(keylen == 5 && !strcmp(rkeybuf, "key2"));
+    TEST_CHK(last_bid == offset[2] / blocksize);
+
+    delete handle;
+    FileMgr::close(file, true, NULL, NULL);
+    FileMgr::shutdown();
+
+    TEST_RESULT("read cached key test");
+}
+
 int main()
 {
     #ifdef _MEMPOOL
@@ -123,6 +206,7 @@ int main()
 
 
     basic_test();
+    read_cached_key_test();
 
     return 0;
 }
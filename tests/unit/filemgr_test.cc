@@ -59,6 +59,51 @@ void basic_test(fdb_encryption_algorithm_t encryption)
     TEST_RESULT(buf);
 }
 
+void write_block_vector_test(fdb_encryption_algorithm_t encryption)
+{
+    TEST_INIT();
+
+    FileMgr *file;
+    FileMgrConfig config(4096, 1024, 0, 0, FILEMGR_CREATE,
+                         FDB_SEQTREE_NOT_USE, 0, 8, 0, encryption,
+                         0x55, 0, 0);
+    const unsigned nblocks = 300;
+    void *blocks[nblocks];
+    uint8_t *buf;
+    unsigned i;
+    ssize_t r;
+    char msg[256];
+
+    std::string fname("./filemgr_testfile");
+    filemgr_open_result result = FileMgr::open(fname,
+                                               get_filemgr_ops(),
+                                               &config, NULL);
+    file = result.file;
+
+    // blocks in separate buffers are written to consecutive bids
+    for (i = 0; i < nblocks; ++i) {
+        blocks[i] = malloc(4096);
+        memset(blocks[i], i % 251, 4096);
+    }
+    r = file->writeBlockVector(blocks, nblocks, 2);
+    TEST_CHK(r == (ssize_t)nblocks * 4096);
+
+    buf = (uint8_t *)malloc((size_t)nblocks * 4096);
+    r = file->readBlocks(buf, nblocks, 2);
+    TEST_CHK(r == (ssize_t)nblocks * 4096);
+    for (i = 0; i < nblocks; ++i) {
+        TEST_CMP(buf + (size_t)i * 4096, blocks[i], 4096);
+        free(blocks[i]);
+    }
+    free(buf);
+
+    FileMgr::close(file, true, NULL, NULL);
+    FileMgr::shutdown();
+
+    sprintf(msg, "write block vector test, encryption=%d", (int)encryption);
+    TEST_RESULT(msg);
+}
+
 void mt_init_test()
 {
     TEST_INIT();
@@ -73,6 +118,8 @@ int main()
 
     basic_test(FDB_ENCRYPTION_NONE);
     basic_test(FDB_ENCRYPTION_BOGUS);
+    write_block_vector_test(FDB_ENCRYPTION_NONE);
+    write_block_vector_test(FDB_ENCRYPTION_BOGUS);
     mt_init_test();
 
     return 0;
@@ -697,6 +697,50 @@ void hbtrie_partial_update_test()
     TEST_RESULT("HB+trie partial update test");
 }
 
+void hbtrie_estimate_chunksize_test()
+{
+    TEST_INIT();
+    memleak_start();
+
+    int i, j, n = 1024;
+    size_t chunksize;
+    size_t min_chunksize = (sizeof(void *) > 4) ? sizeof(void *) : 4;
+    char *keys = (char *)malloc(n * 32);
+    const void **keyptrs = (const void **)malloc(n * sizeof(void *));
+    size_t *keylens = (size_t *)malloc(n * sizeof(size_t));
+
+    // random binary keys: the smallest chunk is enough
+    srand(0x1234);
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < 16; ++j) {
+            keys[i * 32 + j] = rand() & 0xff;
+        }
+        keyptrs[i] = keys + i * 32;
+        keylens[i] = 16;
+    }
+    chunksize = HBTrie::estimateChunkSize(keyptrs, keylens, n, 1000000,
+                                          FDB_BLOCKSIZE);
+    TEST_CHK(chunksize == min_chunksize);
+
+    // four 8-byte fields with four distinct values each: an 8-byte chunk
+    // needs four levels, whereas a 16-byte chunk covers two fields per level
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < 4; ++j) {
+            memset(keys + i * 32 + j * 8, 'a' + ((i >> (j * 2)) & 0x3), 8);
+        }
+        keylens[i] = 32;
+    }
+    chunksize = HBTrie::estimateChunkSize(keyptrs, keylens, n, n,
+                                          FDB_BLOCKSIZE);
+    TEST_CHK(chunksize == 16);
+
+    free(keys);
+    free(keyptrs);
+    free(keylens);
+    memleak_end();
+    TEST_RESULT("HB+trie chunk size estimation test");
+}
+
 int main(){
 #ifdef _MEMPOOL
     mempool_init();
@@ -706,6 +750,7 @@ int main(){
     skew_basic_test();
     hbtrie_reverse_iterator_test();
     hbtrie_partial_update_test();
+    hbtrie_estimate_chunksize_test();
 
     return 0;
 }